@@ -0,0 +1,90 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _ADC_H_
+#define _ADC_H_
+
+#include "gpio.h"
+
+/*
+ * ADC1 acquisition. Conversions of the configured sequence are triggered by TIM6 and moved by a
+ * circular GPDMA into a sample ring, then packed and streamed to the host on the EP4 IN endpoint.
+ * Stream format: 12-bit samples in sequence order, two samples in three bytes:
+ * byte0 = s0[7:0], byte1 = s0[11:8] | s1[3:0] << 4, byte2 = s1[11:4].
+ * Whole scans are dropped when the host does not read fast enough, so the channel order is kept.
+ */
+#define ADC_MAX_CHANNELS		16
+#define ADC_CLK_HZ				62500000	// HCLK/4
+#define ADC_TIM_CLK_HZ			250000000	// TIM6
+#define ADC_SAMPLE_RING			8192		// samples
+#define ADC_STREAM_RING			8192		// bytes, must be a power of 2
+
+#define ERROR_ADC_CHANNEL		-112	// the pin has no ADC1 channel
+#define ERROR_ADC_RATE			-113	// the conversions do not fit in the trigger period
+#define ERROR_ADC_BUSY			-114
+#define ERROR_ADC_TIMEOUT		-115
+
+typedef struct __attribute__((packed)) {
+	uint8_t port;
+	uint8_t pin;
+} adc_pin_t;
+
+/*
+ * ADC_CONFIG request: sets the pins in analog mode and programs the conversion sequence.
+ * The pins stay owned by the ADC until the next ADC_CONFIG.
+ * sample_time is the SMP code, from 0 (2.5 ADC cycles) to 7 (640.5 cycles).
+ * Each result is the average of 2^oversampling conversions, oversampling from 0 to 8.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t count;
+	uint8_t sample_time;
+	uint8_t oversampling;
+	uint8_t reserved;
+	adc_pin_t pins[];
+} adc_config_request_t;
+
+/*
+ * ADC_START request: starts streaming at rate_hz scans per second.
+ * Reply: int32 result, uint32 actual rate in millihertz.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t rate_hz;
+} adc_start_request_t;
+
+/*
+ * ADC_READ request (no parameters): converts the sequence once.
+ * Reply: int32 result, followed by one uint16 per channel.
+ * ADC_STOP request (no parameters): stops streaming. Reply: int32 result.
+ * ADC_STATUS request (no parameters). Reply: int32 result, followed by adc_status_t.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t samples;		// samples converted since ADC_START
+	uint32_t dropped;		// samples dropped because the host did not read fast enough
+	uint32_t pending;		// bytes waiting to be sent to the host
+} adc_status_t;
+
+void adc_tick();
+uint32_t adc_stream_peek(const uint8_t** data);
+void adc_stream_consume(uint32_t n);
+void adc_dma_isr();
+int adc_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _ADC_H_ */
@@ -0,0 +1,59 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#include "gpio.h"
+
+/*
+ * Boot profiler: time of each startup phase in microseconds since the entry of mcu_init().
+ * The time is counted in core cycles until TIM5 runs, then read from TIM5, so that the late phases
+ * (enumeration by the host) are not limited by the wrap of the cycle counter.
+ * The time between power-on and mcu_init() (boot ROM, startup code) is not included.
+ */
+enum boot_phase {
+	BOOT_RESET = 0,			// mcu_init() entry
+	BOOT_CLOCK,				// system clock on the PLL
+	BOOT_USB_POWER,			// USB transceiver powered, still disconnected
+	BOOT_PERIPHERALS,		// GPIO, timers and DMA initialized
+	BOOT_USB_CONNECT,		// DP pull-up enabled
+	BOOT_PROFILE,			// boot profile applied, end of mcu_init()
+	BOOT_LATE_INIT,			// init not needed for the enumeration done (UART)
+	BOOT_USB_RESET,			// first bus reset from the host
+	BOOT_USB_CONFIGURED,	// SET_CONFIGURATION from the host
+	BOOT_PHASES
+};
+
+/*
+ * BOOT_TIMES reply: int32 result, followed by boot_times_reply_t.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t reached;					// bit n set if phase n was reached
+	uint32_t time_us[BOOT_PHASES];
+} boot_times_reply_t;
+
+void boot_start();
+void boot_timebase();
+void boot_mark(enum boot_phase phase);
+uint32_t boot_time_us();
+int boot_time(enum boot_phase phase, uint32_t* time_us);
+const char* boot_phase_name(enum boot_phase phase);
+int boot_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _BOOT_H_ */
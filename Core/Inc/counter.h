@@ -0,0 +1,85 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+#include "gpio.h"
+
+/*
+ * Hardware counters. A timer counts the edges on a pin in external clock mode, or the
+ * quadrature steps of an encoder in encoder mode, with no CPU involvement.
+ * The 16-bit counters are extended to 32 bits every millisecond by SysTick,
+ * so a counter must not count more than 32767 steps per millisecond.
+ */
+#define COUNTER_CHANNELS		4
+
+#define ERROR_COUNTER_BUSY		-128
+
+enum counter_mode {
+	COUNTER_PULSES = 0,		// pin A on timer channel 1 or 2
+	COUNTER_ENCODER			// pin A on channel 1 and pin B on channel 2 of TIM1, TIM3, TIM4 or TIM8
+};
+
+#define COUNTER_FALLING			0x01	// pulses: counts the falling edges. encoder: reverses the direction
+#define COUNTER_BOTH_EDGES		0x02	// pulses: counts both edges
+#define COUNTER_PULL_UP			0x04	// enables the pull-ups of the pins
+
+/*
+ * COUNTER_START request: connects the pins to a free timer and starts counting from 0.
+ * filter is the input filter code of the timer, 0 to 15.
+ * If snapshot_ms is not 0, the value is sent every snapshot_ms as an EVENT_COUNTER event
+ * with a counter_event_t payload.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t counter;
+	uint8_t mode;
+	uint8_t flags;
+	uint8_t filter;
+	uint8_t port_a;
+	uint8_t pin_a;
+	uint8_t port_b;
+	uint8_t pin_b;
+	uint32_t snapshot_ms;
+} counter_start_request_t;
+
+/*
+ * COUNTER_READ request (no parameters).
+ * Reply: int32 result, uint32 timestamp in microseconds, followed by COUNTER_CHANNELS uint32 values.
+ * Encoder positions are signed. Stopped counters read 0.
+ * COUNTER_STOP request: stops a counter and releases its timer. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t counter;
+	uint8_t reserved[3];
+} counter_stop_request_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t counter;
+	uint8_t reserved[3];
+	uint32_t timestamp_us;
+	uint32_t value;
+} counter_event_t;
+
+void counter_tick();
+int counter_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _COUNTER_H_ */
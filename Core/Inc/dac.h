@@ -0,0 +1,77 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _DAC_H_
+#define _DAC_H_
+
+#include "gpio.h"
+
+/*
+ * DAC1 playback on OUT1 (PA4) or OUT2 (PA5), one channel at a time. Updates are triggered by TIM7
+ * and the samples are moved to the DAC by a circular GPDMA.
+ * In stream mode, the host sends 16-bit samples (12-bit right aligned) on the EP4 OUT endpoint. They are queued
+ * in a FIFO and copied into the half of the playback buffer that the DMA has just finished.
+ * Playback starts when the FIFO holds the first two halves. If the FIFO runs dry, the last sample is held
+ * and the missing samples are counted as underruns.
+ * In loop mode, the table sent with DAC_START is played repeatedly.
+ */
+#define DAC_TIM_CLK_HZ			250000000	// TIM7
+#define DAC_MAX_RATE_HZ			1000000
+#define DAC_HALF				256			// samples in each half of the stream playback buffer
+#define DAC_TABLE_LENGTH		2048		// samples, must be at least 2*DAC_HALF
+#define DAC_FIFO_LENGTH			16384		// bytes, must be a power of 2
+
+#define ERROR_DAC_CHANNEL		-120
+#define ERROR_DAC_RATE			-121
+#define ERROR_DAC_LENGTH		-122	// empty or too long loop table
+
+enum dac_mode {
+	DAC_MODE_STREAM = 0,
+	DAC_MODE_LOOP
+};
+
+/*
+ * DAC_START request: (re)starts playback on channel 1 or 2 at rate_hz samples per second.
+ * In loop mode, the request is followed by the table of 16-bit samples.
+ * Reply: int32 result, uint32 actual rate in millihertz.
+ * DAC_STOP request (no parameters): stops playback, the output keeps the last value. Reply: int32 result.
+ * DAC_STATUS request (no parameters). Reply: int32 result, followed by dac_status_t.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t mode;
+	uint16_t reserved;
+	uint32_t rate_hz;
+	uint16_t samples[];
+} dac_start_request_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t played;		// samples sent to the DAC since DAC_START, in stream mode
+	uint32_t underruns;		// samples missing because the host did not send fast enough
+	uint32_t dma_underruns;	// triggers that occurred before the DMA wrote the previous sample
+	uint32_t pending;		// bytes waiting in the FIFO
+} dac_status_t;
+
+int dac_streaming();
+uint32_t dac_stream_free();
+int dac_stream_push(const uint8_t* data, uint32_t n);
+void dac_dma_isr();
+int dac_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _DAC_H_ */
@@ -0,0 +1,101 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _DMA_H_
+#define _DMA_H_
+
+#include "stm32h5xx.h"
+
+/*
+ * GPDMA channel allocation.
+ * GPDMA1: CH0/CH1 SPI, CH2/CH3 I2C, CH4/CH5 UART bridge, CH6 single-wire encoder, CH7 ADC.
+ * GPDMA2: CH0 DAC, CH1 synchronous port update, CH2 parallel bus, CH3 single-wire sampling.
+ */
+#define DMA_SPI_RX				GPDMA1_Channel0
+#define DMA_SPI_TX				GPDMA1_Channel1
+#define DMA_I2C_RX				GPDMA1_Channel2
+#define DMA_I2C_TX				GPDMA1_Channel3
+#define DMA_UART_RX				GPDMA1_Channel4
+#define DMA_UART_TX				GPDMA1_Channel5
+#define DMA_WIRE				GPDMA1_Channel6
+#define DMA_ADC					GPDMA1_Channel7
+#define DMA_DAC					GPDMA2_Channel0
+#define DMA_SYNC				GPDMA2_Channel1
+#define DMA_PAR					GPDMA2_Channel2
+#define DMA_WIRE_SAMPLE			GPDMA2_Channel3
+
+/* GPDMA hardware requests (REQSEL) */
+#define DMA_REQUEST_ADC1		0
+#define DMA_REQUEST_DAC1_CH1	2		// CH2 follows
+#define DMA_REQUEST_SPI1_RX		6
+#define DMA_REQUEST_SPI1_TX		7
+#define DMA_REQUEST_I2C1_RX		12
+#define DMA_REQUEST_I2C1_TX		13
+#define DMA_REQUEST_USART2_RX	23
+#define DMA_REQUEST_USART2_TX	24
+#define DMA_REQUEST_TIM1_CC1	58		// CC2 to CC4 follow
+#define DMA_REQUEST_TIM1_UP		62
+#define DMA_REQUEST_TIM8_CC1	65
+#define DMA_REQUEST_TIM8_UP		69
+#define DMA_REQUEST_TIM3_CC1	77
+#define DMA_REQUEST_TIM3_UP		81
+#define DMA_REQUEST_TIM4_CC1	83
+#define DMA_REQUEST_TIM4_UP		87
+#define DMA_REQUEST_TIM15_CC1	94		// no CC2 request
+#define DMA_REQUEST_TIM15_UP	95
+#define DMA_REQUEST_TIM16_UP	99
+#define DMA_REQUEST_TIM17_UP	101
+
+/* dma_start() flags */
+#define DMA_TO_PERIPH			0x01	// memory to peripheral, otherwise peripheral to memory
+#define DMA_MEM_FIXED			0x02	// the memory address is not incremented
+#define DMA_IRQ_TC				0x04	// transfer complete interrupt
+#define DMA_IRQ_HT				0x08	// half transfer interrupt
+#define DMA_WIDTH_8				0x00
+#define DMA_WIDTH_16			0x10
+#define DMA_WIDTH_32			0x20
+
+/*
+ * Linked-list item of a circular transfer: it reloads the block size and the memory address,
+ * and links to itself
+ */
+typedef struct {
+	uint32_t br1;
+	uint32_t address;
+	uint32_t llr;
+} dma_node_t;
+
+/*
+ * Linked-list item of a copy list: one word from src to dst. Only src and dst are set by the caller.
+ */
+typedef struct {
+	uint32_t tr2;
+	uint32_t br1;
+	uint32_t src;
+	uint32_t dst;
+	uint32_t llr;
+} dma_copy_t;
+
+void dma_start(DMA_Channel_TypeDef* ch, uint32_t request, volatile void* periph, const void* mem, uint32_t length, uint32_t flags);
+void dma_start_circular(DMA_Channel_TypeDef* ch, uint32_t request, volatile void* periph, const void* mem, uint32_t length, uint32_t flags, dma_node_t* node);
+void dma_start_copies(DMA_Channel_TypeDef* ch, uint32_t request, dma_copy_t* copies, uint32_t count);
+int dma_status(DMA_Channel_TypeDef* ch);
+uint32_t dma_remaining(DMA_Channel_TypeDef* ch);
+void dma_stop(DMA_Channel_TypeDef* ch);
+
+#endif /* _DMA_H_ */
@@ -0,0 +1,85 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _EDGE_H_
+#define _EDGE_H_
+
+#include "gpio.h"
+
+#define EDGE_RING_LENGTH		1024	// must be a power of 2
+
+#define ERROR_EDGE_LINE_BUSY	-32
+
+enum edge_trigger {
+	EDGE_NONE = 0,
+	EDGE_RISING,
+	EDGE_FALLING,
+	EDGE_BOTH
+};
+
+/*
+ * Features sharing the EXTI lines. The line triggers on the edges requested by any of them.
+ */
+enum edge_user {
+	EDGE_USER_CAPTURE = 0,
+	EDGE_USER_ROUTE,
+	EDGE_USERS
+};
+
+/*
+ * Edge record. timestamp is the TIM2 counter, which runs at TIM2_CLK_HZ.
+ * edge is EDGE_RISING or EDGE_FALLING.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t timestamp;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t edge;
+	uint8_t reserved;
+} edge_record_t;
+
+/*
+ * EDGE_CONFIG request: routes a pin to its EXTI line. trigger = EDGE_NONE releases the line.
+ * Only one port at a time can use each EXTI line, i.e., pins with the same number on different ports
+ * cannot be captured together. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t trigger;
+	uint8_t reserved;
+} edge_config_request_t;
+
+/*
+ * EDGE_READ request: drains up to max_records records from the ring.
+ * Reply: int32 result, uint32 timer frequency in Hz, uint32 records lost because the ring was full,
+ * uint32 number of records, followed by the records.
+ * EDGE_RESET request: header only, empties the ring and clears the lost records counter. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t max_records;
+} edge_read_request_t;
+
+int edge_line_use(char port, uint8_t pin, enum edge_user user, enum edge_trigger trigger);
+int edge_config(char port, uint8_t pin, enum edge_trigger trigger);
+void edge_isr(uint32_t line);
+int edge_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _EDGE_H_ */
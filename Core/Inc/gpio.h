@@ -26,6 +26,9 @@
 #define ERROR_GPIO_ALREADY_USED_AF		-2
 #define ERROR_GPIO_ALREADY_USED_ANALOG	-3
 #define ERROR_COUNT						-4
+#define ERROR_REQUEST_LENGTH			-5
+#define ERROR_REQUEST_OPERATION			-6
+#define ERROR_GPIO_PIN_BUSY				-7	// the pin is owned by another peripheral
 
 enum operation_type {
 
@@ -35,9 +38,75 @@ enum operation_type {
 	GPIO_GET,
 	GPIO_CONFIG,
 
+	/* sequencer */
+	SEQ_LOAD = 0x0300,
+	SEQ_RUN,
+
+	/* scheduler */
+	SCHED_SUBMIT = 0x0400,
+	SCHED_STATUS,
+	SCHED_CANCEL,
+	SCHED_TIME,
+
+	/* edge capture */
+	EDGE_CONFIG = 0x0500,
+	EDGE_READ,
+	EDGE_RESET,
+	MEAS_RUN = 0x0600,
+	MEAS_STREAM,
+	MEAS_STOP,
+	PWM_CONFIG = 0x0700,
+	PWM_DUTY,
+	PWM_STOP,
+	SPI_TRANSFER = 0x0800,
+	I2C_TRANSFER = 0x0900,
+	I3C_CONFIG = 0x0A00,
+	I3C_DAA,
+	I3C_TRANSFER,
+	JTAG_RUN = 0x0B00,
+	UART_CONFIG = 0x0C00,
+	UART_STATUS,
+	UART_STOP,
+	WIRE_RUN = 0x0D00,
+	ADC_CONFIG = 0x0E00,
+	ADC_START,
+	ADC_READ,
+	ADC_STOP,
+	ADC_STATUS,
+	DAC_START = 0x0F00,
+	DAC_STOP,
+	DAC_STATUS,
+	COUNTER_START = 0x1000,
+	COUNTER_READ,
+	COUNTER_STOP,
+	ROUTE_CONFIG = 0x1100,
+	ROUTE_ENABLE,
+	ROUTE_DISABLE,
+	ROUTE_STATUS,
+	WAIT_PINS = 0x1200,
+	PULSE_START = 0x1300,
+	PULSE_STOP,
+	PULSE_STATUS,
+	PAR_CONFIG = 0x1400,
+	PAR_RUN,
+	MOTION_CONFIG = 0x1500,
+	MOTION_MOVE,
+	MOTION_STOP,
+	MOTION_STATUS,
+	SYNC_WRITE = 0x1600,
+	PORT_CONFIG = 0x1700,
+	PROFILE_SAVE = 0x1800,
+	PROFILE_LIST,
+	PROFILE_BOOT,
+	PROFILE_APPLY,
+	BOOT_TIMES = 0x1900,
+
 	NO_OP = 0xFFFF
 };
 
+#define OPERATION_GROUP(op)		((op) & 0xFF00)
+#define REQUEST_MAX_LENGTH		4096	// maximum length of both requests and replies
+
 enum gpio_direction {
 	GPIO_INPUT = 0,
 	GPIO_OUTPUT
@@ -54,6 +123,35 @@ enum gpio_pull {
 	GPIO_PULL_DOWN
 };
 
+#define GPIO_PORTS		8	// A to H
+
+/*
+ * Owners of the pins. The gpio functions only use the pins owned by PIN_OWNER_GPIO.
+ */
+enum pin_owner {
+	PIN_OWNER_GPIO = 0,
+	PIN_OWNER_SYSTEM,	// USB, virtual COM port and debug port pins
+	PIN_OWNER_ADC,
+	PIN_OWNER_DAC,
+	PIN_OWNER_TIM,		// timer channels, see tim_map.h
+	PIN_OWNER_SPI,
+	PIN_OWNER_I2C,		// I2C and I3C bridges, which take turns on PB8/PB9
+	PIN_OWNER_UART,
+	PIN_OWNER_JTAG,
+	PIN_OWNER_PAR,		// parallel bus engine
+	PIN_OWNER_MOTION	// step, dir and enable pins of the motion axes
+};
+
+/*
+ * Pin descriptor of the registry
+ */
+typedef struct {
+	GPIO_TypeDef* port;
+	uint16_t mask;
+	uint8_t index;		// port index, 0 for A
+	uint8_t owner;
+} gpio_pin_t;
+
 typedef struct {
 	uint32_t operation;
 	uint8_t port;
@@ -63,10 +161,71 @@ typedef struct {
 	uint8_t pull;
 } gpio_request_t;
 
+/*
+ * Events are sent by the device on the EP2 IN endpoint, one per packet.
+ * sequence is incremented for every event, so that the host can detect the events lost
+ * because the event queue was full.
+ */
+enum event_type {
+	EVENT_MEAS = 1,
+	EVENT_I3C_IBI,
+	EVENT_COUNTER
+};
+
+typedef struct __attribute__((packed)) {
+	uint16_t type;
+	uint8_t length;		// payload length
+	uint8_t sequence;
+	uint32_t timestamp;	// TIM5 time in microseconds
+} event_header_t;
+
+/*
+ * All requests but the gpio ones start with this header.
+ * length is the total number of bytes of the request, header included, so that requests longer
+ * than a USB packet can be reassembled before being executed.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t operation;
+	uint32_t length;
+} request_header_t;
+
+/*
+ * PORT_CONFIG request: configures the pins of mask of a port in one go. The fields have the layout of the
+ * port registers (2 bits per pin for MODER, OSPEEDR and PUPDR, 1 bit for OTYPER, 4 bits for AFRL/AFRH)
+ * and only the bits of the pins in mask are used. Each register is written once, the mode last.
+ * Refused if a pin of mask is owned by a peripheral. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t port;
+	uint8_t reserved;
+	uint16_t mask;
+	uint32_t moder;
+	uint32_t otyper;
+	uint32_t ospeedr;
+	uint32_t pupdr;
+	uint32_t afr[2];	// AFRL, AFRH
+} port_config_t;
+
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	port_config_t config;
+} port_config_request_t;
+
+void gpio_init();
+GPIO_TypeDef* gpio_port(char port);
+const gpio_pin_t* gpio_lookup(char port, uint8_t pin);
+int gpio_claim(char port, uint8_t pin, enum pin_owner owner);
+void gpio_release(char port, uint8_t pin, enum pin_owner owner);
+int gpio_mode(char port, uint8_t pin, uint32_t mode, enum pin_owner owner);
+int gpio_check(char port, uint16_t mask);
 int gpio_set(char port, uint8_t pin);
 int gpio_clear(char port, uint8_t pin);
 int gpio_get(char port, uint8_t pin);
 int gpio_config(char port, uint8_t pin, enum gpio_direction direction, enum gpio_output_type type, enum gpio_pull pull );
+int gpio_alternate(char port, uint8_t pin, uint32_t af, enum pin_owner owner);
+int gpio_port_config(const port_config_t* config, const uint16_t* levels);
+int gpio_port_read(char port, port_config_t* config, uint16_t* levels);
+int gpio_port_request(const request_header_t* request, uint8_t* reply);
 
 extern int gpio_op_completed;
 extern gpio_request_t gpio_request;
@@ -0,0 +1,60 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _I2C_H_
+#define _I2C_H_
+
+#include "gpio.h"
+
+/*
+ * I2C1 on the Arduino connector: SCL PB8 (D15), SDA PB9 (D14).
+ * The internal pull-ups are enabled, but they are too weak above the standard mode.
+ * The pins are shared with the I3C bridge.
+ */
+#define ERROR_I2C_NACK			-72
+#define ERROR_I2C_BUS			-73		// arbitration lost or bus error
+#define ERROR_I2C_TIMEOUT		-74
+
+/*
+ * A transaction writes tx_length bytes to the 7-bit address, then reads rx_length bytes after a repeated start,
+ * then sends a stop. A transaction with no tx and no rx bytes only addresses the target, which probes it.
+ * The transaction is followed by tx_length bytes of data.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t address;
+	uint8_t reserved;
+	uint16_t tx_length;
+	uint16_t rx_length;
+	uint16_t reserved2;
+} i2c_transaction_t;
+
+/*
+ * I2C_TRANSFER request: executes count transactions at speed_hz, which is rounded down to 100 kHz, 400 kHz or 1 MHz.
+ * A NACK only fails its transaction, the following ones are executed anyway.
+ * Reply: int32 result, uint32 number of transactions executed, int32 status of each transaction,
+ * followed by the rx data of all of them. The rx data of a failed transaction is zero-filled.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t speed_hz;
+	uint32_t count;
+} i2c_transfer_request_t;
+
+int i2c_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _I2C_H_ */
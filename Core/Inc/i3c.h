@@ -0,0 +1,119 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _I3C_H_
+#define _I3C_H_
+
+#include "gpio.h"
+
+/*
+ * I3C1 controller on the Arduino connector: SCL PB8 (D15), SDA PB9 (D14), shared with the I2C bridge.
+ * The bus must only have I3C targets.
+ */
+#define I3C_KER_CLK_HZ			250000000	// PCLK1
+#define I3C_MIN_SPEED_HZ		(I3C_KER_CLK_HZ / 512)	// SCL high and low times of 256 kernel clocks at most
+#define I3C_MAX_SPEED_HZ		12500000
+#define I3C_MAX_TARGETS			16
+#define I3C_IBI_TARGETS			4			// targets whose in-band interrupts are accepted
+
+#define ERROR_I3C_NACK			-80
+#define ERROR_I3C_BUS			-81
+#define ERROR_I3C_TIMEOUT		-82
+#define ERROR_I3C_PARAMETER		-83
+#define ERROR_I3C_TARGETS		-84		// more targets than I3C_MAX_TARGETS or dynamic addresses left
+
+/* Common command codes */
+#define I3C_CCC_ENEC			0x00
+#define I3C_CCC_DISEC			0x01
+#define I3C_CCC_RSTDAA			0x06
+#define I3C_CCC_ENTDAA			0x07
+
+enum i3c_transaction_type {
+	I3C_PRIVATE = 0,	// private write of the tx bytes, then private read of the rx bytes after a repeated start
+	I3C_CCC_BROADCAST,	// broadcast CCC with the tx bytes
+	I3C_CCC_DIRECT		// direct CCC: writes the tx bytes, or reads the rx bytes if rx_length > 0
+};
+
+/* i3c_transaction_t flags */
+#define I3C_DEFINING_BYTE		0x01	// the first tx byte of a direct CCC is its defining byte
+
+/*
+ * The transaction is followed by tx_length bytes of data
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t type;
+	uint8_t address;	// dynamic address, ignored by broadcast CCCs
+	uint8_t ccc;
+	uint8_t flags;
+	uint16_t tx_length;
+	uint16_t rx_length;
+} i3c_transaction_t;
+
+/*
+ * I3C_CONFIG request: sets the push-pull SCL frequency, from I3C_MIN_SPEED_HZ to I3C_MAX_SPEED_HZ, ERROR_I3C_PARAMETER otherwise.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t speed_hz;
+} i3c_config_request_t;
+
+/*
+ * I3C_DAA request: runs ENTDAA and assigns the dynamic addresses first_address, first_address+1, ...
+ * The in-band interrupts of the first I3C_IBI_TARGETS targets are accepted and forwarded as
+ * EVENT_I3C_IBI events. Reply: int32 result, uint32 number of targets, followed by i3c_target_t records.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t first_address;
+	uint8_t reserved[3];
+} i3c_daa_request_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t pid[6];		// provisioned ID, most significant byte first
+	uint8_t bcr;
+	uint8_t dcr;
+	uint8_t address;
+	uint8_t reserved[3];
+} i3c_target_t;
+
+/*
+ * I3C_TRANSFER request: executes count transactions. A NACK only fails its transaction.
+ * Reply: int32 result, uint32 number of transactions executed, int32 status of each transaction
+ * (number of bytes actually read, or a negative error), followed by the rx data of all of them.
+ * Bytes not read because of an error or an early end of a read by the target are zero-filled.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t count;
+} i3c_transfer_request_t;
+
+/*
+ * EVENT_I3C_IBI payload
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t address;
+	uint8_t length;
+	uint8_t reserved[2];
+	uint8_t data[4];
+} i3c_ibi_event_t;
+
+void i3c_isr();
+int i3c_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _I3C_H_ */
@@ -0,0 +1,84 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _JTAG_H_
+#define _JTAG_H_
+
+#include "gpio.h"
+
+/*
+ * JTAG/SWD shift engine on fixed pins of port E (CN9):
+ * TCK/SWCLK PE2, TMS/SWDIO PE4, TDI PE5, TDO PE6, nRESET PE3 (open-drain).
+ * Bits are shifted LSB first, data changes while TCK is low and the target samples it on the rising edge.
+ */
+#define JTAG_MAX_COMMANDS		1024	// per JTAG_RUN request, ERROR_REQUEST_LENGTH above
+
+#define ERROR_JTAG_COMMAND		-88
+#define ERROR_SWD_ACK			-89		// no acknowledge or invalid acknowledge
+#define ERROR_SWD_WAIT			-90		// still WAIT after the retries
+#define ERROR_SWD_FAULT			-91
+#define ERROR_SWD_PARITY		-92
+
+enum jtag_opcode {
+	JTAG_TMS = 1,		// bits TMS bits from the data, TDI held at JTAG_TDI_HIGH
+	JTAG_SHIFT,			// bits TDI bits from the data, TMS low but on the last bit if JTAG_EXIT
+	JTAG_CLOCK,			// bits clocks, TMS/SWDIO held at JTAG_TMS_HIGH
+	JTAG_RESET,			// drives nRESET low if JTAG_ASSERT, releases it otherwise
+	JTAG_DELAY_US,		// waits bits microseconds
+	SWD_SEQUENCE,		// bits SWDIO bits from the data (line reset, JTAG-to-SWD switch...)
+	SWD_READ,			// reads a DP or AP register, 4 bytes of reply
+	SWD_WRITE,			// writes a DP or AP register with the 4 bytes of data
+	JTAG_OPCODE_COUNT
+};
+
+/* jtag_command_t flags */
+#define JTAG_TDI_HIGH			0x01	// JTAG_TMS
+#define JTAG_CAPTURE			0x02	// JTAG_SHIFT: TDO bits are appended to the reply
+#define JTAG_EXIT				0x04	// JTAG_SHIFT: TMS high on the last bit
+#define JTAG_TMS_HIGH			0x08	// JTAG_CLOCK
+#define JTAG_ASSERT				0x01	// JTAG_RESET
+#define SWD_AP					0x01	// SWD_READ, SWD_WRITE: access port register, debug port otherwise
+#define SWD_ADDRESS				0x0C	// SWD_READ, SWD_WRITE: register address bits A[3:2]
+
+/*
+ * Command followed by (bits+7)/8 bytes of data for JTAG_TMS, JTAG_SHIFT and SWD_SEQUENCE,
+ * by 4 bytes for SWD_WRITE and by nothing otherwise
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t bits;
+} jtag_command_t;
+
+/*
+ * JTAG_RUN request: executes the commands following the header until the end of the request.
+ * half_period is the number of delay loops in each half of a clock period, 0 is the fastest.
+ * SWD transfers answered with WAIT are tried again at most wait_retries times.
+ * Reply: int32 result, uint32 number of commands executed, followed by the captured TDO bits of
+ * the JTAG_SHIFT commands with JTAG_CAPTURE ((bits+7)/8 bytes each) and by the data of the SWD_READ commands.
+ * The first failed command stops the execution.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint16_t half_period;
+	uint16_t wait_retries;
+} jtag_run_request_t;
+
+int jtag_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _JTAG_H_ */
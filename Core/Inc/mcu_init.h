@@ -73,12 +73,47 @@
                                                                  0 bit  for subpriority */
 #endif
 
+#define SCHED_INT_PRIORITY			0
+#define EDGE_INT_PRIORITY			1
+#define MOTION_INT_PRIORITY			1	// step timing, TIM2 compare
 #define USB_DRD_FS_INTR_PRI			2
+#define I3C_INT_PRIORITY			4
+#define UART_INT_PRIORITY			USB_DRD_FS_INTR_PRI	// the UART rings are shared with the USB interrupt without locking
+#define ADC_INT_PRIORITY			USB_DRD_FS_INTR_PRI	// same for the ADC stream ring
+#define DAC_INT_PRIORITY			USB_DRD_FS_INTR_PRI	// and the DAC FIFO
 #define TICK_INT_PRIORITY         	3
+#define PENDSV_INT_PRIORITY			15
+
+/*
+ * FAST_BOOT shortens the time from reset to enumeration: parallel oscillator startup, USB connection
+ * after a deadline instead of a fixed delay, and the UART started after the connection. See mcu_init().
+ * 0 keeps the serial startup, e.g. to compare the boot times.
+ */
+#ifndef FAST_BOOT
+#define FAST_BOOT				1
+#endif
+/*
+ * ICACHE_ENABLE turns on the instruction cache, which serves all the flash reads of the core (code and constants)
+ * without the 5 wait states of the flash at 250 MHz. The SRAM is never cached on the H563 (the DCACHE only
+ * serves the external memories), so the DMA buffers need no maintenance.
+ * RAMFUNC functions are copied to RAM with the initialized data and run without wait states or cache misses:
+ * it is used for the whole USB interrupt path of usb.c. The ring buffer helpers of the UART, ADC and DAC
+ * bridges that this path calls stay in flash, behind the ICACHE.
+ */
+#ifndef ICACHE_ENABLE
+#define ICACHE_ENABLE			1
+#endif
+#define RAMFUNC					__attribute__((section(".RamFunc")))
+
+#define USB_STARTUP_US			1000	// transceiver startup, with margin for the host to see a disconnect after a reset
+
+#define TIM_CLK_HZ				250000000	// timer kernel clock, all APB prescalers are 1
+#define TIM2_CLK_HZ				TIM_CLK_HZ	// TIM2 runs at the full timer clock, used for edge timestamps
 
 extern uint64_t sys_tick;
 
 int mcu_init();
+void mcu_late_init();
 void delay_us(uint32_t d_us);
 
 #endif /* MCU_INIT_H_ */
@@ -0,0 +1,96 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _MEAS_H_
+#define _MEAS_H_
+
+#include "gpio.h"
+
+#define MEAS_CHANNELS			4
+#define MEAS_MAX_GATE_MS		10000
+
+#define ERROR_MEAS_BUSY			-48
+
+/*
+ * Measurement result.
+ * The frequency is counted over the first half of the gate: frequency = edges * gate_hz / gate_ticks.
+ * The period and high time are sampled over the second half with the timer in PWM input mode,
+ * in ticks of sample_hz. duty_ppm is computed from the sampled periods and high times.
+ * If the pin does not toggle, frequency_hz is 0 and duty_ppm tells the pin level (0 or 1000000).
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t frequency_hz;
+	uint32_t duty_ppm;
+	uint32_t edges;
+	uint32_t gate_ticks;
+	uint32_t gate_hz;
+	uint32_t samples;
+	uint32_t sample_hz;
+	uint32_t min_period;
+	uint32_t max_period;
+	uint32_t min_high;
+	uint32_t max_high;
+} meas_result_t;
+
+/*
+ * MEAS_RUN request: measures the pin over gate_ms milliseconds.
+ * Only timer channels 1 and 2 can be used, so the pin must be connected to one of them.
+ * Reply: int32 result followed by meas_result_t.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint16_t reserved;
+	uint32_t gate_ms;
+} meas_run_request_t;
+
+/*
+ * MEAS_STREAM request: measures the pin repeatedly, starting a new measurement every interval_ms
+ * (or as soon as the previous one ends if interval_ms is shorter than gate_ms).
+ * Each result is sent as an EVENT_MEAS event with a meas_event_t payload. Reply: int32 result.
+ * MEAS_STOP request: stops the stream of a channel and releases its timer. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t reserved;
+	uint32_t gate_ms;
+	uint32_t interval_ms;
+} meas_stream_request_t;
+
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t reserved[3];
+} meas_stop_request_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t channel;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t reserved;
+	meas_result_t result;
+} meas_event_t;
+
+void meas_tick();
+int meas_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _MEAS_H_ */
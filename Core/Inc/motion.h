@@ -0,0 +1,112 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _MOTION_H_
+#define _MOTION_H_
+
+#include "gpio.h"
+
+/*
+ * Stepper motion engine for step/dir drivers. Moves are queued and executed one after the other;
+ * the axes of a move are coordinated: the axis with the most steps follows the speed profile and the
+ * others are stepped along by Bresenham interpolation, so that all of them end together.
+ * Step times are set by the TIM2 channel 3 compare interrupt at the TIM2 clock resolution.
+ * The speed profile is computed at every step from the step index, with the same
+ * acceleration and deceleration distance:
+ * - MOTION_TRAPEZOID: constant acceleration, v^2 = start^2 + 2*accel*steps.
+ * - MOTION_S_CURVE: v^2 follows a smoothstep over the same distance, the acceleration rises from 0
+ *   and falls back to 0 (peak 1.5*accel), which limits the jerk.
+ * A move too short to reach max_speed peaks in its middle.
+ */
+#define MOTION_AXES				3
+#define MOTION_QUEUE			16
+
+#define ERROR_MOTION_QUEUE_FULL	-160
+#define ERROR_MOTION_AXIS		-161	// axis not configured
+#define ERROR_MOTION_SPEED		-162
+#define ERROR_MOTION_BUSY		-163
+
+enum motion_profile {
+	MOTION_TRAPEZOID = 0,
+	MOTION_S_CURVE
+};
+
+/* motion_config_request_t flags */
+#define MOTION_DIR_INVERT		0x01	// dir pin high for negative steps
+#define MOTION_STEP_LOW			0x02	// active-low step pulses
+#define MOTION_ENABLE_HIGH		0x04	// active-high enable pin, active-low otherwise
+
+/* motion_stop_request_t flags */
+#define MOTION_DECELERATE		0x01	// the current move decelerates to its start speed, immediate stop otherwise
+
+/*
+ * MOTION_CONFIG request: sets up the pins of an axis and clears its position. A port of 0 means no enable pin.
+ * The enable pin is asserted immediately. pulse_ns is the step pulse width of all the axes.
+ * The pins are reserved for the axis until its next MOTION_CONFIG, ERROR_GPIO_PIN_BUSY if another peripheral uses one.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t axis;
+	uint8_t flags;
+	uint8_t step_port;
+	uint8_t step_pin;
+	uint8_t dir_port;
+	uint8_t dir_pin;
+	uint8_t enable_port;
+	uint8_t enable_pin;
+	uint32_t pulse_ns;
+} motion_config_request_t;
+
+/*
+ * MOTION_MOVE request: queues a relative move. Speeds are in steps per second and accel in steps per second^2,
+ * on the axis with the most steps.
+ * Reply: int32 result, uint32 free queue entries.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t profile;
+	uint8_t reserved[3];
+	int32_t steps[MOTION_AXES];
+	uint32_t start_speed;
+	uint32_t max_speed;
+	uint32_t accel;
+} motion_move_request_t;
+
+/*
+ * MOTION_STOP request: flushes the queue and stops the current move. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t flags;
+	uint8_t reserved[3];
+} motion_stop_request_t;
+
+/*
+ * MOTION_STATUS reply, after the int32 result
+ */
+typedef struct __attribute__((packed)) {
+	int32_t position[MOTION_AXES];
+	uint32_t queued;	// moves in the queue, the current one included
+	uint32_t speed;		// current step rate of the leading axis
+} motion_status_t;
+
+int motion_request(const request_header_t* request, uint8_t* reply);
+void motion_isr();
+
+#endif /* _MOTION_H_ */
@@ -0,0 +1,103 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _PAR_H_
+#define _PAR_H_
+
+#include "gpio.h"
+
+/*
+ * Parallel bus engine for 8080 and 6800 style interfaces: an 8-bit or 16-bit data bus on one port,
+ * written and read as a whole through BSRR and IDR, plus WR/RD (or E and R/W), CS and DC strobes on any pins.
+ * CS is asserted for the whole PAR_RUN and DC is low only for the commands with PAR_COMMAND.
+ * 8080: data is latched on the rising edge of WR, read while RD is low. 6800: E is active high and R/W is high for reads.
+ * Strobe timings are counts of delay loops, 0 is the fastest.
+ * With dma_period_ns, writes are paced by TIM16 and DMA at one bus cycle per period, which needs the
+ * write strobe (WR or E) on the data port.
+ */
+#define ERROR_PAR_CONFIG		-152	// bus not configured, or invalid pins
+#define ERROR_PAR_COMMAND		-153
+#define ERROR_PAR_TIMING		-154
+#define ERROR_PAR_DMA			-155
+
+#define PAR_DMA_UNITS			1024	// bus cycles per DMA block, longer writes are split
+
+enum par_mode {
+	PAR_8080 = 0,
+	PAR_6800
+};
+
+enum par_opcode {
+	PAR_WRITE = 1,		// count bus words from the data
+	PAR_READ,			// count bus words appended to the reply
+	PAR_DELAY_US,		// waits count microseconds
+	PAR_OPCODE_COUNT
+};
+
+/* par_command_t flags */
+#define PAR_COMMAND				0x01	// DC low, data otherwise
+
+/*
+ * PAR_CONFIG request: configures the pins and keeps the strobes inactive. A port of 0 means the strobe is not used;
+ * WR (E for PAR_6800) is mandatory. For an 8-bit bus, data_shift is 0 for pins 0-7 and 8 for pins 8-15.
+ * The pins are reserved for the bus until the next PAR_CONFIG, ERROR_GPIO_PIN_BUSY if another peripheral uses one.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t mode;
+	uint8_t width;			// 8 or 16
+	uint8_t data_port;
+	uint8_t data_shift;
+	uint8_t wr_port;		// E for PAR_6800
+	uint8_t wr_pin;
+	uint8_t rd_port;		// R/W for PAR_6800
+	uint8_t rd_pin;
+	uint8_t cs_port;
+	uint8_t cs_pin;
+	uint8_t dc_port;
+	uint8_t dc_pin;
+	uint16_t setup_loops;	// data or DC valid before the strobe
+	uint16_t strobe_loops;	// strobe active
+	uint16_t hold_loops;	// after the strobe
+	uint16_t reserved;
+	uint32_t dma_period_ns;	// 0: writes by the CPU
+} par_config_request_t;
+
+/*
+ * Command followed by count words of data for PAR_WRITE, one byte each for an 8-bit bus and two
+ * (little-endian) for a 16-bit bus
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t count;
+} par_command_t;
+
+/*
+ * PAR_RUN request: executes the commands following the header until the end of the request.
+ * Reply: int32 result, uint32 number of commands executed, followed by the words read by the PAR_READ commands.
+ * The first failed command stops the execution.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+} par_run_request_t;
+
+int par_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _PAR_H_ */
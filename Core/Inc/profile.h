@@ -0,0 +1,101 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "gpio.h"
+
+/*
+ * Configuration profiles, kept in the last sector of the flash (bank 2) so that they survive resets.
+ * A profile holds the configuration and the initial levels of the pins of up to 8 ports, and a list of
+ * requests replayed in order to start the engines: PORT_CONFIG, the *_CONFIG requests, ADC/DAC/COUNTER/PULSE_START
+ * and ROUTE_ENABLE. Other requests are refused by PROFILE_SAVE.
+ * The boot profile is applied at the end of mcu_init(), unless the user button is pressed.
+ * The sector is rewritten as a whole by PROFILE_SAVE and PROFILE_BOOT, from an image in RAM.
+ */
+#define PROFILE_SLOTS			7
+#define PROFILE_NAME_LENGTH		16
+#define PROFILE_PORTS			8
+#define PROFILE_REQUESTS_SIZE	744		// bytes of stored requests per profile
+#define PROFILE_NONE			0xFF	// no boot profile
+
+#define PROFILE_FLASH_ADDRESS	0x081FE000	// last 8 KB sector of bank 2, excluded from the linker script
+#define PROFILE_FLASH_SECTOR	127
+
+#define ERROR_PROFILE_SLOT		-176	// invalid or empty slot
+#define ERROR_PROFILE_FLASH		-177	// erase or program error
+#define ERROR_PROFILE_REQUEST	-178	// invalid stored request
+
+/* profile_save_request_t flags */
+#define PROFILE_CAPTURE			0x01	// save the current pin configuration instead of ports
+
+typedef struct __attribute__((packed)) {
+	port_config_t config;	// a mask of 0 leaves the port unchanged
+	uint16_t levels;		// output levels of the pins of config.mask
+	uint16_t reserved;
+} profile_port_t;
+
+typedef struct __attribute__((packed)) {
+	char name[PROFILE_NAME_LENGTH];		// empty for a free slot
+	uint16_t requests_length;
+	uint16_t reserved;
+	uint32_t reserved2;
+	profile_port_t ports[PROFILE_PORTS];
+	uint8_t requests[PROFILE_REQUESTS_SIZE];
+} profile_t;
+
+/*
+ * PROFILE_SAVE request: stores a profile in slot, replacing the previous one. The requests follow the ports,
+ * each with its request_header_t, up to the end of the request. An empty name frees the slot.
+ * Deferred, as the flash sector is erased. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t flags;
+	uint16_t reserved;
+	char name[PROFILE_NAME_LENGTH];
+	profile_port_t ports[PROFILE_PORTS];
+	uint8_t requests[];
+} profile_save_request_t;
+
+/*
+ * PROFILE_BOOT request: selects the profile applied at boot, PROFILE_NONE for none. Deferred. Reply: int32 result.
+ * PROFILE_APPLY request: applies a profile now. Deferred.
+ * Reply: int32 result, uint32 index of the stored request that failed (the result is then its own).
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+} profile_slot_request_t;
+
+/*
+ * PROFILE_LIST reply: int32 result, followed by profile_list_reply_t.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t boot;
+	uint8_t reserved[3];
+	char names[PROFILE_SLOTS][PROFILE_NAME_LENGTH];
+} profile_list_reply_t;
+
+void profile_boot();
+int profile_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _PROFILE_H_ */
@@ -0,0 +1,73 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _PULSE_H_
+#define _PULSE_H_
+
+#include "gpio.h"
+
+/*
+ * Pulse generation with a timer in one-pulse mode. A cycle is delay_ticks at the idle level
+ * followed by width_ticks at the active level, and is repeated count times by the repetition counter,
+ * so N pulses at period P are delay = P - W. Times are in ticks of TIM_CLK_HZ and are rounded
+ * to the prescaler needed to fit a cycle in the 16-bit counter; the actual values are returned.
+ * With PULSE_TRIGGER, the burst is started in hardware by each edge on the trigger pin, which must be
+ * on channel 1 or 2 of the same timer as the output.
+ * Between bursts, and after PULSE_STOP, the output pin is held at the idle level.
+ */
+#define PULSE_CHANNELS			4
+
+#define ERROR_PULSE_TIMING		-144
+#define ERROR_PULSE_COUNT		-145	// count > 1 needs a timer with a repetition counter (TIM1, TIM8, TIM15)
+
+#define PULSE_ACTIVE_LOW		0x01
+#define PULSE_TRIGGER			0x02	// started by the trigger pin
+#define PULSE_TRIGGER_FALLING	0x04	// on its falling edges, rising otherwise
+
+/*
+ * PULSE_START request: (re)starts a pulse channel.
+ * Reply: int32 result, uint32 actual delay ticks, uint32 actual width ticks.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t flags;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t trigger_port;
+	uint8_t trigger_pin;
+	uint16_t reserved;
+	uint32_t delay_ticks;
+	uint32_t width_ticks;
+	uint32_t count;
+} pulse_start_request_t;
+
+/*
+ * PULSE_STOP request: stops a channel and releases its timer. Reply: int32 result.
+ * PULSE_STATUS request (no parameters). Reply: int32 result, uint32 mask of the channels started,
+ * uint32 mask of the channels whose timer is running a burst.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t reserved[3];
+} pulse_stop_request_t;
+
+int pulse_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _PULSE_H_ */
@@ -0,0 +1,80 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _PWM_H_
+#define _PWM_H_
+
+#include "gpio.h"
+
+#define PWM_MAX_CHANNELS		16
+
+#define ERROR_PWM_FREQUENCY		-56
+#define ERROR_PWM_CHANNEL		-57
+#define ERROR_PWM_COUNT			-58		// more than PWM_MAX_CHANNELS duty cycles
+
+enum pwm_polarity {
+	PWM_ACTIVE_HIGH = 0,
+	PWM_ACTIVE_LOW
+};
+
+/*
+ * PWM_CONFIG request: connects the pin to a timer channel and starts the PWM, or updates it if the pin
+ * is already a PWM output. The channels of a timer share its frequency, so a timer that already drives
+ * other pins only accepts their frequency. Reply: int32 result, uint64 actual frequency in millihertz.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t polarity;
+	uint8_t reserved;
+	uint32_t frequency_hz;
+	uint32_t duty_ppm;
+} pwm_config_request_t;
+
+/*
+ * PWM_DUTY request: changes the duty cycle of several PWM pins. The new values of the channels
+ * of a timer take effect together at its next update event. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t port;
+	uint8_t pin;
+	uint16_t reserved;
+	uint32_t duty_ppm;
+} pwm_duty_t;
+
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t count;
+	pwm_duty_t duty[];
+} pwm_duty_request_t;
+
+/*
+ * PWM_STOP request: stops the PWM and gives the pin back to the gpio functions as an input.
+ * Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint16_t reserved;
+} pwm_stop_request_t;
+
+int pwm_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _PWM_H_ */
@@ -0,0 +1,74 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _ROUTE_H_
+#define _ROUTE_H_
+
+#include "gpio.h"
+
+/*
+ * Reflex routes: an edge on a source pin applies an action to a target pin directly
+ * in the EXTI interrupt handler, with no USB traffic.
+ * Source pins share the EXTI lines with the edge capture, so the same one-port-per-line rule applies.
+ * The pin modes are left to the gpio functions: sources must be inputs and targets outputs.
+ */
+#define ROUTE_COUNT				16
+
+enum route_action {
+	ROUTE_NONE = 0,		// releases the route
+	ROUTE_COPY,			// the target takes the level of the source
+	ROUTE_INVERT,		// the target takes the inverted level of the source
+	ROUTE_SET,
+	ROUTE_CLEAR,
+	ROUTE_PULSE,		// the target goes high for pulse_us, a new edge restarts the pulse
+	ROUTE_PULSE_LOW		// the target goes low for pulse_us
+};
+
+/*
+ * ROUTE_CONFIG request: sets up a route, which stays disabled until ROUTE_ENABLE, and clears its hit counter.
+ * trigger is the edge of the source pin that fires the route. Reply: int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t route;
+	uint8_t action;
+	uint8_t trigger;
+	uint8_t reserved;
+	uint8_t source_port;
+	uint8_t source_pin;
+	uint8_t target_port;
+	uint8_t target_pin;
+	uint32_t pulse_us;
+} route_config_request_t;
+
+/*
+ * ROUTE_ENABLE and ROUTE_DISABLE requests: enable or disable the configured routes in mask
+ * (bit n for route n). Reply: int32 result.
+ * ROUTE_STATUS request (no parameters). Reply: int32 result, uint32 mask of the enabled routes,
+ * followed by ROUTE_COUNT uint32 hit counters.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t mask;
+} route_enable_request_t;
+
+void route_isr(uint32_t line, GPIO_TypeDef* source, uint32_t rising, uint32_t falling);
+void route_timer_isr();
+int route_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _ROUTE_H_ */
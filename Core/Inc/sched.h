@@ -0,0 +1,82 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include "gpio.h"
+
+#define SCHED_QUEUE_LENGTH		64
+#define SCHED_RECORDS_LENGTH	64	// must be a power of 2
+
+#define ERROR_SCHED_FULL		-24
+#define ERROR_SCHED_ACTION		-25
+
+/*
+ * Actions that can be scheduled. They apply to the pins of port in mask.
+ */
+enum sched_action {
+	SCHED_SET = 0,
+	SCHED_CLEAR,
+	SCHED_WRITE,	// pins in mask take the value of the corresponding bits of value
+	SCHED_TOGGLE
+};
+
+/*
+ * time is the target execution time in the device timebase (TIM5, microseconds).
+ * Commands whose time is already past are executed immediately.
+ * Commands cannot be scheduled more than 2^31 microseconds ahead.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t time;
+	uint16_t tag;		// returned in the completion record
+	uint8_t action;
+	uint8_t port;
+	uint16_t mask;
+	uint16_t value;
+} sched_command_t;
+
+/*
+ * Completion record. skew = actual - target, in microseconds.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t tag;
+	uint16_t reserved;
+	uint32_t target;
+	int32_t skew;
+} sched_record_t;
+
+/*
+ * SCHED_SUBMIT request: header followed by the commands. Reply: int32 result.
+ * SCHED_STATUS request: header only. Reply: int32 result, uint32 pending commands, uint32 lost records,
+ * uint32 number of records, followed by the completion records (which are removed from the device).
+ * SCHED_CANCEL request: header only, drops all pending commands. Reply: int32 result.
+ * SCHED_TIME request: header only. Reply: int32 result, uint32 device time in microseconds.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	sched_command_t commands[];
+} sched_submit_request_t;
+
+void sched_init();
+int sched_submit(const sched_command_t* commands, uint32_t count);
+void sched_cancel();
+void sched_isr();
+int sched_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _SCHED_H_ */
@@ -0,0 +1,96 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _SEQ_H_
+#define _SEQ_H_
+
+#include "gpio.h"
+
+#define SEQ_MAX_PROGRAMS		4
+#define SEQ_MAX_INSTRUCTIONS	128
+#define SEQ_MAX_RESULTS			256
+#define SEQ_LOOP_COUNTERS		4
+#define SEQ_MAX_TIMEOUT_US		1000000		// SEQ_RUN blocks the deferred requests for at most this long
+
+#define ERROR_SEQ_PROGRAM		-16
+#define ERROR_SEQ_SLOT			-17
+#define ERROR_SEQ_EMPTY			-18
+#define ERROR_SEQ_TIMEOUT		-19
+#define ERROR_SEQ_RESULTS		-20
+
+/*
+ * Sequencer instruction set.
+ * Every instruction is 12-byte long. Ports are given as letters ('a' to 'h'), pins as 16-bit masks.
+ * acc is the only data register: it is loaded by SEQ_READ and by the timestamp instructions, and it is
+ * the value emitted by SEQ_EMIT and compared by the conditional branches.
+ */
+enum seq_opcode {
+	SEQ_END = 0,		// stop the program
+	SEQ_SET,			// port.BSRR = mask
+	SEQ_CLEAR,			// port.BRR = mask
+	SEQ_WRITE,			// pins in mask take the value of the corresponding bits of value
+	SEQ_READ,			// acc = port.IDR & mask
+	SEQ_WAIT_US,		// busy-wait arg microseconds
+	SEQ_WAIT_PIN,		// wait until (port.IDR & mask) == value, for at most arg microseconds. acc = 1 on timeout, 0 otherwise
+	SEQ_JUMP,			// jump to instruction target
+	SEQ_BRANCH_EQ,		// jump to target if acc == arg
+	SEQ_BRANCH_NE,		// jump to target if acc != arg
+	SEQ_LOOP_INIT,		// counter[port] = arg
+	SEQ_LOOP,			// if --counter[port] != 0, jump to target
+	SEQ_EMIT,			// append acc to the results
+	SEQ_TIMESTAMP,		// acc = TIM5 counter (microseconds)
+	SEQ_OPCODE_COUNT
+};
+
+typedef struct __attribute__((packed)) {
+	uint8_t opcode;
+	uint8_t port;		// port letter, or loop counter index for SEQ_LOOP_INIT and SEQ_LOOP
+	uint16_t mask;
+	uint16_t value;
+	uint16_t target;
+	uint32_t arg;
+} seq_instruction_t;
+
+/*
+ * SEQ_LOAD request: header followed by the program instructions.
+ * The reply is the int32 result.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+	seq_instruction_t program[];
+} seq_load_request_t;
+
+/*
+ * SEQ_RUN request. The program is aborted if it runs for longer than timeout_us, at most SEQ_MAX_TIMEOUT_US
+ * (ERROR_GPIO_PARAMETER above).
+ * The reply is the int32 result, followed by the uint32 number of results and by the results themselves.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+	uint32_t timeout_us;
+} seq_run_request_t;
+
+int seq_load(uint8_t slot, const seq_instruction_t* program, uint32_t count);
+int seq_run(uint8_t slot, uint32_t timeout_us, uint32_t* results, uint32_t* count);
+int seq_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _SEQ_H_ */
@@ -0,0 +1,68 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _SPI_H_
+#define _SPI_H_
+
+#include "gpio.h"
+
+/*
+ * SPI1 on the Arduino connector: SCK PA5 (D13), MISO PG9 (D12), MOSI PB5 (D11)
+ */
+#define SPI_KER_CLK_HZ			64000000	// HSI through CLKP
+#define SPI_MAX_TRANSFER		REQUEST_MAX_LENGTH	// bytes clocked by a single transaction
+
+#define ERROR_SPI_TIMEOUT		-64
+#define ERROR_SPI_DMA			-65
+
+/* spi_transaction_t flags */
+#define SPI_LSB_FIRST			0x01
+#define SPI_FULL_DUPLEX			0x02	// rx bytes are received while tx bytes are sent, otherwise after them
+#define SPI_CS_ACTIVE_HIGH		0x04
+#define SPI_CS_HOLD				0x08	// chip select stays active after the transaction
+
+/*
+ * A transaction asserts the chip select pin, clocks tx_length bytes out and rx_length bytes in, and
+ * releases the chip select. Without SPI_FULL_DUPLEX, the rx bytes are clocked after the tx bytes with
+ * 0xFF on MOSI. cs_port = 0 means no chip select. The chip select pin must be configured as an output
+ * with gpio_config(). The transaction is followed by tx_length bytes of data.
+ * clock_hz is rounded down to the SPI_KER_CLK_HZ divisions, from 2 to 256.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t cs_port;
+	uint8_t cs_pin;
+	uint8_t mode;		// CPOL and CPHA, 0 to 3
+	uint8_t flags;
+	uint32_t clock_hz;
+	uint16_t tx_length;
+	uint16_t rx_length;
+} spi_transaction_t;
+
+/*
+ * SPI_TRANSFER request: executes count transactions, each followed by its tx data.
+ * Reply: int32 result, uint32 number of transactions executed, followed by the rx data of all of them.
+ * Execution stops at the first failing transaction.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t count;
+} spi_transfer_request_t;
+
+int spi_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _SPI_H_ */
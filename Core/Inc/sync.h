@@ -0,0 +1,57 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _SYNC_H_
+#define _SYNC_H_
+
+#include "gpio.h"
+
+/*
+ * Synchronous update of several ports. The BSRR words of the ports are staged in a GPDMA linked list
+ * that is started by a single TIM17 update event and runs the writes back to back without the CPU.
+ * The list is framed by two copies of the TIM2 counter, so that the time taken by the port writes
+ * is measured: all the ports change within span_ns.
+ */
+#define SYNC_MAX_PORTS			8
+#define SYNC_MAX_DELAY_US		65535
+
+#define ERROR_SYNC_TIMEOUT		-168
+
+typedef struct __attribute__((packed)) {
+	uint8_t port;
+	uint8_t reserved;
+	uint16_t mask;		// pins to write
+	uint16_t value;		// levels of the pins in mask
+	uint16_t reserved2;
+} sync_port_t;
+
+/*
+ * SYNC_WRITE request: writes the ports delay_us after the request, 0 for as soon as possible.
+ * Reply: int32 result, uint32 span_ns between the first and the last port write, TIM2 resolution.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t delay_us;
+	uint8_t count;
+	uint8_t reserved[3];
+	sync_port_t ports[];
+} sync_write_request_t;
+
+int sync_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _SYNC_H_ */
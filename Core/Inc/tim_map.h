@@ -0,0 +1,64 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _TIM_MAP_H_
+#define _TIM_MAP_H_
+
+#include "stm32h5xx_ll_tim.h"
+#include "stm32h5xx_ll_gpio.h"
+
+#define ERROR_TIM_NO_CHANNEL	-40
+#define ERROR_TIM_BUSY			-41
+
+/*
+ * Features that can own a general-purpose timer.
+ * A timer is owned by one feature at a time, but a feature can use several timers.
+ */
+enum tim_owner {
+	TIM_OWNER_NONE = 0,
+	TIM_OWNER_MEAS,
+	TIM_OWNER_PWM,
+	TIM_OWNER_WIRE,
+	TIM_OWNER_COUNTER,
+	TIM_OWNER_PULSE
+};
+
+/*
+ * Timer channel that can be connected to a pin through its alternate function
+ */
+typedef struct {
+	char port;
+	uint8_t pin;
+	uint8_t channel;	// 1 to 4
+	uint8_t af;
+	TIM_TypeDef* tim;
+} tim_pin_t;
+
+#define TIM_CHANNEL_MASK(ch)	(1U << ((ch)-1))
+
+/*
+ * tim_pin_lookup() with owner = TIM_OWNER_NONE only returns channels of free timers
+ */
+const tim_pin_t* tim_pin_lookup(char port, uint8_t pin, enum tim_owner owner, uint32_t channel_mask);
+int tim_claim(TIM_TypeDef* tim, enum tim_owner owner);
+void tim_release(TIM_TypeDef* tim, enum tim_owner owner);
+uint32_t tim_ll_channel(uint8_t channel);
+int tim_pin_connect(const tim_pin_t* map);
+void tim_pin_disconnect(const tim_pin_t* map);
+
+#endif /* _TIM_MAP_H_ */
@@ -0,0 +1,85 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _UART_H_
+#define _UART_H_
+
+#include "gpio.h"
+
+/*
+ * USB-to-UART bridge on USART2: TX PD5, RX PD6, RTS PD4, CTS PD3 (CN9).
+ * The byte stream is carried by the EP3 bulk endpoints: EP3 OUT to TX, RX to EP3 IN.
+ * RX is received by a circular DMA, TX is sent by DMA from a ring.
+ */
+#define UART_KER_CLK_HZ			250000000	// PCLK1
+#define UART_MAX_BAUD			(UART_KER_CLK_HZ / 8)
+#define UART_MIN_BAUD			15			// BRR fits in 16 bits with the kernel clock divided by 256
+#define UART_RX_RING			4096		// must be a power of 2
+#define UART_TX_RING			4096		// must be a power of 2
+
+#define ERROR_UART_BAUD			-96
+
+enum uart_parity {
+	UART_PARITY_NONE = 0,
+	UART_PARITY_EVEN,
+	UART_PARITY_ODD
+};
+
+/* uart_config_request_t flags */
+#define UART_RTS_CTS			0x01	// hardware flow control
+#define UART_STOP_2				0x02	// 2 stop bits
+
+/*
+ * UART_CONFIG request: (re)starts the bridge, discarding the data not transferred yet.
+ * data_bits is 7 or 8, parity bit excluded.
+ * Reply: int32 result, uint32 actual baud rate.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint32_t baud;
+	uint8_t data_bits;
+	uint8_t parity;
+	uint8_t flags;
+	uint8_t reserved;
+} uart_config_request_t;
+
+/*
+ * UART_STATUS reply: int32 result followed by the counters, cleared by UART_CONFIG
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t rx_bytes;			// bytes received from the line
+	uint32_t tx_bytes;			// bytes sent on the line
+	uint32_t rx_dropped;		// bytes lost because the host did not read EP3 IN fast enough
+	uint32_t overruns;			// USART overrun errors
+	uint32_t line_errors;		// framing, parity and noise errors
+	uint32_t flow_stalls;		// times EP3 OUT was held because the TX ring was full
+	uint16_t rx_pending;		// bytes waiting to be sent to the host
+	uint16_t tx_pending;		// bytes waiting to be sent on the line
+} uart_status_t;
+
+int uart_enabled();
+uint32_t uart_rx_peek(const uint8_t** data);
+void uart_rx_consume(uint32_t n);
+uint32_t uart_tx_free();
+int uart_tx_push(const uint8_t* data, uint32_t n);
+void uart_isr();
+void uart_rx_dma_isr();
+void uart_tx_dma_isr();
+int uart_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _UART_H_ */
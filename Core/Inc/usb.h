@@ -9,6 +9,7 @@
 #define INC_USB_H_
 
 #include "usb_ll.h"
+#include "gpio.h"
 
 struct __attribute__((packed)) usb_request {
 	uint8_t bmRequestType;
@@ -37,8 +38,18 @@ struct __attribute__((packed)) usb_request {
 #define DESCR_SUPERSPEED_USB_ENDPOINT_COMPANION	48
 
 void usb_reset_isr();
+void usb_deferred_isr();
+void usb_event_isr();
+void usb_uart_isr();
+void usb_analog_isr();
+int usb_execute(const request_header_t* request, uint8_t* reply);
+int usb_event_post(uint16_t type, const void* payload, uint32_t length);
 int usb_ctr_isr();
 int ctr_isr();
 void USB_Init();
+extern uint32_t usb_isr_cycles;
+extern uint32_t usb_isr_cycles_max;
+void USB_Power();
+void USB_Connect();
 
 #endif /* INC_USB_H_ */
@@ -23,7 +23,7 @@
 
 #define EP_MAX_PACKET_SIZE		64
 #define CONTROL_ENDPOINT_COUNT	2
-#define BULK_ENDPOINT_COUNT		2
+#define BULK_ENDPOINT_COUNT		8
 #define TOT_ENDPOINT_COUNT		(CONTROL_ENDPOINT_COUNT + BULK_ENDPOINT_COUNT)
 
 struct __attribute__((packed)) usb_device_descriptor {
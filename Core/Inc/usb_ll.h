@@ -557,6 +557,8 @@ typedef USB_EPTypeDef       USB_DRD_EPTypeDef;
 #endif /* defined (USB_DRD_FS) */
 
 void USB_ll_init();
+void USB_ll_power();
+void USB_ll_connect();
 int USB_ActivateEndpoint(USB_DRD_TypeDef *USBx, USB_DRD_EPTypeDef *ep);
 void USB_WritePMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
 void USB_ReadPMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes);
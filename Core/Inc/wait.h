@@ -0,0 +1,55 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _WAIT_H_
+#define _WAIT_H_
+
+#include "gpio.h"
+
+#define ERROR_WAIT_TIMEOUT		-136
+
+enum wait_mode {
+	WAIT_MATCH = 0,		// until (port & mask) == value
+	WAIT_CHANGE			// until any pin in mask changes
+};
+
+/*
+ * WAIT_PINS request: waits on the device for a condition on the pins of a port, for at most timeout_us.
+ * The request is deferred, so the other endpoints keep being serviced while it waits.
+ * Reply: int32 result (ERROR_WAIT_TIMEOUT if the condition was not met), followed by wait_reply_t.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t mode;
+	uint16_t mask;
+	uint16_t value;
+	uint16_t reserved;
+	uint32_t timeout_us;
+} wait_request_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t timestamp_us;	// device time of the last sample
+	uint32_t elapsed_us;
+	uint16_t port_value;	// port input register at that time
+	uint16_t reserved;
+} wait_reply_t;
+
+int wait_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _WAIT_H_ */
@@ -0,0 +1,79 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include "gpio.h"
+
+/*
+ * Single-wire timing protocol engine (WS2812-style LED chains, 1-Wire-like buses).
+ * Each bit is a timer period starting with a pulse, whose width is written by DMA into the
+ * compare register at every update event. Reply slots are sampled by DMA at a fixed time in the
+ * period, triggered by a second compare channel of the same timer.
+ * The pin must be connected to a channel of a timer listed in tim_map.c.
+ */
+#define WIRE_MAX_SLOTS			8192	// bits of a single command
+
+#define ERROR_WIRE_COMMAND		-104
+#define ERROR_WIRE_TIMING		-105
+#define ERROR_WIRE_TIMEOUT		-106
+
+enum wire_opcode {
+	WIRE_WRITE = 1,		// length bytes: pulse of t0_ns for 0 bits, t1_ns for 1 bits
+	WIRE_READ,			// length slots: pulse of t0_ns, then the pin is sampled at t1_ns. Reset/presence is a 1-slot read
+	WIRE_DELAY,			// idle level for period_ns
+	WIRE_OPCODE_COUNT
+};
+
+/* wire_run_request_t flags */
+#define WIRE_ACTIVE_LOW			0x01	// pulses are low and the idle level is high
+#define WIRE_OPEN_DRAIN			0x02	// open-drain output with pull-up, needed by reads
+
+/* wire_command_t flags */
+#define WIRE_LSB_FIRST			0x01
+
+/*
+ * Command followed by length bytes of data for WIRE_WRITE
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t length;
+	uint32_t period_ns;
+	uint32_t t0_ns;
+	uint32_t t1_ns;
+} wire_command_t;
+
+/*
+ * WIRE_RUN request: executes count commands on the pin, then leaves it as a gpio output at the idle level.
+ * Reply: int32 result, uint32 number of commands executed, followed by the bits read by the WIRE_READ
+ * commands, (length+7)/8 bytes each, packed in the bit order of the command. A sampled high level is a 1.
+ */
+typedef struct __attribute__((packed)) {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t count;
+} wire_run_request_t;
+
+int wire_request(const request_header_t* request, uint8_t* reply);
+
+#endif /* _WIRE_H_ */
@@ -0,0 +1,386 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "adc.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include <string.h>
+
+#define ADC_EXTSEL_TIM6_TRGO	13
+#define ADC_TIMEOUT_US			100000
+
+typedef struct {
+	char port;
+	uint8_t pin;
+	uint8_t channel;
+} adc_channel_t;
+
+/* ADC1 inputs available on the NUCLEO-H563ZI pins */
+static const adc_channel_t adc_channels[] = {
+	{'a', 0, 0}, {'a', 1, 1}, {'a', 2, 14}, {'a', 3, 15}, {'a', 4, 18}, {'a', 5, 19}, {'a', 6, 3}, {'a', 7, 7},
+	{'b', 0, 9}, {'b', 1, 5},
+	{'c', 0, 10}, {'c', 1, 11}, {'c', 2, 12}, {'c', 3, 13}, {'c', 4, 4}, {'c', 5, 8},
+	{'f', 11, 2}, {'f', 12, 6},
+};
+
+/* Sampling times in half ADC cycles, indexed by the SMP code. A conversion takes 12.5 more cycles. */
+static const uint16_t sample_half_cycles[8] = {5, 13, 25, 49, 95, 185, 495, 1281};
+
+static int powered;
+static int streaming;
+static uint8_t count;		// channels in the sequence
+static const adc_channel_t* claimed[ADC_MAX_CHANNELS];	// pins owned by the sequence
+static uint8_t sample_time;
+static uint8_t oversampling;
+
+/*
+ * The sample ring holds a whole number of units of two scans, so that every unit is packed
+ * into whole bytes and no unit wraps around the ring. Indexes are free-running sample or byte counts.
+ */
+static uint16_t samples[ADC_SAMPLE_RING] __attribute__((aligned(4)));
+static uint8_t stream[ADC_STREAM_RING];
+static dma_node_t node;
+static uint32_t ring_length, unit;
+static uint32_t dma_w, dma_pos, packed;
+static uint32_t stream_w, stream_r;
+static adc_status_t status;
+
+static const adc_channel_t* find_channel(char port, uint8_t pin)
+{
+	port |= 0x20;	// lower case
+	for(int i=0;i<sizeof(adc_channels)/sizeof(adc_channels[0]);i++)
+		if(adc_channels[i].port == port && adc_channels[i].pin == pin)
+			return &adc_channels[i];
+	return NULL;
+}
+
+static int wait_flag(volatile uint32_t* reg, uint32_t mask, uint32_t value)
+{
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while((*reg & mask) != value)
+		if(LL_TIM_GetCounter(TIM5) - start > ADC_TIMEOUT_US)
+			return ERROR_ADC_TIMEOUT;
+	return 0;
+}
+
+/*
+ * Powers up, calibrates and enables ADC1, clocked synchronously by HCLK/4
+ */
+static int adc_power()
+{
+	if(powered)
+		return 0;
+
+	LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_ADC);
+	MODIFY_REG(ADC12_COMMON->CCR, ADC_CCR_CKMODE, ADC_CCR_CKMODE_0 | ADC_CCR_CKMODE_1);
+	CLEAR_BIT(ADC1->CR, ADC_CR_DEEPPWD);
+	SET_BIT(ADC1->CR, ADC_CR_ADVREGEN);
+	delay_us(20);
+
+	SET_BIT(ADC1->CR, ADC_CR_ADCAL);
+	int res = wait_flag(&ADC1->CR, ADC_CR_ADCAL, 0);
+	if(res < 0)
+		return res;
+
+	WRITE_REG(ADC1->ISR, ADC_ISR_ADRDY);
+	SET_BIT(ADC1->CR, ADC_CR_ADEN);
+	res = wait_flag(&ADC1->ISR, ADC_ISR_ADRDY, ADC_ISR_ADRDY);
+	if(res < 0)
+		return res;
+
+	powered = 1;
+	return 0;
+}
+
+static void adc_stop()
+{
+	if(!streaming)
+		return;
+
+	LL_TIM_DisableCounter(TIM6);
+	if(READ_BIT(ADC1->CR, ADC_CR_ADSTART)) {
+		SET_BIT(ADC1->CR, ADC_CR_ADSTP);
+		wait_flag(&ADC1->CR, ADC_CR_ADSTART, 0);
+	}
+	NVIC_DisableIRQ(GPDMA1_Channel7_IRQn);
+	dma_stop(DMA_ADC);
+	CLEAR_BIT(ADC1->CFGR, ADC_CFGR_DMAEN | ADC_CFGR_DMACFG | ADC_CFGR_EXTEN);
+	streaming = 0;
+}
+
+static int adc_config(const adc_config_request_t* config)
+{
+	if(streaming)
+		return ERROR_ADC_BUSY;
+	if(config->count == 0 || config->count > ADC_MAX_CHANNELS || config->sample_time > 7 || config->oversampling > 8)
+		return ERROR_GPIO_PARAMETER;
+
+	const adc_channel_t* channels[ADC_MAX_CHANNELS];
+	for(int i=0;i<config->count;i++) {
+		channels[i] = find_channel(config->pins[i].port, config->pins[i].pin);
+		if(channels[i] == NULL)
+			return ERROR_ADC_CHANNEL;
+	}
+
+	/* the pins of the previous sequence are given back, still in analog mode */
+	for(int i=0;i<ADC_MAX_CHANNELS;i++) {
+		if(claimed[i] != NULL)
+			gpio_release(claimed[i]->port, claimed[i]->pin, PIN_OWNER_ADC);
+		claimed[i] = NULL;
+	}
+	for(int i=0;i<config->count;i++) {
+		int res = gpio_claim(channels[i]->port, channels[i]->pin, PIN_OWNER_ADC);
+		if(res < 0) {
+			for(int j=0;j<i;j++) {
+				gpio_release(claimed[j]->port, claimed[j]->pin, PIN_OWNER_ADC);
+				claimed[j] = NULL;
+			}
+			return res;
+		}
+		claimed[i] = channels[i];
+	}
+
+	int res = adc_power();
+	if(res < 0)
+		return res;
+
+	uint32_t sqr[4] = {config->count - 1, 0, 0, 0};
+	for(int i=0;i<config->count;i++) {
+		uint32_t rank = i + 1;
+		uint32_t ch = channels[i]->channel;
+		sqr[rank / 5] |= ch << ((rank % 5) * 6);
+		if(ch < 10)
+			MODIFY_REG(ADC1->SMPR1, 7U << (ch*3), (uint32_t)config->sample_time << (ch*3));
+		else
+			MODIFY_REG(ADC1->SMPR2, 7U << ((ch-10)*3), (uint32_t)config->sample_time << ((ch-10)*3));
+		LL_GPIO_SetPinMode(gpio_port(channels[i]->port), 1U << channels[i]->pin, LL_GPIO_MODE_ANALOG);
+	}
+	WRITE_REG(ADC1->SQR1, sqr[0]);
+	WRITE_REG(ADC1->SQR2, sqr[1]);
+	WRITE_REG(ADC1->SQR3, sqr[2]);
+	WRITE_REG(ADC1->SQR4, sqr[3]);
+
+	WRITE_REG(ADC1->CFGR, ADC_CFGR_OVRMOD);
+	if(config->oversampling > 0)
+		WRITE_REG(ADC1->CFGR2, ADC_CFGR2_ROVSE | ((config->oversampling - 1U) << ADC_CFGR2_OVSR_Pos) | ((uint32_t)config->oversampling << ADC_CFGR2_OVSS_Pos));
+	else
+		WRITE_REG(ADC1->CFGR2, 0);
+
+	count = config->count;
+	sample_time = config->sample_time;
+	oversampling = config->oversampling;
+	return 0;
+}
+
+/*
+ * Single shot: in discontinuous mode every start converts the next channel of the sequence
+ */
+static int adc_read(uint16_t* values)
+{
+	if(streaming)
+		return ERROR_ADC_BUSY;
+	if(count == 0)
+		return ERROR_ADC_CHANNEL;
+
+	MODIFY_REG(ADC1->CFGR, ADC_CFGR_EXTEN | ADC_CFGR_DMAEN | ADC_CFGR_DISCNUM, ADC_CFGR_DISCEN);
+	for(int i=0;i<count;i++) {
+		WRITE_REG(ADC1->ISR, ADC_ISR_EOC | ADC_ISR_OVR);
+		SET_BIT(ADC1->CR, ADC_CR_ADSTART);
+		int res = wait_flag(&ADC1->ISR, ADC_ISR_EOC, ADC_ISR_EOC);
+		if(res < 0)
+			return res;
+		values[i] = READ_REG(ADC1->DR);
+	}
+	CLEAR_BIT(ADC1->CFGR, ADC_CFGR_DISCEN);
+	return 0;
+}
+
+/*
+ * Packs the complete units converted since the last call into the stream ring
+ */
+static void pack()
+{
+	uint32_t pos = (ring_length - dma_remaining(DMA_ADC)/sizeof(uint16_t)) % ring_length;
+	uint32_t n = (pos + ring_length - dma_pos) % ring_length;
+	dma_pos = pos;
+	dma_w += n;
+	status.samples += n;
+
+	if(dma_w - packed > ring_length) {
+		uint32_t lost = (dma_w - packed - ring_length + unit - 1) / unit * unit;
+		packed += lost;
+		status.dropped += lost;
+	}
+
+	while(dma_w - packed >= unit) {
+		if(ADC_STREAM_RING - (stream_w - stream_r) < unit/2*3) {
+			packed += unit;
+			status.dropped += unit;
+			continue;
+		}
+		const uint16_t* s = &samples[packed % ring_length];
+		for(uint32_t i=0;i<unit;i+=2) {
+			stream[stream_w++ & (ADC_STREAM_RING-1)] = s[i];
+			stream[stream_w++ & (ADC_STREAM_RING-1)] = ((s[i] >> 8) & 0x0F) | (s[i+1] << 4);
+			stream[stream_w++ & (ADC_STREAM_RING-1)] = s[i+1] >> 4;
+		}
+		packed += unit;
+	}
+}
+
+/*
+ * Returns the number of stream bytes that can be read contiguously from *data
+ */
+uint32_t adc_stream_peek(const uint8_t** data)
+{
+	if(streaming)
+		pack();
+
+	uint32_t n = stream_w - stream_r;
+	uint32_t contiguous = ADC_STREAM_RING - (stream_r & (ADC_STREAM_RING-1));
+	*data = &stream[stream_r & (ADC_STREAM_RING-1)];
+	return n < contiguous ? n : contiguous;
+}
+
+void adc_stream_consume(uint32_t n)
+{
+	if(n <= stream_w - stream_r)
+		stream_r += n;
+}
+
+void adc_dma_isr()
+{
+	WRITE_REG(DMA_ADC->CFCR, DMA_CFCR_HTF | DMA_CFCR_TCF);
+	pack();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+}
+
+/*
+ * Called every millisecond by SysTick, which preempts the USB interrupt:
+ * only wakes it up when new samples have been converted, so that slow streams are not delayed
+ * until the next half-ring interrupt
+ */
+void adc_tick()
+{
+	static uint32_t last;
+
+	if(!streaming)
+		return;
+	uint32_t remaining = dma_remaining(DMA_ADC);
+	if(remaining != last) {
+		last = remaining;
+		NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+	}
+}
+
+static int adc_start(uint32_t rate_hz, uint32_t* actual_mhz)
+{
+	if(streaming)
+		return ERROR_ADC_BUSY;
+	if(count == 0)
+		return ERROR_ADC_CHANNEL;
+	if(rate_hz == 0)
+		return ERROR_ADC_RATE;
+
+	/* the scan must fit in the trigger period */
+	uint64_t scan_half_cycles = (uint64_t)count * (1U << oversampling) * (sample_half_cycles[sample_time] + 25);
+	if(scan_half_cycles * rate_hz >= 2ULL * ADC_CLK_HZ)
+		return ERROR_ADC_RATE;
+
+	uint32_t ticks = (ADC_TIM_CLK_HZ + rate_hz/2) / rate_hz;
+	uint32_t psc = (ticks-1) / 65536;
+	uint32_t arr = ticks/(psc+1) - 1;
+	*actual_mhz = (uint64_t)ADC_TIM_CLK_HZ * 1000 / ((uint64_t)(psc+1) * (arr+1));
+
+	unit = 2 * count;
+	ring_length = ADC_SAMPLE_RING / unit * unit;
+	dma_w = dma_pos = packed = 0;
+	stream_w = stream_r = 0;
+	memset(&status, 0, sizeof(status));
+
+	MODIFY_REG(ADC1->CFGR, ADC_CFGR_DISCEN | ADC_CFGR_EXTSEL | ADC_CFGR_EXTEN,
+			ADC_CFGR_DMAEN | ADC_CFGR_DMACFG | (ADC_EXTSEL_TIM6_TRGO << ADC_CFGR_EXTSEL_Pos) | ADC_CFGR_EXTEN_0);
+	dma_start_circular(DMA_ADC, DMA_REQUEST_ADC1, &ADC1->DR, samples, ring_length*sizeof(uint16_t), DMA_WIDTH_16 | DMA_IRQ_TC | DMA_IRQ_HT, &node);
+	NVIC_SetPriority(GPDMA1_Channel7_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), ADC_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(GPDMA1_Channel7_IRQn);
+	WRITE_REG(ADC1->ISR, ADC_ISR_OVR);
+	SET_BIT(ADC1->CR, ADC_CR_ADSTART);
+
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM6);
+	LL_TIM_DisableCounter(TIM6);
+	LL_TIM_SetPrescaler(TIM6, psc);
+	LL_TIM_SetAutoReload(TIM6, arr);
+	LL_TIM_SetTriggerOutput(TIM6, LL_TIM_TRGO_UPDATE);
+	LL_TIM_GenerateEvent_UPDATE(TIM6);
+	streaming = 1;
+	LL_TIM_EnableCounter(TIM6);
+	return 0;
+}
+
+/*
+ * Executes an ADC request and fills in the reply. Returns the reply length in bytes.
+ * ADC_CONFIG and ADC_READ are deferred, since calibration and oversampled conversions can take milliseconds.
+ */
+int adc_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case ADC_CONFIG:
+		const adc_config_request_t* config = (const adc_config_request_t*)request;
+		if(request->length < sizeof(*config) || request->length < sizeof(*config) + config->count*sizeof(adc_pin_t))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = adc_config(config);
+		return sizeof(*result);
+
+	case ADC_START:
+		const adc_start_request_t* start = (const adc_start_request_t*)request;
+		uint32_t* actual_mhz = (uint32_t*)(reply + sizeof(*result));
+		*actual_mhz = 0;
+		if(request->length < sizeof(*start))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = adc_start(start->rate_hz, actual_mhz);
+		return sizeof(*result) + sizeof(*actual_mhz);
+
+	case ADC_READ:
+		uint16_t* values = (uint16_t*)(reply + sizeof(*result));
+		*result = adc_read(values);
+		if(*result < 0)
+			return sizeof(*result);
+		return sizeof(*result) + count*sizeof(uint16_t);
+
+	case ADC_STOP:
+		adc_stop();
+		return sizeof(*result);
+
+	case ADC_STATUS:
+		adc_status_t* s = (adc_status_t*)(reply + sizeof(*result));
+		if(streaming)
+			pack();
+		memcpy(s, &status, sizeof(*s));
+		s->pending = stream_w - stream_r;
+		return sizeof(*result) + sizeof(*s);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
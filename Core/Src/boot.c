@@ -0,0 +1,126 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "boot.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+static uint32_t times[BOOT_PHASES];
+static volatile uint32_t reached;
+
+static uint32_t last_cycles;	// cycle counter at the last update of elapsed_ns
+static uint64_t elapsed_ns;
+static uint32_t tim5_offset;	// boot time when TIM5 started
+static int tim5_based;
+
+static const char* const names[BOOT_PHASES] = {
+	"reset", "clock", "usb power", "peripherals", "usb connect", "profile", "late init", "usb reset", "usb configured"
+};
+
+/*
+ * Starts the cycle counter. Called first thing in mcu_init().
+ */
+void boot_start()
+{
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	last_cycles = 0;
+	elapsed_ns = 0;
+	tim5_based = 0;
+	reached = 0;
+	boot_mark(BOOT_RESET);
+}
+
+/*
+ * Microseconds since boot_start(). Before TIM5 runs, the cycles are converted with SystemCoreClock,
+ * so BOOT_CLOCK is marked right after the switch to the PLL.
+ */
+uint32_t boot_time_us()
+{
+	if(tim5_based)
+		return tim5_offset + LL_TIM_GetCounter(TIM5);
+
+	uint32_t cycles = DWT->CYCCNT;
+	elapsed_ns += (uint64_t)(cycles - last_cycles) * 1000000000 / SystemCoreClock;
+	last_cycles = cycles;
+	return elapsed_ns / 1000;
+}
+
+/*
+ * Switches to TIM5, called right after TIM5_Init()
+ */
+void boot_timebase()
+{
+	tim5_offset = boot_time_us() - LL_TIM_GetCounter(TIM5);
+	tim5_based = 1;
+}
+
+/*
+ * Records the time of a phase, the first time only. Called from thread mode and from the USB interrupt,
+ * so reached and the cycle count of boot_time_us() are updated with the interrupts masked.
+ */
+void boot_mark(enum boot_phase phase)
+{
+	if(phase >= BOOT_PHASES)
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if((reached & (1U << phase)) == 0) {
+		times[phase] = boot_time_us();
+		reached |= 1U << phase;
+	}
+	__set_PRIMASK(primask);
+}
+
+int boot_time(enum boot_phase phase, uint32_t* time_us)
+{
+	if(phase >= BOOT_PHASES || (reached & (1U << phase)) == 0)
+		return -1;
+	*time_us = times[phase];
+	return 0;
+}
+
+const char* boot_phase_name(enum boot_phase phase)
+{
+	return phase < BOOT_PHASES ? names[phase] : NULL;
+}
+
+/*
+ * Executes a boot request and fills in the reply. Returns the reply length in bytes.
+ */
+int boot_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	switch(request->operation) {
+
+	case BOOT_TIMES:
+		boot_times_reply_t* r = (boot_times_reply_t*)(reply + sizeof(*result));
+		r->reached = reached;
+		for(int i=0;i<BOOT_PHASES;i++)
+			r->time_us[i] = (reached & (1U << i)) ? times[i] : 0;
+		*result = 0;
+		return sizeof(*result) + sizeof(*r);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,214 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "counter.h"
+#include "tim_map.h"
+#include "usb.h"
+#include <stddef.h>
+
+/*
+ * Counter state. Counters are started and stopped by the USB requests and extended by counter_tick().
+ * SysTick preempts the USB interrupt, so a request writes active last when starting
+ * a counter and first when stopping it.
+ */
+typedef struct {
+	volatile int active;
+	uint8_t mode;
+	const tim_pin_t* map_a;
+	const tim_pin_t* map_b;
+	uint16_t last_count;
+	uint32_t value;
+	uint32_t snapshot_ms;
+	uint32_t ticks;
+} counter_t;
+
+static counter_t counters[COUNTER_CHANNELS];
+
+/*
+ * Adds the steps counted since the last update. Encoders count in both directions.
+ */
+static void update(counter_t* c)
+{
+	uint16_t count = LL_TIM_GetCounter(c->map_a->tim);
+
+	if(c->mode == COUNTER_ENCODER)
+		c->value += (int16_t)(count - c->last_count);
+	else
+		c->value += (uint16_t)(count - c->last_count);
+	c->last_count = count;
+}
+
+/*
+ * Called every millisecond by the SysTick handler
+ */
+void counter_tick()
+{
+	for(int i=0;i<COUNTER_CHANNELS;i++) {
+		counter_t* c = &counters[i];
+		if(!c->active)
+			continue;
+		update(c);
+		if(c->snapshot_ms == 0 || ++c->ticks < c->snapshot_ms)
+			continue;
+		c->ticks = 0;
+		counter_event_t event = {
+			.counter = i,
+			.timestamp_us = LL_TIM_GetCounter(TIM5),
+			.value = c->value,
+		};
+		usb_event_post(EVENT_COUNTER, &event, sizeof(event));
+	}
+}
+
+static void counter_stop(counter_t* c)
+{
+	if(!c->active)
+		return;
+	c->active = 0;
+	tim_pin_disconnect(c->map_a);
+	if(c->map_b != NULL)
+		tim_pin_disconnect(c->map_b);
+	tim_release(c->map_a->tim, TIM_OWNER_COUNTER);
+}
+
+static int connect(const tim_pin_t* map, uint8_t flags)
+{
+	int res = tim_pin_connect(map);
+	if(res == 0)
+		LL_GPIO_SetPinPull(gpio_port(map->port), 1U << map->pin, (flags & COUNTER_PULL_UP) ? LL_GPIO_PULL_UP : LL_GPIO_PULL_NO);
+	return res;
+}
+
+static int counter_start(counter_t* c, const counter_start_request_t* start)
+{
+	if(c->active)
+		return ERROR_COUNTER_BUSY;
+	if(start->mode > COUNTER_ENCODER || start->filter > 15 || gpio_port(start->port_a) == NULL || start->pin_a > 15)
+		return ERROR_GPIO_PARAMETER;
+
+	const tim_pin_t* map_a = NULL;
+	const tim_pin_t* map_b = NULL;
+	if(start->mode == COUNTER_ENCODER) {
+		if(gpio_port(start->port_b) == NULL || start->pin_b > 15)
+			return ERROR_GPIO_PARAMETER;
+		map_a = tim_pin_lookup(start->port_a, start->pin_a, TIM_OWNER_NONE, TIM_CHANNEL_MASK(1));
+		map_b = tim_pin_lookup(start->port_b, start->pin_b, TIM_OWNER_NONE, TIM_CHANNEL_MASK(2));
+		if(map_a == NULL || map_b == NULL || map_a->tim != map_b->tim || !IS_TIM_ENCODER_INTERFACE_INSTANCE(map_a->tim))
+			return ERROR_TIM_NO_CHANNEL;
+	}
+	else {
+		map_a = tim_pin_lookup(start->port_a, start->pin_a, TIM_OWNER_NONE, TIM_CHANNEL_MASK(1) | TIM_CHANNEL_MASK(2));
+		if(map_a == NULL)
+			return ERROR_TIM_NO_CHANNEL;
+	}
+	int res = tim_claim(map_a->tim, TIM_OWNER_COUNTER);
+	if(res < 0)
+		return res;
+
+	TIM_TypeDef* tim = map_a->tim;
+	uint32_t filter = ((uint32_t)start->filter << TIM_CCMR1_IC1F_Pos) << 16U;	// same encoding as LL_TIM_IC_FILTER_*
+	uint32_t polarity = (start->flags & COUNTER_FALLING) ? LL_TIM_IC_POLARITY_FALLING : LL_TIM_IC_POLARITY_RISING;
+
+	LL_TIM_SetPrescaler(tim, 0);
+	LL_TIM_SetAutoReload(tim, 0xFFFF);
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	if(start->mode == COUNTER_ENCODER) {
+		LL_TIM_IC_Config(tim, LL_TIM_CHANNEL_CH1, LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | filter | polarity);
+		LL_TIM_IC_Config(tim, LL_TIM_CHANNEL_CH2, LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | filter | LL_TIM_IC_POLARITY_RISING);
+		LL_TIM_SetEncoderMode(tim, LL_TIM_ENCODERMODE_X4_TI12);
+	}
+	else {
+		if(start->flags & COUNTER_BOTH_EDGES)
+			polarity = LL_TIM_IC_POLARITY_BOTHEDGE;
+		LL_TIM_IC_Config(tim, tim_ll_channel(map_a->channel), LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | filter | polarity);
+		LL_TIM_SetTriggerInput(tim, map_a->channel == 1 ? LL_TIM_TS_TI1FP1 : LL_TIM_TS_TI2FP2);
+		LL_TIM_SetClockSource(tim, LL_TIM_CLOCKSOURCE_EXT_MODE1);
+	}
+
+	res = connect(map_a, start->flags);
+	if(res == 0 && map_b != NULL)
+		res = connect(map_b, start->flags);
+	if(res < 0) {
+		tim_pin_disconnect(map_a);
+		tim_release(tim, TIM_OWNER_COUNTER);
+		return res;
+	}
+
+	c->mode = start->mode;
+	c->map_a = map_a;
+	c->map_b = map_b;
+	c->last_count = 0;
+	c->value = 0;
+	c->snapshot_ms = start->snapshot_ms;
+	c->ticks = 0;
+	LL_TIM_EnableCounter(tim);
+	c->active = 1;
+	return 0;
+}
+
+/*
+ * Executes a counter request and fills in the reply. Returns the reply length in bytes.
+ */
+int counter_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case COUNTER_START:
+		const counter_start_request_t* start = (const counter_start_request_t*)request;
+		if(request->length < sizeof(*start))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(start->counter >= COUNTER_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			*result = counter_start(&counters[start->counter], start);
+		return sizeof(*result);
+
+	case COUNTER_READ:
+		uint32_t* timestamp_us = (uint32_t*)(reply + sizeof(*result));
+		uint32_t* values = timestamp_us + 1;
+		/* SysTick is held off so that the counters are not updated twice */
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		*timestamp_us = LL_TIM_GetCounter(TIM5);
+		for(int i=0;i<COUNTER_CHANNELS;i++) {
+			values[i] = 0;
+			if(counters[i].active) {
+				update(&counters[i]);
+				values[i] = counters[i].value;
+			}
+		}
+		__set_PRIMASK(primask);
+		return sizeof(*result) + sizeof(*timestamp_us) + COUNTER_CHANNELS*sizeof(uint32_t);
+
+	case COUNTER_STOP:
+		const counter_stop_request_t* stop = (const counter_stop_request_t*)request;
+		if(request->length < sizeof(*stop))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(stop->counter >= COUNTER_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			counter_stop(&counters[stop->counter]);
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,256 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "dac.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include "usb_descriptors.h"
+#include <string.h>
+
+#define DAC_TSEL_TIM7_TRGO		6
+#define FIFO_MASK				(DAC_FIFO_LENGTH-1)
+
+enum dac_state {
+	DAC_IDLE,
+	DAC_ARMED,		// stream mode, waiting for the first two halves
+	DAC_STREAM,
+	DAC_LOOP
+};
+
+static volatile int state;
+static uint8_t channel;
+
+/*
+ * The DAC registers are accessed by words, so the playback buffer holds 32-bit samples.
+ * In stream mode only its first 2*DAC_HALF samples are used.
+ */
+static uint32_t samples[DAC_TABLE_LENGTH];
+static dma_node_t node;
+static uint8_t fifo[DAC_FIFO_LENGTH];
+static uint32_t fifo_w, fifo_r;
+static uint32_t hold;		// last sample sent, repeated on underruns
+static dac_status_t status;
+
+static uint32_t cr_shift()
+{
+	return (channel - 1) * 16;
+}
+
+static volatile uint32_t* dhr()
+{
+	return channel == 1 ? &DAC1->DHR12R1 : &DAC1->DHR12R2;
+}
+
+int dac_streaming()
+{
+	return state == DAC_ARMED || state == DAC_STREAM;
+}
+
+uint32_t dac_stream_free()
+{
+	return DAC_FIFO_LENGTH - (fifo_w - fifo_r);
+}
+
+/*
+ * Copies the next DAC_HALF samples from the FIFO into a half of the playback buffer
+ */
+static void refill(uint32_t* half)
+{
+	uint32_t n = (fifo_w - fifo_r) / 2;
+	if(n > DAC_HALF)
+		n = DAC_HALF;
+
+	for(uint32_t i=0;i<n;i++) {
+		hold = (fifo[fifo_r & FIFO_MASK] | (fifo[(fifo_r+1) & FIFO_MASK] << 8)) & 0x0FFF;
+		half[i] = hold;
+		fifo_r += 2;
+	}
+	for(uint32_t i=n;i<DAC_HALF;i++)
+		half[i] = hold;
+	status.underruns += DAC_HALF - n;
+}
+
+/*
+ * The DAC stops requesting samples after a DMA underrun: the flag is cleared and the requests re-enabled
+ */
+static void check_dma_underrun()
+{
+	uint32_t flag = DAC_SR_DMAUDR1 << cr_shift();
+
+	if(READ_BIT(DAC1->SR, flag)) {
+		status.dma_underruns++;
+		WRITE_REG(DAC1->SR, flag);
+		CLEAR_BIT(DAC1->CR, DAC_CR_DMAEN1 << cr_shift());
+		SET_BIT(DAC1->CR, DAC_CR_DMAEN1 << cr_shift());
+	}
+}
+
+static void begin_stream()
+{
+	refill(&samples[0]);
+	refill(&samples[DAC_HALF]);
+	dma_start_circular(DMA_DAC, DMA_REQUEST_DAC1_CH1 + channel - 1, dhr(), samples, 2*DAC_HALF*sizeof(uint32_t), DMA_TO_PERIPH | DMA_WIDTH_32 | DMA_IRQ_HT | DMA_IRQ_TC, &node);
+	NVIC_SetPriority(GPDMA2_Channel0_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), DAC_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(GPDMA2_Channel0_IRQn);
+	state = DAC_STREAM;
+	LL_TIM_EnableCounter(TIM7);
+}
+
+/*
+ * Queues n bytes of samples, n must not exceed dac_stream_free().
+ * Returns 0 if there is no room left for another packet, in which case the host must be held off
+ * until dac_stream_free() is at least EP_MAX_PACKET_SIZE.
+ */
+int dac_stream_push(const uint8_t* data, uint32_t n)
+{
+	n &= ~1U;
+	for(uint32_t i=0;i<n;i++)
+		fifo[(fifo_w + i) & FIFO_MASK] = data[i];
+	fifo_w += n;
+
+	if(state == DAC_ARMED && fifo_w - fifo_r >= 2*DAC_HALF*sizeof(uint16_t))
+		begin_stream();
+
+	return dac_stream_free() >= EP_MAX_PACKET_SIZE;
+}
+
+/*
+ * Half and full transfer interrupts: the half just played is refilled, and the USB interrupt
+ * is woken up in case EP4 OUT was held off
+ */
+void dac_dma_isr()
+{
+	uint32_t csr = READ_REG(DMA_DAC->CSR);
+
+	WRITE_REG(DMA_DAC->CFCR, DMA_CFCR_HTF | DMA_CFCR_TCF);
+	if(csr & DMA_CSR_HTF) {
+		refill(&samples[0]);
+		status.played += DAC_HALF;
+	}
+	if(csr & DMA_CSR_TCF) {
+		refill(&samples[DAC_HALF]);
+		status.played += DAC_HALF;
+	}
+	check_dma_underrun();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+}
+
+static void dac_stop()
+{
+	if(state == DAC_IDLE)
+		return;
+
+	LL_TIM_DisableCounter(TIM7);
+	NVIC_DisableIRQ(GPDMA2_Channel0_IRQn);
+	dma_stop(DMA_DAC);
+	CLEAR_BIT(DAC1->CR, (DAC_CR_DMAEN1 | DAC_CR_TEN1) << cr_shift());	// the output keeps the last value
+	gpio_release('a', channel == 1 ? 4 : 5, PIN_OWNER_DAC);
+	state = DAC_IDLE;
+}
+
+static int dac_start(const dac_start_request_t* start, uint32_t table_length, uint32_t* actual_mhz)
+{
+	if(start->channel < 1 || start->channel > 2)
+		return ERROR_DAC_CHANNEL;
+	if(start->rate_hz == 0 || start->rate_hz > DAC_MAX_RATE_HZ)
+		return ERROR_DAC_RATE;
+	if(start->mode > DAC_MODE_LOOP)
+		return ERROR_GPIO_PARAMETER;
+	if(start->mode == DAC_MODE_LOOP && (table_length == 0 || table_length > DAC_TABLE_LENGTH))
+		return ERROR_DAC_LENGTH;
+
+	dac_stop();
+	int res = gpio_claim('a', start->channel == 1 ? 4 : 5, PIN_OWNER_DAC);
+	if(res < 0)
+		return res;
+	channel = start->channel;
+
+	uint32_t ticks = (DAC_TIM_CLK_HZ + start->rate_hz/2) / start->rate_hz;
+	uint32_t psc = (ticks-1) / 65536;
+	uint32_t arr = ticks/(psc+1) - 1;
+	*actual_mhz = (uint64_t)DAC_TIM_CLK_HZ * 1000 / ((uint64_t)(psc+1) * (arr+1));
+
+	/* the mode register can only be written with both channels disabled, so one channel is used at a time */
+	LL_AHB2_GRP1_EnableClock(LL_AHB2_GRP1_PERIPH_DAC1);
+	WRITE_REG(DAC1->CR, 0);
+	WRITE_REG(DAC1->MCR, DAC_MCR_HFSEL_1);		// AHB clock above 160 MHz, buffered output on the pin
+	WRITE_REG(DAC1->SR, DAC_SR_DMAUDR1 | DAC_SR_DMAUDR2);
+	LL_GPIO_SetPinMode(GPIOA, channel == 1 ? LL_GPIO_PIN_4 : LL_GPIO_PIN_5, LL_GPIO_MODE_ANALOG);
+	WRITE_REG(DAC1->CR, (DAC_CR_TEN1 | (DAC_TSEL_TIM7_TRGO << DAC_CR_TSEL1_Pos) | DAC_CR_DMAEN1) << cr_shift());
+	SET_BIT(DAC1->CR, DAC_CR_EN1 << cr_shift());
+	delay_us(10);	// output buffer wake-up
+
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM7);
+	LL_TIM_DisableCounter(TIM7);
+	LL_TIM_SetPrescaler(TIM7, psc);
+	LL_TIM_SetAutoReload(TIM7, arr);
+	LL_TIM_SetTriggerOutput(TIM7, LL_TIM_TRGO_UPDATE);
+	LL_TIM_GenerateEvent_UPDATE(TIM7);
+
+	memset(&status, 0, sizeof(status));
+	if(start->mode == DAC_MODE_LOOP) {
+		for(uint32_t i=0;i<table_length;i++)
+			samples[i] = start->samples[i] & 0x0FFF;
+		dma_start_circular(DMA_DAC, DMA_REQUEST_DAC1_CH1 + channel - 1, dhr(), samples, table_length*sizeof(uint32_t), DMA_TO_PERIPH | DMA_WIDTH_32, &node);
+		state = DAC_LOOP;
+		LL_TIM_EnableCounter(TIM7);
+		return 0;
+	}
+
+	fifo_w = fifo_r = 0;
+	hold = READ_REG(*dhr()) & 0x0FFF;
+	state = DAC_ARMED;
+	return 0;
+}
+
+/*
+ * Executes a DAC request and fills in the reply. Returns the reply length in bytes.
+ */
+int dac_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case DAC_START:
+		const dac_start_request_t* start = (const dac_start_request_t*)request;
+		uint32_t* actual_mhz = (uint32_t*)(reply + sizeof(*result));
+		*actual_mhz = 0;
+		if(request->length < sizeof(*start))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = dac_start(start, (request->length - sizeof(*start)) / sizeof(uint16_t), actual_mhz);
+		return sizeof(*result) + sizeof(*actual_mhz);
+
+	case DAC_STOP:
+		dac_stop();
+		return sizeof(*result);
+
+	case DAC_STATUS:
+		dac_status_t* s = (dac_status_t*)(reply + sizeof(*result));
+		if(state != DAC_IDLE)
+			check_dma_underrun();
+		memcpy(s, &status, sizeof(*s));
+		s->pending = fifo_w - fifo_r;
+		return sizeof(*result) + sizeof(*s);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "dma.h"
+
+#define DMA_ERROR_FLAGS		(DMA_CSR_DTEF | DMA_CSR_ULEF | DMA_CSR_USEF)
+#define DMA_CLEAR_FLAGS		(DMA_CFCR_TCF | DMA_CFCR_HTF | DMA_CFCR_DTEF | DMA_CFCR_ULEF | DMA_CFCR_USEF | DMA_CFCR_SUSPF | DMA_CFCR_TOF)
+
+static void dma_setup(DMA_Channel_TypeDef* ch, uint32_t request, volatile void* periph, const void* mem, uint32_t length, uint32_t flags)
+{
+	uint32_t width = (flags >> 4) & 3;
+	uint32_t mem_inc = (flags & DMA_MEM_FIXED) == 0;
+
+	WRITE_REG(ch->CCR, 0);
+	WRITE_REG(ch->CFCR, DMA_CLEAR_FLAGS);
+	WRITE_REG(ch->CLLR, 0);
+	WRITE_REG(ch->CBR1, length & DMA_CBR1_BNDT);
+	if(flags & DMA_TO_PERIPH) {
+		WRITE_REG(ch->CTR1, (width << DMA_CTR1_SDW_LOG2_Pos) | (width << DMA_CTR1_DDW_LOG2_Pos) | (mem_inc ? DMA_CTR1_SINC : 0));
+		WRITE_REG(ch->CTR2, (request << DMA_CTR2_REQSEL_Pos) | DMA_CTR2_DREQ);
+		WRITE_REG(ch->CSAR, (uint32_t)mem);
+		WRITE_REG(ch->CDAR, (uint32_t)periph);
+	}
+	else {
+		WRITE_REG(ch->CTR1, (width << DMA_CTR1_SDW_LOG2_Pos) | (width << DMA_CTR1_DDW_LOG2_Pos) | (mem_inc ? DMA_CTR1_DINC : 0));
+		WRITE_REG(ch->CTR2, request << DMA_CTR2_REQSEL_Pos);
+		WRITE_REG(ch->CSAR, (uint32_t)periph);
+		WRITE_REG(ch->CDAR, (uint32_t)mem);
+	}
+	WRITE_REG(ch->CCR, ((flags & DMA_IRQ_TC) ? DMA_CCR_TCIE : 0) | ((flags & DMA_IRQ_HT) ? DMA_CCR_HTIE : 0));
+}
+
+/*
+ * Starts a single block transfer between a peripheral data register and memory.
+ * length is in bytes and must be a multiple of the data width. The peripheral address is never incremented.
+ */
+void dma_start(DMA_Channel_TypeDef* ch, uint32_t request, volatile void* periph, const void* mem, uint32_t length, uint32_t flags)
+{
+	dma_setup(ch, request, periph, mem, length, flags);
+	SET_BIT(ch->CCR, DMA_CCR_EN);
+}
+
+/*
+ * Starts a transfer that restarts from the beginning of the memory buffer at the end of each block,
+ * until dma_stop(). The node must stay valid while the channel runs.
+ */
+void dma_start_circular(DMA_Channel_TypeDef* ch, uint32_t request, volatile void* periph, const void* mem, uint32_t length, uint32_t flags, dma_node_t* node)
+{
+	uint32_t update = DMA_CLLR_UB1 | DMA_CLLR_ULL | ((flags & DMA_TO_PERIPH) ? DMA_CLLR_USA : DMA_CLLR_UDA);
+
+	dma_setup(ch, request, periph, mem, length, flags);
+	node->br1 = length & DMA_CBR1_BNDT;
+	node->address = (uint32_t)mem;
+	node->llr = ((uint32_t)node & DMA_CLLR_LA) | update;
+	WRITE_REG(ch->CLBAR, (uint32_t)node & DMA_CLBAR_LBA);
+	WRITE_REG(ch->CLLR, node->llr);
+	SET_BIT(ch->CCR, DMA_CCR_EN);
+}
+
+/*
+ * Starts a list of word copies between any addresses: the first one waits for the hardware request,
+ * the following ones are chained as memory-to-memory transfers and run back to back right after it.
+ * The transfer is complete at the end of the last copy. The list must stay valid while the channel runs,
+ * within a single 64 KB region.
+ */
+void dma_start_copies(DMA_Channel_TypeDef* ch, uint32_t request, dma_copy_t* copies, uint32_t count)
+{
+	uint32_t update = DMA_CLLR_UT2 | DMA_CLLR_UB1 | DMA_CLLR_USA | DMA_CLLR_UDA | DMA_CLLR_ULL;
+
+	for(uint32_t i=0;i<count;i++) {
+		copies[i].tr2 = (i == 0 ? request << DMA_CTR2_REQSEL_Pos : DMA_CTR2_SWREQ) | DMA_CTR2_TCEM;
+		copies[i].br1 = sizeof(uint32_t);
+		copies[i].llr = i+1 < count ? ((uint32_t)&copies[i+1] & DMA_CLLR_LA) | update : 0;
+	}
+
+	WRITE_REG(ch->CCR, 0);
+	WRITE_REG(ch->CFCR, DMA_CLEAR_FLAGS);
+	WRITE_REG(ch->CTR1, (2 << DMA_CTR1_SDW_LOG2_Pos) | (2 << DMA_CTR1_DDW_LOG2_Pos));
+	WRITE_REG(ch->CTR2, copies[0].tr2);
+	WRITE_REG(ch->CBR1, copies[0].br1);
+	WRITE_REG(ch->CSAR, copies[0].src);
+	WRITE_REG(ch->CDAR, copies[0].dst);
+	WRITE_REG(ch->CLBAR, (uint32_t)copies & DMA_CLBAR_LBA);
+	WRITE_REG(ch->CLLR, copies[0].llr);
+	SET_BIT(ch->CCR, DMA_CCR_EN);
+}
+
+/*
+ * Returns 1 when the transfer is complete, 0 while it is running and a negative value on transfer errors
+ */
+int dma_status(DMA_Channel_TypeDef* ch)
+{
+	uint32_t csr = READ_REG(ch->CSR);
+	if(csr & DMA_ERROR_FLAGS)
+		return -1;
+	return (csr & DMA_CSR_TCF) != 0;
+}
+
+/*
+ * Returns the number of bytes not transferred yet
+ */
+uint32_t dma_remaining(DMA_Channel_TypeDef* ch)
+{
+	return READ_REG(ch->CBR1) & DMA_CBR1_BNDT;
+}
+
+/*
+ * Aborts a transfer: the channel is suspended, then reset
+ */
+void dma_stop(DMA_Channel_TypeDef* ch)
+{
+	if(READ_BIT(ch->CCR, DMA_CCR_EN)) {
+		SET_BIT(ch->CCR, DMA_CCR_SUSP);
+		while(READ_BIT(ch->CSR, DMA_CSR_SUSPF | DMA_CSR_IDLEF) == 0)
+			;
+	}
+	WRITE_REG(ch->CCR, DMA_CCR_RESET);
+	WRITE_REG(ch->CFCR, DMA_CLEAR_FLAGS);
+}
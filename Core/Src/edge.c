@@ -0,0 +1,209 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "edge.h"
+#include "route.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/*
+ * The ring is written by the EXTI interrupts, which all have the same priority and
+ * therefore never preempt each other, and read by the USB interrupt.
+ */
+static edge_record_t ring[EDGE_RING_LENGTH];
+static volatile uint32_t w_idx, r_idx;
+static volatile uint32_t lost_records;
+
+/* Port letter using each EXTI line, 0 if the line is not used */
+static char line_port[16];
+/* Edges each user wants on each line */
+static uint8_t line_trigger[EDGE_USERS][16];
+
+static int port_index(char port)
+{
+	if(port >= 'a' && port <= 'h')
+		return port - 'a';
+	if(port >= 'A' && port <= 'H')
+		return port - 'A';
+	return -1;
+}
+
+/*
+ * Sets the edges a user wants on the EXTI line of a pin. trigger = EDGE_NONE stops using the line,
+ * which is released when no user is left.
+ */
+int edge_line_use(char port, uint8_t pin, enum edge_user user, enum edge_trigger trigger)
+{
+	int idx = port_index(port);
+	if(idx < 0 || pin > 15 || trigger > EDGE_BOTH || user >= EDGE_USERS)
+		return ERROR_GPIO_PARAMETER;
+
+	uint32_t line = 1U << pin;
+
+	if(trigger == EDGE_NONE && line_port[pin] != 'a'+idx)
+		return ERROR_GPIO_PARAMETER;
+	if(line_port[pin] != 0 && line_port[pin] != 'a'+idx)
+		return ERROR_EDGE_LINE_BUSY;
+
+	line_trigger[user][pin] = trigger;
+	trigger = EDGE_NONE;
+	for(int i=0;i<EDGE_USERS;i++)
+		trigger |= line_trigger[i][pin];
+
+	if(trigger == EDGE_NONE) {
+		CLEAR_BIT(EXTI->IMR1, line);
+		CLEAR_BIT(EXTI->RTSR1, line);
+		CLEAR_BIT(EXTI->FTSR1, line);
+		line_port[pin] = 0;
+		return 0;
+	}
+
+	NVIC_DisableIRQ(EXTI0_IRQn + pin);
+	CLEAR_BIT(EXTI->IMR1, line);
+	MODIFY_REG(EXTI->EXTICR[pin >> 2], 0xFFU << ((pin & 3)*8), (uint32_t)idx << ((pin & 3)*8));
+	if(trigger & EDGE_RISING)
+		SET_BIT(EXTI->RTSR1, line);
+	else
+		CLEAR_BIT(EXTI->RTSR1, line);
+	if(trigger & EDGE_FALLING)
+		SET_BIT(EXTI->FTSR1, line);
+	else
+		CLEAR_BIT(EXTI->FTSR1, line);
+	if(line_port[pin] == 0) {
+		WRITE_REG(EXTI->RPR1, line);
+		WRITE_REG(EXTI->FPR1, line);
+	}
+	line_port[pin] = 'a'+idx;
+	SET_BIT(EXTI->IMR1, line);
+
+	NVIC_SetPriority(EXTI0_IRQn + pin, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), EDGE_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(EXTI0_IRQn + pin);
+	return 0;
+}
+
+int edge_config(char port, uint8_t pin, enum edge_trigger trigger)
+{
+	return edge_line_use(port, pin, EDGE_USER_CAPTURE, trigger);
+}
+
+static void push(uint32_t timestamp, uint32_t line, uint8_t edge)
+{
+	if(w_idx - r_idx >= EDGE_RING_LENGTH) {
+		lost_records++;
+		return;
+	}
+	edge_record_t* r = &ring[w_idx & (EDGE_RING_LENGTH-1)];
+	r->timestamp = timestamp;
+	r->port = line_port[line];
+	r->pin = line;
+	r->edge = edge;
+	r->reserved = 0;
+	w_idx++;
+}
+
+/*
+ * Called by the EXTI line interrupt handlers.
+ * The timestamp is taken first, so that it is only delayed by the interrupt latency,
+ * then the routes of the line react before the edges are recorded.
+ * If both edges are pending, the pin level tells which one came last.
+ */
+void edge_isr(uint32_t line)
+{
+	uint32_t timestamp = LL_TIM_GetCounter(TIM2);
+	uint32_t mask = 1U << line;
+	uint32_t rising = READ_BIT(EXTI->RPR1, mask);
+	uint32_t falling = READ_BIT(EXTI->FPR1, mask);
+
+	WRITE_REG(EXTI->RPR1, rising);
+	WRITE_REG(EXTI->FPR1, falling);
+
+	if(line_port[line] == 0)
+		return;
+
+	if(line_trigger[EDGE_USER_ROUTE][line] != EDGE_NONE)
+		route_isr(line, gpio_port(line_port[line]), rising, falling);
+
+	uint8_t capture = line_trigger[EDGE_USER_CAPTURE][line];
+	if((capture & EDGE_RISING) == 0)
+		rising = 0;
+	if((capture & EDGE_FALLING) == 0)
+		falling = 0;
+
+	if(rising && falling) {
+		GPIO_TypeDef* port = gpio_port(line_port[line]);
+		if(READ_BIT(port->IDR, mask)) {
+			push(timestamp, line, EDGE_FALLING);
+			push(timestamp, line, EDGE_RISING);
+		}
+		else {
+			push(timestamp, line, EDGE_RISING);
+			push(timestamp, line, EDGE_FALLING);
+		}
+	}
+	else if(rising)
+		push(timestamp, line, EDGE_RISING);
+	else if(falling)
+		push(timestamp, line, EDGE_FALLING);
+}
+
+/*
+ * Executes an edge capture request and fills in the reply. Returns the reply length in bytes.
+ */
+int edge_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* data = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case EDGE_CONFIG:
+		const edge_config_request_t* config = (const edge_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = edge_config(config->port, config->pin, config->trigger);
+		return sizeof(*result);
+
+	case EDGE_READ:
+		const edge_read_request_t* read = (const edge_read_request_t*)request;
+		uint32_t header_size = sizeof(*result) + 3*sizeof(uint32_t);
+		uint32_t max_records = (REQUEST_MAX_LENGTH - header_size)/sizeof(edge_record_t);
+		if(request->length >= sizeof(*read) && read->max_records < max_records)
+			max_records = read->max_records;
+
+		edge_record_t* r = (edge_record_t*)&data[3];
+		uint32_t count = 0;
+		while(r_idx != w_idx && count < max_records) {
+			r[count++] = ring[r_idx & (EDGE_RING_LENGTH-1)];
+			r_idx++;
+		}
+		data[0] = TIM2_CLK_HZ;
+		data[1] = lost_records;
+		data[2] = count;
+		return header_size + count*sizeof(edge_record_t);
+
+	case EDGE_RESET:
+		r_idx = w_idx;
+		lost_records = 0;
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
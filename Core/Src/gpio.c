@@ -18,6 +18,7 @@
 
 
 #include "gpio.h"
+#include <stddef.h>
 
 gpio_request_t gpio_request;
 
@@ -29,76 +30,124 @@ gpio_request_t gpio_request;
  */
 int gpio_op_completed;
 
-static GPIO_TypeDef* gpio_port(char port)
-{
-	switch(port) {
-	case 'a':
-	case 'A':
-		return GPIOA;
-	case 'b':
-	case 'B':
-		return GPIOB;
-	case 'c':
-	case 'C':
-		return GPIOC;
-	case 'd':
-	case 'D':
-		return GPIOD;
-	case 'e':
-	case 'E':
-		return GPIOE;
-	case 'f':
-	case 'F':
-		return GPIOF;
-	case 'g':
-	case 'G':
-		return GPIOG;
-	case 'h':
-	case 'H':
-		return GPIOH;
-	default:
+/*
+ * Pin registry. Every pin has a descriptor with its owner, and every port a bitmap of the pins usable
+ * by gpio_set(), gpio_clear() and gpio_get(): owned by no peripheral, and in input or output mode.
+ * The bitmaps are kept up to date by the functions below that change the owner or the mode of a pin.
+ */
+static GPIO_TypeDef* const ports[GPIO_PORTS] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH};
+static gpio_pin_t pins[GPIO_PORTS][16];
+static volatile uint16_t usable[GPIO_PORTS];
+
+static int port_index(char port)
+{
+	uint32_t index = (uint8_t)(port | 0x20) - 'a';	// lower case
+	return index < GPIO_PORTS ? (int)index : -1;
+}
+
+GPIO_TypeDef* gpio_port(char port)
+{
+	int index = port_index(port);
+	return index < 0 ? NULL : ports[index];
+}
+
+const gpio_pin_t* gpio_lookup(char port, uint8_t pin)
+{
+	int index = port_index(port);
+	if(index < 0 || pin > 15)
 		return NULL;
-	}
+	return &pins[index][pin];
 }
 
-static uint32_t gpio_pin(uint8_t pin)
-{
-	switch(pin) {
-	case 0:
-		return LL_GPIO_PIN_0;
-	case 1:
-		return LL_GPIO_PIN_1;
-	case 2:
-		return LL_GPIO_PIN_2;
-	case 3:
-		return LL_GPIO_PIN_3;
-	case 4:
-		return LL_GPIO_PIN_4;
-	case 5:
-		return LL_GPIO_PIN_5;
-	case 6:
-		return LL_GPIO_PIN_6;
-	case 7:
-		return LL_GPIO_PIN_7;
-	case 8:
-		return LL_GPIO_PIN_8;
-	case 9:
-		return LL_GPIO_PIN_9;
-	case 10:
-		return LL_GPIO_PIN_10;
-	case 11:
-		return LL_GPIO_PIN_11;
-	case 12:
-		return LL_GPIO_PIN_12;
-	case 13:
-		return LL_GPIO_PIN_13;
-	case 14:
-		return LL_GPIO_PIN_14;
-	case 15:
-		return LL_GPIO_PIN_15;
-	default:
-		return 0;
-	}
+/*
+ * Updates the usable bit of a pin after a change of its owner or mode
+ */
+static void refresh(const gpio_pin_t* p)
+{
+	uint32_t mode = LL_GPIO_GetPinMode(p->port, p->mask);
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(p->owner == PIN_OWNER_GPIO && (mode == LL_GPIO_MODE_INPUT || mode == LL_GPIO_MODE_OUTPUT))
+		usable[p->index] |= p->mask;
+	else
+		usable[p->index] &= ~p->mask;
+	__set_PRIMASK(primask);
+}
+
+/*
+ * Builds the registry from the pin modes set up at boot: the pins already connected
+ * to a peripheral (USB, debug port) belong to the system. So do the virtual COM port pins (PD8/PD9),
+ * which are only connected to USART3 after gpio_init() with FAST_BOOT.
+ */
+void gpio_init()
+{
+	for(int i=0;i<GPIO_PORTS;i++)
+		for(int j=0;j<16;j++) {
+			gpio_pin_t* p = &pins[i][j];
+			p->port = ports[i];
+			p->mask = 1U << j;
+			p->index = i;
+			p->owner = LL_GPIO_GetPinMode(p->port, p->mask) == LL_GPIO_MODE_ALTERNATE ? PIN_OWNER_SYSTEM : PIN_OWNER_GPIO;
+			if(i == 'd' - 'a' && (j == 8 || j == 9))
+				p->owner = PIN_OWNER_SYSTEM;
+			refresh(p);
+		}
+}
+
+/*
+ * Error returned for a pin that is not usable as a gpio
+ */
+static int unusable(const gpio_pin_t* p)
+{
+	uint32_t mode = LL_GPIO_GetPinMode(p->port, p->mask);
+	if(mode == LL_GPIO_MODE_ANALOG)
+		return ERROR_GPIO_ALREADY_USED_ANALOG;
+	if(mode == LL_GPIO_MODE_ALTERNATE)
+		return ERROR_GPIO_ALREADY_USED_AF;
+	return ERROR_GPIO_PIN_BUSY;
+}
+
+/*
+ * Gives the pin to owner. Fails if another peripheral owns it.
+ */
+int gpio_claim(char port, uint8_t pin, enum pin_owner owner)
+{
+	gpio_pin_t* p = (gpio_pin_t*)gpio_lookup(port, pin);
+	if(p == NULL)
+		return ERROR_GPIO_PARAMETER;
+	if(p->owner != PIN_OWNER_GPIO && p->owner != owner)
+		return ERROR_GPIO_PIN_BUSY;
+	p->owner = owner;
+	refresh(p);
+	return 0;
+}
+
+/*
+ * Gives the pin back to the gpio functions, if owned by owner. Its mode is not changed.
+ */
+void gpio_release(char port, uint8_t pin, enum pin_owner owner)
+{
+	gpio_pin_t* p = (gpio_pin_t*)gpio_lookup(port, pin);
+	if(p == NULL || p->owner != owner)
+		return;
+	p->owner = PIN_OWNER_GPIO;
+	refresh(p);
+}
+
+/*
+ * Sets the mode (LL_GPIO_MODE_INPUT or LL_GPIO_MODE_OUTPUT) of a pin owned by owner.
+ * Used by the engines that drive pins as gpios.
+ */
+int gpio_mode(char port, uint8_t pin, uint32_t mode, enum pin_owner owner)
+{
+	const gpio_pin_t* p = gpio_lookup(port, pin);
+	if(p == NULL)
+		return ERROR_GPIO_PARAMETER;
+	if(p->owner != owner)
+		return ERROR_GPIO_PIN_BUSY;
+	LL_GPIO_SetPinMode(p->port, p->mask, mode);
+	refresh(p);
+	return 0;
 }
 
 static uint32_t gpio_type(uint8_t type)
@@ -142,25 +191,19 @@ static uint32_t gpio_dir(uint8_t direction)
 int gpio_set(char port, uint8_t pin)
 {
 	gpio_op_completed = 0;
-	GPIO_TypeDef* gport = gpio_port(port);
-	uint32_t gpin = gpio_pin(pin);
+	const gpio_pin_t* p = gpio_lookup(port, pin);
 
-	if(gpin==0 || gport==NULL) {
+	if(p == NULL) {
 		gpio_op_completed = -1;
 		return ERROR_GPIO_PARAMETER;
 	}
 
-	if(LL_GPIO_GetPinMode(gport,gpin) == LL_GPIO_MODE_ANALOG) {
-		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_ANALOG;
-	}
-
-	if(LL_GPIO_GetPinMode(gport,gpin)==LL_GPIO_MODE_ALTERNATE) {
+	if((usable[p->index] & p->mask) == 0) {
 		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_AF;
+		return unusable(p);
 	}
 
-	LL_GPIO_SetOutputPin(gport, gpin);
+	p->port->BSRR = p->mask;
 	gpio_op_completed = 1;
 	return 0;
 }
@@ -168,25 +211,19 @@ int gpio_set(char port, uint8_t pin)
 int gpio_clear(char port, uint8_t pin)
 {
 	gpio_op_completed = 0;
-	GPIO_TypeDef* gport = gpio_port(port);
-	uint32_t gpin = gpio_pin(pin);
+	const gpio_pin_t* p = gpio_lookup(port, pin);
 
-	if(gpin==0 || gport==NULL) {
+	if(p == NULL) {
 		gpio_op_completed = -1;
 		return ERROR_GPIO_PARAMETER;
 	}
 
-	if(LL_GPIO_GetPinMode(gport,gpin) == LL_GPIO_MODE_ANALOG) {
+	if((usable[p->index] & p->mask) == 0) {
 		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_ANALOG;
+		return unusable(p);
 	}
 
-	if(LL_GPIO_GetPinMode(gport,gpin)==LL_GPIO_MODE_ALTERNATE) {
-		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_AF;
-	}
-
-	LL_GPIO_ResetOutputPin(gport, gpin);
+	p->port->BRR = p->mask;
 	gpio_op_completed = 1;
 	return 0;
 }
@@ -194,56 +231,186 @@ int gpio_clear(char port, uint8_t pin)
 int gpio_get(char port, uint8_t pin)
 {
 	gpio_op_completed = 0;
-	GPIO_TypeDef* gport = gpio_port(port);
-	uint32_t gpin = gpio_pin(pin);
+	const gpio_pin_t* p = gpio_lookup(port, pin);
 
-	if(gpin==0 || gport==NULL) {
+	if(p == NULL) {
 		gpio_op_completed = -1;
 		return ERROR_GPIO_PARAMETER;
 	}
 
-	if(LL_GPIO_GetPinMode(gport,gpin) == LL_GPIO_MODE_ANALOG) {
+	if((usable[p->index] & p->mask) == 0) {
 		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_ANALOG;
-	}
-
-	if(LL_GPIO_GetPinMode(gport,gpin)==LL_GPIO_MODE_ALTERNATE) {
-		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_AF;
+		return unusable(p);
 	}
 
 	gpio_op_completed = 1;
-	return LL_GPIO_IsInputPinSet(gport, gpin);
+	return (p->port->IDR & p->mask) != 0;
 }
 
+/*
+ * Refused for the pins owned by a peripheral. A pin in analog mode becomes usable once configured as an input or output.
+ */
 int gpio_config(char port, uint8_t pin, enum gpio_direction direction,  enum gpio_output_type type, enum gpio_pull pull)
 {
 	gpio_op_completed = 0;
-	GPIO_TypeDef* gport = gpio_port(port);
-	uint32_t gpin = gpio_pin(pin);
+	const gpio_pin_t* p = gpio_lookup(port, pin);
 	uint32_t gtype = gpio_type(type);
 	uint32_t gpull = gpio_pull(pull);
 	uint32_t gdir = gpio_dir(direction);
 
-	if(gpin==0 || gport==NULL) {
+	if(p == NULL) {
 		gpio_op_completed = -1;
 		return ERROR_GPIO_PARAMETER;
 	}
 
-	if(LL_GPIO_GetPinMode(gport,gpin)==LL_GPIO_MODE_ALTERNATE) {
+	if(p->owner != PIN_OWNER_GPIO) {
 		gpio_op_completed = -1;
-		return ERROR_GPIO_ALREADY_USED_AF;
+		return unusable(p);
 	}
 
 	if(gdir != 0xFFFFFFFF)
-		LL_GPIO_SetPinMode(gport,gpin,gdir);
+		LL_GPIO_SetPinMode(p->port, p->mask, gdir);
 	if(gtype != 0xFFFFFFFF)
-		LL_GPIO_SetPinOutputType(gport,gpin,gtype);
+		LL_GPIO_SetPinOutputType(p->port, p->mask, gtype);
 	if(gpull != 0xFFFFFFFF)
-		LL_GPIO_SetPinPull(gport,gpin,gpull);
+		LL_GPIO_SetPinPull(p->port, p->mask, gpull);
+	refresh(p);
 
 	gpio_op_completed=1;
 
 	return 0;
 }
 
+
+/*
+ * Connects the pin to a peripheral through its alternate function af (LL_GPIO_AF_x), and gives it to owner.
+ * Fails if another peripheral owns the pin. The gpio functions refuse the pin until it is released.
+ */
+int gpio_alternate(char port, uint8_t pin, uint32_t af, enum pin_owner owner)
+{
+	int res = gpio_claim(port, pin, owner);
+	if(res < 0)
+		return res;
+
+	const gpio_pin_t* p = gpio_lookup(port, pin);
+	LL_GPIO_SetPinSpeed(p->port, p->mask, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	if(pin < 8)
+		LL_GPIO_SetAFPin_0_7(p->port, p->mask, af);
+	else
+		LL_GPIO_SetAFPin_8_15(p->port, p->mask, af);
+	LL_GPIO_SetPinMode(p->port, p->mask, LL_GPIO_MODE_ALTERNATE);
+	return 0;
+}
+
+/*
+ * Spreads the 16 bits of mask to width bits per pin, as in the port registers
+ */
+static uint32_t spread(uint16_t mask, int width, int first)
+{
+	uint32_t field = (1U << width) - 1;
+	uint32_t spread = 0;
+	for(int i=0;i<32/width;i++)
+		if(mask & (1U << (first + i)))
+			spread |= field << (width*i);
+	return spread;
+}
+
+/*
+ * Checks that no peripheral owns the pins of mask. Used by the engines that write whole ports through BSRR.
+ */
+int gpio_check(char port, uint16_t mask)
+{
+	int index = port_index(port);
+	if(index < 0)
+		return ERROR_GPIO_PARAMETER;
+	for(int i=0;i<16;i++)
+		if((mask & (1U << i)) && pins[index][i].owner != PIN_OWNER_GPIO)
+			return unusable(&pins[index][i]);
+	return 0;
+}
+
+/*
+ * Configures the pins of config->mask. If levels is not NULL, the output levels of these pins
+ * are set before their mode is changed.
+ */
+int gpio_port_config(const port_config_t* config, const uint16_t* levels)
+{
+	int res = gpio_check(config->port, config->mask);
+	if(res < 0)
+		return res;
+	int index = port_index(config->port);
+
+	GPIO_TypeDef* port = ports[index];
+	uint32_t mask2 = spread(config->mask, 2, 0);
+	uint32_t afrl = spread(config->mask, 4, 0);
+	uint32_t afrh = spread(config->mask, 4, 8);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(levels != NULL)
+		port->BSRR = (*levels & config->mask) | (uint32_t)(~*levels & config->mask) << 16;
+	MODIFY_REG(port->OTYPER, config->mask, config->otyper & config->mask);
+	MODIFY_REG(port->OSPEEDR, mask2, config->ospeedr & mask2);
+	MODIFY_REG(port->PUPDR, mask2, config->pupdr & mask2);
+	MODIFY_REG(port->AFR[0], afrl, config->afr[0] & afrl);
+	MODIFY_REG(port->AFR[1], afrh, config->afr[1] & afrh);
+	MODIFY_REG(port->MODER, mask2, config->moder & mask2);
+
+	/* only the pins in input or output mode stay usable by the gpio functions */
+	uint32_t moder = port->MODER;
+	uint16_t gpio = 0;
+	for(int i=0;i<16;i++) {
+		uint32_t mode = (moder >> (2*i)) & 3;
+		if(mode == LL_GPIO_MODE_INPUT || mode == LL_GPIO_MODE_OUTPUT)
+			gpio |= 1U << i;
+	}
+	usable[index] = (usable[index] & ~config->mask) | (gpio & config->mask);
+	__set_PRIMASK(primask);
+	return 0;
+}
+
+/*
+ * Reads the configuration and output levels of the pins of a port owned by no peripheral
+ */
+int gpio_port_read(char port, port_config_t* config, uint16_t* levels)
+{
+	int index = port_index(port);
+	if(index < 0)
+		return ERROR_GPIO_PARAMETER;
+
+	GPIO_TypeDef* p = ports[index];
+	config->port = port;
+	config->reserved = 0;
+	config->mask = 0;
+	for(int i=0;i<16;i++)
+		if(pins[index][i].owner == PIN_OWNER_GPIO)
+			config->mask |= 1U << i;
+	config->moder = p->MODER;
+	config->otyper = p->OTYPER;
+	config->ospeedr = p->OSPEEDR;
+	config->pupdr = p->PUPDR;
+	config->afr[0] = p->AFR[0];
+	config->afr[1] = p->AFR[1];
+	*levels = p->ODR;
+	return 0;
+}
+
+int gpio_port_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	switch(request->operation) {
+
+	case PORT_CONFIG:
+		const port_config_request_t* config = (const port_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = gpio_port_config(&config->config, NULL);
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,243 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "i2c.h"
+#include "dma.h"
+#include "stm32h5xx_ll_bus.h"
+#include "stm32h5xx_ll_rcc.h"
+#include "stm32h5xx_ll_tim.h"
+#include <string.h>
+
+#define I2C_MAX_NBYTES			255
+
+/* TIMINGR values for the 64 MHz HSI kernel clock */
+#define I2C_TIMING_100K			0x10707DBC
+#define I2C_TIMING_400K			0x00602173
+#define I2C_TIMING_1M			0x00300B29
+
+static int initialized;
+static uint32_t current_speed;
+
+static void i2c_init()
+{
+	LL_RCC_SetI2CClockSource(LL_RCC_I2C1_CLKSOURCE_HSI);
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_I2C1);
+	LL_APB1_GRP1_ForceReset(LL_APB1_GRP1_PERIPH_I2C1);
+	LL_APB1_GRP1_ReleaseReset(LL_APB1_GRP1_PERIPH_I2C1);
+	LL_APB3_GRP1_EnableClock(LL_APB3_GRP1_PERIPH_SBS);
+	initialized = 1;
+}
+
+/*
+ * The pins are shared with the I3C bridge, so they are connected again for every batch
+ */
+static int i2c_pins()
+{
+	/* the pins are claimed before they are touched */
+	int res = gpio_claim('b', 8, PIN_OWNER_I2C);
+	if(res == 0)
+		res = gpio_claim('b', 9, PIN_OWNER_I2C);
+	if(res != 0) {
+		gpio_release('b', 8, PIN_OWNER_I2C);
+		return res;
+	}
+
+	GPIO_TypeDef* port = gpio_port('b');
+	LL_GPIO_SetPinOutputType(port, LL_GPIO_PIN_8 | LL_GPIO_PIN_9, LL_GPIO_OUTPUT_OPENDRAIN);
+	LL_GPIO_SetPinPull(port, LL_GPIO_PIN_8, LL_GPIO_PULL_UP);
+	LL_GPIO_SetPinPull(port, LL_GPIO_PIN_9, LL_GPIO_PULL_UP);
+	gpio_alternate('b', 8, LL_GPIO_AF_4, PIN_OWNER_I2C);
+	gpio_alternate('b', 9, LL_GPIO_AF_4, PIN_OWNER_I2C);
+	return 0;
+}
+
+/*
+ * The timing register can only be written while the peripheral is disabled.
+ * Fast-mode Plus also needs the stronger drive of the pins.
+ */
+static void i2c_speed(uint32_t speed_hz)
+{
+	uint32_t speed = speed_hz >= 1000000 ? 1000000 : speed_hz >= 400000 ? 400000 : 100000;
+	if(speed == current_speed)
+		return;
+
+	CLEAR_BIT(I2C1->CR1, I2C_CR1_PE);
+	WRITE_REG(I2C1->TIMINGR, speed == 1000000 ? I2C_TIMING_1M : speed == 400000 ? I2C_TIMING_400K : I2C_TIMING_100K);
+	if(speed == 1000000)
+		SET_BIT(SBS->PMCR, SBS_PMCR_PB8_FMP | SBS_PMCR_PB9_FMP);
+	else
+		CLEAR_BIT(SBS->PMCR, SBS_PMCR_PB8_FMP | SBS_PMCR_PB9_FMP);
+	SET_BIT(I2C1->CR1, I2C_CR1_PE);
+	current_speed = speed;
+}
+
+/*
+ * Transfers length bytes in one direction after a start or repeated start, through DMA.
+ * Transfers longer than 255 bytes are split with the reload mode. With stop = 0, the bus is kept
+ * for a repeated start.
+ */
+static int i2c_phase(uint8_t address, int read, uint8_t* data, uint32_t length, int stop)
+{
+	uint32_t remaining = length;
+	uint32_t chunk = remaining > I2C_MAX_NBYTES ? I2C_MAX_NBYTES : remaining;
+	uint32_t end_mode = remaining > I2C_MAX_NBYTES ? I2C_CR2_RELOAD : (stop ? I2C_CR2_AUTOEND : 0);
+	int res = 0;
+
+	WRITE_REG(I2C1->ICR, I2C_ICR_NACKCF | I2C_ICR_STOPCF | I2C_ICR_ARLOCF | I2C_ICR_BERRCF);
+	if(length > 0) {
+		if(read) {
+			dma_start(DMA_I2C_RX, DMA_REQUEST_I2C1_RX, &I2C1->RXDR, data, length, DMA_WIDTH_8);
+			SET_BIT(I2C1->CR1, I2C_CR1_RXDMAEN);
+		}
+		else {
+			dma_start(DMA_I2C_TX, DMA_REQUEST_I2C1_TX, &I2C1->TXDR, data, length, DMA_TO_PERIPH | DMA_WIDTH_8);
+			SET_BIT(I2C1->CR1, I2C_CR1_TXDMAEN);
+		}
+	}
+	WRITE_REG(I2C1->CR2, ((uint32_t)address << 1 << I2C_CR2_SADD_Pos) | (read ? I2C_CR2_RD_WRN : 0)
+			| (chunk << I2C_CR2_NBYTES_Pos) | end_mode | I2C_CR2_START);
+
+	/* twice the transfer time, plus some clock stretching */
+	uint32_t timeout_us = (uint64_t)(length+2) * 9 * 2000000 / current_speed + 10000;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(1) {
+		uint32_t isr = READ_REG(I2C1->ISR);
+		if(isr & I2C_ISR_NACKF) {
+			if((isr & I2C_ISR_STOPF) == 0 && (isr & I2C_ISR_BUSY))
+				SET_BIT(I2C1->CR2, I2C_CR2_STOP);
+			while(READ_BIT(I2C1->ISR, I2C_ISR_STOPF) == 0 && LL_TIM_GetCounter(TIM5) - start <= timeout_us)
+				;
+			res = ERROR_I2C_NACK;
+			break;
+		}
+		if(isr & (I2C_ISR_ARLO | I2C_ISR_BERR)) {
+			res = ERROR_I2C_BUS;
+			break;
+		}
+		if(isr & I2C_ISR_TCR) {
+			remaining -= chunk;
+			chunk = remaining > I2C_MAX_NBYTES ? I2C_MAX_NBYTES : remaining;
+			end_mode = remaining > I2C_MAX_NBYTES ? I2C_CR2_RELOAD : (stop ? I2C_CR2_AUTOEND : 0);
+			MODIFY_REG(I2C1->CR2, I2C_CR2_NBYTES | I2C_CR2_RELOAD | I2C_CR2_AUTOEND, (chunk << I2C_CR2_NBYTES_Pos) | end_mode);
+		}
+		if((stop && (isr & I2C_ISR_STOPF)) || (!stop && (isr & I2C_ISR_TC)))
+			break;
+		if(LL_TIM_GetCounter(TIM5) - start > timeout_us) {
+			res = ERROR_I2C_TIMEOUT;
+			break;
+		}
+	}
+
+	CLEAR_BIT(I2C1->CR1, I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN);
+	WRITE_REG(I2C1->ICR, I2C_ICR_NACKCF | I2C_ICR_STOPCF | I2C_ICR_ARLOCF | I2C_ICR_BERRCF);
+	if(res < 0 && length > 0)
+		dma_stop(read ? DMA_I2C_RX : DMA_I2C_TX);
+
+	/* a timeout or a bus error can leave the peripheral in any state: reset it */
+	if(res == ERROR_I2C_TIMEOUT || res == ERROR_I2C_BUS) {
+		CLEAR_BIT(I2C1->CR1, I2C_CR1_PE);
+		SET_BIT(I2C1->CR1, I2C_CR1_PE);
+	}
+	return res;
+}
+
+static int i2c_transaction(const i2c_transaction_t* t, const uint8_t* tx, uint8_t* rx)
+{
+	static uint8_t tx_buffer[REQUEST_MAX_LENGTH] __attribute__((aligned(4)));
+	int res;
+
+	if(t->address > 0x7F)
+		return ERROR_GPIO_PARAMETER;
+
+	if(t->tx_length > 0 || t->rx_length == 0) {
+		memcpy(tx_buffer, tx, t->tx_length);
+		res = i2c_phase(t->address, 0, tx_buffer, t->tx_length, t->rx_length == 0);
+		if(res < 0)
+			return res;
+	}
+	if(t->rx_length > 0)
+		return i2c_phase(t->address, 1, rx, t->rx_length, 1);
+	return 0;
+}
+
+/*
+ * Executes an I2C request and fills in the reply. Returns the reply length in bytes.
+ * I2C_TRANSFER is deferred. The whole batch is checked before the first transaction is executed.
+ */
+int i2c_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case I2C_TRANSFER:
+		const i2c_transfer_request_t* transfer = (const i2c_transfer_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*transfer)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(transfer + 1);
+		uint32_t rx_total = 0;
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const i2c_transaction_t* t = (const i2c_transaction_t*)p;
+			if(p + sizeof(*t) > end || p + sizeof(*t) + t->tx_length > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			rx_total += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+		}
+		if(rx_total + transfer->count*sizeof(int32_t) > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		if(!initialized)
+			i2c_init();
+		if((*result = i2c_pins()) < 0)
+			return sizeof(*result);
+		i2c_speed(transfer->speed_hz);
+
+		int32_t* status = (int32_t*)(executed + 1);
+		uint8_t* rx = (uint8_t*)(status + transfer->count);
+		memset(status, 0, transfer->count*sizeof(int32_t) + rx_total);
+		p = (const uint8_t*)(transfer + 1);
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const i2c_transaction_t* t = (const i2c_transaction_t*)p;
+			status[i] = i2c_transaction(t, p + sizeof(*t), rx);
+			if(status[i] < 0)
+				memset(rx, 0, t->rx_length);
+			rx += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+			(*executed)++;
+			if(status[i] < 0 && status[i] != ERROR_I2C_NACK) {
+				*result = status[i];
+				break;
+			}
+		}
+		return (uint8_t*)(status + transfer->count) - reply + rx_total;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
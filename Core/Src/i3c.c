@@ -0,0 +1,372 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "i3c.h"
+#include "mcu_init.h"
+#include "usb.h"
+#include "stm32h5xx_ll_bus.h"
+#include "stm32h5xx_ll_rcc.h"
+#include "stm32h5xx_ll_tim.h"
+#include <string.h>
+
+/* Controller message types */
+#define MTYPE_PRIVATE			I3C_CR_MTYPE_1								// private I3C message
+#define MTYPE_DIRECT			(I3C_CR_MTYPE_1 | I3C_CR_MTYPE_0)			// direct CCC message, after its CCC command
+#define MTYPE_CCC				(I3C_CR_MTYPE_2 | I3C_CR_MTYPE_1)			// CCC command
+
+#define CONTROLLER_ADDRESS		0x08
+#define FRAME_TIMEOUT_US		100000
+
+static int initialized;
+
+/*
+ * Push-pull SCL: the high time is at most half of the period.
+ * Open-drain SCL low time 256 ns (200 ns minimum), bus available time 1 us.
+ */
+static void i3c_timing(uint32_t speed_hz)
+{
+	uint32_t period = I3C_KER_CLK_HZ / speed_hz;
+	uint32_t high = period/2 > 256 ? 256 : period/2;
+	uint32_t low = period - high > 256 ? 256 : period - high;
+
+	CLEAR_BIT(I3C1->CFGR, I3C_CFGR_EN);
+	WRITE_REG(I3C1->TIMINGR0, ((low-1) << I3C_TIMINGR0_SCLL_PP_Pos) | ((high-1) << I3C_TIMINGR0_SCLH_I3C_Pos)
+			| (63 << I3C_TIMINGR0_SCLL_OD_Pos) | ((high-1) << I3C_TIMINGR0_SCLH_I2C_Pos));
+	WRITE_REG(I3C1->TIMINGR1, (249 << I3C_TIMINGR1_AVAL_Pos) | (63 << I3C_TIMINGR1_FREE_Pos));
+	SET_BIT(I3C1->CFGR, I3C_CFGR_EN);
+}
+
+static void i3c_init()
+{
+	LL_RCC_SetI3CClockSource(LL_RCC_I3C1_CLKSOURCE_PCLK1);
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_I3C1);
+	LL_APB1_GRP1_ForceReset(LL_APB1_GRP1_PERIPH_I3C1);
+	LL_APB1_GRP1_ReleaseReset(LL_APB1_GRP1_PERIPH_I3C1);
+
+	WRITE_REG(I3C1->CFGR, I3C_CFGR_CRINIT);
+	WRITE_REG(I3C1->DEVR0, (CONTROLLER_ADDRESS << I3C_DEVR0_DA_Pos) | I3C_DEVR0_DAVAL);
+	i3c_timing(I3C_MAX_SPEED_HZ);
+
+	WRITE_REG(I3C1->IER, I3C_IER_IBIIE);
+	NVIC_SetPriority(I3C1_EV_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), I3C_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(I3C1_EV_IRQn);
+	initialized = 1;
+}
+
+/*
+ * The pins are shared with the I2C bridge, so they are connected again for every request.
+ * The controller drives SCL in push-pull, and SDA in push-pull or open-drain depending on the phase.
+ */
+static int i3c_pins()
+{
+	/* the pins are claimed before they are touched */
+	int res = gpio_claim('b', 8, PIN_OWNER_I2C);
+	if(res == 0)
+		res = gpio_claim('b', 9, PIN_OWNER_I2C);
+	if(res != 0) {
+		gpio_release('b', 8, PIN_OWNER_I2C);
+		return res;
+	}
+
+	GPIO_TypeDef* port = gpio_port('b');
+	LL_GPIO_SetPinOutputType(port, LL_GPIO_PIN_8 | LL_GPIO_PIN_9, LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinPull(port, LL_GPIO_PIN_8, LL_GPIO_PULL_NO);
+	LL_GPIO_SetPinPull(port, LL_GPIO_PIN_9, LL_GPIO_PULL_UP);
+	gpio_alternate('b', 8, LL_GPIO_AF_3, PIN_OWNER_I2C);
+	gpio_alternate('b', 9, LL_GPIO_AF_3, PIN_OWNER_I2C);
+	return 0;
+}
+
+/*
+ * Takes the peripheral and the pins, once the request is known to be valid
+ */
+static int i3c_prepare()
+{
+	if(!initialized)
+		i3c_init();
+	return i3c_pins();
+}
+
+/*
+ * Forwards the in-band interrupts accepted by the controller to the host
+ */
+void i3c_isr()
+{
+	if(READ_BIT(I3C1->EVR, I3C_EVR_IBIF) == 0)
+		return;
+
+	uint32_t rmr = READ_REG(I3C1->RMR);
+	uint32_t data = READ_REG(I3C1->IBIDR);
+	WRITE_REG(I3C1->CEVR, I3C_CEVR_CIBIF);
+
+	i3c_ibi_event_t event = {
+		.address = (rmr & I3C_RMR_RADD) >> I3C_RMR_RADD_Pos,
+		.length = (rmr & I3C_RMR_IBIRDCNT) >> I3C_RMR_IBIRDCNT_Pos,
+	};
+	memcpy(event.data, &data, sizeof(event.data));
+	usb_event_post(EVENT_I3C_IBI, &event, sizeof(event));
+}
+
+static int frame_error()
+{
+	uint32_t ser = READ_REG(I3C1->SER);
+	WRITE_REG(I3C1->CEVR, I3C_CEVR_CERRF);
+	return (ser & (I3C_SER_ANACK | I3C_SER_DNACK)) ? ERROR_I3C_NACK : ERROR_I3C_BUS;
+}
+
+/*
+ * Executes a frame of count messages. The first control word starts the frame, the following ones are
+ * written when the controller asks for them. Returns the number of bytes received, or a negative error.
+ */
+static int i3c_frame(const uint32_t* control, int count, const uint8_t* tx, uint32_t tx_length, uint8_t* rx, uint32_t rx_length)
+{
+	uint32_t tx_idx = 0, rx_idx = 0;
+	int res = 0;
+
+	SET_BIT(I3C1->CFGR, I3C_CFGR_TXFLUSH | I3C_CFGR_RXFLUSH | I3C_CFGR_CFLUSH);
+	WRITE_REG(I3C1->CEVR, I3C_CEVR_CFCF | I3C_CEVR_CERRF);
+	WRITE_REG(I3C1->CR, control[0]);
+
+	int control_idx = 1;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(1) {
+		uint32_t evr = READ_REG(I3C1->EVR);
+		if(control_idx < count && (evr & I3C_EVR_CFNFF))
+			WRITE_REG(I3C1->CR, control[control_idx++]);
+		if(tx_idx < tx_length && (evr & I3C_EVR_TXFNFF))
+			*(__IO uint8_t*)&I3C1->TDR = tx[tx_idx++];
+		if(evr & I3C_EVR_RXFNEF) {
+			uint8_t b = *(__IO uint8_t*)&I3C1->RDR;
+			if(rx_idx < rx_length)
+				rx[rx_idx++] = b;
+		}
+		if(evr & I3C_EVR_ERRF) {
+			res = frame_error();
+			break;
+		}
+		if(evr & I3C_EVR_FCF) {
+			while(READ_BIT(I3C1->EVR, I3C_EVR_RXFNEF) && rx_idx < rx_length)
+				rx[rx_idx++] = *(__IO uint8_t*)&I3C1->RDR;
+			WRITE_REG(I3C1->CEVR, I3C_CEVR_CFCF);
+			break;
+		}
+		if(LL_TIM_GetCounter(TIM5) - start > FRAME_TIMEOUT_US) {
+			res = ERROR_I3C_TIMEOUT;
+			break;
+		}
+	}
+
+	return res < 0 ? res : (int)rx_idx;
+}
+
+static int i3c_transaction(const i3c_transaction_t* t, const uint8_t* tx, uint8_t* rx)
+{
+	uint32_t control[2];
+	uint32_t address = (uint32_t)(t->address & 0x7F) << I3C_CR_ADD_Pos;
+	uint32_t ccc = (uint32_t)t->ccc << I3C_CR_CCC_Pos;
+	int n = 0;
+
+	switch(t->type) {
+	case I3C_PRIVATE:
+		if(t->tx_length > 0 || t->rx_length == 0)
+			control[n++] = address | t->tx_length | MTYPE_PRIVATE | (t->rx_length == 0 ? I3C_CR_MEND : 0);
+		if(t->rx_length > 0)
+			control[n++] = address | I3C_CR_RNW | t->rx_length | MTYPE_PRIVATE | I3C_CR_MEND;
+		break;
+
+	case I3C_CCC_BROADCAST:
+		if(t->rx_length > 0)
+			return ERROR_GPIO_PARAMETER;
+		control[n++] = ccc | t->tx_length | MTYPE_CCC | I3C_CR_MEND;
+		break;
+
+	case I3C_CCC_DIRECT:
+		uint32_t defining = (t->flags & I3C_DEFINING_BYTE) ? 1 : 0;
+		if(t->tx_length < defining || (t->rx_length > 0 && t->tx_length > defining))
+			return ERROR_GPIO_PARAMETER;
+		control[n++] = ccc | defining | MTYPE_CCC;
+		if(t->rx_length > 0)
+			control[n++] = address | I3C_CR_RNW | t->rx_length | MTYPE_DIRECT | I3C_CR_MEND;
+		else
+			control[n++] = address | (t->tx_length - defining) | MTYPE_DIRECT | I3C_CR_MEND;
+		break;
+
+	default:
+		return ERROR_GPIO_PARAMETER;
+	}
+
+	return i3c_frame(control, n, tx, t->tx_length, rx, t->rx_length);
+}
+
+/*
+ * ENTDAA: each target taking part sends its provisioned ID, BCR and DCR, then the controller
+ * sends the dynamic address. The procedure ends when no target acknowledges.
+ */
+static int i3c_daa(uint8_t first_address, i3c_target_t* targets)
+{
+	uint8_t payload[8];
+	uint32_t payload_idx = 0;
+	int count = 0;
+	int res = 0;
+
+	SET_BIT(I3C1->CFGR, I3C_CFGR_TXFLUSH | I3C_CFGR_RXFLUSH | I3C_CFGR_CFLUSH);
+	WRITE_REG(I3C1->CEVR, I3C_CEVR_CFCF | I3C_CEVR_CERRF);
+	WRITE_REG(I3C1->CR, ((uint32_t)I3C_CCC_ENTDAA << I3C_CR_CCC_Pos) | MTYPE_CCC | I3C_CR_MEND);
+
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(1) {
+		uint32_t evr = READ_REG(I3C1->EVR);
+		if(evr & I3C_EVR_RXFNEF) {
+			uint8_t b = *(__IO uint8_t*)&I3C1->RDR;
+			if(payload_idx < sizeof(payload))
+				payload[payload_idx++] = b;
+			continue;
+		}
+		if(evr & I3C_EVR_TXFNFF) {
+			uint8_t address = first_address + count;
+			if(count >= I3C_MAX_TARGETS || address > 0x7D) {
+				res = ERROR_I3C_TARGETS;
+				break;
+			}
+			i3c_target_t* target = &targets[count++];
+			memcpy(target->pid, payload, 6);
+			target->bcr = payload[6];
+			target->dcr = payload[7];
+			target->address = address;
+			memset(target->reserved, 0, sizeof(target->reserved));
+			*(__IO uint8_t*)&I3C1->TDR = address;
+			payload_idx = 0;
+		}
+		if(evr & I3C_EVR_ERRF) {
+			/* the NACK of the broadcast address after the last target ends the procedure */
+			res = frame_error();
+			if(res == ERROR_I3C_NACK)
+				res = 0;
+			break;
+		}
+		if(evr & I3C_EVR_FCF) {
+			WRITE_REG(I3C1->CEVR, I3C_CEVR_CFCF);
+			break;
+		}
+		if(LL_TIM_GetCounter(TIM5) - start > FRAME_TIMEOUT_US) {
+			res = ERROR_I3C_TIMEOUT;
+			break;
+		}
+	}
+
+	/* accept the in-band interrupts of the first targets, with their data byte if BCR says they send one */
+	for(int i=0;i<I3C_IBI_TARGETS;i++) {
+		if(i < count)
+			WRITE_REG(I3C1->DEVRX[i], ((uint32_t)targets[i].address << I3C_DEVRX_DA_Pos) | I3C_DEVRX_IBIACK
+					| ((targets[i].bcr & 0x04) ? I3C_DEVRX_IBIDEN : 0));
+		else
+			WRITE_REG(I3C1->DEVRX[i], 0);
+	}
+
+	return res < 0 ? res : count;
+}
+
+/*
+ * Executes an I3C request and fills in the reply. Returns the reply length in bytes.
+ * I3C_DAA and I3C_TRANSFER are deferred. The whole batch is checked before the first transaction is executed.
+ */
+int i3c_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case I3C_CONFIG:
+		const i3c_config_request_t* config = (const i3c_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(config->speed_hz < I3C_MIN_SPEED_HZ || config->speed_hz > I3C_MAX_SPEED_HZ)
+			*result = ERROR_I3C_PARAMETER;
+		else if((*result = i3c_prepare()) == 0)
+			i3c_timing(config->speed_hz);
+		return sizeof(*result);
+
+	case I3C_DAA:
+		const i3c_daa_request_t* daa = (const i3c_daa_request_t*)request;
+		if(request->length < sizeof(*daa)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		if((*result = i3c_prepare()) < 0)
+			return sizeof(*result);
+		i3c_target_t* targets = (i3c_target_t*)(executed + 1);
+		int n = i3c_daa(daa->first_address, targets);
+		if(n < 0) {
+			*result = n;
+			return sizeof(*result);
+		}
+		*executed = n;
+		return sizeof(*result) + sizeof(*executed) + n*sizeof(i3c_target_t);
+
+	case I3C_TRANSFER:
+		const i3c_transfer_request_t* transfer = (const i3c_transfer_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*transfer)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(transfer + 1);
+		uint32_t rx_total = 0;
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const i3c_transaction_t* t = (const i3c_transaction_t*)p;
+			if(p + sizeof(*t) > end || p + sizeof(*t) + t->tx_length > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			rx_total += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+		}
+		if(rx_total + transfer->count*sizeof(int32_t) > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		if((*result = i3c_prepare()) < 0)
+			return sizeof(*result);
+
+		int32_t* status = (int32_t*)(executed + 1);
+		uint8_t* rx = (uint8_t*)(status + transfer->count);
+		memset(status, 0, transfer->count*sizeof(int32_t) + rx_total);
+		p = (const uint8_t*)(transfer + 1);
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const i3c_transaction_t* t = (const i3c_transaction_t*)p;
+			status[i] = i3c_transaction(t, p + sizeof(*t), rx);
+			if(status[i] < 0)
+				memset(rx, 0, t->rx_length);
+			rx += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+			(*executed)++;
+			if(status[i] < 0 && status[i] != ERROR_I3C_NACK) {
+				*result = status[i];
+				break;
+			}
+		}
+		return (uint8_t*)(status + transfer->count) - reply + rx_total;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
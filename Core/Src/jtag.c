@@ -0,0 +1,299 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "jtag.h"
+#include "mcu_init.h"
+#include <string.h>
+
+#define PIN_TCK			LL_GPIO_PIN_2
+#define PIN_RESET		LL_GPIO_PIN_3
+#define PIN_TMS			LL_GPIO_PIN_4
+#define PIN_TDI			LL_GPIO_PIN_5
+#define PIN_TDO			LL_GPIO_PIN_6
+
+#define LEVEL(pin, high)	((high) ? (pin) : (pin) << 16)	// BSRR value
+
+#define SWD_ACK_OK		1
+#define SWD_ACK_WAIT	2
+#define SWD_ACK_FAULT	4
+
+static uint32_t half_period;
+
+static inline void wait_half()
+{
+	for(uint32_t i=half_period;i>0;i--)
+		__NOP();
+}
+
+/*
+ * One clock period. TCK is low on entry and on exit. Returns IDR sampled before the rising edge.
+ */
+static inline uint32_t clock_bit(uint32_t bsrr)
+{
+	GPIOE->BSRR = bsrr;
+	wait_half();
+	uint32_t idr = GPIOE->IDR;
+	GPIOE->BSRR = PIN_TCK;
+	wait_half();
+	GPIOE->BSRR = PIN_TCK << 16;
+	return idr;
+}
+
+static inline void swdio_output()
+{
+	MODIFY_REG(GPIOE->MODER, GPIO_MODER_MODE4, GPIO_MODER_MODE4_0);
+}
+
+static inline void swdio_input()
+{
+	CLEAR_BIT(GPIOE->MODER, GPIO_MODER_MODE4);
+}
+
+/*
+ * The pins are owned by the engine during a run
+ */
+static int jtag_pins()
+{
+	for(uint8_t pin=2;pin<=6;pin++) {
+		int res = gpio_claim('e', pin, PIN_OWNER_JTAG);
+		if(res < 0) {
+			for(uint8_t i=2;i<pin;i++)
+				gpio_release('e', i, PIN_OWNER_JTAG);
+			return res;
+		}
+	}
+
+	GPIOE->BSRR = (PIN_TCK << 16) | PIN_TMS | PIN_TDI | PIN_RESET;
+	LL_GPIO_SetPinOutputType(GPIOE, PIN_TCK | PIN_TMS | PIN_TDI, LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinOutputType(GPIOE, PIN_RESET, LL_GPIO_OUTPUT_OPENDRAIN);
+	LL_GPIO_SetPinSpeed(GPIOE, PIN_TCK, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	LL_GPIO_SetPinSpeed(GPIOE, PIN_TMS, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	LL_GPIO_SetPinSpeed(GPIOE, PIN_TDI, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	LL_GPIO_SetPinPull(GPIOE, PIN_TMS, LL_GPIO_PULL_UP);
+	LL_GPIO_SetPinPull(GPIOE, PIN_TDO, LL_GPIO_PULL_UP);
+	LL_GPIO_SetPinPull(GPIOE, PIN_RESET, LL_GPIO_PULL_UP);
+	LL_GPIO_SetPinMode(GPIOE, PIN_TCK, LL_GPIO_MODE_OUTPUT);
+	LL_GPIO_SetPinMode(GPIOE, PIN_TMS, LL_GPIO_MODE_OUTPUT);
+	LL_GPIO_SetPinMode(GPIOE, PIN_TDI, LL_GPIO_MODE_OUTPUT);
+	LL_GPIO_SetPinMode(GPIOE, PIN_RESET, LL_GPIO_MODE_OUTPUT);
+	LL_GPIO_SetPinMode(GPIOE, PIN_TDO, LL_GPIO_MODE_INPUT);
+	return 0;
+}
+
+static void jtag_tms(const uint8_t* data, uint32_t bits, uint32_t tdi)
+{
+	for(uint32_t i=0;i<bits;i++)
+		clock_bit(LEVEL(PIN_TMS, data[i/8] & (1 << (i%8))) | tdi);
+}
+
+static void jtag_shift(const uint8_t* data, uint32_t bits, uint8_t* tdo, uint32_t exit)
+{
+	for(uint32_t i=0;i<bits;i++) {
+		uint32_t tms = LEVEL(PIN_TMS, exit && i == bits-1);
+		uint32_t idr = clock_bit(LEVEL(PIN_TDI, data[i/8] & (1 << (i%8))) | tms);
+		if(tdo != NULL) {
+			if(i%8 == 0)
+				tdo[i/8] = 0;
+			if(idr & PIN_TDO)
+				tdo[i/8] |= 1 << (i%8);
+		}
+	}
+}
+
+static void swd_write_bits(uint32_t value, uint32_t bits)
+{
+	for(uint32_t i=0;i<bits;i++)
+		clock_bit(LEVEL(PIN_TMS, value & (1 << i)));
+}
+
+static uint32_t swd_read_bits(uint32_t bits)
+{
+	uint32_t value = 0;
+	for(uint32_t i=0;i<bits;i++)
+		if(clock_bit(0) & PIN_TMS)
+			value |= 1 << i;
+	return value;
+}
+
+/*
+ * SWD packet: request, turnaround, acknowledge, then data phase in the direction given by read.
+ * A WAIT acknowledge repeats the whole packet at most retries times.
+ */
+static int swd_transfer(uint8_t flags, int read, uint32_t* data, uint32_t retries)
+{
+	uint32_t request = ((flags & SWD_AP) ? 0x02 : 0) | (read ? 0x04 : 0) | ((flags & SWD_ADDRESS) << 1);
+	request |= 0x81 | (__builtin_parity(request) << 5);
+
+	for(uint32_t attempt=0;;attempt++) {
+		swd_write_bits(request, 8);
+		swdio_input();
+		clock_bit(0);
+		uint32_t ack = swd_read_bits(3);
+
+		if(ack == SWD_ACK_OK) {
+			if(read) {
+				uint32_t value = swd_read_bits(32);
+				uint32_t parity = swd_read_bits(1);
+				clock_bit(0);
+				swdio_output();
+				if(parity != (uint32_t)__builtin_parity(value))
+					return ERROR_SWD_PARITY;
+				*data = value;
+			} else {
+				clock_bit(0);
+				swdio_output();
+				swd_write_bits(*data, 32);
+				swd_write_bits(__builtin_parity(*data), 1);
+			}
+			return 0;
+		}
+
+		if(ack == SWD_ACK_WAIT || ack == SWD_ACK_FAULT) {
+			clock_bit(0);
+			swdio_output();
+			if(ack == SWD_ACK_WAIT && attempt < retries)
+				continue;
+			return ack == SWD_ACK_WAIT ? ERROR_SWD_WAIT : ERROR_SWD_FAULT;
+		}
+
+		/* no target answering: clocks the data phase out so that a target out of sync releases the line */
+		swd_read_bits(32);
+		swd_read_bits(2);
+		swdio_output();
+		return ERROR_SWD_ACK;
+	}
+}
+
+static uint32_t data_length(const jtag_command_t* command)
+{
+	switch(command->opcode) {
+	case JTAG_TMS:
+	case JTAG_SHIFT:
+	case SWD_SEQUENCE:
+		return (command->bits + 7) / 8;
+	case SWD_WRITE:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t reply_length(const jtag_command_t* command)
+{
+	if(command->opcode == JTAG_SHIFT && (command->flags & JTAG_CAPTURE))
+		return (command->bits + 7) / 8;
+	if(command->opcode == SWD_READ)
+		return 4;
+	return 0;
+}
+
+/*
+ * Executes a JTAG request and fills in the reply. Returns the reply length in bytes.
+ * JTAG_RUN is deferred. The whole command buffer is checked before the first command is executed.
+ */
+int jtag_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case JTAG_RUN:
+		const jtag_run_request_t* run = (const jtag_run_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*run)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(run + 1);
+		uint32_t rx_total = 0;
+		uint32_t commands = 0;
+		while(p < end) {
+			const jtag_command_t* command = (const jtag_command_t*)p;
+			if(++commands > JTAG_MAX_COMMANDS || p + sizeof(*command) > end || p + sizeof(*command) + data_length(command) > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			if(command->opcode == 0 || command->opcode >= JTAG_OPCODE_COUNT) {
+				*result = ERROR_JTAG_COMMAND;
+				return sizeof(*result);
+			}
+			rx_total += reply_length(command);
+			p += sizeof(*command) + data_length(command);
+		}
+		if(rx_total > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		half_period = run->half_period;
+		if((*result = jtag_pins()) < 0)
+			return sizeof(*result);
+
+		uint8_t* rx = (uint8_t*)(executed + 1);
+		memset(rx, 0, rx_total);
+		p = (const uint8_t*)(run + 1);
+		while(p < end && *result == 0) {
+			const jtag_command_t* command = (const jtag_command_t*)p;
+			const uint8_t* data = p + sizeof(*command);
+			uint32_t value = 0;
+			switch(command->opcode) {
+			case JTAG_TMS:
+				jtag_tms(data, command->bits, LEVEL(PIN_TDI, command->flags & JTAG_TDI_HIGH));
+				break;
+			case JTAG_SHIFT:
+				jtag_shift(data, command->bits, (command->flags & JTAG_CAPTURE) ? rx : NULL, command->flags & JTAG_EXIT);
+				break;
+			case JTAG_CLOCK:
+				for(uint32_t i=0;i<command->bits;i++)
+					clock_bit(LEVEL(PIN_TMS, command->flags & JTAG_TMS_HIGH));
+				break;
+			case JTAG_RESET:
+				GPIOE->BSRR = LEVEL(PIN_RESET, !(command->flags & JTAG_ASSERT));
+				break;
+			case JTAG_DELAY_US:
+				delay_us(command->bits);
+				break;
+			case SWD_SEQUENCE:
+				jtag_tms(data, command->bits, 0);
+				break;
+			case SWD_READ:
+				*result = swd_transfer(command->flags, 1, &value, run->wait_retries);
+				memcpy(rx, &value, sizeof(value));
+				break;
+			case SWD_WRITE:
+				memcpy(&value, data, sizeof(value));
+				*result = swd_transfer(command->flags, 0, &value, run->wait_retries);
+				break;
+			}
+			if(*result == 0)
+				(*executed)++;
+			rx += reply_length(command);
+			p += sizeof(*command) + data_length(command);
+		}
+		for(uint8_t pin=2;pin<=6;pin++)
+			gpio_release('e', pin, PIN_OWNER_JTAG);
+		return (uint8_t*)(executed + 1) - reply + rx_total;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -21,6 +21,8 @@
 #include "mcu_init.h"
 #include "version.h"
 #include "gpio.h"
+#include "boot.h"
+#include "usb.h"
 #include <string.h>
 #include <stdlib.h>
 #include <getopt.h>
@@ -53,9 +55,21 @@ static void print_help()
 	DPRINT("                                                        -d 0|1   -> gpio direction: input(0), output(1)\n");
 	DPRINT("                                                        -p 0|1|2 -> pull-ups: none(0), up(1), down(2)\n");
 	DPRINT("                                                        -t 0|1   -> output type: pushpull(0), opendrain(1)\n");
+	DPRINT("boot                                                 -- print the boot phase times.\n");
+	DPRINT("isr                                                  -- print the USB interrupt cycles, and reset the longest.\n");
 	DPRINT("\n");
 }
 
+static void boot_print()
+{
+	uint32_t t;
+	for(int i=0;i<BOOT_PHASES;i++)
+		if(boot_time(i, &t) == 0)
+			DPRINT("%-16s %10lu us\n", boot_phase_name(i), (unsigned long)t);
+		else
+			DPRINT("%-16s %10s\n", boot_phase_name(i), "-");
+}
+
 static int tokenise(char* str, char** tokens)
 {
 	int count=0;
@@ -190,6 +204,7 @@ static int gpio(char** tokens)
 int main(void)
 {
 	mcu_init();
+	mcu_late_init();
 
 	DPRINT("\n\n** NUCLEO-H563ZI I3C Controller v%d.%d.%d, %s %s **\n",FW_ver_major,FW_ver_minor,FW_ver_build,__DATE__,__TIME__);
 	print_help();
@@ -210,6 +225,14 @@ int main(void)
 				DPRINT("Error\n");
 		}
 
+		else if(strcmp(tokens[0],"boot")==0)
+			boot_print();
+
+		else if(strcmp(tokens[0],"isr")==0) {
+			DPRINT("USB interrupt: last %lu cycles, longest %lu cycles\n", (unsigned long)usb_isr_cycles, (unsigned long)usb_isr_cycles_max);
+			usb_isr_cycles_max = 0;
+		}
+
 		else
 			DPRINT("The command is ill-formatted\n");
 	}
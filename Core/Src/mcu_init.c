@@ -18,6 +18,10 @@
 
 #include "mcu_init.h"
 #include "usb.h"
+#include "sched.h"
+#include "gpio.h"
+#include "profile.h"
+#include "boot.h"
 
 #define TIM5_PRESCALED_CLK_HZ     1000000 // used for delay_us()
 
@@ -25,6 +29,19 @@ uint64_t sys_tick;
 
 static void SystemClock_Config(void)
 {
+#if FAST_BOOT
+	/*
+	 * The regulator scales up while the oscillators start. The PLL only needs the CSI, the switch
+	 * to the PLL needs the voltage scale, and the HSI48 is waited for by mcu_init() before the USB connects.
+	 */
+	LL_FLASH_SetLatency(LL_FLASH_LATENCY_5);
+	LL_PWR_SetRegulVoltageScaling(LL_PWR_REGU_VOLTAGE_SCALE0);
+	LL_RCC_HSI48_Enable();
+	LL_RCC_CSI_Enable();
+	while(LL_FLASH_GetLatency()!= LL_FLASH_LATENCY_5 || LL_RCC_CSI_IsReady() != 1)
+	{
+	}
+#else
 	LL_FLASH_SetLatency(LL_FLASH_LATENCY_5);
 	while(LL_FLASH_GetLatency()!= LL_FLASH_LATENCY_5)
 	{
@@ -47,6 +64,7 @@ static void SystemClock_Config(void)
 	while(LL_RCC_CSI_IsReady() != 1)
 	{
 	}
+#endif
 
 	LL_RCC_CSI_SetCalibTrimming(32);
 	LL_RCC_PLL1_SetSource(LL_RCC_PLL1SOURCE_CSI);
@@ -60,6 +78,12 @@ static void SystemClock_Config(void)
 	LL_RCC_PLL1P_Enable();
 	LL_RCC_PLL1_Enable();
 
+#if FAST_BOOT
+	while (LL_PWR_IsActiveFlag_VOS() == 0)
+	{
+	}
+#endif
+
 	/* Wait till PLL is ready */
 	while(LL_RCC_PLL1_IsReady() != 1)
 	{
@@ -71,12 +95,17 @@ static void SystemClock_Config(void)
 	while(LL_RCC_GetSysClkSource() != LL_RCC_SYS_CLKSOURCE_STATUS_PLL1)
 	{
 	}
+	boot_mark(BOOT_CLOCK);
 
 	LL_RCC_SetAHBPrescaler(LL_RCC_SYSCLK_DIV_1);
 	LL_RCC_SetAPB1Prescaler(LL_RCC_APB1_DIV_1);
 	LL_RCC_SetAPB2Prescaler(LL_RCC_APB2_DIV_1);
 	LL_RCC_SetAPB3Prescaler(LL_RCC_APB3_DIV_1);
 
+	/* HSI at 64 MHz, through CLKP, is the kernel clock of the serial bridges */
+	LL_RCC_HSI_SetDivider(LL_RCC_HSI_DIV_1);
+	LL_RCC_SetCLKPClockSource(LL_RCC_CLKP_CLKSOURCE_HSI);
+
 	LL_Init1msTick(250000000);
 
 	/* Enable interrupt from SysTick */
@@ -95,6 +124,27 @@ static void SystemClock_Config(void)
 	LL_CRS_SetHSI48SmoothTrimming(32);
 }
 
+/*
+ * The profile sector is written by the firmware, so it is made non-cacheable by the MPU:
+ * its reads always return the programmed data. The rest of the memory map keeps its default attributes.
+ */
+static void Cache_Init(void)
+{
+	ARM_MPU_Disable();
+	ARM_MPU_SetMemAttr(0, ARM_MPU_ATTR(ARM_MPU_ATTR_NON_CACHEABLE, ARM_MPU_ATTR_NON_CACHEABLE));
+	ARM_MPU_SetRegion(0, ARM_MPU_RBAR(PROFILE_FLASH_ADDRESS, ARM_MPU_SH_NON, 0, 0, 1),
+			ARM_MPU_RLAR(PROFILE_FLASH_ADDRESS + FLASH_SECTOR_SIZE - 1, 0));
+	ARM_MPU_Enable(MPU_CTRL_PRIVDEFENA_Msk);
+
+#if ICACHE_ENABLE
+	/* the cache is invalidated after reset, and can be enabled once done */
+	while(ICACHE->SR & ICACHE_SR_BUSYF)
+	{
+	}
+	ICACHE->CR |= ICACHE_CR_EN;
+#endif
+}
+
 static void TIM5_Init(void)
 {
 	LL_TIM_DisableCounter(TIM5);
@@ -116,6 +166,37 @@ static void TIM5_Init(void)
 	LL_TIM_EnableCounter(TIM5);
 }
 
+/*
+ * TIM2 is a free-running 32-bit counter at the timer clock frequency,
+ * used as the high-resolution timebase of the edge timestamps
+ */
+static void TIM2_Init(void)
+{
+	LL_TIM_DisableCounter(TIM2);
+	LL_TIM_InitTypeDef TIM_InitStruct = {0};
+
+	/* Peripheral clock enable */
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM2);
+
+	TIM_InitStruct.Prescaler = SystemCoreClock/TIM2_CLK_HZ-1;
+	TIM_InitStruct.CounterMode = LL_TIM_COUNTERMODE_UP;
+	TIM_InitStruct.Autoreload = 4294967295;
+	TIM_InitStruct.ClockDivision = LL_TIM_CLOCKDIVISION_DIV1;
+	LL_TIM_Init(TIM2, &TIM_InitStruct);
+	LL_TIM_DisableARRPreload(TIM2);
+	LL_TIM_SetClockSource(TIM2, LL_TIM_CLOCKSOURCE_INTERNAL);
+	LL_TIM_SetTriggerOutput(TIM2, LL_TIM_TRGO_RESET);
+	LL_TIM_DisableMasterSlaveMode(TIM2);
+
+	LL_TIM_EnableCounter(TIM2);
+}
+
+static void DMA_Init(void)
+{
+	LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPDMA1);
+	LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPDMA2);
+}
+
 static void USART3_UART_Init(void)
 {
 
@@ -271,12 +352,18 @@ static void GPIO_Init(void)
 
 int mcu_init()
 {
+	boot_start();
+	Cache_Init();
+
 	/* System interrupt init*/
 	NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_4);
 
 	/* SysTick_IRQn interrupt configuration */
 	NVIC_SetPriority(SysTick_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(),1, 0));
 
+	/* PendSV_IRQn executes the deferred USB requests, so it must have the lowest priority */
+	NVIC_SetPriority(PendSV_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(),PENDSV_INT_PRIORITY, 0));
+
 	/** Disable the internal Pull-Up in Dead Battery pins of UCPD peripheral
 	*/
 	LL_PWR_DisableUCPDDeadBattery();
@@ -284,15 +371,61 @@ int mcu_init()
 	/* Configure the system clock */
 	SystemClock_Config();
 
+#if FAST_BOOT
+	/*
+	 * The USB transceiver starts while the other peripherals are initialized, and the device connects
+	 * as soon as its startup deadline has passed. The host then waits at least 100 ms before the bus reset,
+	 * which covers the boot profile and mcu_late_init(). The USB interrupt is enabled by the connection.
+	 */
+	USB_Power();
+	uint32_t usb_deadline = boot_time_us() + USB_STARTUP_US;
+	boot_mark(BOOT_USB_POWER);
+
+	GPIO_Init();
+	TIM5_Init();
+	boot_timebase();
+	sched_init();
+	TIM2_Init();
+	DMA_Init();
+	boot_mark(BOOT_PERIPHERALS);
+
+	while(LL_RCC_HSI48_IsReady() != 1 || (int32_t)(boot_time_us() - usb_deadline) < 0)
+	{
+	}
+	USB_Connect();
+	boot_mark(BOOT_USB_CONNECT);
+#else
 	/* Initialize all configured peripherals */
 	GPIO_Init();
 	TIM5_Init();
+	boot_timebase();
+	sched_init();
+	TIM2_Init();
+	DMA_Init();
+	boot_mark(BOOT_PERIPHERALS);
 	USB_Init();
+	boot_mark(BOOT_USB_CONNECT);
 	USART3_UART_Init();
+#endif
+	gpio_init();
+	profile_boot();
+	boot_mark(BOOT_PROFILE);
 
 	return 0;
 }
 
+/*
+ * Initialization not needed for the enumeration, called by main() after mcu_init().
+ * With FAST_BOOT, the virtual COM port of the CLI and trace is started here.
+ */
+void mcu_late_init()
+{
+#if FAST_BOOT
+	USART3_UART_Init();
+#endif
+	boot_mark(BOOT_LATE_INIT);
+}
+
 void delay_us(uint32_t d_us)
 {
     uint32_t start = LL_TIM_GetCounter(TIM5);
@@ -0,0 +1,339 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "meas.h"
+#include "tim_map.h"
+#include "mcu_init.h"
+#include "usb.h"
+#include <stddef.h>
+
+#define SAMPLE_MAX_TICKS		60000	// longest period in sample timer ticks, with some margin below the 16-bit counter range
+
+enum meas_phase {
+	MEAS_IDLE = 0,
+	MEAS_START,
+	MEAS_COUNT,
+	MEAS_SAMPLE,
+	MEAS_WAIT,
+	MEAS_DONE
+};
+
+/*
+ * Channel state. Channels are started and stopped by the USB requests and advanced by meas_tick().
+ * SysTick preempts the USB interrupt, so a request only has to write phase last when starting
+ * a channel and first when stopping it.
+ */
+typedef struct {
+	volatile enum meas_phase phase;
+	const tim_pin_t* map;
+	uint32_t gate_ms;
+	uint32_t interval_ms;	// 0 for a single measurement
+	uint32_t ticks;			// ticks spent in the current measurement
+	uint16_t last_count;
+	uint32_t t_start;
+	uint32_t t_last;
+	uint64_t sum_period;
+	uint64_t sum_high;
+	meas_result_t result;
+} meas_channel_t;
+
+/* The last channel is used by MEAS_RUN */
+static meas_channel_t channels[MEAS_CHANNELS+1];
+
+static uint32_t count_ms(const meas_channel_t* ch)
+{
+	return ch->gate_ms/2 > 0 ? ch->gate_ms/2 : 1;
+}
+
+/*
+ * First half of the gate: the timer counts the rising edges on the pin in external clock mode 1
+ */
+static void start_count(meas_channel_t* ch)
+{
+	TIM_TypeDef* tim = ch->map->tim;
+	uint32_t ll_channel = tim_ll_channel(ch->map->channel);
+
+	LL_TIM_DisableCounter(tim);
+	LL_TIM_CC_DisableChannel(tim, LL_TIM_CHANNEL_CH1 | LL_TIM_CHANNEL_CH2);
+	LL_TIM_SetPrescaler(tim, 0);
+	LL_TIM_SetAutoReload(tim, 0xFFFF);
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	LL_TIM_IC_Config(tim, ll_channel, LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | LL_TIM_IC_FILTER_FDIV1 | LL_TIM_IC_POLARITY_RISING);
+	LL_TIM_SetTriggerInput(tim, ch->map->channel == 1 ? LL_TIM_TS_TI1FP1 : LL_TIM_TS_TI2FP2);
+	LL_TIM_SetClockSource(tim, LL_TIM_CLOCKSOURCE_EXT_MODE1);
+	LL_TIM_EnableCounter(tim);
+
+	ch->ticks = 0;
+	ch->sum_period = 0;
+	ch->sum_high = 0;
+	ch->result = (meas_result_t){0};
+	ch->result.gate_hz = TIM2_CLK_HZ;
+	ch->result.min_period = UINT32_MAX;
+	ch->result.min_high = UINT32_MAX;
+	ch->phase = MEAS_COUNT;
+}
+
+/*
+ * Second half of the gate: the timer runs from its internal clock in PWM input mode.
+ * The channel of the pin captures the period on the rising edges, which also reset the counter,
+ * and the other channel of the pair captures the high time on the falling edges.
+ * The prescaler is chosen from the counted frequency so that a period fits in the counter.
+ */
+static void start_sample(meas_channel_t* ch)
+{
+	TIM_TypeDef* tim = ch->map->tim;
+	uint32_t direct = ch->map->channel == 1 ? LL_TIM_CHANNEL_CH1 : LL_TIM_CHANNEL_CH2;
+	uint32_t indirect = ch->map->channel == 1 ? LL_TIM_CHANNEL_CH2 : LL_TIM_CHANNEL_CH1;
+
+	/* a lower bound of the frequency, in edges per count_ms() milliseconds */
+	uint32_t edges = ch->result.edges > 1 ? ch->result.edges - 1 : 1;
+	uint64_t max_period = (uint64_t)TIM_CLK_HZ * count_ms(ch) / 1000 / edges;
+	uint32_t prescaler = max_period / SAMPLE_MAX_TICKS;
+	if(prescaler > 0xFFFF)
+		prescaler = 0xFFFF;
+
+	LL_TIM_DisableCounter(tim);
+	LL_TIM_SetClockSource(tim, LL_TIM_CLOCKSOURCE_INTERNAL);
+	LL_TIM_SetPrescaler(tim, prescaler);
+	LL_TIM_SetUpdateSource(tim, LL_TIM_UPDATESOURCE_REGULAR);
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	LL_TIM_SetUpdateSource(tim, LL_TIM_UPDATESOURCE_COUNTER);	// the counter resets of the slave mode must not set UIF
+	LL_TIM_IC_Config(tim, direct, LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | LL_TIM_IC_FILTER_FDIV1 | LL_TIM_IC_POLARITY_RISING);
+	LL_TIM_IC_Config(tim, indirect, LL_TIM_ACTIVEINPUT_INDIRECTTI | LL_TIM_ICPSC_DIV1 | LL_TIM_IC_FILTER_FDIV1 | LL_TIM_IC_POLARITY_FALLING);
+	LL_TIM_SetTriggerInput(tim, ch->map->channel == 1 ? LL_TIM_TS_TI1FP1 : LL_TIM_TS_TI2FP2);
+	LL_TIM_SetSlaveMode(tim, LL_TIM_SLAVEMODE_RESET);
+	LL_TIM_CC_EnableChannel(tim, LL_TIM_CHANNEL_CH1 | LL_TIM_CHANNEL_CH2);
+	WRITE_REG(tim->SR, 0);
+	LL_TIM_EnableCounter(tim);
+
+	ch->result.sample_hz = TIM_CLK_HZ / (prescaler+1);
+	ch->phase = MEAS_SAMPLE;
+}
+
+static void stop_timer(meas_channel_t* ch)
+{
+	TIM_TypeDef* tim = ch->map->tim;
+	LL_TIM_DisableCounter(tim);
+	LL_TIM_CC_DisableChannel(tim, LL_TIM_CHANNEL_CH1 | LL_TIM_CHANNEL_CH2);
+	LL_TIM_SetSlaveMode(tim, LL_TIM_SLAVEMODE_DISABLED);
+}
+
+static void count_tick(meas_channel_t* ch)
+{
+	uint16_t count = LL_TIM_GetCounter(ch->map->tim);
+	uint32_t t = LL_TIM_GetCounter(TIM2);
+
+	if(ch->ticks == 0)
+		ch->t_start = t;
+	else
+		ch->result.edges += (uint16_t)(count - ch->last_count);
+	ch->last_count = count;
+	ch->t_last = t;
+
+	if(++ch->ticks > count_ms(ch)) {
+		ch->result.gate_ticks = ch->t_last - ch->t_start;
+		start_sample(ch);
+	}
+}
+
+/*
+ * Polls the latest captured period and high time.
+ * A sample is discarded if the counter overflowed, i.e., a period was too long for the prescaler.
+ */
+static void sample_tick(meas_channel_t* ch)
+{
+	TIM_TypeDef* tim = ch->map->tim;
+	uint32_t sr = READ_REG(tim->SR);
+	uint32_t direct_flag = ch->map->channel == 1 ? TIM_SR_CC1IF : TIM_SR_CC2IF;
+
+	if(sr & TIM_SR_UIF) {
+		WRITE_REG(tim->SR, 0);
+	}
+	else if(sr & direct_flag) {
+		uint32_t period = ch->map->channel == 1 ? LL_TIM_IC_GetCaptureCH1(tim) : LL_TIM_IC_GetCaptureCH2(tim);
+		uint32_t high = ch->map->channel == 1 ? LL_TIM_IC_GetCaptureCH2(tim) : LL_TIM_IC_GetCaptureCH1(tim);
+		WRITE_REG(tim->SR, 0);
+		if(period > 0 && high <= period) {
+			meas_result_t* r = &ch->result;
+			r->samples++;
+			ch->sum_period += period;
+			ch->sum_high += high;
+			if(period < r->min_period)
+				r->min_period = period;
+			if(period > r->max_period)
+				r->max_period = period;
+			if(high < r->min_high)
+				r->min_high = high;
+			if(high > r->max_high)
+				r->max_high = high;
+		}
+	}
+
+	if(++ch->ticks <= ch->gate_ms)
+		return;
+
+	stop_timer(ch);
+
+	meas_result_t* r = &ch->result;
+	if(r->edges >= 1000 && r->gate_ticks > 0)
+		r->frequency_hz = ((uint64_t)r->edges * r->gate_hz + r->gate_ticks/2) / r->gate_ticks;
+	else if(ch->sum_period > 0)
+		r->frequency_hz = ((uint64_t)r->samples * r->sample_hz + ch->sum_period/2) / ch->sum_period;
+
+	if(ch->sum_period > 0)
+		r->duty_ppm = ch->sum_high * 1000000 / ch->sum_period;
+	else if(r->edges == 0)
+		r->duty_ppm = READ_BIT(gpio_port(ch->map->port)->IDR, 1U << ch->map->pin) ? 1000000 : 0;
+
+	if(r->samples == 0) {
+		r->min_period = 0;
+		r->min_high = 0;
+	}
+
+	if(ch->interval_ms == 0) {
+		ch->phase = MEAS_DONE;
+		return;
+	}
+
+	meas_event_t event = {
+		.channel = ch - channels,
+		.port = ch->map->port,
+		.pin = ch->map->pin,
+		.result = *r,
+	};
+	usb_event_post(EVENT_MEAS, &event, sizeof(event));
+	ch->phase = MEAS_WAIT;
+}
+
+/*
+ * Called every millisecond by the SysTick handler
+ */
+void meas_tick()
+{
+	for(int i=0;i<MEAS_CHANNELS+1;i++) {
+		meas_channel_t* ch = &channels[i];
+		switch(ch->phase) {
+		case MEAS_START:
+			start_count(ch);
+			break;
+		case MEAS_COUNT:
+			count_tick(ch);
+			break;
+		case MEAS_SAMPLE:
+			sample_tick(ch);
+			break;
+		case MEAS_WAIT:
+			if(++ch->ticks >= ch->interval_ms)
+				start_count(ch);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * Connects the pin to a free timer and starts measuring. phase is written last.
+ */
+static int meas_start(meas_channel_t* ch, char port, uint8_t pin, uint32_t gate_ms, uint32_t interval_ms)
+{
+	if(ch->phase != MEAS_IDLE)
+		return ERROR_MEAS_BUSY;
+	if(gpio_port(port) == NULL || pin > 15 || gate_ms == 0 || gate_ms > MEAS_MAX_GATE_MS)
+		return ERROR_GPIO_PARAMETER;
+
+	const tim_pin_t* map = tim_pin_lookup(port, pin, TIM_OWNER_NONE, TIM_CHANNEL_MASK(1) | TIM_CHANNEL_MASK(2));
+	if(map == NULL)
+		return ERROR_TIM_NO_CHANNEL;
+	int res = tim_claim(map->tim, TIM_OWNER_MEAS);
+	if(res < 0)
+		return res;
+
+	res = tim_pin_connect(map);
+	if(res < 0) {
+		tim_release(map->tim, TIM_OWNER_MEAS);
+		return res;
+	}
+	ch->map = map;
+	ch->gate_ms = gate_ms;
+	ch->interval_ms = interval_ms;
+	ch->phase = MEAS_START;
+	return 0;
+}
+
+static void meas_stop(meas_channel_t* ch)
+{
+	if(ch->phase == MEAS_IDLE)
+		return;
+	ch->phase = MEAS_IDLE;
+	tim_pin_disconnect(ch->map);
+	tim_release(ch->map->tim, TIM_OWNER_MEAS);
+}
+
+/*
+ * Executes a measurement request and fills in the reply. Returns the reply length in bytes.
+ * MEAS_RUN is deferred: it waits for the end of the gate.
+ */
+int meas_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case MEAS_RUN:
+		const meas_run_request_t* run = (const meas_run_request_t*)request;
+		meas_channel_t* ch = &channels[MEAS_CHANNELS];
+		if(request->length < sizeof(*run)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		*result = meas_start(ch, run->port, run->pin, run->gate_ms, 0);
+		if(*result < 0)
+			return sizeof(*result);
+		while(ch->phase != MEAS_DONE)
+			__WFI();
+		*(meas_result_t*)(reply + sizeof(*result)) = ch->result;
+		meas_stop(ch);
+		return sizeof(*result) + sizeof(meas_result_t);
+
+	case MEAS_STREAM:
+		const meas_stream_request_t* stream = (const meas_stream_request_t*)request;
+		if(request->length < sizeof(*stream))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(stream->channel >= MEAS_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			*result = meas_start(&channels[stream->channel], stream->port, stream->pin,
+					stream->gate_ms, stream->interval_ms > stream->gate_ms ? stream->interval_ms : stream->gate_ms);
+		return sizeof(*result);
+
+	case MEAS_STOP:
+		const meas_stop_request_t* stop = (const meas_stop_request_t*)request;
+		if(request->length < sizeof(*stop))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(stop->channel >= MEAS_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			meas_stop(&channels[stop->channel]);
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,365 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "motion.h"
+#include "mcu_init.h"
+#include <math.h>
+#include <stddef.h>
+
+typedef struct {
+	GPIO_TypeDef* step_port;	// NULL if the axis is not configured
+	uint32_t step_on;			// BSRR values of the step pin
+	uint32_t step_off;
+	GPIO_TypeDef* dir_port;
+	uint32_t dir_mask;
+	uint8_t flags;
+	uint8_t pins[6];			// claimed step, dir and enable pins as port and pin pairs, port 0 if unused
+} axis_t;
+
+typedef struct {
+	int32_t steps[MOTION_AXES];
+	uint32_t n;					// steps of the leading axis
+	uint32_t ramp;				// acceleration steps, the deceleration is symmetric
+	float v2_start;				// squared speeds
+	float v2_peak;
+	uint8_t profile;
+} move_t;
+
+static axis_t axes[MOTION_AXES];
+static volatile int32_t position[MOTION_AXES];
+static uint32_t pulse_ticks = TIM2_CLK_HZ / 500000;	// 2 us
+
+/* Moves are added at head by the requests and executed from tail by the interrupt */
+static move_t queue[MOTION_QUEUE];
+static volatile uint32_t head;
+static volatile uint32_t tail;
+static volatile int running;
+
+/* State of the current move, owned by the interrupt */
+static move_t* cur;
+static uint32_t done;			// steps of the leading axis
+static uint32_t errors[MOTION_AXES];
+static uint32_t step_time;		// TIM2 time of the next step
+static int pulse_high;
+static volatile uint32_t speed;
+
+static inline int before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static void arm(uint32_t time)
+{
+	LL_TIM_OC_SetCompareCH3(TIM2, time);
+	LL_TIM_ClearFlag_CC3(TIM2);
+	if(!before(LL_TIM_GetCounter(TIM2), time))
+		NVIC_SetPendingIRQ(TIM2_IRQn);
+}
+
+/*
+ * Interval in TIM2 ticks before step i of the move
+ */
+static uint32_t step_interval(const move_t* m, uint32_t i)
+{
+	uint32_t u = i < m->n-1-i ? i : m->n-1-i;
+	float v2 = m->v2_peak;
+	if(u < m->ramp) {
+		float x = (float)u / m->ramp;
+		if(m->profile == MOTION_S_CURVE)
+			x = x*x*(3.0f - 2.0f*x);
+		v2 = m->v2_start + (m->v2_peak - m->v2_start) * x;
+	}
+	float v = sqrtf(v2);
+	speed = v;
+	return TIM2_CLK_HZ / v;
+}
+
+/*
+ * Starts the move at tail. Called by the interrupt, or with it disabled.
+ */
+static void start_move(uint32_t now)
+{
+	cur = &queue[tail % MOTION_QUEUE];
+	done = 0;
+	for(int i=0;i<MOTION_AXES;i++) {
+		errors[i] = cur->n / 2;
+		if(cur->steps[i] != 0) {
+			int high = (cur->steps[i] < 0) != ((axes[i].flags & MOTION_DIR_INVERT) != 0);
+			axes[i].dir_port->BSRR = high ? axes[i].dir_mask : axes[i].dir_mask << 16;
+		}
+	}
+	pulse_high = 0;
+	step_time = now + step_interval(cur, 0);
+	arm(step_time);
+	LL_TIM_EnableIT_CC3(TIM2);
+}
+
+/*
+ * TIM2 channel 3 compare interrupt: a step, then the end of its pulse
+ */
+void motion_isr()
+{
+	LL_TIM_ClearFlag_CC3(TIM2);
+	if(!running)
+		return;
+
+	if(pulse_high) {
+		for(int i=0;i<MOTION_AXES;i++)
+			if(axes[i].step_port != NULL)
+				axes[i].step_port->BSRR = axes[i].step_off;
+		pulse_high = 0;
+		if(done < cur->n) {
+			arm(step_time);
+			return;
+		}
+		tail++;
+		if(tail != head)
+			start_move(LL_TIM_GetCounter(TIM2));
+		else {
+			LL_TIM_DisableIT_CC3(TIM2);
+			speed = 0;
+			running = 0;
+		}
+		return;
+	}
+
+	for(int i=0;i<MOTION_AXES;i++) {
+		int32_t steps = cur->steps[i];
+		if(steps == 0)
+			continue;
+		errors[i] += steps < 0 ? -steps : steps;
+		if(errors[i] >= cur->n) {
+			errors[i] -= cur->n;
+			axes[i].step_port->BSRR = axes[i].step_on;
+			position[i] += steps < 0 ? -1 : 1;
+		}
+	}
+	uint32_t now = step_time;
+	done++;
+	if(done < cur->n)
+		step_time += step_interval(cur, done);
+	pulse_high = 1;
+	arm(now + pulse_ticks);
+}
+
+/*
+ * Gives back the pins of an axis, except those another axis still uses
+ */
+static void release_pins(int axis)
+{
+	uint8_t* pins = axes[axis].pins;
+	for(int i=0;i<6;i+=2) {
+		if(pins[i] == 0)
+			continue;
+		int shared = 0;
+		for(int j=0;j<MOTION_AXES;j++)
+			for(int k=0;k<6;k+=2)
+				if(j != axis && axes[j].pins[k] == pins[i] && axes[j].pins[k+1] == pins[i+1])
+					shared = 1;
+		if(!shared)
+			gpio_release(pins[i], pins[i+1], PIN_OWNER_MOTION);
+		pins[i] = 0;
+	}
+}
+
+/*
+ * Claims the step, dir and enable pins of the configuration for an axis. Nothing stays claimed on failure.
+ */
+static int claim_pins(int axis, const motion_config_request_t* config)
+{
+	const uint8_t* pin = &config->step_port;
+	int res = 0;
+	for(int i=0;i<6 && res == 0;i+=2)
+		if(pin[i] != 0) {
+			res = gpio_claim(pin[i], pin[i+1], PIN_OWNER_MOTION);
+			if(res == 0) {
+				axes[axis].pins[i] = pin[i];
+				axes[axis].pins[i+1] = pin[i+1];
+			}
+		}
+	if(res != 0)
+		release_pins(axis);
+	return res;
+}
+
+static int motion_config(const motion_config_request_t* config)
+{
+	if(config->axis >= MOTION_AXES || config->pulse_ns < 100 || config->pulse_ns > 100000)
+		return ERROR_GPIO_PARAMETER;
+	GPIO_TypeDef* step_port = gpio_port(config->step_port);
+	GPIO_TypeDef* dir_port = gpio_port(config->dir_port);
+	GPIO_TypeDef* enable_port = gpio_port(config->enable_port);
+	if(step_port == NULL || config->step_pin > 15 || dir_port == NULL || config->dir_pin > 15
+			|| (config->enable_port != 0 && (enable_port == NULL || config->enable_pin > 15)))
+		return ERROR_GPIO_PARAMETER;
+	if(running)
+		return ERROR_MOTION_BUSY;
+
+	/* the pins of the previous configuration are given back before the new ones are claimed */
+	axis_t* a = &axes[config->axis];
+	a->step_port = NULL;
+	release_pins(config->axis);
+	int res = claim_pins(config->axis, config);
+	if(res != 0)
+		return res;
+
+	uint32_t step_mask = 1U << config->step_pin;
+	a->step_port = step_port;
+	a->step_on = (config->flags & MOTION_STEP_LOW) ? step_mask << 16 : step_mask;
+	a->step_off = (config->flags & MOTION_STEP_LOW) ? step_mask : step_mask << 16;
+	a->dir_port = dir_port;
+	a->dir_mask = 1U << config->dir_pin;
+	a->flags = config->flags;
+	position[config->axis] = 0;
+	pulse_ticks = (uint64_t)config->pulse_ns * (TIM2_CLK_HZ/1000000) / 1000;
+
+	step_port->BSRR = a->step_off;
+	LL_GPIO_SetPinOutputType(step_port, step_mask, LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinSpeed(step_port, step_mask, LL_GPIO_SPEED_FREQ_HIGH);
+	gpio_mode(config->step_port, config->step_pin, LL_GPIO_MODE_OUTPUT, PIN_OWNER_MOTION);
+	LL_GPIO_SetPinOutputType(dir_port, a->dir_mask, LL_GPIO_OUTPUT_PUSHPULL);
+	gpio_mode(config->dir_port, config->dir_pin, LL_GPIO_MODE_OUTPUT, PIN_OWNER_MOTION);
+	if(enable_port != NULL) {
+		uint32_t enable_mask = 1U << config->enable_pin;
+		if(config->flags & MOTION_ENABLE_HIGH)
+			LL_GPIO_SetOutputPin(enable_port, enable_mask);
+		else
+			LL_GPIO_ResetOutputPin(enable_port, enable_mask);
+		LL_GPIO_SetPinOutputType(enable_port, enable_mask, LL_GPIO_OUTPUT_PUSHPULL);
+		gpio_mode(config->enable_port, config->enable_pin, LL_GPIO_MODE_OUTPUT, PIN_OWNER_MOTION);
+	}
+
+	NVIC_SetPriority(TIM2_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), MOTION_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(TIM2_IRQn);
+	return 0;
+}
+
+static int motion_move(const motion_move_request_t* move)
+{
+	if(move->profile > MOTION_S_CURVE)
+		return ERROR_GPIO_PARAMETER;
+	if(move->start_speed == 0 || move->start_speed > move->max_speed || move->accel == 0
+			|| TIM2_CLK_HZ / move->max_speed <= 2*pulse_ticks)
+		return ERROR_MOTION_SPEED;
+
+	uint32_t n = 0;
+	for(int i=0;i<MOTION_AXES;i++) {
+		uint32_t steps = move->steps[i] < 0 ? -move->steps[i] : move->steps[i];
+		if(steps != 0 && axes[i].step_port == NULL)
+			return ERROR_MOTION_AXIS;
+		if(steps > n)
+			n = steps;
+	}
+	if(n == 0)
+		return 0;
+	if(head - tail >= MOTION_QUEUE)
+		return ERROR_MOTION_QUEUE_FULL;
+
+	move_t* m = &queue[head % MOTION_QUEUE];
+	for(int i=0;i<MOTION_AXES;i++)
+		m->steps[i] = move->steps[i];
+	m->n = n;
+	m->profile = move->profile;
+	m->v2_start = (float)move->start_speed * move->start_speed;
+	m->v2_peak = (float)move->max_speed * move->max_speed;
+	m->ramp = ceilf((m->v2_peak - m->v2_start) / (2.0f * move->accel));
+	if(m->ramp > n/2) {
+		m->ramp = n/2;
+		m->v2_peak = m->v2_start + 2.0f * move->accel * m->ramp;
+	}
+	head++;
+
+	if(!running) {
+		NVIC_DisableIRQ(TIM2_IRQn);
+		running = 1;
+		start_move(LL_TIM_GetCounter(TIM2));
+		NVIC_EnableIRQ(TIM2_IRQn);
+	}
+	return 0;
+}
+
+static void motion_stop(uint8_t flags)
+{
+	NVIC_DisableIRQ(TIM2_IRQn);
+	if(running && (flags & MOTION_DECELERATE)) {
+		head = tail + 1;
+		/* ends the move after as many steps as it took to reach the current speed */
+		uint32_t ramp = done < cur->ramp ? done : cur->ramp;
+		if(done + ramp + 1 < cur->n)
+			cur->n = done + ramp + 1;
+	}
+	else {
+		LL_TIM_DisableIT_CC3(TIM2);
+		for(int i=0;i<MOTION_AXES;i++)
+			if(axes[i].step_port != NULL)
+				axes[i].step_port->BSRR = axes[i].step_off;
+		tail = head;
+		speed = 0;
+		running = 0;
+	}
+	NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+/*
+ * Executes a motion request and fills in the reply. Returns the reply length in bytes.
+ */
+int motion_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case MOTION_CONFIG:
+		const motion_config_request_t* config = (const motion_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = motion_config(config);
+		return sizeof(*result);
+
+	case MOTION_MOVE:
+		const motion_move_request_t* move = (const motion_move_request_t*)request;
+		uint32_t* free_entries = (uint32_t*)(reply + sizeof(*result));
+		if(request->length < sizeof(*move))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = motion_move(move);
+		*free_entries = MOTION_QUEUE - (head - tail);
+		return sizeof(*result) + sizeof(*free_entries);
+
+	case MOTION_STOP:
+		const motion_stop_request_t* stop = (const motion_stop_request_t*)request;
+		if(request->length < sizeof(*stop))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			motion_stop(stop->flags);
+		return sizeof(*result);
+
+	case MOTION_STATUS:
+		motion_status_t* status = (motion_status_t*)(reply + sizeof(*result));
+		for(int i=0;i<MOTION_AXES;i++)
+			status->position[i] = position[i];
+		status->queued = head - tail;
+		status->speed = speed;
+		return sizeof(*result) + sizeof(*status);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,390 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "par.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include <string.h>
+
+/*
+ * Output pin driven through BSRR: on and off are the BSRR values of its active and inactive levels
+ */
+typedef struct {
+	GPIO_TypeDef* port;
+	uint32_t on;
+	uint32_t off;
+} par_pin_t;
+
+static struct {
+	GPIO_TypeDef* data;
+	uint32_t mask;				// data pins
+	uint32_t moder_mask;		// MODER bits of the data pins
+	uint32_t moder_output;
+	uint8_t shift;
+	uint8_t bytes;				// per bus word
+	par_pin_t write_strobe;
+	par_pin_t read_strobe;
+	par_pin_t rw;				// 6800 R/W, on for reads
+	par_pin_t cs;
+	par_pin_t dc;				// on for commands
+	uint16_t setup_loops;
+	uint16_t strobe_loops;
+	uint16_t hold_loops;
+	uint32_t dma_ticks;			// TIM16 ticks per half bus cycle, 0 without DMA
+} bus;
+
+/* Pins claimed by the configuration: port and pin of each strobe as in par_config_request_t, then the data pins */
+static uint8_t claimed_strobes[8];
+static uint8_t claimed_port;
+static uint32_t claimed_mask;
+
+/* BSRR values of a bus cycle paced by DMA: the data with the write strobe active, then the strobe inactive */
+static uint32_t dma_words[2*PAR_DMA_UNITS];
+
+static inline void spin(uint32_t loops)
+{
+	for(uint32_t i=loops;i>0;i--)
+		__NOP();
+}
+
+static inline void pin_set(const par_pin_t* p, int on)
+{
+	if(p->port != NULL)
+		p->port->BSRR = on ? p->on : p->off;
+}
+
+/*
+ * Sets up an output pin at its inactive level. port 0 leaves the pin unused.
+ */
+static int pin_setup(par_pin_t* p, uint8_t port, uint8_t pin, int active_high)
+{
+	p->port = NULL;
+	if(port == 0)
+		return 0;
+	GPIO_TypeDef* gport = gpio_port(port);
+	if(gport == NULL || pin > 15)
+		return ERROR_GPIO_PARAMETER;
+
+	uint32_t pin_mask = 1U << pin;
+	p->port = gport;
+	p->on = active_high ? pin_mask : pin_mask << 16;
+	p->off = active_high ? pin_mask << 16 : pin_mask;
+	gport->BSRR = p->off;
+	LL_GPIO_SetPinOutputType(gport, pin_mask, LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinSpeed(gport, pin_mask, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	gpio_mode(port, pin, LL_GPIO_MODE_OUTPUT, PIN_OWNER_PAR);
+	return 0;
+}
+
+static void release_pins()
+{
+	for(int i=0;i<4;i++)
+		if(claimed_strobes[2*i] != 0)
+			gpio_release(claimed_strobes[2*i], claimed_strobes[2*i+1], PIN_OWNER_PAR);
+	for(uint8_t pin=0;pin<16;pin++)
+		if(claimed_mask & (1U << pin))
+			gpio_release(claimed_port, pin, PIN_OWNER_PAR);
+	memset(claimed_strobes, 0, sizeof(claimed_strobes));
+	claimed_mask = 0;
+}
+
+/*
+ * Claims the strobes and the data pins of mask. Nothing stays claimed on failure.
+ */
+static int claim_pins(const par_config_request_t* config, uint32_t mask)
+{
+	const uint8_t* strobe = &config->wr_port;
+	int res = 0;
+	for(int i=0;i<4 && res == 0;i++)
+		if(strobe[2*i] != 0) {
+			res = gpio_claim(strobe[2*i], strobe[2*i+1], PIN_OWNER_PAR);
+			if(res == 0) {
+				claimed_strobes[2*i] = strobe[2*i];
+				claimed_strobes[2*i+1] = strobe[2*i+1];
+			}
+		}
+	claimed_port = config->data_port;
+	for(uint8_t pin=0;pin<16 && res == 0;pin++)
+		if(mask & (1U << pin)) {
+			res = gpio_claim(config->data_port, pin, PIN_OWNER_PAR);
+			if(res == 0)
+				claimed_mask |= 1U << pin;
+		}
+	if(res != 0)
+		release_pins();
+	return res;
+}
+
+static int par_config(const par_config_request_t* config)
+{
+	GPIO_TypeDef* data = gpio_port(config->data_port);
+	if(data == NULL || config->mode > PAR_6800 || (config->width != 8 && config->width != 16)
+			|| (config->width == 8 ? config->data_shift != 0 && config->data_shift != 8 : config->data_shift != 0))
+		return ERROR_GPIO_PARAMETER;
+	if(config->wr_port == 0)
+		return ERROR_PAR_CONFIG;
+
+	/* the strobes must not be data pins */
+	uint32_t mask = (config->width == 8 ? 0xFFU : 0xFFFFU) << config->data_shift;
+	const uint8_t* strobe = &config->wr_port;
+	for(int i=0;i<4;i++)
+		if(strobe[2*i] != 0 && gpio_port(strobe[2*i]) == data && strobe[2*i+1] < 16 && (mask & (1U << strobe[2*i+1])))
+			return ERROR_PAR_CONFIG;
+	if(config->dma_period_ns != 0 && gpio_port(config->wr_port) != data)
+		return ERROR_PAR_CONFIG;
+
+	uint32_t dma_ticks = (uint64_t)config->dma_period_ns * (TIM_CLK_HZ/1000000) / 2000;
+	if(config->dma_period_ns != 0 && (dma_ticks < 8 || dma_ticks > 65536))
+		return ERROR_PAR_TIMING;
+
+	/* the pins of the previous configuration are given back before the new ones are claimed */
+	bus.data = NULL;
+	release_pins();
+	int res = claim_pins(config, mask);
+	if(res != 0)
+		return res;
+
+	if(config->mode == PAR_8080) {
+		res |= pin_setup(&bus.write_strobe, config->wr_port, config->wr_pin, 0);
+		res |= pin_setup(&bus.read_strobe, config->rd_port, config->rd_pin, 0);
+		bus.rw.port = NULL;
+	}
+	else {
+		res |= pin_setup(&bus.write_strobe, config->wr_port, config->wr_pin, 1);
+		bus.read_strobe = bus.write_strobe;
+		res |= pin_setup(&bus.rw, config->rd_port, config->rd_pin, 1);
+	}
+	res |= pin_setup(&bus.cs, config->cs_port, config->cs_pin, 0);
+	res |= pin_setup(&bus.dc, config->dc_port, config->dc_pin, 0);
+	if(res != 0) {
+		release_pins();
+		return ERROR_GPIO_PARAMETER;
+	}
+
+	bus.mask = mask;
+	bus.shift = config->data_shift;
+	bus.bytes = config->width / 8;
+	bus.moder_mask = 0;
+	bus.moder_output = 0;
+	for(int i=0;i<16;i++)
+		if(mask & (1U << i)) {
+			bus.moder_mask |= 3U << (2*i);
+			bus.moder_output |= LL_GPIO_MODE_OUTPUT << (2*i);
+		}
+	bus.setup_loops = config->setup_loops;
+	bus.strobe_loops = config->strobe_loops;
+	bus.hold_loops = config->hold_loops;
+	bus.dma_ticks = dma_ticks;
+
+	data->BSRR = mask << 16;
+	LL_GPIO_SetPinOutputType(data, mask, LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinSpeed(data, mask, LL_GPIO_SPEED_FREQ_VERY_HIGH);
+	for(uint8_t pin=0;pin<16;pin++)
+		if(mask & (1U << pin))
+			gpio_mode(config->data_port, pin, LL_GPIO_MODE_OUTPUT, PIN_OWNER_PAR);
+	bus.data = data;
+	return 0;
+}
+
+static inline uint32_t data_bsrr(uint32_t value)
+{
+	uint32_t bits = (value << bus.shift) & bus.mask;
+	return bits | ((~bits & bus.mask) << 16);
+}
+
+static uint32_t get_word(const uint8_t* data)
+{
+	return bus.bytes == 1 ? data[0] : data[0] | (data[1] << 8);
+}
+
+static void write_cpu(const uint8_t* data, uint32_t count)
+{
+	for(uint32_t i=0;i<count;i++) {
+		bus.data->BSRR = data_bsrr(get_word(data + i*bus.bytes));
+		spin(bus.setup_loops);
+		pin_set(&bus.write_strobe, 1);
+		spin(bus.strobe_loops);
+		pin_set(&bus.write_strobe, 0);
+		spin(bus.hold_loops);
+	}
+}
+
+/*
+ * Writes through TIM16 update DMA requests, one BSRR word every half bus cycle
+ */
+static int write_dma(const uint8_t* data, uint32_t count)
+{
+	LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM16);
+	LL_TIM_DisableCounter(TIM16);
+	LL_TIM_SetPrescaler(TIM16, 0);
+	LL_TIM_SetAutoReload(TIM16, bus.dma_ticks - 1);
+	LL_TIM_GenerateEvent_UPDATE(TIM16);
+
+	while(count > 0) {
+		uint32_t n = count < PAR_DMA_UNITS ? count : PAR_DMA_UNITS;
+		for(uint32_t i=0;i<n;i++) {
+			dma_words[2*i] = data_bsrr(get_word(data + i*bus.bytes)) | bus.write_strobe.on;
+			dma_words[2*i+1] = bus.write_strobe.off;
+		}
+
+		LL_TIM_SetCounter(TIM16, 0);
+		WRITE_REG(TIM16->SR, 0);
+		dma_start(DMA_PAR, DMA_REQUEST_TIM16_UP, &bus.data->BSRR, dma_words, 2*n*sizeof(uint32_t), DMA_TO_PERIPH | DMA_WIDTH_32);
+		SET_BIT(TIM16->DIER, TIM_DIER_UDE);
+		LL_TIM_EnableCounter(TIM16);
+
+		int res = 0;
+		uint32_t timeout_us = (uint64_t)bus.dma_ticks * 2 * n / (TIM_CLK_HZ/1000000) + 1000;
+		uint32_t start = LL_TIM_GetCounter(TIM5);
+		while(dma_status(DMA_PAR) == 0)
+			if(LL_TIM_GetCounter(TIM5) - start > timeout_us)
+				break;
+		if(dma_status(DMA_PAR) != 1)
+			res = ERROR_PAR_DMA;
+
+		LL_TIM_DisableCounter(TIM16);
+		WRITE_REG(TIM16->DIER, 0);
+		dma_stop(DMA_PAR);
+		if(res != 0) {
+			pin_set(&bus.write_strobe, 0);
+			return res;
+		}
+		spin(bus.hold_loops);
+		data += n*bus.bytes;
+		count -= n;
+	}
+	return 0;
+}
+
+static void read_cpu(uint8_t* rx, uint32_t count)
+{
+	pin_set(&bus.rw, 1);
+	CLEAR_BIT(bus.data->MODER, bus.moder_mask);
+	for(uint32_t i=0;i<count;i++) {
+		spin(bus.setup_loops);
+		pin_set(&bus.read_strobe, 1);
+		spin(bus.strobe_loops);
+		uint32_t value = (bus.data->IDR & bus.mask) >> bus.shift;
+		pin_set(&bus.read_strobe, 0);
+		rx[i*bus.bytes] = value;
+		if(bus.bytes == 2)
+			rx[i*bus.bytes + 1] = value >> 8;
+		spin(bus.hold_loops);
+	}
+	MODIFY_REG(bus.data->MODER, bus.moder_mask, bus.moder_output);
+	pin_set(&bus.rw, 0);
+}
+
+static uint32_t data_length(const par_command_t* command)
+{
+	return command->opcode == PAR_WRITE ? command->count * bus.bytes : 0;
+}
+
+static uint32_t reply_length(const par_command_t* command)
+{
+	return command->opcode == PAR_READ ? command->count * bus.bytes : 0;
+}
+
+/*
+ * Executes a parallel bus request and fills in the reply. Returns the reply length in bytes.
+ * PAR_RUN is deferred. The whole command buffer is checked before the first command is executed.
+ */
+int par_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case PAR_CONFIG:
+		const par_config_request_t* config = (const par_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = par_config(config);
+		return sizeof(*result);
+
+	case PAR_RUN:
+		const par_run_request_t* run = (const par_run_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*run)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		if(bus.data == NULL) {
+			*result = ERROR_PAR_CONFIG;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(run + 1);
+		uint32_t rx_total = 0;
+		while(p < end) {
+			const par_command_t* command = (const par_command_t*)p;
+			if(p + sizeof(*command) > end || p + sizeof(*command) + data_length(command) > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			if(command->opcode == 0 || command->opcode >= PAR_OPCODE_COUNT) {
+				*result = ERROR_PAR_COMMAND;
+				return sizeof(*result);
+			}
+			rx_total += reply_length(command);
+			p += sizeof(*command) + data_length(command);
+		}
+		if(rx_total > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		uint8_t* rx = (uint8_t*)(executed + 1);
+		memset(rx, 0, rx_total);
+		pin_set(&bus.cs, 1);
+		p = (const uint8_t*)(run + 1);
+		while(p < end && *result == 0) {
+			const par_command_t* command = (const par_command_t*)p;
+			const uint8_t* data = p + sizeof(*command);
+			pin_set(&bus.dc, command->flags & PAR_COMMAND);
+			switch(command->opcode) {
+			case PAR_WRITE:
+				if(bus.dma_ticks != 0)
+					*result = write_dma(data, command->count);
+				else
+					write_cpu(data, command->count);
+				break;
+			case PAR_READ:
+				read_cpu(rx, command->count);
+				break;
+			case PAR_DELAY_US:
+				delay_us(command->count);
+				break;
+			}
+			if(*result == 0)
+				(*executed)++;
+			rx += reply_length(command);
+			p += sizeof(*command) + data_length(command);
+		}
+		pin_set(&bus.dc, 0);
+		pin_set(&bus.cs, 0);
+		return (uint8_t*)(executed + 1) - reply + rx_total;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
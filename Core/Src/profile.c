@@ -0,0 +1,318 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "profile.h"
+#include "mcu_init.h"
+#include "usb.h"
+#include <stddef.h>
+#include <string.h>
+
+#define PROFILE_MAGIC			0x50524F46	// "PROF"
+#define FLASH_KEY1				0x45670123
+#define FLASH_KEY2				0xCDEF89AB
+#define FLASH_ERRORS			(FLASH_SR_WRPERR | FLASH_SR_PGSERR | FLASH_SR_STRBERR | FLASH_SR_INCERR)
+
+typedef struct {
+	uint32_t magic;
+	uint32_t crc;		// of the rest of the store, from boot
+	uint8_t boot;
+	uint8_t reserved[7];
+	profile_t profiles[PROFILE_SLOTS];
+} profile_store_t;
+
+_Static_assert(sizeof(profile_t) == 1024, "profile_t must stay 1 KB");
+_Static_assert(sizeof(profile_store_t) % 16 == 0 && sizeof(profile_store_t) <= FLASH_SECTOR_SIZE, "the store must fit the sector in quad-words");
+
+static const profile_store_t* const flash_store = (const profile_store_t*)PROFILE_FLASH_ADDRESS;
+static profile_store_t image __attribute__((aligned(16)));	// store being rewritten
+static uint8_t scratch[REQUEST_MAX_LENGTH] __attribute__((aligned(4)));	// replies of the replayed requests
+
+static uint32_t crc32(const uint8_t* data, uint32_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	while(length--) {
+		crc ^= *data++;
+		for(int i=0;i<8;i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint32_t store_crc(const profile_store_t* store)
+{
+	return crc32(&store->boot, sizeof(*store) - offsetof(profile_store_t, boot));
+}
+
+/*
+ * The store is valid once written: an erased or half written sector holds no profile
+ */
+static int store_valid()
+{
+	return flash_store->magic == PROFILE_MAGIC && flash_store->crc == store_crc(flash_store);
+}
+
+static const profile_t* stored_profile(uint8_t slot)
+{
+	if(slot >= PROFILE_SLOTS || !store_valid() || flash_store->profiles[slot].name[0] == 0)
+		return NULL;
+	return &flash_store->profiles[slot];
+}
+
+static int flash_wait()
+{
+	while(FLASH->NSSR & (FLASH_SR_BSY | FLASH_SR_WBNE | FLASH_SR_DBNE));
+	uint32_t errors = FLASH->NSSR & FLASH_ERRORS;
+	FLASH->NSCCR = errors | FLASH_SR_EOP;
+	return errors ? ERROR_PROFILE_FLASH : 0;
+}
+
+/*
+ * Erases the profile sector and programs it with the image, one quad-word at a time.
+ * The code runs from bank 1, so it keeps being fetched while bank 2 is busy.
+ */
+static int store_write()
+{
+	image.magic = PROFILE_MAGIC;
+	image.crc = store_crc(&image);
+
+	if(FLASH->NSCR & FLASH_CR_LOCK) {
+		FLASH->NSKEYR = FLASH_KEY1;
+		FLASH->NSKEYR = FLASH_KEY2;
+	}
+	int res = flash_wait();
+	if(res == 0) {
+		FLASH->NSCR = FLASH_CR_SER | FLASH_CR_BKSEL | (PROFILE_FLASH_SECTOR << FLASH_CR_SNB_Pos);
+		FLASH->NSCR |= FLASH_CR_START;
+		res = flash_wait();
+	}
+	if(res == 0) {
+		FLASH->NSCR = FLASH_CR_PG;
+		const uint32_t* src = (const uint32_t*)&image;
+		volatile uint32_t* dst = (volatile uint32_t*)PROFILE_FLASH_ADDRESS;
+		for(uint32_t i=0;i<sizeof(image)/4 && res == 0;i+=4) {
+			dst[i] = src[i];
+			dst[i+1] = src[i+1];
+			dst[i+2] = src[i+2];
+			dst[i+3] = src[i+3];
+			res = flash_wait();
+		}
+	}
+	FLASH->NSCR = FLASH_CR_LOCK;
+
+	/* no cache invalidation: the sector is not cacheable, see Cache_Init() */
+	if(res == 0 && !store_valid())
+		res = ERROR_PROFILE_FLASH;
+	return res;
+}
+
+/*
+ * Copies the store to the image, or starts an empty one
+ */
+static void image_load()
+{
+	if(store_valid())
+		memcpy(&image, flash_store, sizeof(image));
+	else {
+		memset(&image, 0, sizeof(image));
+		image.boot = PROFILE_NONE;
+	}
+}
+
+/*
+ * Only the requests that configure or start an engine are stored: one-shot actions, queries and
+ * requests with absolute times would block the boot or be meaningless after a reset.
+ */
+static int replayable(uint32_t operation)
+{
+	switch(operation) {
+	case PORT_CONFIG:
+	case EDGE_CONFIG:
+	case PWM_CONFIG:
+	case I3C_CONFIG:
+	case UART_CONFIG:
+	case ADC_CONFIG:
+	case ADC_START:
+	case DAC_START:
+	case COUNTER_START:
+	case ROUTE_CONFIG:
+	case ROUTE_ENABLE:
+	case PULSE_START:
+	case PAR_CONFIG:
+	case MOTION_CONFIG:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Stored requests must be complete and replayable
+ */
+static int requests_valid(const uint8_t* requests, uint32_t length)
+{
+	const uint8_t* end = requests + length;
+	while(requests < end) {
+		const request_header_t* r = (const request_header_t*)requests;
+		if(requests + sizeof(*r) > end || r->length < sizeof(*r) || requests + r->length > end)
+			return 0;
+		if(!replayable(r->operation))
+			return 0;
+		requests += r->length;
+	}
+	return 1;
+}
+
+static int profile_save(const profile_save_request_t* save)
+{
+	uint32_t length = save->header.length - sizeof(*save);
+	if(save->slot >= PROFILE_SLOTS)
+		return ERROR_PROFILE_SLOT;
+	if(length > PROFILE_REQUESTS_SIZE)
+		return ERROR_REQUEST_LENGTH;
+	if(!requests_valid(save->requests, length))
+		return ERROR_PROFILE_REQUEST;
+
+	image_load();
+	profile_t* p = &image.profiles[save->slot];
+	memset(p, 0, sizeof(*p));
+	if(save->name[0] != 0) {
+		memcpy(p->name, save->name, PROFILE_NAME_LENGTH);
+		p->name[PROFILE_NAME_LENGTH-1] = 0;
+		for(int i=0;i<PROFILE_PORTS;i++)
+			if(save->flags & PROFILE_CAPTURE) {
+				uint16_t levels;
+				gpio_port_read('a' + i, &p->ports[i].config, &levels);
+				p->ports[i].levels = levels;
+			}
+			else
+				p->ports[i] = save->ports[i];
+		p->requests_length = length;
+		memcpy(p->requests, save->requests, length);
+	}
+	else if(image.boot == save->slot)
+		image.boot = PROFILE_NONE;
+	return store_write();
+}
+
+static int profile_select(uint8_t slot)
+{
+	if(slot != PROFILE_NONE && stored_profile(slot) == NULL)
+		return ERROR_PROFILE_SLOT;
+	image_load();
+	image.boot = slot;
+	return store_write();
+}
+
+/*
+ * Configures the ports, then replays the requests. Stops at the first request that fails,
+ * and returns its result with its index in failed.
+ */
+static int profile_apply(uint8_t slot, uint32_t* failed)
+{
+	const profile_t* p = stored_profile(slot);
+	*failed = 0;
+	if(p == NULL)
+		return ERROR_PROFILE_SLOT;
+
+	for(int i=0;i<PROFILE_PORTS;i++)
+		if(p->ports[i].config.mask != 0) {
+			uint16_t levels = p->ports[i].levels;
+			int res = gpio_port_config(&p->ports[i].config, &levels);
+			if(res < 0)
+				return res;
+		}
+
+	const uint8_t* r = p->requests;
+	const uint8_t* end = p->requests + p->requests_length;
+	while(r < end) {
+		const request_header_t* request = (const request_header_t*)r;
+		usb_execute(request, scratch);
+		int32_t res = *(int32_t*)scratch;
+		if(res < 0)
+			return res;
+		r += request->length;
+		(*failed)++;
+	}
+	*failed = 0;
+	return 0;
+}
+
+/*
+ * Applies the boot profile, unless the user button is held down during the reset
+ */
+void profile_boot()
+{
+	if(!store_valid() || flash_store->boot == PROFILE_NONE || LL_GPIO_IsInputPinSet(USER_BUTTON_GPIO_Port, USER_BUTTON_Pin))
+		return;
+	uint32_t failed;
+	profile_apply(flash_store->boot, &failed);
+}
+
+/*
+ * Executes a profile request and fills in the reply. Returns the reply length in bytes.
+ * PROFILE_SAVE, PROFILE_BOOT and PROFILE_APPLY are deferred.
+ */
+int profile_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	switch(request->operation) {
+
+	case PROFILE_SAVE:
+		const profile_save_request_t* save = (const profile_save_request_t*)request;
+		if(request->length < sizeof(*save))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = profile_save(save);
+		return sizeof(*result);
+
+	case PROFILE_LIST:
+		profile_list_reply_t* list = (profile_list_reply_t*)(reply + sizeof(*result));
+		memset(list, 0, sizeof(*list));
+		list->boot = PROFILE_NONE;
+		if(store_valid()) {
+			list->boot = flash_store->boot;
+			for(int i=0;i<PROFILE_SLOTS;i++)
+				memcpy(list->names[i], flash_store->profiles[i].name, PROFILE_NAME_LENGTH);
+		}
+		*result = 0;
+		return sizeof(*result) + sizeof(*list);
+
+	case PROFILE_BOOT:
+		const profile_slot_request_t* boot = (const profile_slot_request_t*)request;
+		if(request->length < sizeof(*boot))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = profile_select(boot->slot);
+		return sizeof(*result);
+
+	case PROFILE_APPLY:
+		const profile_slot_request_t* apply = (const profile_slot_request_t*)request;
+		uint32_t* failed = (uint32_t*)(reply + sizeof(*result));
+		*failed = 0;
+		if(request->length < sizeof(*apply))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = profile_apply(apply->slot, failed);
+		return sizeof(*result) + sizeof(*failed);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,192 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "pulse.h"
+#include "tim_map.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+typedef struct {
+	const tim_pin_t* output;
+	const tim_pin_t* trigger;	// NULL if started by software
+	uint8_t flags;
+} pulse_channel_t;
+
+static pulse_channel_t channels[PULSE_CHANNELS];
+
+static void set_compare(TIM_TypeDef* tim, uint8_t channel, uint32_t compare)
+{
+	*(&tim->CCR1 + (channel-1)) = compare;
+}
+
+/*
+ * Stops the timer and leaves the output pin at the idle level as a gpio output
+ */
+static void pulse_stop(pulse_channel_t* ch)
+{
+	if(ch->output == NULL)
+		return;
+
+	TIM_TypeDef* tim = ch->output->tim;
+	GPIO_TypeDef* port = gpio_port(ch->output->port);
+	uint32_t pin_mask = 1U << ch->output->pin;
+
+	LL_TIM_DisableCounter(tim);
+	if(ch->flags & PULSE_ACTIVE_LOW)
+		LL_GPIO_SetOutputPin(port, pin_mask);
+	else
+		LL_GPIO_ResetOutputPin(port, pin_mask);
+	LL_GPIO_SetPinMode(port, pin_mask, LL_GPIO_MODE_OUTPUT);
+	gpio_release(ch->output->port, ch->output->pin, PIN_OWNER_TIM);
+	if(ch->trigger != NULL)
+		tim_pin_disconnect(ch->trigger);
+	tim_release(tim, TIM_OWNER_PULSE);
+	ch->output = NULL;
+	ch->trigger = NULL;
+}
+
+static int pulse_start(pulse_channel_t* ch, const pulse_start_request_t* start, uint32_t* actual)
+{
+	if(gpio_port(start->port) == NULL || start->pin > 15)
+		return ERROR_GPIO_PARAMETER;
+	if(start->width_ticks == 0 || start->delay_ticks == 0 || start->count == 0
+			|| (uint64_t)start->delay_ticks + start->width_ticks > 0x100000000ULL)
+		return ERROR_PULSE_TIMING;
+
+	pulse_stop(ch);
+
+	const tim_pin_t* trigger = NULL;
+	if(start->flags & PULSE_TRIGGER) {
+		if(gpio_port(start->trigger_port) == NULL || start->trigger_pin > 15)
+			return ERROR_GPIO_PARAMETER;
+		trigger = tim_pin_lookup(start->trigger_port, start->trigger_pin, TIM_OWNER_NONE, TIM_CHANNEL_MASK(1) | TIM_CHANNEL_MASK(2));
+		if(trigger == NULL)
+			return ERROR_TIM_NO_CHANNEL;
+	}
+	const tim_pin_t* output = tim_pin_lookup(start->port, start->pin, TIM_OWNER_NONE, 0xF);
+	if(output == NULL || (trigger != NULL && (trigger->tim != output->tim || trigger->channel == output->channel)))
+		return ERROR_TIM_NO_CHANNEL;
+
+	TIM_TypeDef* tim = output->tim;
+	if(start->count > 1 && (!IS_TIM_REPETITION_COUNTER_INSTANCE(tim) || start->count-1 > (tim == TIM15 ? 0xFFU : 0xFFFFU)))
+		return ERROR_PULSE_COUNT;
+
+	/* the delay must stay at least one tick, otherwise the output would be active while the timer waits */
+	uint32_t psc = ((uint64_t)start->delay_ticks + start->width_ticks - 1) / 65536;
+	uint32_t delay = start->delay_ticks / (psc+1);
+	uint32_t width = start->width_ticks / (psc+1);
+	if(delay == 0)
+		delay = 1;
+	if(width == 0)
+		width = 1;
+	if(delay + width > 65536)
+		width = 65536 - delay;
+
+	int res = tim_claim(tim, TIM_OWNER_PULSE);
+	if(res < 0)
+		return res;
+
+	uint32_t channel = tim_ll_channel(output->channel);
+	LL_TIM_SetPrescaler(tim, psc);
+	LL_TIM_SetAutoReload(tim, delay + width - 1);
+	if(IS_TIM_REPETITION_COUNTER_INSTANCE(tim))
+		LL_TIM_SetRepetitionCounter(tim, start->count - 1);
+	LL_TIM_OC_SetMode(tim, channel, LL_TIM_OCMODE_PWM2);
+	LL_TIM_OC_SetPolarity(tim, channel, (start->flags & PULSE_ACTIVE_LOW) ? LL_TIM_OCPOLARITY_LOW : LL_TIM_OCPOLARITY_HIGH);
+	LL_TIM_OC_EnablePreload(tim, channel);
+	set_compare(tim, output->channel, delay);
+	LL_TIM_SetOnePulseMode(tim, LL_TIM_ONEPULSEMODE_SINGLE);
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	LL_TIM_CC_EnableChannel(tim, channel);
+	if(IS_TIM_BREAK_INSTANCE(tim))
+		LL_TIM_EnableAllOutputs(tim);
+	res = tim_pin_connect(output);
+	if(res < 0) {
+		tim_release(tim, TIM_OWNER_PULSE);
+		return res;
+	}
+
+	ch->output = output;
+	ch->trigger = trigger;
+	ch->flags = start->flags;
+	actual[0] = delay * (psc+1);
+	actual[1] = width * (psc+1);
+
+	if(trigger != NULL) {
+		LL_TIM_IC_Config(tim, tim_ll_channel(trigger->channel), LL_TIM_ACTIVEINPUT_DIRECTTI | LL_TIM_ICPSC_DIV1 | LL_TIM_IC_FILTER_FDIV1
+				| ((start->flags & PULSE_TRIGGER_FALLING) ? LL_TIM_IC_POLARITY_FALLING : LL_TIM_IC_POLARITY_RISING));
+		LL_TIM_SetTriggerInput(tim, trigger->channel == 1 ? LL_TIM_TS_TI1FP1 : LL_TIM_TS_TI2FP2);
+		LL_TIM_SetSlaveMode(tim, LL_TIM_SLAVEMODE_TRIGGER);
+		res = tim_pin_connect(trigger);
+		if(res < 0) {
+			pulse_stop(ch);
+			return res;
+		}
+	}
+	else
+		LL_TIM_EnableCounter(tim);
+	return 0;
+}
+
+/*
+ * Executes a pulse request and fills in the reply. Returns the reply length in bytes.
+ */
+int pulse_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* data = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case PULSE_START:
+		const pulse_start_request_t* start = (const pulse_start_request_t*)request;
+		data[0] = data[1] = 0;
+		if(request->length < sizeof(*start))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(start->channel >= PULSE_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			*result = pulse_start(&channels[start->channel], start, data);
+		return sizeof(*result) + 2*sizeof(uint32_t);
+
+	case PULSE_STOP:
+		const pulse_stop_request_t* stop = (const pulse_stop_request_t*)request;
+		if(request->length < sizeof(*stop))
+			*result = ERROR_REQUEST_LENGTH;
+		else if(stop->channel >= PULSE_CHANNELS)
+			*result = ERROR_GPIO_PARAMETER;
+		else
+			pulse_stop(&channels[stop->channel]);
+		return sizeof(*result);
+
+	case PULSE_STATUS:
+		data[0] = data[1] = 0;
+		for(int i=0;i<PULSE_CHANNELS;i++) {
+			if(channels[i].output == NULL)
+				continue;
+			data[0] |= 1U << i;
+			if(LL_TIM_IsEnabledCounter(channels[i].output->tim))
+				data[1] |= 1U << i;
+		}
+		return sizeof(*result) + 2*sizeof(uint32_t);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,247 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "pwm.h"
+#include "tim_map.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/* Timer channels driving the PWM pins, NULL for unused entries */
+static const tim_pin_t* outputs[PWM_MAX_CHANNELS];
+
+static int find_output(char port, uint8_t pin)
+{
+	port |= 0x20;	// lower case
+	for(int i=0;i<PWM_MAX_CHANNELS;i++)
+		if(outputs[i] != NULL && outputs[i]->port == port && outputs[i]->pin == pin)
+			return i;
+	return -1;
+}
+
+static int free_output()
+{
+	for(int i=0;i<PWM_MAX_CHANNELS;i++)
+		if(outputs[i] == NULL)
+			return i;
+	return -1;
+}
+
+/*
+ * Returns the number of PWM pins using the timer, not counting the entry except
+ */
+static int timer_users(TIM_TypeDef* tim, int except)
+{
+	int n = 0;
+	for(int i=0;i<PWM_MAX_CHANNELS;i++)
+		if(i != except && outputs[i] != NULL && outputs[i]->tim == tim)
+			n++;
+	return n;
+}
+
+/*
+ * Computes the prescaler and the auto-reload values giving the closest frequency
+ * with the finest duty cycle resolution
+ */
+static int timing(uint32_t frequency_hz, uint32_t* prescaler, uint32_t* reload)
+{
+	if(frequency_hz == 0 || frequency_hz > TIM_CLK_HZ/2)
+		return ERROR_PWM_FREQUENCY;
+
+	uint32_t ticks = (TIM_CLK_HZ + frequency_hz/2) / frequency_hz;
+	uint32_t psc = (ticks-1) / 65536;
+	if(psc > 0xFFFF)
+		return ERROR_PWM_FREQUENCY;
+
+	*prescaler = psc;
+	*reload = ticks/(psc+1) - 1;
+	return 0;
+}
+
+/*
+ * Writes the compare register. It is preloaded, so the new value takes effect at the next update event.
+ */
+static void set_duty(const tim_pin_t* map, uint32_t duty_ppm)
+{
+	TIM_TypeDef* tim = map->tim;
+	uint32_t compare = (uint64_t)(LL_TIM_GetAutoReload(tim)+1) * duty_ppm / 1000000;
+
+	switch(map->channel) {
+	case 1:
+		LL_TIM_OC_SetCompareCH1(tim, compare);
+		break;
+	case 2:
+		LL_TIM_OC_SetCompareCH2(tim, compare);
+		break;
+	case 3:
+		LL_TIM_OC_SetCompareCH3(tim, compare);
+		break;
+	case 4:
+		LL_TIM_OC_SetCompareCH4(tim, compare);
+		break;
+	}
+}
+
+static int pwm_config(char port, uint8_t pin, uint8_t polarity, uint32_t frequency_hz, uint32_t duty_ppm, uint64_t* actual_mhz)
+{
+	if(gpio_port(port) == NULL || pin > 15 || polarity > PWM_ACTIVE_LOW || duty_ppm > 1000000)
+		return ERROR_GPIO_PARAMETER;
+
+	uint32_t prescaler, reload;
+	int res = timing(frequency_hz, &prescaler, &reload);
+	if(res < 0)
+		return res;
+
+	const tim_pin_t* map;
+	int idx = find_output(port, pin);
+	int is_new = idx < 0;
+	if(is_new) {
+		idx = free_output();
+		if(idx < 0)
+			return ERROR_PWM_CHANNEL;
+		map = tim_pin_lookup(port, pin, TIM_OWNER_PWM, 0xF);
+		if(map == NULL)
+			return ERROR_TIM_NO_CHANNEL;
+		for(int i=0;i<PWM_MAX_CHANNELS;i++)
+			if(outputs[i] != NULL && outputs[i]->tim == map->tim && outputs[i]->channel == map->channel)
+				return ERROR_PWM_CHANNEL;
+	}
+	else
+		map = outputs[idx];
+
+	TIM_TypeDef* tim = map->tim;
+	int shared = timer_users(tim, is_new ? -1 : idx) > 0;
+	if(shared && (LL_TIM_GetPrescaler(tim) != prescaler || LL_TIM_GetAutoReload(tim) != reload))
+		return ERROR_PWM_FREQUENCY;
+
+	if(is_new) {
+		res = tim_claim(tim, TIM_OWNER_PWM);
+		if(res < 0)
+			return res;
+		outputs[idx] = map;
+	}
+
+	uint32_t channel = tim_ll_channel(map->channel);
+	LL_TIM_OC_SetMode(tim, channel, LL_TIM_OCMODE_PWM1);
+	LL_TIM_OC_SetPolarity(tim, channel, polarity == PWM_ACTIVE_LOW ? LL_TIM_OCPOLARITY_LOW : LL_TIM_OCPOLARITY_HIGH);
+	LL_TIM_OC_EnablePreload(tim, channel);
+	if(!shared) {
+		LL_TIM_SetPrescaler(tim, prescaler);
+		LL_TIM_SetAutoReload(tim, reload);
+		LL_TIM_EnableARRPreload(tim);
+		set_duty(map, duty_ppm);
+		LL_TIM_GenerateEvent_UPDATE(tim);
+	}
+	else
+		set_duty(map, duty_ppm);
+	LL_TIM_CC_EnableChannel(tim, channel);
+	if(IS_TIM_BREAK_INSTANCE(tim))
+		LL_TIM_EnableAllOutputs(tim);
+	LL_TIM_EnableCounter(tim);
+
+	if(is_new && (res = tim_pin_connect(map)) < 0) {
+		LL_TIM_CC_DisableChannel(tim, channel);
+		outputs[idx] = NULL;
+		if(timer_users(tim, -1) == 0)
+			tim_release(tim, TIM_OWNER_PWM);
+		return res;
+	}
+
+	*actual_mhz = (uint64_t)TIM_CLK_HZ * 1000 / ((uint64_t)(prescaler+1) * (reload+1));
+	return 0;
+}
+
+static int pwm_stop(char port, uint8_t pin)
+{
+	int idx = find_output(port, pin);
+	if(idx < 0)
+		return ERROR_GPIO_PARAMETER;
+
+	const tim_pin_t* map = outputs[idx];
+	tim_pin_disconnect(map);
+	LL_TIM_CC_DisableChannel(map->tim, tim_ll_channel(map->channel));
+	outputs[idx] = NULL;
+	if(timer_users(map->tim, -1) == 0)
+		tim_release(map->tim, TIM_OWNER_PWM);
+	return 0;
+}
+
+/*
+ * The update events of the timers are disabled while their compare registers are written,
+ * so that the channels of a timer switch to their new duty cycles at the same update event.
+ */
+static int pwm_duty(const pwm_duty_t* duty, uint32_t count)
+{
+	int idx[PWM_MAX_CHANNELS];
+
+	if(count > PWM_MAX_CHANNELS)
+		return ERROR_PWM_COUNT;
+	for(int i=0;i<count;i++) {
+		idx[i] = find_output(duty[i].port, duty[i].pin);
+		if(idx[i] < 0 || duty[i].duty_ppm > 1000000)
+			return ERROR_GPIO_PARAMETER;
+	}
+
+	for(int i=0;i<count;i++)
+		LL_TIM_DisableUpdateEvent(outputs[idx[i]]->tim);
+	for(int i=0;i<count;i++)
+		set_duty(outputs[idx[i]], duty[i].duty_ppm);
+	for(int i=0;i<count;i++)
+		LL_TIM_EnableUpdateEvent(outputs[idx[i]]->tim);
+	return 0;
+}
+
+/*
+ * Executes a PWM request and fills in the reply. Returns the reply length in bytes.
+ */
+int pwm_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case PWM_CONFIG:
+		const pwm_config_request_t* config = (const pwm_config_request_t*)request;
+		uint64_t* actual_mhz = (uint64_t*)(reply + sizeof(*result));
+		*actual_mhz = 0;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = pwm_config(config->port, config->pin, config->polarity, config->frequency_hz, config->duty_ppm, actual_mhz);
+		return sizeof(*result) + sizeof(*actual_mhz);
+
+	case PWM_DUTY:
+		const pwm_duty_request_t* duty = (const pwm_duty_request_t*)request;
+		if(request->length < sizeof(*duty) || request->length < sizeof(*duty) + duty->count*sizeof(pwm_duty_t))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = pwm_duty(duty->duty, duty->count);
+		return sizeof(*result);
+
+	case PWM_STOP:
+		const pwm_stop_request_t* stop = (const pwm_stop_request_t*)request;
+		if(request->length < sizeof(*stop))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = pwm_stop(stop->port, stop->pin);
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,268 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "route.h"
+#include "edge.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/*
+ * Routes are fired by the EXTI interrupts and their pulses ended by the TIM5 interrupt,
+ * which preempts them. The end of a pulse is a TIM5 channel 2 compare, channel 1 being the scheduler's.
+ * A request only changes a route while it is disabled.
+ */
+typedef struct {
+	uint8_t action;
+	uint8_t trigger;
+	char source_port;
+	uint8_t source_pin;
+	GPIO_TypeDef* target;
+	uint32_t target_mask;
+	uint32_t pulse_us;
+	volatile uint32_t hits;
+	volatile uint32_t pulse_end;
+	volatile int pulse_active;
+} route_t;
+
+static route_t routes[ROUTE_COUNT];
+static volatile uint32_t enabled;
+static uint16_t line_routes[16];	// routes fired by each EXTI line
+
+static int before(uint32_t t1, uint32_t t2)
+{
+	return (int32_t)(t1 - t2) < 0;
+}
+
+/*
+ * Loads the channel 2 compare register with the earliest pulse end.
+ * If that time has already passed, the interrupt is set pending straight away.
+ */
+static void arm()
+{
+	uint32_t next = 0;
+	int any = 0;
+
+	for(int i=0;i<ROUTE_COUNT;i++) {
+		if(routes[i].pulse_active && (!any || before(routes[i].pulse_end, next))) {
+			next = routes[i].pulse_end;
+			any = 1;
+		}
+	}
+	if(!any) {
+		LL_TIM_DisableIT_CC2(TIM5);
+		return;
+	}
+	LL_TIM_OC_SetCompareCH2(TIM5, next);
+	LL_TIM_ClearFlag_CC2(TIM5);
+	LL_TIM_EnableIT_CC2(TIM5);
+	if(!before(LL_TIM_GetCounter(TIM5), next))
+		NVIC_SetPendingIRQ(TIM5_IRQn);
+}
+
+static uint32_t pulse_bsrr(const route_t* r, int start)
+{
+	int high = (r->action == ROUTE_PULSE) == (start != 0);
+	return high ? r->target_mask : r->target_mask << 16;
+}
+
+static void start_pulse(route_t* r)
+{
+	WRITE_REG(r->target->BSRR, pulse_bsrr(r, 1));
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	r->pulse_end = LL_TIM_GetCounter(TIM5) + r->pulse_us;
+	r->pulse_active = 1;
+	arm();
+	__set_PRIMASK(primask);
+}
+
+/*
+ * Called by edge_isr() with the pending edges of a line
+ */
+void route_isr(uint32_t line, GPIO_TypeDef* source, uint32_t rising, uint32_t falling)
+{
+	uint32_t pending = line_routes[line] & enabled;
+	if(pending == 0)
+		return;
+
+	int level = READ_BIT(source->IDR, 1U << line) != 0;
+	while(pending) {
+		route_t* r = &routes[__CLZ(__RBIT(pending))];
+		pending &= pending - 1;
+		if(!((rising && (r->trigger & EDGE_RISING)) || (falling && (r->trigger & EDGE_FALLING))))
+			continue;
+
+		switch(r->action) {
+		case ROUTE_COPY:
+			WRITE_REG(r->target->BSRR, level ? r->target_mask : r->target_mask << 16);
+			break;
+		case ROUTE_INVERT:
+			WRITE_REG(r->target->BSRR, level ? r->target_mask << 16 : r->target_mask);
+			break;
+		case ROUTE_SET:
+			WRITE_REG(r->target->BSRR, r->target_mask);
+			break;
+		case ROUTE_CLEAR:
+			WRITE_REG(r->target->BSRR, r->target_mask << 16);
+			break;
+		case ROUTE_PULSE:
+		case ROUTE_PULSE_LOW:
+			start_pulse(r);
+			break;
+		default:
+			break;
+		}
+		r->hits++;
+	}
+}
+
+/*
+ * Called by the TIM5 interrupt handler: ends the pulses that are due
+ */
+void route_timer_isr()
+{
+	LL_TIM_ClearFlag_CC2(TIM5);
+
+	uint32_t now = LL_TIM_GetCounter(TIM5);
+	for(int i=0;i<ROUTE_COUNT;i++) {
+		route_t* r = &routes[i];
+		if(r->pulse_active && !before(now, r->pulse_end)) {
+			WRITE_REG(r->target->BSRR, pulse_bsrr(r, 0));
+			r->pulse_active = 0;
+		}
+	}
+	arm();
+}
+
+static enum edge_trigger line_trigger(uint8_t pin)
+{
+	uint32_t trigger = EDGE_NONE;
+	for(int i=0;i<ROUTE_COUNT;i++)
+		if(line_routes[pin] & (1U << i))
+			trigger |= routes[i].trigger;
+	return trigger;
+}
+
+/*
+ * Disables a route, ends its pulse and removes it from its EXTI line
+ */
+static void route_release(int index)
+{
+	route_t* r = &routes[index];
+
+	enabled &= ~(1U << index);
+	if(r->action == ROUTE_NONE)
+		return;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(r->pulse_active) {
+		WRITE_REG(r->target->BSRR, pulse_bsrr(r, 0));
+		r->pulse_active = 0;
+	}
+	__set_PRIMASK(primask);
+
+	line_routes[r->source_pin] &= ~(1U << index);
+	edge_line_use(r->source_port, r->source_pin, EDGE_USER_ROUTE, line_trigger(r->source_pin));
+	r->action = ROUTE_NONE;
+}
+
+static int route_config(const route_config_request_t* config)
+{
+	if(config->route >= ROUTE_COUNT || config->action > ROUTE_PULSE_LOW)
+		return ERROR_GPIO_PARAMETER;
+
+	route_release(config->route);
+	if(config->action == ROUTE_NONE)
+		return 0;
+
+	GPIO_TypeDef* target = gpio_port(config->target_port);
+	if(gpio_port(config->source_port) == NULL || config->source_pin > 15 || target == NULL || config->target_pin > 15
+			|| config->trigger == EDGE_NONE || config->trigger > EDGE_BOTH)
+		return ERROR_GPIO_PARAMETER;
+	int res = gpio_check(config->target_port, 1U << config->target_pin);
+	if(res < 0)
+		return res;
+
+	route_t* r = &routes[config->route];
+	r->trigger = config->trigger;
+	r->source_port = config->source_port | 0x20;	// lower case
+	r->source_pin = config->source_pin;
+	r->target = target;
+	r->target_mask = 1U << config->target_pin;
+	r->pulse_us = config->pulse_us;
+	r->hits = 0;
+
+	line_routes[r->source_pin] |= 1U << config->route;
+	r->action = config->action;
+	res = edge_line_use(r->source_port, r->source_pin, EDGE_USER_ROUTE, line_trigger(r->source_pin));
+	if(res < 0) {
+		line_routes[r->source_pin] &= ~(1U << config->route);
+		r->action = ROUTE_NONE;
+	}
+	return res;
+}
+
+/*
+ * Executes a route request and fills in the reply. Returns the reply length in bytes.
+ */
+int route_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case ROUTE_CONFIG:
+		const route_config_request_t* config = (const route_config_request_t*)request;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = route_config(config);
+		return sizeof(*result);
+
+	case ROUTE_ENABLE:
+	case ROUTE_DISABLE:
+		const route_enable_request_t* enable = (const route_enable_request_t*)request;
+		if(request->length < sizeof(*enable)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		uint32_t configured = 0;
+		for(int i=0;i<ROUTE_COUNT;i++)
+			if(routes[i].action != ROUTE_NONE)
+				configured |= 1U << i;
+		if(enable->mask & ~configured)
+			*result = ERROR_GPIO_PARAMETER;
+		else if(request->operation == ROUTE_ENABLE)
+			enabled |= enable->mask;
+		else
+			enabled &= ~enable->mask;
+		return sizeof(*result);
+
+	case ROUTE_STATUS:
+		uint32_t* data = (uint32_t*)(reply + sizeof(*result));
+		data[0] = enabled;
+		for(int i=0;i<ROUTE_COUNT;i++)
+			data[1+i] = routes[i].hits;
+		return sizeof(*result) + (1+ROUTE_COUNT)*sizeof(uint32_t);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
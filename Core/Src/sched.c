@@ -0,0 +1,254 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "sched.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/*
+ * Pending commands are kept in a min-heap ordered by target time, whose root is loaded
+ * into the TIM5 channel 1 compare register. Times are compared as signed differences so that
+ * the TIM5 counter wrap-around is handled.
+ */
+typedef struct {
+	uint32_t time;
+	GPIO_TypeDef* port;
+	uint32_t bsrr;		// precomputed BSRR value, not used by SCHED_TOGGLE
+	uint16_t mask;
+	uint16_t tag;
+	uint8_t action;
+} sched_entry_t;
+
+static sched_entry_t heap[SCHED_QUEUE_LENGTH];
+static uint32_t heap_size;
+
+/*
+ * Completion records are written by the TIM5 interrupt and read by the USB interrupt
+ */
+static sched_record_t records[SCHED_RECORDS_LENGTH];
+static volatile uint32_t rec_w_idx, rec_r_idx;
+static volatile uint32_t lost_records;
+
+static int before(uint32_t t1, uint32_t t2)
+{
+	return (int32_t)(t1 - t2) < 0;
+}
+
+static void heap_push(const sched_entry_t* e)
+{
+	uint32_t i = heap_size++;
+	while(i > 0) {
+		uint32_t parent = (i-1)/2;
+		if(!before(e->time, heap[parent].time))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = *e;
+}
+
+static void heap_pop()
+{
+	sched_entry_t last = heap[--heap_size];
+	uint32_t i = 0;
+	while(1) {
+		uint32_t child = 2*i+1;
+		if(child >= heap_size)
+			break;
+		if(child+1 < heap_size && before(heap[child+1].time, heap[child].time))
+			child++;
+		if(!before(heap[child].time, last.time))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+}
+
+/*
+ * Loads the compare register with the time of the next command.
+ * If that time has already passed, the compare match would not happen until the counter wraps around,
+ * so the interrupt is set pending straight away.
+ */
+static void arm()
+{
+	if(heap_size == 0) {
+		LL_TIM_DisableIT_CC1(TIM5);
+		return;
+	}
+	LL_TIM_OC_SetCompareCH1(TIM5, heap[0].time);
+	LL_TIM_ClearFlag_CC1(TIM5);
+	LL_TIM_EnableIT_CC1(TIM5);
+	if(!before(LL_TIM_GetCounter(TIM5), heap[0].time))
+		NVIC_SetPendingIRQ(TIM5_IRQn);
+}
+
+static void execute(const sched_entry_t* e)
+{
+	if(e->action == SCHED_TOGGLE) {
+		uint32_t odr = READ_REG(e->port->ODR);
+		WRITE_REG(e->port->BSRR, ((odr & e->mask) << 16) | (~odr & e->mask));
+	}
+	else
+		WRITE_REG(e->port->BSRR, e->bsrr);
+}
+
+void sched_init()
+{
+	heap_size = 0;
+	NVIC_SetPriority(TIM5_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), SCHED_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(TIM5_IRQn);
+}
+
+/*
+ * Called by the TIM5 interrupt handler
+ */
+void sched_isr()
+{
+	LL_TIM_ClearFlag_CC1(TIM5);
+
+	while(heap_size > 0 && !before(LL_TIM_GetCounter(TIM5), heap[0].time)) {
+		execute(&heap[0]);
+		uint32_t actual = LL_TIM_GetCounter(TIM5);
+
+		if(rec_w_idx - rec_r_idx < SCHED_RECORDS_LENGTH) {
+			sched_record_t* r = &records[rec_w_idx & (SCHED_RECORDS_LENGTH-1)];
+			r->tag = heap[0].tag;
+			r->reserved = 0;
+			r->target = heap[0].time;
+			r->skew = (int32_t)(actual - heap[0].time);
+			rec_w_idx++;
+		}
+		else
+			lost_records++;
+
+		heap_pop();
+	}
+	arm();
+}
+
+static int to_entry(const sched_command_t* c, sched_entry_t* e)
+{
+	e->port = gpio_port(c->port);
+	if(e->port == NULL)
+		return ERROR_GPIO_PARAMETER;
+	int res = gpio_check(c->port, c->mask);
+	if(res < 0)
+		return res;
+	e->time = c->time;
+	e->tag = c->tag;
+	e->mask = c->mask;
+	e->action = c->action;
+	switch(c->action) {
+	case SCHED_SET:
+		e->bsrr = c->mask;
+		return 0;
+	case SCHED_CLEAR:
+		e->bsrr = (uint32_t)c->mask << 16;
+		return 0;
+	case SCHED_WRITE:
+		e->bsrr = (c->value & c->mask) | ((uint32_t)(~c->value & c->mask) << 16);
+		return 0;
+	case SCHED_TOGGLE:
+		e->bsrr = 0;
+		return 0;
+	default:
+		return ERROR_SCHED_ACTION;
+	}
+}
+
+/*
+ * Queues the commands. Either all the commands are queued or none is.
+ */
+int sched_submit(const sched_command_t* commands, uint32_t count)
+{
+	sched_entry_t e;
+
+	for(uint32_t i=0;i<count;i++) {
+		int ret = to_entry(&commands[i], &e);
+		if(ret < 0)
+			return ret;
+	}
+
+	int ret = 0;
+	NVIC_DisableIRQ(TIM5_IRQn);
+	if(heap_size + count > SCHED_QUEUE_LENGTH)
+		ret = ERROR_SCHED_FULL;
+	else {
+		for(uint32_t i=0;i<count;i++) {
+			to_entry(&commands[i], &e);
+			heap_push(&e);
+		}
+		arm();
+	}
+	NVIC_EnableIRQ(TIM5_IRQn);
+	return ret;
+}
+
+void sched_cancel()
+{
+	NVIC_DisableIRQ(TIM5_IRQn);
+	heap_size = 0;
+	arm();
+	NVIC_EnableIRQ(TIM5_IRQn);
+}
+
+/*
+ * Executes a scheduler request and fills in the reply. Returns the reply length in bytes.
+ */
+int sched_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* data = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case SCHED_SUBMIT:
+		const sched_submit_request_t* submit = (const sched_submit_request_t*)request;
+		if(request->length < sizeof(*submit) + sizeof(sched_command_t)) {
+			*result = ERROR_REQUEST_LENGTH;	// at least one command
+			return sizeof(*result);
+		}
+		*result = sched_submit(submit->commands, (request->length - sizeof(*submit))/sizeof(sched_command_t));
+		return sizeof(*result);
+
+	case SCHED_STATUS:
+		uint32_t count = 0;
+		sched_record_t* r = (sched_record_t*)&data[3];
+		while(rec_r_idx != rec_w_idx) {
+			r[count++] = records[rec_r_idx & (SCHED_RECORDS_LENGTH-1)];
+			rec_r_idx++;
+		}
+		data[0] = heap_size;
+		data[1] = lost_records;
+		data[2] = count;
+		return sizeof(*result) + 3*sizeof(uint32_t) + count*sizeof(sched_record_t);
+
+	case SCHED_CANCEL:
+		sched_cancel();
+		return sizeof(*result);
+
+	case SCHED_TIME:
+		data[0] = LL_TIM_GetCounter(TIM5);
+		return sizeof(*result) + sizeof(uint32_t);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,236 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "seq.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/*
+ * Programs are validated and translated when loaded, so that the interpreter loop
+ * does not need to look up ports or check targets while running.
+ */
+typedef struct {
+	GPIO_TypeDef* port;
+	uint8_t opcode;
+	uint8_t counter;
+	uint16_t mask;
+	uint16_t value;
+	uint16_t target;
+	uint32_t arg;
+} seq_op_t;
+
+typedef struct {
+	uint32_t length;
+	seq_op_t ops[SEQ_MAX_INSTRUCTIONS];
+} seq_program_t;
+
+static seq_program_t programs[SEQ_MAX_PROGRAMS];
+
+static int uses_port(uint8_t opcode)
+{
+	switch(opcode) {
+	case SEQ_SET:
+	case SEQ_CLEAR:
+	case SEQ_WRITE:
+	case SEQ_READ:
+	case SEQ_WAIT_PIN:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int uses_target(uint8_t opcode)
+{
+	switch(opcode) {
+	case SEQ_JUMP:
+	case SEQ_BRANCH_EQ:
+	case SEQ_BRANCH_NE:
+	case SEQ_LOOP:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int seq_load(uint8_t slot, const seq_instruction_t* program, uint32_t count)
+{
+	if(slot >= SEQ_MAX_PROGRAMS)
+		return ERROR_SEQ_SLOT;
+	if(count == 0 || count > SEQ_MAX_INSTRUCTIONS)
+		return ERROR_SEQ_PROGRAM;
+
+	seq_program_t* p = &programs[slot];
+	p->length = 0;
+
+	for(uint32_t i=0;i<count;i++) {
+		const seq_instruction_t* in = &program[i];
+		seq_op_t* op = &p->ops[i];
+
+		if(in->opcode >= SEQ_OPCODE_COUNT)
+			return ERROR_SEQ_PROGRAM;
+
+		op->port = NULL;
+		if(uses_port(in->opcode)) {
+			op->port = gpio_port(in->port);
+			if(op->port == NULL)
+				return ERROR_GPIO_PARAMETER;
+		}
+		/* the pins a program writes must not belong to a peripheral, any pin can be read */
+		if(in->opcode == SEQ_SET || in->opcode == SEQ_CLEAR || in->opcode == SEQ_WRITE) {
+			int res = gpio_check(in->port, in->mask);
+			if(res < 0)
+				return res;
+		}
+		if(uses_target(in->opcode) && in->target >= count)
+			return ERROR_SEQ_PROGRAM;
+		if((in->opcode == SEQ_LOOP_INIT || in->opcode == SEQ_LOOP) && in->port >= SEQ_LOOP_COUNTERS)
+			return ERROR_SEQ_PROGRAM;
+
+		op->opcode = in->opcode;
+		op->counter = in->port;
+		op->mask = in->mask;
+		op->value = in->value & in->mask;	// only the pins of mask are written or compared
+		op->target = in->target;
+		op->arg = in->arg;
+	}
+
+	p->length = count;
+	return 0;
+}
+
+/*
+ * Runs the program loaded in slot, storing the emitted values in results.
+ * count returns the number of emitted values, also when the program fails.
+ */
+int seq_run(uint8_t slot, uint32_t timeout_us, uint32_t* results, uint32_t* count)
+{
+	*count = 0;
+	if(slot >= SEQ_MAX_PROGRAMS)
+		return ERROR_SEQ_SLOT;
+	if(timeout_us > SEQ_MAX_TIMEOUT_US)
+		return ERROR_GPIO_PARAMETER;
+
+	const seq_program_t* p = &programs[slot];
+	if(p->length == 0)
+		return ERROR_SEQ_EMPTY;
+
+	uint32_t counter[SEQ_LOOP_COUNTERS] = {0};
+	uint32_t acc = 0;
+	uint32_t pc = 0;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+
+	while(pc < p->length) {
+		const seq_op_t* op = &p->ops[pc++];
+
+		switch(op->opcode) {
+		case SEQ_END:
+			return 0;
+		case SEQ_SET:
+			WRITE_REG(op->port->BSRR, op->mask);
+			break;
+		case SEQ_CLEAR:
+			WRITE_REG(op->port->BRR, op->mask);
+			break;
+		case SEQ_WRITE:
+			WRITE_REG(op->port->BSRR, (op->value & op->mask) | ((uint32_t)(~op->value & op->mask) << 16));
+			break;
+		case SEQ_READ:
+			acc = READ_REG(op->port->IDR) & op->mask;
+			break;
+		case SEQ_WAIT_US:
+			delay_us(op->arg);
+			break;
+		case SEQ_WAIT_PIN:
+			uint32_t t0 = LL_TIM_GetCounter(TIM5);
+			acc = 0;
+			while((READ_REG(op->port->IDR) & op->mask) != op->value) {
+				if(LL_TIM_GetCounter(TIM5) - t0 >= op->arg) {
+					acc = 1;
+					break;
+				}
+			}
+			break;
+		case SEQ_JUMP:
+			pc = op->target;
+			break;
+		case SEQ_BRANCH_EQ:
+			if(acc == op->arg)
+				pc = op->target;
+			break;
+		case SEQ_BRANCH_NE:
+			if(acc != op->arg)
+				pc = op->target;
+			break;
+		case SEQ_LOOP_INIT:
+			counter[op->counter] = op->arg;
+			break;
+		case SEQ_LOOP:
+			if(counter[op->counter] != 0 && --counter[op->counter] != 0)
+				pc = op->target;
+			break;
+		case SEQ_EMIT:
+			if(*count >= SEQ_MAX_RESULTS)
+				return ERROR_SEQ_RESULTS;
+			results[(*count)++] = acc;
+			break;
+		case SEQ_TIMESTAMP:
+			acc = LL_TIM_GetCounter(TIM5);
+			break;
+		default:
+			return ERROR_SEQ_PROGRAM;
+		}
+
+		if(LL_TIM_GetCounter(TIM5) - start > timeout_us)
+			return ERROR_SEQ_TIMEOUT;
+	}
+	return 0;
+}
+
+/*
+ * Executes a sequencer request and fills in the reply. Returns the reply length in bytes.
+ */
+int seq_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	switch(request->operation) {
+	case SEQ_LOAD:
+		const seq_load_request_t* load = (const seq_load_request_t*)request;
+		if(request->length < sizeof(*load)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		*result = seq_load(load->slot, load->program, (request->length - sizeof(*load))/sizeof(seq_instruction_t));
+		return sizeof(*result);
+
+	case SEQ_RUN:
+		const seq_run_request_t* run = (const seq_run_request_t*)request;
+		uint32_t* count = (uint32_t*)(reply + sizeof(*result));
+		if(request->length < sizeof(*run)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+		*result = seq_run(run->slot, run->timeout_us, count+1, count);
+		return sizeof(*result) + sizeof(*count) + (*count)*sizeof(uint32_t);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,215 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "spi.h"
+#include "dma.h"
+#include "stm32h5xx_ll_bus.h"
+#include "stm32h5xx_ll_rcc.h"
+#include "stm32h5xx_ll_tim.h"
+#include <string.h>
+
+static uint8_t tx_buffer[SPI_MAX_TRANSFER] __attribute__((aligned(4)));
+static uint8_t rx_buffer[SPI_MAX_TRANSFER] __attribute__((aligned(4)));
+static int initialized;
+
+static int spi_init()
+{
+	LL_RCC_SetSPIClockSource(LL_RCC_SPI1_CLKSOURCE_CLKP);
+	LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_SPI1);
+	LL_APB2_GRP1_ForceReset(LL_APB2_GRP1_PERIPH_SPI1);
+	LL_APB2_GRP1_ReleaseReset(LL_APB2_GRP1_PERIPH_SPI1);
+
+	int res = gpio_alternate('a', 5, LL_GPIO_AF_5, PIN_OWNER_SPI);
+	if(res == 0)
+		res = gpio_alternate('g', 9, LL_GPIO_AF_5, PIN_OWNER_SPI);
+	if(res == 0)
+		res = gpio_alternate('b', 5, LL_GPIO_AF_5, PIN_OWNER_SPI);
+	if(res < 0) {
+		gpio_release('a', 5, PIN_OWNER_SPI);
+		gpio_release('g', 9, PIN_OWNER_SPI);
+		gpio_release('b', 5, PIN_OWNER_SPI);
+		return res;
+	}
+	initialized = 1;
+	return 0;
+}
+
+/*
+ * The clock is the fastest division of the kernel clock not above clock_hz. Returns the SCK frequency.
+ * AFCNTR keeps SCK at its idle level between the transactions.
+ */
+static uint32_t spi_configure(const spi_transaction_t* t)
+{
+	uint32_t div = 0;
+	while(div < 7 && (SPI_KER_CLK_HZ >> (div+1)) > t->clock_hz)
+		div++;
+
+	CLEAR_BIT(SPI1->CR1, SPI_CR1_SPE);
+	WRITE_REG(SPI1->CFG1, (div << SPI_CFG1_MBR_Pos) | (7 << SPI_CFG1_DSIZE_Pos));
+	WRITE_REG(SPI1->CFG2, SPI_CFG2_MASTER | SPI_CFG2_SSM | SPI_CFG2_AFCNTR
+			| ((t->mode & 2) ? SPI_CFG2_CPOL : 0)
+			| ((t->mode & 1) ? SPI_CFG2_CPHA : 0)
+			| ((t->flags & SPI_LSB_FIRST) ? SPI_CFG2_LSBFRST : 0));
+	WRITE_REG(SPI1->CR1, SPI_CR1_SSI);
+	return SPI_KER_CLK_HZ >> (div+1);
+}
+
+/*
+ * Clocks length bytes from tx_buffer to rx_buffer with both DMA channels,
+ * following the enable sequence of the reference manual
+ */
+static int spi_run(uint32_t length, uint32_t sck_hz)
+{
+	int res = 0;
+
+	MODIFY_REG(SPI1->CR2, SPI_CR2_TSIZE, length << SPI_CR2_TSIZE_Pos);
+	SET_BIT(SPI1->CFG1, SPI_CFG1_RXDMAEN);
+	dma_start(DMA_SPI_RX, DMA_REQUEST_SPI1_RX, &SPI1->RXDR, rx_buffer, length, DMA_WIDTH_8);
+	dma_start(DMA_SPI_TX, DMA_REQUEST_SPI1_TX, &SPI1->TXDR, tx_buffer, length, DMA_TO_PERIPH | DMA_WIDTH_8);
+	SET_BIT(SPI1->CFG1, SPI_CFG1_TXDMAEN);
+	SET_BIT(SPI1->CR1, SPI_CR1_SPE);
+	SET_BIT(SPI1->CR1, SPI_CR1_CSTART);
+
+	/* twice the transfer time, plus a millisecond */
+	uint32_t timeout_us = (uint64_t)length * 8 * 2000000 / sck_hz + 1000;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(READ_BIT(SPI1->SR, SPI_SR_EOT) == 0 || dma_status(DMA_SPI_RX) == 0) {
+		if(dma_status(DMA_SPI_RX) < 0 || dma_status(DMA_SPI_TX) < 0) {
+			res = ERROR_SPI_DMA;
+			break;
+		}
+		if(LL_TIM_GetCounter(TIM5) - start > timeout_us) {
+			res = ERROR_SPI_TIMEOUT;
+			break;
+		}
+	}
+
+	WRITE_REG(SPI1->IFCR, SPI_IFCR_EOTC | SPI_IFCR_TXTFC | SPI_IFCR_OVRC | SPI_IFCR_SUSPC);
+	CLEAR_BIT(SPI1->CR1, SPI_CR1_SPE);
+	CLEAR_BIT(SPI1->CFG1, SPI_CFG1_TXDMAEN | SPI_CFG1_RXDMAEN);
+	if(res < 0) {
+		dma_stop(DMA_SPI_TX);
+		dma_stop(DMA_SPI_RX);
+	}
+	return res;
+}
+
+static int cs_write(const spi_transaction_t* t, int active)
+{
+	if(t->cs_port == 0)
+		return 0;
+	int level = (t->flags & SPI_CS_ACTIVE_HIGH) ? active : !active;
+	return level ? gpio_set(t->cs_port, t->cs_pin) : gpio_clear(t->cs_port, t->cs_pin);
+}
+
+/*
+ * Bytes clocked by a transaction: the received bytes follow the sent ones, unless they are clocked together
+ */
+static uint32_t transfer_length(const spi_transaction_t* t)
+{
+	if(t->flags & SPI_FULL_DUPLEX)
+		return t->tx_length > t->rx_length ? t->tx_length : t->rx_length;
+	return t->tx_length + t->rx_length;
+}
+
+static int spi_transaction(const spi_transaction_t* t, const uint8_t* tx, uint8_t* rx)
+{
+	uint32_t length = transfer_length(t);
+	uint32_t rx_offset = (t->flags & SPI_FULL_DUPLEX) ? 0 : t->tx_length;
+
+	uint32_t sck_hz = spi_configure(t);
+	int res = cs_write(t, 1);
+	if(res < 0)
+		return res;
+
+	if(length > 0) {
+		memcpy(tx_buffer, tx, t->tx_length);
+		memset(tx_buffer + t->tx_length, 0xFF, length - t->tx_length);
+		res = spi_run(length, sck_hz);
+	}
+
+	if(res < 0 || (t->flags & SPI_CS_HOLD) == 0)
+		cs_write(t, 0);
+	if(res < 0)
+		return res;
+
+	memcpy(rx, rx_buffer + rx_offset, t->rx_length);
+	return 0;
+}
+
+/*
+ * Executes an SPI request and fills in the reply. Returns the reply length in bytes.
+ * SPI_TRANSFER is deferred. The whole batch is checked before the first transaction is executed.
+ */
+int spi_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+	uint8_t* rx = reply + sizeof(*result) + sizeof(*executed);
+
+	*result = 0;
+	switch(request->operation) {
+	case SPI_TRANSFER:
+		const spi_transfer_request_t* transfer = (const spi_transfer_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*transfer)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(transfer + 1);
+		uint32_t rx_total = 0;
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const spi_transaction_t* t = (const spi_transaction_t*)p;
+			if(p + sizeof(*t) > end || p + sizeof(*t) + t->tx_length > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			if(transfer_length(t) > SPI_MAX_TRANSFER || t->mode > 3) {
+				*result = ERROR_GPIO_PARAMETER;
+				return sizeof(*result);
+			}
+			rx_total += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+		}
+		if(rx_total > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		if(!initialized && (*result = spi_init()) < 0)
+			return sizeof(*result);
+
+		p = (const uint8_t*)(transfer + 1);
+		for(uint32_t i=0;i<transfer->count;i++) {
+			const spi_transaction_t* t = (const spi_transaction_t*)p;
+			*result = spi_transaction(t, p + sizeof(*t), rx);
+			if(*result < 0)
+				break;
+			rx += t->rx_length;
+			p += sizeof(*t) + t->tx_length;
+			(*executed)++;
+		}
+		return rx - reply;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -24,6 +24,16 @@
 /* USER CODE BEGIN Includes */
 #include "mcu_init.h"
 #include "usb.h"
+#include "sched.h"
+#include "edge.h"
+#include "meas.h"
+#include "i3c.h"
+#include "uart.h"
+#include "adc.h"
+#include "dac.h"
+#include "counter.h"
+#include "route.h"
+#include "motion.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -171,12 +181,7 @@ void DebugMon_Handler(void)
   */
 void PendSV_Handler(void)
 {
-  /* USER CODE BEGIN PendSV_IRQn 0 */
-
-  /* USER CODE END PendSV_IRQn 0 */
-  /* USER CODE BEGIN PendSV_IRQn 1 */
-
-  /* USER CODE END PendSV_IRQn 1 */
+	usb_deferred_isr();
 }
 
 /**
@@ -185,6 +190,9 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
 	sys_tick++;
+	meas_tick();
+	adc_tick();
+	counter_tick();
 }
 
 /******************************************************************************/
@@ -195,30 +203,161 @@ void SysTick_Handler(void)
 /******************************************************************************/
 
 /**
-  * @brief This function handles EXTI Line13 interrupt.
+  * @brief These functions handle the EXTI line interrupts, which timestamp the edges of the captured pins.
   */
-//void EXTI13_IRQHandler(void)
-//{
-//  /* USER CODE BEGIN EXTI13_IRQn 0 */
-//
-//  /* USER CODE END EXTI13_IRQn 0 */
-//  if (LL_EXTI_IsActiveRisingFlag_0_31(LL_EXTI_LINE_13) != RESET)
-//  {
-//    LL_EXTI_ClearRisingFlag_0_31(LL_EXTI_LINE_13);
-//    /* USER CODE BEGIN LL_EXTI_LINE_13_RISING */
-//	UserButton_Callback();
-//    /* USER CODE END LL_EXTI_LINE_13_RISING */
-//  }
-//  /* USER CODE BEGIN EXTI13_IRQn 1 */
-//
-//  /* USER CODE END EXTI13_IRQn 1 */
-//}
-
-
-void USB_DRD_FS_IRQHandler(void)
+void EXTI0_IRQHandler(void)
+{
+	edge_isr(0);
+}
+
+void EXTI1_IRQHandler(void)
+{
+	edge_isr(1);
+}
+
+void EXTI2_IRQHandler(void)
+{
+	edge_isr(2);
+}
+
+void EXTI3_IRQHandler(void)
+{
+	edge_isr(3);
+}
+
+void EXTI4_IRQHandler(void)
+{
+	edge_isr(4);
+}
+
+void EXTI5_IRQHandler(void)
+{
+	edge_isr(5);
+}
+
+void EXTI6_IRQHandler(void)
+{
+	edge_isr(6);
+}
+
+void EXTI7_IRQHandler(void)
+{
+	edge_isr(7);
+}
+
+void EXTI8_IRQHandler(void)
+{
+	edge_isr(8);
+}
+
+void EXTI9_IRQHandler(void)
+{
+	edge_isr(9);
+}
+
+void EXTI10_IRQHandler(void)
+{
+	edge_isr(10);
+}
+
+void EXTI11_IRQHandler(void)
+{
+	edge_isr(11);
+}
+
+void EXTI12_IRQHandler(void)
+{
+	edge_isr(12);
+}
+
+void EXTI13_IRQHandler(void)
+{
+	edge_isr(13);
+}
+
+void EXTI14_IRQHandler(void)
+{
+	edge_isr(14);
+}
+
+void EXTI15_IRQHandler(void)
+{
+	edge_isr(15);
+}
+
+/**
+  * @brief This function handles TIM2 global interrupt.
+  */
+void TIM2_IRQHandler(void)
+{
+	motion_isr();
+}
+
+/**
+  * @brief This function handles TIM5 global interrupt.
+  */
+void TIM5_IRQHandler(void)
+{
+	sched_isr();
+	route_timer_isr();
+}
+
+/**
+  * @brief This function handles I3C1 event interrupt.
+  */
+void I3C1_EV_IRQHandler(void)
+{
+	i3c_isr();
+}
+
+/**
+  * @brief This function handles USART2 global interrupt.
+  */
+void USART2_IRQHandler(void)
+{
+	uart_isr();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 4 (UART RX) global interrupt.
+  */
+void GPDMA1_Channel4_IRQHandler(void)
+{
+	uart_rx_dma_isr();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 5 (UART TX) global interrupt.
+  */
+void GPDMA1_Channel5_IRQHandler(void)
+{
+	uart_tx_dma_isr();
+}
+
+/**
+  * @brief This function handles GPDMA1 Channel 7 (ADC) global interrupt.
+  */
+void GPDMA1_Channel7_IRQHandler(void)
+{
+	adc_dma_isr();
+}
+
+/**
+  * @brief This function handles GPDMA2 Channel 0 (DAC) global interrupt.
+  */
+void GPDMA2_Channel0_IRQHandler(void)
+{
+	dac_dma_isr();
+}
+
+static RAMFUNC void usb_isr(void)
 {
 	uint32_t istr= USB_DRD_FS->ISTR;
 
+	usb_event_isr();
+	usb_uart_isr();
+	usb_analog_isr();
+
 	if((istr & USB_ISTR_CTR) == USB_ISTR_CTR) {
 		ctr_isr();
 		return;
@@ -268,3 +407,18 @@ void USB_DRD_FS_IRQHandler(void)
 		return;
 	}
 }
+
+/*
+ * Core cycles of the last and of the longest USB interrupt, printed by the "isr" CLI command
+ */
+uint32_t usb_isr_cycles;
+uint32_t usb_isr_cycles_max;
+
+RAMFUNC void USB_DRD_FS_IRQHandler(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	usb_isr();
+	usb_isr_cycles = DWT->CYCCNT - start;
+	if(usb_isr_cycles > usb_isr_cycles_max)
+		usb_isr_cycles_max = usb_isr_cycles;
+}
@@ -0,0 +1,107 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "sync.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/* TIM2 counter, port writes, TIM2 counter */
+static dma_copy_t copies[SYNC_MAX_PORTS + 2];
+static uint32_t words[SYNC_MAX_PORTS];
+static volatile uint32_t stamps[2];
+
+static int sync_write(const sync_write_request_t* write, uint32_t* span_ns)
+{
+	if(write->count == 0 || write->count > SYNC_MAX_PORTS || write->delay_us > SYNC_MAX_DELAY_US)
+		return ERROR_GPIO_PARAMETER;
+	for(int i=0;i<write->count;i++) {
+		int res = gpio_check(write->ports[i].port, write->ports[i].mask);
+		if(res < 0)
+			return res;
+	}
+
+	uint32_t n = write->count;
+	copies[0].src = (uint32_t)&TIM2->CNT;
+	copies[0].dst = (uint32_t)&stamps[0];
+	for(uint32_t i=0;i<n;i++) {
+		const sync_port_t* p = &write->ports[i];
+		words[i] = (p->value & p->mask) | ((~p->value & p->mask) << 16);
+		copies[i+1].src = (uint32_t)&words[i];
+		copies[i+1].dst = (uint32_t)&gpio_port(p->port)->BSRR;
+	}
+	copies[n+1].src = (uint32_t)&TIM2->CNT;
+	copies[n+1].dst = (uint32_t)&stamps[1];
+
+	/* one-pulse TIM17 at 1 MHz, only its overflow raises the DMA request */
+	LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM17);
+	LL_TIM_DisableCounter(TIM17);
+	WRITE_REG(TIM17->DIER, 0);
+	LL_TIM_SetUpdateSource(TIM17, LL_TIM_UPDATESOURCE_COUNTER);
+	LL_TIM_SetOnePulseMode(TIM17, LL_TIM_ONEPULSEMODE_SINGLE);
+	LL_TIM_SetPrescaler(TIM17, TIM_CLK_HZ/1000000 - 1);
+	LL_TIM_SetAutoReload(TIM17, write->delay_us ? write->delay_us : 1);
+	LL_TIM_GenerateEvent_UPDATE(TIM17);
+	LL_TIM_SetCounter(TIM17, 0);
+	WRITE_REG(TIM17->SR, 0);
+
+	dma_start_copies(DMA_SYNC, DMA_REQUEST_TIM17_UP, copies, n+2);
+	SET_BIT(TIM17->DIER, TIM_DIER_UDE);
+	LL_TIM_EnableCounter(TIM17);
+
+	int res = 0;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(dma_status(DMA_SYNC) == 0)
+		if(LL_TIM_GetCounter(TIM5) - start > write->delay_us + 1000)
+			break;
+	if(dma_status(DMA_SYNC) != 1)
+		res = ERROR_SYNC_TIMEOUT;
+
+	LL_TIM_DisableCounter(TIM17);
+	WRITE_REG(TIM17->DIER, 0);
+	dma_stop(DMA_SYNC);
+	if(res == 0)
+		*span_ns = (uint64_t)(stamps[1] - stamps[0]) * 1000000000 / TIM2_CLK_HZ;
+	return res;
+}
+
+/*
+ * Executes a sync request and fills in the reply. Returns the reply length in bytes.
+ * SYNC_WRITE is deferred.
+ */
+int sync_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case SYNC_WRITE:
+		const sync_write_request_t* write = (const sync_write_request_t*)request;
+		uint32_t* span_ns = (uint32_t*)(reply + sizeof(*result));
+		*span_ns = 0;
+		if(request->length < sizeof(*write) || request->length < sizeof(*write) + write->count*sizeof(sync_port_t))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = sync_write(write, span_ns);
+		return sizeof(*result) + sizeof(*span_ns);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
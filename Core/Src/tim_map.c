@@ -0,0 +1,188 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "tim_map.h"
+#include "stm32h5xx_ll_bus.h"
+#include "gpio.h"
+#include <stddef.h>
+
+/*
+ * Timer channels available on the NUCLEO-H563ZI pins.
+ * TIM2 and TIM5 are not listed, since they are the device timebases.
+ * Pins used by the USB, the debug USART and the user button are left out.
+ */
+static const tim_pin_t tim_pins[] = {
+	{'a', 8, 1, LL_GPIO_AF_1, TIM1},
+	{'e', 9, 1, LL_GPIO_AF_1, TIM1},
+	{'a', 9, 2, LL_GPIO_AF_1, TIM1},
+	{'e', 11, 2, LL_GPIO_AF_1, TIM1},
+	{'a', 10, 3, LL_GPIO_AF_1, TIM1},
+	{'e', 13, 3, LL_GPIO_AF_1, TIM1},
+	{'e', 14, 4, LL_GPIO_AF_1, TIM1},
+
+	{'a', 6, 1, LL_GPIO_AF_2, TIM3},
+	{'b', 4, 1, LL_GPIO_AF_2, TIM3},
+	{'c', 6, 1, LL_GPIO_AF_2, TIM3},
+	{'a', 7, 2, LL_GPIO_AF_2, TIM3},
+	{'b', 5, 2, LL_GPIO_AF_2, TIM3},
+	{'c', 7, 2, LL_GPIO_AF_2, TIM3},
+	{'b', 0, 3, LL_GPIO_AF_2, TIM3},
+	{'c', 8, 3, LL_GPIO_AF_2, TIM3},
+	{'b', 1, 4, LL_GPIO_AF_2, TIM3},
+	{'c', 9, 4, LL_GPIO_AF_2, TIM3},
+
+	{'b', 6, 1, LL_GPIO_AF_2, TIM4},
+	{'d', 12, 1, LL_GPIO_AF_2, TIM4},
+	{'b', 7, 2, LL_GPIO_AF_2, TIM4},
+	{'d', 13, 2, LL_GPIO_AF_2, TIM4},
+	{'b', 8, 3, LL_GPIO_AF_2, TIM4},
+	{'d', 14, 3, LL_GPIO_AF_2, TIM4},
+	{'b', 9, 4, LL_GPIO_AF_2, TIM4},
+	{'d', 15, 4, LL_GPIO_AF_2, TIM4},
+
+	{'c', 6, 1, LL_GPIO_AF_3, TIM8},
+	{'c', 7, 2, LL_GPIO_AF_3, TIM8},
+	{'c', 8, 3, LL_GPIO_AF_3, TIM8},
+	{'c', 9, 4, LL_GPIO_AF_3, TIM8},
+
+	{'e', 5, 1, LL_GPIO_AF_4, TIM15},
+	{'a', 2, 1, LL_GPIO_AF_4, TIM15},
+	{'e', 6, 2, LL_GPIO_AF_4, TIM15},
+	{'a', 3, 2, LL_GPIO_AF_4, TIM15},
+};
+
+typedef struct {
+	TIM_TypeDef* tim;
+	enum tim_owner owner;
+} tim_slot_t;
+
+static tim_slot_t tim_slots[] = {
+	{TIM1, TIM_OWNER_NONE},
+	{TIM3, TIM_OWNER_NONE},
+	{TIM4, TIM_OWNER_NONE},
+	{TIM8, TIM_OWNER_NONE},
+	{TIM15, TIM_OWNER_NONE},
+};
+
+static tim_slot_t* find_slot(TIM_TypeDef* tim)
+{
+	for(int i=0;i<sizeof(tim_slots)/sizeof(tim_slots[0]);i++)
+		if(tim_slots[i].tim == tim)
+			return &tim_slots[i];
+	return NULL;
+}
+
+static void enable_clock(TIM_TypeDef* tim)
+{
+	if(tim == TIM1)
+		LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM1);
+	else if(tim == TIM3)
+		LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM3);
+	else if(tim == TIM4)
+		LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_TIM4);
+	else if(tim == TIM8)
+		LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM8);
+	else if(tim == TIM15)
+		LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_TIM15);
+}
+
+/*
+ * Returns the first timer channel on the given pin whose timer is either free or already owned by owner,
+ * among the channels in channel_mask. Returns NULL if there is none, or if the pin is owned by a peripheral.
+ */
+const tim_pin_t* tim_pin_lookup(char port, uint8_t pin, enum tim_owner owner, uint32_t channel_mask)
+{
+	const gpio_pin_t* gpin = gpio_lookup(port, pin);
+	if(gpin == NULL || gpin->owner != PIN_OWNER_GPIO)
+		return NULL;
+	port |= 0x20;	// lower case
+	for(int i=0;i<sizeof(tim_pins)/sizeof(tim_pins[0]);i++) {
+		const tim_pin_t* p = &tim_pins[i];
+		if(p->port != port || p->pin != pin || (TIM_CHANNEL_MASK(p->channel) & channel_mask) == 0)
+			continue;
+		tim_slot_t* slot = find_slot(p->tim);
+		if(slot->owner == TIM_OWNER_NONE || slot->owner == owner)
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ * Claims a timer for owner and enables its clock.
+ * The first claim of a free timer resets it.
+ */
+int tim_claim(TIM_TypeDef* tim, enum tim_owner owner)
+{
+	tim_slot_t* slot = find_slot(tim);
+	if(slot == NULL)
+		return ERROR_TIM_NO_CHANNEL;
+	if(slot->owner == owner)
+		return 0;
+	if(slot->owner != TIM_OWNER_NONE)
+		return ERROR_TIM_BUSY;
+
+	slot->owner = owner;
+	enable_clock(tim);
+	LL_TIM_DeInit(tim);
+	return 0;
+}
+
+void tim_release(TIM_TypeDef* tim, enum tim_owner owner)
+{
+	tim_slot_t* slot = find_slot(tim);
+	if(slot == NULL || slot->owner != owner)
+		return;
+	LL_TIM_DeInit(tim);
+	slot->owner = TIM_OWNER_NONE;
+}
+
+uint32_t tim_ll_channel(uint8_t channel)
+{
+	switch(channel) {
+	case 1:
+		return LL_TIM_CHANNEL_CH1;
+	case 2:
+		return LL_TIM_CHANNEL_CH2;
+	case 3:
+		return LL_TIM_CHANNEL_CH3;
+	case 4:
+		return LL_TIM_CHANNEL_CH4;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Connects the pin to the timer channel. Fails if a peripheral owns the pin.
+ */
+int tim_pin_connect(const tim_pin_t* map)
+{
+	return gpio_alternate(map->port, map->pin, map->af, PIN_OWNER_TIM);
+}
+
+/*
+ * Gives the pin back to the gpio functions as an input, if the timers own it
+ */
+void tim_pin_disconnect(const tim_pin_t* map)
+{
+	const gpio_pin_t* p = gpio_lookup(map->port, map->pin);
+	if(p == NULL || p->owner != PIN_OWNER_TIM)
+		return;
+	LL_GPIO_SetPinMode(p->port, p->mask, LL_GPIO_MODE_INPUT);
+	gpio_release(map->port, map->pin, PIN_OWNER_TIM);
+}
@@ -0,0 +1,292 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "uart.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include "usb_descriptors.h"
+#include <string.h>
+
+#define RX_MASK		(UART_RX_RING - 1)
+#define TX_MASK		(UART_TX_RING - 1)
+
+/*
+ * Ring indexes are free-running byte counts. The RX write index follows the DMA position,
+ * which is sampled at least twice per lap by the half and complete transfer interrupts.
+ */
+static uint8_t rx_ring[UART_RX_RING] __attribute__((aligned(4)));
+static uint8_t tx_ring[UART_TX_RING] __attribute__((aligned(4)));
+static dma_node_t rx_node;
+static uint32_t rx_w, rx_r, rx_dma_pos;
+static uint32_t tx_w, tx_r, tx_dma_length;
+static int enabled;
+static uint8_t flags;
+
+/* Divisions of the kernel clock, from LL_USART_PRESCALER_DIV1 to LL_USART_PRESCALER_DIV256 */
+static const uint16_t prescaler_div[] = {1, 2, 4, 6, 8, 10, 12, 16, 32, 64, 128, 256};
+static uart_status_t status;
+
+int uart_enabled()
+{
+	return enabled;
+}
+
+static void rx_update()
+{
+	uint32_t pos = (UART_RX_RING - dma_remaining(DMA_UART_RX)) & RX_MASK;
+	uint32_t n = (pos - rx_dma_pos) & RX_MASK;
+
+	rx_dma_pos = pos;
+	rx_w += n;
+	status.rx_bytes += n;
+	if(rx_w - rx_r > UART_RX_RING) {
+		status.rx_dropped += rx_w - rx_r - UART_RX_RING;
+		rx_r = rx_w - UART_RX_RING;
+	}
+}
+
+/*
+ * Returns the number of received bytes that can be read contiguously from *data
+ */
+uint32_t uart_rx_peek(const uint8_t** data)
+{
+	if(!enabled)
+		return 0;
+
+	rx_update();
+	uint32_t n = rx_w - rx_r;
+	uint32_t contiguous = UART_RX_RING - (rx_r & RX_MASK);
+	*data = &rx_ring[rx_r & RX_MASK];
+	return n < contiguous ? n : contiguous;
+}
+
+void uart_rx_consume(uint32_t n)
+{
+	if(n <= rx_w - rx_r)
+		rx_r += n;
+}
+
+uint32_t uart_tx_free()
+{
+	return UART_TX_RING - (tx_w - tx_r);
+}
+
+static void tx_start()
+{
+	if(tx_dma_length != 0 || tx_w == tx_r)
+		return;
+
+	uint32_t n = tx_w - tx_r;
+	uint32_t contiguous = UART_TX_RING - (tx_r & TX_MASK);
+	tx_dma_length = n < contiguous ? n : contiguous;
+	dma_start(DMA_UART_TX, DMA_REQUEST_USART2_TX, &USART2->TDR, &tx_ring[tx_r & TX_MASK], tx_dma_length, DMA_TO_PERIPH | DMA_WIDTH_8 | DMA_IRQ_TC);
+}
+
+/*
+ * Queues n bytes for transmission, n must not exceed uart_tx_free().
+ * Returns 0 if there is no room left for another packet, in which case the host must be held off
+ * until uart_tx_free() is at least EP_MAX_PACKET_SIZE.
+ */
+int uart_tx_push(const uint8_t* data, uint32_t n)
+{
+	for(uint32_t i=0;i<n;i++)
+		tx_ring[(tx_w + i) & TX_MASK] = data[i];
+	tx_w += n;
+	tx_start();
+
+	if(uart_tx_free() >= EP_MAX_PACKET_SIZE)
+		return 1;
+	status.flow_stalls++;
+	return 0;
+}
+
+/*
+ * USART2 interrupt: idle line and receive errors. The USB interrupt is woken up to forward the data.
+ */
+void uart_isr()
+{
+	uint32_t isr = READ_REG(USART2->ISR);
+
+	if(isr & USART_ISR_ORE)
+		status.overruns++;
+	if(isr & (USART_ISR_FE | USART_ISR_PE | USART_ISR_NE))
+		status.line_errors++;
+	WRITE_REG(USART2->ICR, USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_PECF | USART_ICR_NECF);
+
+	rx_update();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+}
+
+void uart_rx_dma_isr()
+{
+	WRITE_REG(DMA_UART_RX->CFCR, DMA_CFCR_HTF | DMA_CFCR_TCF);
+	rx_update();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+}
+
+void uart_tx_dma_isr()
+{
+	WRITE_REG(DMA_UART_TX->CFCR, DMA_CFCR_TCF);
+	tx_r += tx_dma_length;
+	status.tx_bytes += tx_dma_length;
+	tx_dma_length = 0;
+	tx_start();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+}
+
+/*
+ * Gives the pins back to the gpio functions as inputs
+ */
+static void uart_pins_release()
+{
+	for(uint8_t pin=3;pin<=6;pin++) {
+		const gpio_pin_t* p = gpio_lookup('d', pin);
+		if(p->owner != PIN_OWNER_UART)
+			continue;
+		LL_GPIO_SetPinMode(GPIOD, p->mask, LL_GPIO_MODE_INPUT);
+		gpio_release('d', pin, PIN_OWNER_UART);
+	}
+}
+
+static void uart_stop()
+{
+	if(!enabled)
+		return;
+
+	enabled = 0;
+	NVIC_DisableIRQ(USART2_IRQn);
+	NVIC_DisableIRQ(GPDMA1_Channel4_IRQn);
+	NVIC_DisableIRQ(GPDMA1_Channel5_IRQn);
+	dma_stop(DMA_UART_RX);
+	dma_stop(DMA_UART_TX);
+	LL_USART_Disable(USART2);
+	uart_pins_release();
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);	// EP3 OUT discards the data from now on
+}
+
+static int uart_config(const uart_config_request_t* config, uint32_t* actual_baud)
+{
+	if(config->baud < UART_MIN_BAUD || config->baud > UART_MAX_BAUD)
+		return ERROR_UART_BAUD;
+	if((config->data_bits != 7 && config->data_bits != 8) || config->parity > UART_PARITY_ODD)
+		return ERROR_GPIO_PARAMETER;
+
+	uart_stop();
+
+	LL_RCC_SetUSARTClockSource(LL_RCC_USART2_CLKSOURCE_PCLK1);
+	LL_APB1_GRP1_EnableClock(LL_APB1_GRP1_PERIPH_USART2);
+	LL_APB1_GRP1_ForceReset(LL_APB1_GRP1_PERIPH_USART2);
+	LL_APB1_GRP1_ReleaseReset(LL_APB1_GRP1_PERIPH_USART2);
+
+	int res = gpio_claim('d', 5, PIN_OWNER_UART);
+	if(res == 0)
+		res = gpio_claim('d', 6, PIN_OWNER_UART);
+	if(res == 0 && (config->flags & UART_RTS_CTS))
+		res = gpio_claim('d', 3, PIN_OWNER_UART);
+	if(res == 0 && (config->flags & UART_RTS_CTS))
+		res = gpio_claim('d', 4, PIN_OWNER_UART);
+	if(res < 0) {
+		uart_pins_release();
+		return res;
+	}
+	LL_GPIO_SetPinPull(GPIOD, LL_GPIO_PIN_6, LL_GPIO_PULL_UP);
+	gpio_alternate('d', 5, LL_GPIO_AF_7, PIN_OWNER_UART);
+	gpio_alternate('d', 6, LL_GPIO_AF_7, PIN_OWNER_UART);
+	if(config->flags & UART_RTS_CTS) {
+		LL_GPIO_SetPinPull(GPIOD, LL_GPIO_PIN_3, LL_GPIO_PULL_DOWN);
+		gpio_alternate('d', 3, LL_GPIO_AF_7, PIN_OWNER_UART);
+		gpio_alternate('d', 4, LL_GPIO_AF_7, PIN_OWNER_UART);
+	}
+
+	uint32_t word = config->data_bits + (config->parity != UART_PARITY_NONE);
+	LL_USART_InitTypeDef init = {0};
+	/* the smallest prescaler whose BRR value fits in 16 bits, at 16 times oversampling for the slow rates */
+	uint32_t prescaler = 0;
+	while((UART_KER_CLK_HZ / prescaler_div[prescaler] + config->baud/2) / config->baud > 0xFFFF)
+		prescaler++;
+	init.PrescalerValue = prescaler;
+	init.BaudRate = config->baud;
+	init.DataWidth = word == 7 ? LL_USART_DATAWIDTH_7B : word == 8 ? LL_USART_DATAWIDTH_8B : LL_USART_DATAWIDTH_9B;
+	init.StopBits = (config->flags & UART_STOP_2) ? LL_USART_STOPBITS_2 : LL_USART_STOPBITS_1;
+	init.Parity = config->parity == UART_PARITY_EVEN ? LL_USART_PARITY_EVEN : config->parity == UART_PARITY_ODD ? LL_USART_PARITY_ODD : LL_USART_PARITY_NONE;
+	init.TransferDirection = LL_USART_DIRECTION_TX_RX;
+	init.HardwareFlowControl = (config->flags & UART_RTS_CTS) ? LL_USART_HWCONTROL_RTS_CTS : LL_USART_HWCONTROL_NONE;
+	init.OverSampling = config->baud > UART_KER_CLK_HZ / 16 ? LL_USART_OVERSAMPLING_8 : LL_USART_OVERSAMPLING_16;
+	LL_USART_Init(USART2, &init);
+	LL_USART_DisableFIFO(USART2);
+	LL_USART_ConfigAsyncMode(USART2);
+	*actual_baud = LL_USART_GetBaudRate(USART2, UART_KER_CLK_HZ, init.PrescalerValue, init.OverSampling);
+
+	memset(&status, 0, sizeof(status));
+	rx_w = rx_r = rx_dma_pos = 0;
+	tx_w = tx_r = tx_dma_length = 0;
+
+	SET_BIT(USART2->CR1, USART_CR1_IDLEIE | USART_CR1_PEIE);
+	SET_BIT(USART2->CR3, USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE);
+	dma_start_circular(DMA_UART_RX, DMA_REQUEST_USART2_RX, &USART2->RDR, rx_ring, UART_RX_RING, DMA_WIDTH_8 | DMA_IRQ_TC | DMA_IRQ_HT, &rx_node);
+
+	NVIC_SetPriority(USART2_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), UART_INT_PRIORITY, 0));
+	NVIC_SetPriority(GPDMA1_Channel4_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), UART_INT_PRIORITY, 0));
+	NVIC_SetPriority(GPDMA1_Channel5_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), UART_INT_PRIORITY, 0));
+	NVIC_EnableIRQ(USART2_IRQn);
+	NVIC_EnableIRQ(GPDMA1_Channel4_IRQn);
+	NVIC_EnableIRQ(GPDMA1_Channel5_IRQn);
+
+	LL_USART_Enable(USART2);
+	flags = config->flags;
+	enabled = 1;
+	return 0;
+}
+
+/*
+ * Executes a UART request and fills in the reply. Returns the reply length in bytes.
+ */
+int uart_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+
+	*result = 0;
+	switch(request->operation) {
+	case UART_CONFIG:
+		const uart_config_request_t* config = (const uart_config_request_t*)request;
+		uint32_t* actual_baud = (uint32_t*)(reply + sizeof(*result));
+		*actual_baud = 0;
+		if(request->length < sizeof(*config))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = uart_config(config, actual_baud);
+		return sizeof(*result) + sizeof(*actual_baud);
+
+	case UART_STATUS:
+		uart_status_t* s = (uart_status_t*)(reply + sizeof(*result));
+		if(enabled)
+			rx_update();
+		memcpy(s, &status, sizeof(*s));
+		s->rx_pending = rx_w - rx_r;
+		s->tx_pending = tx_w - tx_r;
+		return sizeof(*result) + sizeof(*s);
+
+	case UART_STOP:
+		uart_stop();
+		return sizeof(*result);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -18,12 +18,38 @@
 
 #include "usb.h"
 #include "usb_descriptors.h"
+#include "mcu_init.h"
 #include "cli.h"
 #include "stm32h5xx_ll_utils.h"
 #include "gpio.h"
+#include "seq.h"
+#include "sched.h"
+#include "edge.h"
+#include "meas.h"
+#include "pwm.h"
+#include "spi.h"
+#include "i2c.h"
+#include "i3c.h"
+#include "jtag.h"
+#include "uart.h"
+#include "adc.h"
+#include "dac.h"
+#include "counter.h"
+#include "route.h"
+#include "wait.h"
+#include "pulse.h"
+#include "par.h"
+#include "motion.h"
+#include "sync.h"
+#include "profile.h"
+#include "boot.h"
+#include "wire.h"
 #include <string.h>
 
 #define NUM_BUFF_DESCR_ENTRY 	8
+#define EP1_BUFFER_SIZE			REQUEST_MAX_LENGTH
+#define EVENT_QUEUE_LENGTH		32	// must be a power of 2
+#define EVENT_MAX_PAYLOAD		(EP_MAX_PACKET_SIZE - 1 - sizeof(event_header_t))	// events never fill a packet, so they need no zero-length packet
 
 #define GET_STATUS			0
 #define CLEAR_FEATURE		1
@@ -52,6 +78,40 @@ static int ep_remaining_bytes[TOT_ENDPOINT_COUNT/2];
 static uint8_t* ep_data_p[TOT_ENDPOINT_COUNT/2];
 static uint8_t ep_state[TOT_ENDPOINT_COUNT/2];
 
+/*
+ * Requests longer than a packet are reassembled in ep1_rx_buffer,
+ * replies longer than a packet are sent from ep1_tx_buffer.
+ */
+static uint8_t ep1_rx_buffer[EP1_BUFFER_SIZE] __attribute__((aligned(4)));
+static uint8_t ep1_tx_buffer[EP1_BUFFER_SIZE] __attribute__((aligned(4)));
+static uint32_t ep1_rx_count;
+
+/*
+ * Events can be posted from any interrupt priority and are sent by the USB interrupt
+ */
+typedef struct {
+	uint32_t length;
+	uint8_t data[EP_MAX_PACKET_SIZE];
+} event_slot_t;
+
+static event_slot_t events[EVENT_QUEUE_LENGTH];
+static volatile uint32_t ev_w_idx, ev_r_idx;
+static uint8_t ev_sequence;
+
+/*
+ * EP3 carries the UART byte stream. ep3_in_length is the length of the last packet sent,
+ * ep3_out_held is set while EP3 OUT is NAKed because the UART TX ring is full.
+ */
+static uint32_t ep3_in_length;
+static int ep3_out_held;
+
+/*
+ * EP4 IN carries the ADC sample stream, EP4 OUT the DAC sample stream.
+ * ep4_out_held is set while EP4 OUT is NAKed because the DAC FIFO is full.
+ */
+static uint32_t ep4_in_length;
+static int ep4_out_held;
+
 enum usb_dev_state {
 	USB_NONE,
 	USB_ATTACHED,
@@ -73,7 +133,8 @@ enum  {
 enum {
 	EP_REQ,
 	EP_OUT,
-	EP_IN
+	EP_IN,
+	EP_BUSY		// a deferred request is being executed
 };
 
 static enum usb_dev_state dev_state = USB_NONE;
@@ -91,6 +152,7 @@ void usb_reset_isr()
 	uint32_t packet_buffer_start = ((2+BULK_ENDPOINT_COUNT) * 4);	// one 32-bit USBRAM register is needed for each endpoint before the packet buffers
 
 	STRPRINT("USB Resetting..\n");
+	boot_mark(BOOT_USB_RESET);
 
 	/* Set up structs for default endpoints 0 IN and OUT */
 	ch_ep_out[0].num=0;
@@ -146,8 +208,18 @@ void usb_reset_isr()
 
 	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,0,USB_EP_TX_NAK);
 	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,1,USB_EP_TX_NAK);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,2,USB_EP_TX_NAK);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,3,USB_EP_TX_NAK);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,4,USB_EP_TX_NAK);
 	USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,0,USB_EP_RX_VALID);
 	USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,1,USB_EP_RX_VALID);
+	USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,2,USB_EP_RX_VALID);
+	USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,3,USB_EP_RX_VALID);
+	USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,4,USB_EP_RX_VALID);
+	ep3_in_length = 0;
+	ep3_out_held = 0;
+	ep4_in_length = 0;
+	ep4_out_held = 0;
 }
 
 
@@ -321,7 +393,7 @@ token again. This is done to avoid losing the notification of a SETUP transactio
 to the same endpoint immediately following the transaction, which triggered the VTRX
 interrupt.
  */
-int ep0_sm(uint32_t istr)
+RAMFUNC int ep0_sm(uint32_t istr)
 {
 	uint32_t xfer_count;
 	struct usb_request data;
@@ -407,6 +479,7 @@ int ep0_sm(uint32_t istr)
 					if (data.wValue==1) {
 						configuration_num = 1;
 						dev_state = USB_CONFIGURED;
+						boot_mark(BOOT_USB_CONFIGURED);
 					}
 					else {
 						configuration_num = 0;
@@ -415,9 +488,11 @@ int ep0_sm(uint32_t istr)
 					USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,0,0);
 					ep_state[0] = STATUS_IN;
 					USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,0,USB_EP_TX_VALID);
-					// make end point 1 and 2 ready to receive
+					// make end points 1 to 4 ready to receive
 					USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,1,USB_EP_RX_VALID);
 					USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,2,USB_EP_RX_VALID);
+					USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,3,USB_EP_RX_VALID);
+					USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,4,USB_EP_RX_VALID);
 				}
 				break;
 
@@ -548,13 +623,154 @@ int ep0_sm(uint32_t istr)
 	return 0;
 }
 
+static RAMFUNC void ep1_reply(int length)
+{
+	int ep_num=1;
+	uint32_t xfer_count;
+
+	ep_remaining_bytes[ep_num] = length;
+	ep_data_p[ep_num] = ep1_tx_buffer;
+	ep_state[ep_num] = EP_IN;
+	xfer_count = min(ep_remaining_bytes[ep_num],EP_MAX_PACKET_SIZE);
+	USB_WritePMA(USB_DRD_FS,ep_data_p[ep_num], ch_ep_in[ep_num].pmaadress, xfer_count);
+	USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,ep_num,xfer_count);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_VALID);
+}
+
+/*
+ * Requests that can take long to complete are not executed in the USB interrupt,
+ * but in the PendSV handler, which has the lowest priority. This way the USB peripheral
+ * keeps being serviced while, e.g., a sequencer program is waiting for a pin.
+ */
+static RAMFUNC int is_deferred(uint32_t operation)
+{
+	switch(operation) {
+	case SEQ_RUN:
+	case MEAS_RUN:
+	case SPI_TRANSFER:
+	case I2C_TRANSFER:
+	case I3C_DAA:
+	case I3C_TRANSFER:
+	case JTAG_RUN:
+	case WIRE_RUN:
+	case ADC_CONFIG:
+	case ADC_READ:
+	case WAIT_PINS:
+	case PAR_RUN:
+	case SYNC_WRITE:
+	case PROFILE_SAVE:
+	case PROFILE_BOOT:
+	case PROFILE_APPLY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int ep1_execute(const request_header_t* request, uint8_t* reply)
+{
+	switch(OPERATION_GROUP(request->operation)) {
+	case OPERATION_GROUP(SEQ_LOAD):
+		return seq_request(request, reply);
+	case OPERATION_GROUP(SCHED_SUBMIT):
+		return sched_request(request, reply);
+	case OPERATION_GROUP(EDGE_CONFIG):
+		return edge_request(request, reply);
+	case OPERATION_GROUP(MEAS_RUN):
+		return meas_request(request, reply);
+	case OPERATION_GROUP(PWM_CONFIG):
+		return pwm_request(request, reply);
+	case OPERATION_GROUP(SPI_TRANSFER):
+		return spi_request(request, reply);
+	case OPERATION_GROUP(I2C_TRANSFER):
+		return i2c_request(request, reply);
+	case OPERATION_GROUP(I3C_CONFIG):
+		return i3c_request(request, reply);
+	case OPERATION_GROUP(JTAG_RUN):
+		return jtag_request(request, reply);
+	case OPERATION_GROUP(UART_CONFIG):
+		return uart_request(request, reply);
+	case OPERATION_GROUP(ADC_CONFIG):
+		return adc_request(request, reply);
+	case OPERATION_GROUP(DAC_START):
+		return dac_request(request, reply);
+	case OPERATION_GROUP(COUNTER_START):
+		return counter_request(request, reply);
+	case OPERATION_GROUP(ROUTE_CONFIG):
+		return route_request(request, reply);
+	case OPERATION_GROUP(WAIT_PINS):
+		return wait_request(request, reply);
+	case OPERATION_GROUP(PULSE_START):
+		return pulse_request(request, reply);
+	case OPERATION_GROUP(PAR_CONFIG):
+		return par_request(request, reply);
+	case OPERATION_GROUP(MOTION_CONFIG):
+		return motion_request(request, reply);
+	case OPERATION_GROUP(SYNC_WRITE):
+		return sync_request(request, reply);
+	case OPERATION_GROUP(PORT_CONFIG):
+		return gpio_port_request(request, reply);
+	case OPERATION_GROUP(PROFILE_SAVE):
+		return profile_request(request, reply);
+	case OPERATION_GROUP(BOOT_TIMES):
+		return boot_request(request, reply);
+	case OPERATION_GROUP(WIRE_RUN):
+		return wire_request(request, reply);
+	default:
+		*(int32_t*)reply = ERROR_REQUEST_OPERATION;
+		return sizeof(int32_t);
+	}
+}
+
 /*
- * EP1 is dedicated to GPIOs
+ * Executes a request that does not come from the host, e.g. one stored in a profile.
+ * Called in the context of the caller, whether the request is deferred or not.
  */
-int ep1_sm(uint32_t istr)
+int usb_execute(const request_header_t* request, uint8_t* reply)
+{
+	return ep1_execute(request, reply);
+}
+
+static RAMFUNC void ep1_dispatch()
+{
+	const request_header_t* request = (const request_header_t*)ep1_rx_buffer;
+
+	if(is_deferred(request->operation)) {
+		ep_state[1] = EP_BUSY;
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+		return;
+	}
+	ep1_reply(ep1_execute(request, ep1_tx_buffer));
+}
+
+/*
+ * Called by the PendSV handler to execute a deferred request
+ */
+void usb_deferred_isr()
+{
+	if(ep_state[1] != EP_BUSY)
+		return;
+
+	int length = ep1_execute((const request_header_t*)ep1_rx_buffer, ep1_tx_buffer);
+
+	/* The endpoint registers are also written by the USB interrupt, which must not preempt the update */
+	NVIC_DisableIRQ(USB_DRD_FS_IRQn);
+	if(ep_state[1] == EP_BUSY)
+		ep1_reply(length);
+	NVIC_EnableIRQ(USB_DRD_FS_IRQn);
+}
+
+/*
+ * EP1 carries GPIO requests, which fit in a single packet, and all other requests,
+ * which start with a request_header_t and can span several packets.
+ * Replies longer than a packet are split into packets, and terminated by a zero-length packet
+ * if their length is a multiple of the packet size.
+ */
+RAMFUNC int ep1_sm(uint32_t istr)
 {
 	uint32_t xfer_count;
 	int ep_num=1;
+	const request_header_t* request = (const request_header_t*)ep1_rx_buffer;
 
 	switch(ep_state[ep_num]) {
 
@@ -567,9 +783,26 @@ int ep1_sm(uint32_t istr)
 		}
 		xfer_count = (uint16_t)USB_DRD_GET_CHEP_RX_CNT(USB_DRD_FS, ep_num);
 
+		USB_ReadPMA(USB_DRD_FS, ep1_rx_buffer, ch_ep_out[ep_num].pmaadress, (uint16_t)xfer_count);
+		ep1_rx_count = xfer_count;
+
+		if(OPERATION_GROUP(request->operation) != OPERATION_GROUP(GPIO_SET)) {
+			if(xfer_count < sizeof(request_header_t) || request->length > EP1_BUFFER_SIZE) {
+				*(int32_t*)ep1_tx_buffer = ERROR_REQUEST_LENGTH;
+				ep1_reply(sizeof(int32_t));
+			}
+			else if(ep1_rx_count < request->length) {
+				ep_state[ep_num] = EP_OUT;
+				USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+			}
+			else
+				ep1_dispatch();
+			break;
+		}
+
+		memcpy(&gpio_request, ep1_rx_buffer, min(xfer_count, sizeof(gpio_request)));
 		STRPRINT("Received %d bytes. Operation: %d, pin %c%d\n",xfer_count,gpio_request.operation,gpio_request.port,gpio_request.pin);
 
-		USB_ReadPMA(USB_DRD_FS, (uint8_t*)&gpio_request, ch_ep_out[ep_num].pmaadress, (uint16_t)xfer_count);
 		switch(gpio_request.operation) {
 		case GPIO_CLEAR:
 			gpio_clear(gpio_request.port,gpio_request.pin);
@@ -581,13 +814,8 @@ int ep1_sm(uint32_t istr)
 			break;
 		case GPIO_GET:
 			int v = gpio_get(gpio_request.port,gpio_request.pin);
-			ep_remaining_bytes[ep_num] = sizeof(v);
-			ep_data_p[ep_num] = (uint8_t*)&v;
-			ep_state[ep_num] = EP_IN;
-			xfer_count = min(ep_remaining_bytes[ep_num],EP_MAX_PACKET_SIZE);
-			USB_WritePMA(USB_DRD_FS,ep_data_p[ep_num], ch_ep_in[ep_num].pmaadress, xfer_count);
-			USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,ep_num,xfer_count);
-			USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_VALID);
+			memcpy(ep1_tx_buffer, &v, sizeof(v));
+			ep1_reply(sizeof(v));
 			break;
 		case GPIO_CONFIG:
 			gpio_config(gpio_request.port, gpio_request.pin, gpio_request.direction, gpio_request.type,gpio_request.pull);
@@ -600,6 +828,29 @@ int ep1_sm(uint32_t istr)
 			break;
 		}
 		break;
+	case EP_OUT:
+		USB_DRD_CLEAR_RX_CHEP_CTR(USB_DRD_FS, ep_num);
+		if((istr & USB_ISTR_DIR) == 0) {
+			error(__FUNCTION__,-3);
+			stall_ep(ep_num);
+			return -1;
+		}
+		xfer_count = (uint16_t)USB_DRD_GET_CHEP_RX_CNT(USB_DRD_FS, ep_num);
+		xfer_count = min(xfer_count, EP1_BUFFER_SIZE - ep1_rx_count);
+		USB_ReadPMA(USB_DRD_FS, ep1_rx_buffer + ep1_rx_count, ch_ep_out[ep_num].pmaadress, (uint16_t)xfer_count);
+		ep1_rx_count += xfer_count;
+
+		if(ep1_rx_count < request->length && xfer_count == EP_MAX_PACKET_SIZE) {
+			USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+		}
+		else if(ep1_rx_count < request->length) {
+			/* short packet before the end of the request */
+			*(int32_t*)ep1_tx_buffer = ERROR_REQUEST_LENGTH;
+			ep1_reply(sizeof(int32_t));
+		}
+		else
+			ep1_dispatch();
+		break;
 	case EP_IN:
 		USB_DRD_CLEAR_TX_CHEP_CTR(USB_DRD_FS, ep_num);
 		if((istr & USB_ISTR_DIR) != 0) {
@@ -608,6 +859,15 @@ int ep1_sm(uint32_t istr)
 		}
 		xfer_count = (uint16_t)USB_DRD_GET_CHEP_TX_CNT(USB_DRD_FS, ep_num);
 		STRPRINT("Transmitted %d bytes\n",xfer_count);
+		ep_remaining_bytes[ep_num] -= xfer_count;
+		ep_data_p[ep_num] += xfer_count;
+		if(ep_remaining_bytes[ep_num] > 0 || xfer_count == EP_MAX_PACKET_SIZE) {
+			xfer_count = min(ep_remaining_bytes[ep_num],EP_MAX_PACKET_SIZE);
+			USB_WritePMA(USB_DRD_FS,ep_data_p[ep_num], ch_ep_in[ep_num].pmaadress, xfer_count);
+			USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,ep_num,xfer_count);
+			USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_VALID);
+			break;
+		}
 		ep_state[ep_num] = EP_REQ;
 		USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_NAK);
 		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
@@ -619,7 +879,210 @@ int ep1_sm(uint32_t istr)
 	return 0;
 }
 
-int ctr_isr()
+/*
+ * EP2 OUT is not used yet: packets are discarded.
+ * EP2 IN sends the queued events.
+ */
+RAMFUNC int ep2_sm(uint32_t istr)
+{
+	int ep_num=2;
+
+	if((istr & USB_ISTR_DIR) != 0) {
+		USB_DRD_CLEAR_RX_CHEP_CTR(USB_DRD_FS, ep_num);
+		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+		return 0;
+	}
+
+	USB_DRD_CLEAR_TX_CHEP_CTR(USB_DRD_FS, ep_num);
+	if(ep_state[ep_num] == EP_IN) {
+		ev_r_idx++;
+		ep_state[ep_num] = EP_REQ;
+	}
+	usb_event_isr();
+	return 0;
+}
+
+/*
+ * Queues an event. Returns a negative value if the queue is full, in which case the event is lost.
+ */
+int usb_event_post(uint16_t type, const void* payload, uint32_t length)
+{
+	if(length > EVENT_MAX_PAYLOAD)
+		return ERROR_REQUEST_LENGTH;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint8_t sequence = ev_sequence++;
+	if(ev_w_idx - ev_r_idx >= EVENT_QUEUE_LENGTH) {
+		__set_PRIMASK(primask);
+		return ERROR_REQUEST_LENGTH;
+	}
+	event_slot_t* e = &events[ev_w_idx & (EVENT_QUEUE_LENGTH-1)];
+	event_header_t* h = (event_header_t*)e->data;
+	h->type = type;
+	h->length = length;
+	h->sequence = sequence;
+	h->timestamp = TIM5->CNT;
+	memcpy(e->data + sizeof(*h), payload, length);
+	e->length = sizeof(*h) + length;
+	ev_w_idx++;
+
+	__set_PRIMASK(primask);
+
+	/* let the USB interrupt send the event */
+	NVIC_SetPendingIRQ(USB_DRD_FS_IRQn);
+	return 0;
+}
+
+/*
+ * Called by the USB interrupt handler: sends the oldest queued event if EP2 IN is idle
+ */
+RAMFUNC void usb_event_isr()
+{
+	int ep_num=2;
+
+	if(dev_state != USB_CONFIGURED || ep_state[ep_num] != EP_REQ || ev_r_idx == ev_w_idx)
+		return;
+
+	event_slot_t* e = &events[ev_r_idx & (EVENT_QUEUE_LENGTH-1)];
+	ep_state[ep_num] = EP_IN;
+	USB_WritePMA(USB_DRD_FS, e->data, ch_ep_in[ep_num].pmaadress, e->length);
+	USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,ep_num,e->length);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_VALID);
+}
+
+/*
+ * EP3 OUT packets are queued for UART transmission, or discarded while the bridge is stopped.
+ * EP3 IN sends the received bytes.
+ */
+RAMFUNC int ep3_sm(uint32_t istr)
+{
+	int ep_num=3;
+
+	if((istr & USB_ISTR_DIR) != 0) {
+		USB_DRD_CLEAR_RX_CHEP_CTR(USB_DRD_FS, ep_num);
+		if(uart_enabled()) {
+			uint8_t buf[EP_MAX_PACKET_SIZE];
+			uint32_t xfer_count = (uint16_t)USB_DRD_GET_CHEP_RX_CNT(USB_DRD_FS, ep_num);
+			xfer_count = min(xfer_count, EP_MAX_PACKET_SIZE);
+			USB_ReadPMA(USB_DRD_FS, buf, ch_ep_out[ep_num].pmaadress, (uint16_t)xfer_count);
+			if(uart_tx_push(buf, xfer_count) == 0) {
+				/* the endpoint stays NAK until usb_uart_isr() finds room in the TX ring */
+				ep3_out_held = 1;
+				return 0;
+			}
+		}
+		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+		return 0;
+	}
+
+	USB_DRD_CLEAR_TX_CHEP_CTR(USB_DRD_FS, ep_num);
+	if(ep_state[ep_num] == EP_IN) {
+		uart_rx_consume(ep3_in_length);
+		ep_state[ep_num] = EP_REQ;
+	}
+	usb_uart_isr();
+	return 0;
+}
+
+/*
+ * Sends the next packet of a byte stream on an idle IN endpoint. The bytes are consumed when the
+ * transfer completes. A full packet with nothing behind it is followed by a zero-length packet,
+ * so that the host read completes.
+ */
+static RAMFUNC void stream_in(int ep_num, uint32_t (*peek)(const uint8_t**), uint32_t* last_length)
+{
+	if(ep_state[ep_num] != EP_REQ)
+		return;
+
+	const uint8_t* data = NULL;
+	uint32_t n = min(peek(&data), EP_MAX_PACKET_SIZE);
+	if(n == 0 && *last_length != EP_MAX_PACKET_SIZE)
+		return;
+
+	*last_length = n;
+	ep_state[ep_num] = EP_IN;
+	if(n > 0)
+		USB_WritePMA(USB_DRD_FS, (uint8_t*)data, ch_ep_in[ep_num].pmaadress, n);
+	USB_DRD_SET_CHEP_TX_CNT(USB_DRD_FS,ep_num,n);
+	USB_DRD_SET_CHEP_TX_STATUS(USB_DRD_FS,ep_num,USB_EP_TX_VALID);
+}
+
+/*
+ * Called by the USB interrupt handler, which the UART interrupts wake up: releases EP3 OUT
+ * when the TX ring has room again or the bridge is stopped, and sends the received bytes on EP3 IN if it is idle.
+ */
+RAMFUNC void usb_uart_isr()
+{
+	int ep_num=3;
+
+	if(dev_state != USB_CONFIGURED)
+		return;
+
+	if(ep3_out_held && (!uart_enabled() || uart_tx_free() >= EP_MAX_PACKET_SIZE)) {
+		ep3_out_held = 0;
+		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+	}
+
+	stream_in(ep_num, uart_rx_peek, &ep3_in_length);
+}
+
+/*
+ * EP4 OUT packets are queued for DAC playback, or discarded while no stream is started.
+ * EP4 IN sends the packed ADC samples.
+ */
+RAMFUNC int ep4_sm(uint32_t istr)
+{
+	int ep_num=4;
+
+	if((istr & USB_ISTR_DIR) != 0) {
+		USB_DRD_CLEAR_RX_CHEP_CTR(USB_DRD_FS, ep_num);
+		if(dac_streaming()) {
+			uint8_t buf[EP_MAX_PACKET_SIZE];
+			uint32_t xfer_count = (uint16_t)USB_DRD_GET_CHEP_RX_CNT(USB_DRD_FS, ep_num);
+			xfer_count = min(xfer_count, EP_MAX_PACKET_SIZE);
+			USB_ReadPMA(USB_DRD_FS, buf, ch_ep_out[ep_num].pmaadress, (uint16_t)xfer_count);
+			if(dac_stream_push(buf, xfer_count) == 0) {
+				/* the endpoint stays NAK until usb_analog_isr() finds room in the FIFO */
+				ep4_out_held = 1;
+				return 0;
+			}
+		}
+		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+		return 0;
+	}
+
+	USB_DRD_CLEAR_TX_CHEP_CTR(USB_DRD_FS, ep_num);
+	if(ep_state[ep_num] == EP_IN) {
+		adc_stream_consume(ep4_in_length);
+		ep_state[ep_num] = EP_REQ;
+	}
+	usb_analog_isr();
+	return 0;
+}
+
+/*
+ * Called by the USB interrupt handler, which the ADC and DAC DMA interrupts and SysTick wake up:
+ * releases EP4 OUT when the DAC FIFO has room again or the stream is stopped,
+ * and sends the packed ADC samples on EP4 IN if it is idle.
+ */
+RAMFUNC void usb_analog_isr()
+{
+	int ep_num=4;
+
+	if(dev_state != USB_CONFIGURED)
+		return;
+
+	if(ep4_out_held && (!dac_streaming() || dac_stream_free() >= EP_MAX_PACKET_SIZE)) {
+		ep4_out_held = 0;
+		USB_DRD_SET_CHEP_RX_STATUS(USB_DRD_FS,ep_num,USB_EP_RX_VALID);
+	}
+
+	stream_in(ep_num, adc_stream_peek, &ep4_in_length);
+}
+
+RAMFUNC int ctr_isr()
 {
 	uint16_t istr;
 	uint8_t idn;
@@ -645,6 +1108,15 @@ int ctr_isr()
 			if(res == -1)
 				__NOP();
 			break;
+		case 2:
+			res = ep2_sm(istr);
+			break;
+		case 3:
+			res = ep3_sm(istr);
+			break;
+		case 4:
+			res = ep4_sm(istr);
+			break;
 		default:
 			break;
 		}
@@ -661,3 +1133,19 @@ void USB_Init()
 
 	dev_state = USB_POWERED;
 }
+
+/*
+ * USB_Init() in two steps, so that other initializations run during the transceiver startup
+ */
+void USB_Power()
+{
+	USB_ll_power();
+	set_serial_number();
+
+	dev_state = USB_POWERED;
+}
+
+void USB_Connect()
+{
+	USB_ll_connect();
+}
@@ -39,7 +39,7 @@ const struct usb_device_descriptor usb_device_desc = {
 struct usb_framework_descriptor usb_framework_desc = {
 	.configuration.bLength = 9,
 	.configuration.bDescriptorType = DESCR_CONFIGURATION,
-	.configuration.wTotalLength = 18+7*(BULK_ENDPOINT_COUNT),	// assuming only 1 interface descriptor after the configuration descriptor plus 6 endpoint descriptors
+	.configuration.wTotalLength = 18+7*(BULK_ENDPOINT_COUNT),	// assuming only 1 interface descriptor after the configuration descriptor plus 8 endpoint descriptors
 	.configuration.bNumInterfaces = 1,
 	.configuration.bConfigurationValue = 1,
 	.configuration.iConfiguration = 4,
@@ -69,6 +69,48 @@ struct usb_framework_descriptor usb_framework_desc = {
 	.endpoints[1].bmAttributes = 0x02, 		// Bulk Transfer
 	.endpoints[1].wMaxPacketSize = EP_MAX_PACKET_SIZE,
 	.endpoints[1].bInterval = 1,
+
+	.endpoints[2].bLength = 7,
+	.endpoints[2].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[2].bEndpointAddress = 0x02,	// OUT Endpoint
+	.endpoints[2].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[2].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[2].bInterval = 1,
+
+	.endpoints[3].bLength = 7,
+	.endpoints[3].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[3].bEndpointAddress = 0x82,	// IN Endpoint, events
+	.endpoints[3].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[3].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[3].bInterval = 1,
+
+	.endpoints[4].bLength = 7,
+	.endpoints[4].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[4].bEndpointAddress = 0x03,	// OUT Endpoint, UART TX
+	.endpoints[4].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[4].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[4].bInterval = 1,
+
+	.endpoints[5].bLength = 7,
+	.endpoints[5].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[5].bEndpointAddress = 0x83,	// IN Endpoint, UART RX
+	.endpoints[5].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[5].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[5].bInterval = 1,
+
+	.endpoints[6].bLength = 7,
+	.endpoints[6].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[6].bEndpointAddress = 0x04,	// OUT Endpoint, DAC stream
+	.endpoints[6].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[6].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[6].bInterval = 1,
+
+	.endpoints[7].bLength = 7,
+	.endpoints[7].bDescriptorType = DESCR_ENDPOINT,
+	.endpoints[7].bEndpointAddress = 0x84,	// IN Endpoint, ADC stream
+	.endpoints[7].bmAttributes = 0x02, 		// Bulk Transfer
+	.endpoints[7].wMaxPacketSize = EP_MAX_PACKET_SIZE,
+	.endpoints[7].bInterval = 1,
 };
 
 // USB strings must be UTF-16
@@ -45,13 +45,11 @@
 #include "stm32h5xx_ll_utils.h"
 #include "mcu_init.h"
 
-void USB_ll_init()
+/*
+ * Powers the transceiver, which is then kept in reset and disconnected until USB_ll_connect()
+ */
+void USB_ll_power()
 {
-	uint32_t interrupt_bitmap = USB_CNTR_CTRM  | USB_CNTR_WKUPM |
-			   USB_CNTR_SUSPM | USB_CNTR_ERRM |
-			   USB_CNTR_SOFM | USB_CNTR_ESOFM |
-			   USB_CNTR_RESETM | USB_CNTR_L1REQM;
-
 	LL_RCC_SetUSBClockSource(LL_RCC_USB_CLKSOURCE_HSI48);
 
 	/* Enable VDDUSB */
@@ -62,15 +60,23 @@ void USB_ll_init()
 	SET_BIT(RCC->APB2ENR, RCC_APB2ENR_USBEN);
 	tmpreg = READ_BIT(RCC->APB2ENR, RCC_APB2ENR_USBEN);
 
-	/* Initialize USB global interrupt and its priority */
-	NVIC_SetPriority(USB_DRD_FS_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), USB_DRD_FS_INTR_PRI, 0));
-	NVIC_EnableIRQ(USB_DRD_FS_IRQn);
-
 	/* Remove PDWN but keep USBRST */
 	USB_DRD_FS->CNTR = USB_CNTR_USBRST;
+}
 
-	/* Wait tstartup*/
-	LL_mDelay(100);
+/*
+ * Releases the reset and connects to the bus. The transceiver startup time must have elapsed since USB_ll_power().
+ */
+void USB_ll_connect()
+{
+	uint32_t interrupt_bitmap = USB_CNTR_CTRM  | USB_CNTR_WKUPM |
+			   USB_CNTR_SUSPM | USB_CNTR_ERRM |
+			   USB_CNTR_SOFM | USB_CNTR_ESOFM |
+			   USB_CNTR_RESETM | USB_CNTR_L1REQM;
+
+	/* Initialize USB global interrupt and its priority */
+	NVIC_SetPriority(USB_DRD_FS_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), USB_DRD_FS_INTR_PRI, 0));
+	NVIC_EnableIRQ(USB_DRD_FS_IRQn);
 
 	/* Disable pull-up on DP line to disconnect from the bus*/
 	USB_DRD_FS->BCDR = 0;
@@ -91,6 +97,16 @@ void USB_ll_init()
 	USB_DRD_FS->BCDR |= USB_BCDR_DPPU;
 }
 
+void USB_ll_init()
+{
+	USB_ll_power();
+
+	/* Wait tstartup*/
+	LL_mDelay(100);
+
+	USB_ll_connect();
+}
+
 int USB_ActivateEndpoint(USB_DRD_TypeDef *USBx, USB_DRD_EPTypeDef *ep)
 {
   int ret = 0;
@@ -226,7 +242,7 @@ int USB_ActivateEndpoint(USB_DRD_TypeDef *USBx, USB_DRD_EPTypeDef *ep)
   * @param   wNBytes no. of bytes to be copied.
   * @retval None
   */
-void USB_WritePMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
+RAMFUNC void USB_WritePMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
 {
   (void)(USBx);
   uint32_t WrVal;
@@ -283,7 +299,7 @@ void USB_WritePMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMAB
   * @param   wNBytes no. of bytes to be copied.
   * @retval None
   */
-void USB_ReadPMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
+RAMFUNC void USB_ReadPMA(USB_DRD_TypeDef const *USBx, uint8_t *pbUsrBuf, uint16_t wPMABufAddr, uint16_t wNBytes)
 {
   (void)(USBx);
   uint32_t count;
@@ -0,0 +1,80 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "wait.h"
+#include "mcu_init.h"
+#include <stddef.h>
+
+/*
+ * Polls the port input register until the condition is met. Each sample is timestamped right after
+ * being read, so the resolution is the loop time unless an interrupt comes in between.
+ */
+static int wait_pins(const wait_request_t* wait, wait_reply_t* r)
+{
+	GPIO_TypeDef* port = gpio_port(wait->port);
+	if(port == NULL || wait->mode > WAIT_CHANGE)
+		return ERROR_GPIO_PARAMETER;
+
+	uint32_t mask = wait->mask;
+	uint32_t value = wait->mode == WAIT_MATCH ? wait->value & mask : READ_REG(port->IDR) & mask;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	uint32_t idr, t;
+	int res = 0;
+
+	while(1) {
+		idr = READ_REG(port->IDR);
+		t = LL_TIM_GetCounter(TIM5);
+		if(((idr & mask) == value) == (wait->mode == WAIT_MATCH))
+			break;
+		if(t - start >= wait->timeout_us) {
+			res = ERROR_WAIT_TIMEOUT;
+			break;
+		}
+	}
+
+	r->timestamp_us = t;
+	r->elapsed_us = t - start;
+	r->port_value = idr;
+	return res;
+}
+
+/*
+ * Executes a wait request and fills in the reply. Returns the reply length in bytes.
+ * WAIT_PINS is deferred.
+ */
+int wait_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	wait_reply_t* r = (wait_reply_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case WAIT_PINS:
+		const wait_request_t* wait = (const wait_request_t*)request;
+		*r = (wait_reply_t){0};
+		if(request->length < sizeof(*wait))
+			*result = ERROR_REQUEST_LENGTH;
+		else
+			*result = wait_pins(wait, r);
+		return sizeof(*result) + sizeof(*r);
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
@@ -0,0 +1,289 @@
+/*
+ * This file contains source code licensed under the BSD 3-Clause License.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the full BSD 3-Clause license
+ *    notice, including copyright.
+ * 2. Redistributions in binary form must reproduce the full license notice in
+ *    the documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the original author(s) nor the names of contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * This file is provided "as is" without any express or implied warranties.
+ * See the LICENSE file for full license details.
+ */
+
+#include "wire.h"
+#include "tim_map.h"
+#include "dma.h"
+#include "mcu_init.h"
+#include <string.h>
+
+typedef struct {
+	TIM_TypeDef* tim;
+	uint8_t cc1_request;
+	uint8_t up_request;
+	uint8_t cc_requests;	// channels with a DMA request, starting from CH1
+} wire_tim_t;
+
+static const wire_tim_t timers[] = {
+	{TIM1, DMA_REQUEST_TIM1_CC1, DMA_REQUEST_TIM1_UP, 4},
+	{TIM8, DMA_REQUEST_TIM8_CC1, DMA_REQUEST_TIM8_UP, 4},
+	{TIM3, DMA_REQUEST_TIM3_CC1, DMA_REQUEST_TIM3_UP, 4},
+	{TIM4, DMA_REQUEST_TIM4_CC1, DMA_REQUEST_TIM4_UP, 4},
+	{TIM15, DMA_REQUEST_TIM15_CC1, DMA_REQUEST_TIM15_UP, 1},
+};
+
+/*
+ * Pulse widths of the slots of a command, followed by two idle slots:
+ * the DMA completes at the start of the first one, when the last bit is over.
+ */
+static uint16_t compare[WIRE_MAX_SLOTS + 2];
+static uint16_t samples[WIRE_MAX_SLOTS];
+
+static const wire_tim_t* find_timer(TIM_TypeDef* tim)
+{
+	for(int i=0;i<sizeof(timers)/sizeof(timers[0]);i++)
+		if(timers[i].tim == tim)
+			return &timers[i];
+	return NULL;
+}
+
+static uint32_t ns_to_ticks(uint32_t ns)
+{
+	return (uint64_t)ns * (TIM_CLK_HZ/1000000) / 1000;
+}
+
+/*
+ * Runs n slots of period ticks, the pulse width of each slot being compare[].
+ * If sample_channel is not 0, the port is sampled at the sample tick of every slot.
+ */
+static int wire_slots(const wire_tim_t* t, uint8_t channel, uint8_t sample_channel, GPIO_TypeDef* port,
+		uint32_t n, uint32_t psc, uint32_t period, uint32_t sample, uint32_t timeout_us)
+{
+	TIM_TypeDef* tim = t->tim;
+	volatile uint32_t* ccr = &tim->CCR1 + (channel-1);
+
+	compare[n] = compare[n+1] = 0;
+	LL_TIM_DisableCounter(tim);
+	LL_TIM_SetPrescaler(tim, psc);
+	LL_TIM_SetAutoReload(tim, period-1);
+	LL_TIM_SetCounter(tim, 0);
+	*ccr = compare[0];
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	*ccr = compare[1];	// preloaded for the second slot, the DMA writes the following ones
+	WRITE_REG(tim->SR, 0);
+
+	if(sample_channel != 0) {
+		*(&tim->CCR1 + (sample_channel-1)) = sample;
+		dma_start(DMA_WIRE_SAMPLE, t->cc1_request + sample_channel-1, &port->IDR, samples, n*sizeof(uint16_t), DMA_WIDTH_16);
+		SET_BIT(tim->DIER, TIM_DIER_CC1DE << (sample_channel-1));
+	}
+	dma_start(DMA_WIRE, t->up_request, ccr, &compare[2], n*sizeof(uint16_t), DMA_TO_PERIPH | DMA_WIDTH_16);
+	SET_BIT(tim->DIER, TIM_DIER_UDE);
+	LL_TIM_EnableCounter(tim);
+
+	int res = 0;
+	uint32_t start = LL_TIM_GetCounter(TIM5);
+	while(dma_status(DMA_WIRE) == 0 || (sample_channel != 0 && dma_status(DMA_WIRE_SAMPLE) == 0)) {
+		if(LL_TIM_GetCounter(TIM5) - start > timeout_us) {
+			res = ERROR_WIRE_TIMEOUT;
+			break;
+		}
+	}
+	if(dma_status(DMA_WIRE) < 0 || (sample_channel != 0 && dma_status(DMA_WIRE_SAMPLE) < 0))
+		res = ERROR_WIRE_TIMEOUT;
+
+	LL_TIM_DisableCounter(tim);
+	WRITE_REG(tim->DIER, 0);
+	*ccr = 0;
+	LL_TIM_GenerateEvent_UPDATE(tim);
+	dma_stop(DMA_WIRE);
+	dma_stop(DMA_WIRE_SAMPLE);
+	return res;
+}
+
+/*
+ * Executes a command. Bits read are stored in rx.
+ */
+static int wire_command(const wire_tim_t* t, uint8_t channel, uint8_t sample_channel, GPIO_TypeDef* port, uint32_t pin_mask,
+		const wire_command_t* command, const uint8_t* data, uint8_t* rx)
+{
+	if(command->opcode == WIRE_DELAY) {
+		delay_us(command->period_ns / 1000);
+		return 0;
+	}
+
+	uint32_t ticks = ns_to_ticks(command->period_ns);
+	if(ticks < 2)
+		return ERROR_WIRE_TIMING;
+	uint32_t psc = (ticks-1) / 65536;
+	if(psc > 0xFFFF)
+		return ERROR_WIRE_TIMING;
+	uint32_t period = ticks / (psc+1);
+	uint32_t t0 = ns_to_ticks(command->t0_ns) / (psc+1);
+	uint32_t t1 = ns_to_ticks(command->t1_ns) / (psc+1);
+	uint32_t slots = command->opcode == WIRE_WRITE ? command->length*8 : command->length;
+	uint32_t timeout_us = (uint64_t)command->period_ns * (slots + 2) / 1000 + 1000;
+
+	if(slots == 0)
+		return 0;
+
+	switch(command->opcode) {
+	case WIRE_WRITE:
+		if(t0 >= period || t1 >= period)
+			return ERROR_WIRE_TIMING;
+		for(uint32_t i=0;i<slots;i++) {
+			uint32_t bit = (command->flags & WIRE_LSB_FIRST) ? data[i/8] & (1 << (i%8)) : data[i/8] & (0x80 >> (i%8));
+			compare[i] = bit ? t1 : t0;
+		}
+		return wire_slots(t, channel, 0, port, slots, psc, period, 0, timeout_us);
+
+	case WIRE_READ:
+		if(t0 >= period || t1 >= period || t1 == 0)
+			return ERROR_WIRE_TIMING;
+		if(sample_channel == 0)
+			return ERROR_TIM_NO_CHANNEL;
+		for(uint32_t i=0;i<command->length;i++)
+			compare[i] = t0;
+		int res = wire_slots(t, channel, sample_channel, port, command->length, psc, period, t1, timeout_us);
+		if(res < 0)
+			return res;
+		for(uint32_t i=0;i<command->length;i++)
+			if(samples[i] & pin_mask)
+				rx[i/8] |= (command->flags & WIRE_LSB_FIRST) ? 1 << (i%8) : 0x80 >> (i%8);
+		return 0;
+
+	default:
+		return ERROR_WIRE_COMMAND;
+	}
+}
+
+static uint32_t data_length(const wire_command_t* command)
+{
+	return command->opcode == WIRE_WRITE ? command->length : 0;
+}
+
+static uint32_t reply_length(const wire_command_t* command)
+{
+	return command->opcode == WIRE_READ ? (command->length + 7) / 8 : 0;
+}
+
+static int wire_run(const wire_run_request_t* run, uint8_t* rx, uint32_t* executed)
+{
+	GPIO_TypeDef* port = gpio_port(run->port);
+	if(port == NULL || run->pin > 15)
+		return ERROR_GPIO_PARAMETER;
+	uint32_t pin_mask = 1U << run->pin;
+
+	const tim_pin_t* map = tim_pin_lookup(run->port, run->pin, TIM_OWNER_WIRE, 0xF);
+	if(map == NULL)
+		return ERROR_TIM_NO_CHANNEL;
+	const wire_tim_t* t = find_timer(map->tim);
+	if(t == NULL)
+		return ERROR_TIM_NO_CHANNEL;
+	int res = tim_claim(map->tim, TIM_OWNER_WIRE);
+	if(res < 0)
+		return res;
+
+	/* the sampling channel is any other channel of the timer with a DMA request */
+	uint8_t sample_channel = 0;
+	for(uint8_t ch=1;ch<=t->cc_requests && sample_channel == 0;ch++)
+		if(ch != map->channel)
+			sample_channel = ch;
+
+	TIM_TypeDef* tim = map->tim;
+	uint32_t channel = tim_ll_channel(map->channel);
+	LL_TIM_OC_SetMode(tim, channel, LL_TIM_OCMODE_PWM1);
+	LL_TIM_OC_SetPolarity(tim, channel, (run->flags & WIRE_ACTIVE_LOW) ? LL_TIM_OCPOLARITY_LOW : LL_TIM_OCPOLARITY_HIGH);
+	LL_TIM_OC_EnablePreload(tim, channel);
+	*(&tim->CCR1 + (map->channel-1)) = 0;
+	LL_TIM_CC_EnableChannel(tim, channel);
+	if(IS_TIM_BREAK_INSTANCE(tim))
+		LL_TIM_EnableAllOutputs(tim);
+	LL_TIM_GenerateEvent_UPDATE(tim);
+
+	res = tim_pin_connect(map);
+	if(res < 0) {
+		tim_release(tim, TIM_OWNER_WIRE);
+		return res;
+	}
+	LL_GPIO_SetPinOutputType(port, pin_mask, (run->flags & WIRE_OPEN_DRAIN) ? LL_GPIO_OUTPUT_OPENDRAIN : LL_GPIO_OUTPUT_PUSHPULL);
+	LL_GPIO_SetPinPull(port, pin_mask, (run->flags & WIRE_OPEN_DRAIN) ? LL_GPIO_PULL_UP : LL_GPIO_PULL_NO);
+
+	const uint8_t* p = (const uint8_t*)(run + 1);
+	for(uint32_t i=0;i<run->count && res == 0;i++) {
+		const wire_command_t* command = (const wire_command_t*)p;
+		res = wire_command(t, map->channel, sample_channel, port, pin_mask, command, p + sizeof(*command), rx);
+		if(res == 0)
+			(*executed)++;
+		rx += reply_length(command);
+		p += sizeof(*command) + data_length(command);
+	}
+
+	/* the pin keeps the idle level as a gpio output */
+	if(run->flags & WIRE_ACTIVE_LOW)
+		LL_GPIO_SetOutputPin(port, pin_mask);
+	else
+		LL_GPIO_ResetOutputPin(port, pin_mask);
+	LL_GPIO_SetPinMode(port, pin_mask, LL_GPIO_MODE_OUTPUT);
+	gpio_release(map->port, map->pin, PIN_OWNER_TIM);
+	tim_release(tim, TIM_OWNER_WIRE);
+	return res;
+}
+
+/*
+ * Executes a WIRE request and fills in the reply. Returns the reply length in bytes.
+ * WIRE_RUN is deferred. The whole batch is checked before the first command is executed.
+ */
+int wire_request(const request_header_t* request, uint8_t* reply)
+{
+	int32_t* result = (int32_t*)reply;
+	uint32_t* executed = (uint32_t*)(reply + sizeof(*result));
+
+	*result = 0;
+	switch(request->operation) {
+	case WIRE_RUN:
+		const wire_run_request_t* run = (const wire_run_request_t*)request;
+		*executed = 0;
+		if(request->length < sizeof(*run)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		const uint8_t* end = (const uint8_t*)request + request->length;
+		const uint8_t* p = (const uint8_t*)(run + 1);
+		uint32_t rx_total = 0;
+		for(uint32_t i=0;i<run->count;i++) {
+			const wire_command_t* command = (const wire_command_t*)p;
+			if(p + sizeof(*command) > end || p + sizeof(*command) + data_length(command) > end) {
+				*result = ERROR_REQUEST_LENGTH;
+				return sizeof(*result);
+			}
+			if(command->opcode == 0 || command->opcode >= WIRE_OPCODE_COUNT
+					|| (command->opcode == WIRE_WRITE && command->length*8 > WIRE_MAX_SLOTS)
+					|| (command->opcode == WIRE_READ && command->length > WIRE_MAX_SLOTS)) {
+				*result = ERROR_WIRE_COMMAND;
+				return sizeof(*result);
+			}
+			rx_total += reply_length(command);
+			p += sizeof(*command) + data_length(command);
+		}
+		if(rx_total > REQUEST_MAX_LENGTH - sizeof(*result) - sizeof(*executed)) {
+			*result = ERROR_REQUEST_LENGTH;
+			return sizeof(*result);
+		}
+
+		uint8_t* rx = (uint8_t*)(executed + 1);
+		memset(rx, 0, rx_total);
+		*result = wire_run(run, rx, executed);
+		return (uint8_t*)(executed + 1) - reply + rx_total;
+
+	default:
+		*result = ERROR_REQUEST_OPERATION;
+		return sizeof(*result);
+	}
+}
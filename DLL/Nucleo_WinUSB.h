@@ -65,3 +65,1115 @@ extern "C" NUCLEO_WINUSB_API int gpio_clear(void* handle, char port, uint8_t pin
 /// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
 extern "C" NUCLEO_WINUSB_API int gpio_get(void* handle, char port, uint8_t pin, uint8_t* value);
 
+
+/// @brief Sequencer opcodes. See seq_instruction_t.
+enum seq_opcode {
+	SEQ_END = 0,		///< Stop the program.
+	SEQ_SET,			///< Set the pins of port in mask.
+	SEQ_CLEAR,			///< Clear the pins of port in mask.
+	SEQ_WRITE,			///< The pins of port in mask take the value of the corresponding bits of value.
+	SEQ_READ,			///< acc = (input value of port) & mask.
+	SEQ_WAIT_US,		///< Wait arg microseconds.
+	SEQ_WAIT_PIN,		///< Wait until ((input value of port) & mask) == value, for at most arg microseconds. acc = 1 on timeout, 0 otherwise.
+	SEQ_JUMP,			///< Jump to instruction target.
+	SEQ_BRANCH_EQ,		///< Jump to instruction target if acc == arg.
+	SEQ_BRANCH_NE,		///< Jump to instruction target if acc != arg.
+	SEQ_LOOP_INIT,		///< Loop counter number port (0 to 3) = arg.
+	SEQ_LOOP,			///< Decrement loop counter number port and jump to target if it is not zero.
+	SEQ_EMIT,			///< Append acc to the results.
+	SEQ_TIMESTAMP		///< acc = device time in microseconds.
+};
+
+#pragma pack(push,1)
+/// @brief Sequencer instruction.
+typedef struct {
+	uint8_t opcode;		///< One of seq_opcode.
+	uint8_t port;		///< GPIO port, from 'a' to 'h', or loop counter number for SEQ_LOOP_INIT and SEQ_LOOP.
+	uint16_t mask;		///< Pin mask, bit n is pin n.
+	uint16_t value;		///< Pin values for SEQ_WRITE and SEQ_WAIT_PIN.
+	uint16_t target;	///< Index of the instruction to jump to.
+	uint32_t arg;		///< Time in microseconds, loop count or comparison value.
+} seq_instruction_t;
+#pragma pack(pop)
+
+/// @brief This function uploads a sequencer program to the device.
+///
+/// A program is a list of instructions executed by the device firmware, so that test steps like "toggle a pin until another goes high, then read a third one"
+/// take microseconds rather than a USB round trip each. Programs are kept by the device until overwritten or until a reset.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] slot Program slot. Must be a number from 0 to 3.
+/// @param[in] program Pointer to the instructions.
+/// @param[in] count Number of instructions. Must be a number from 1 to 128.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int seq_load(void* handle, uint8_t slot, const seq_instruction_t* program, uint32_t count);
+
+/// @brief This function runs a sequencer program previously uploaded with seq_load() and returns the values emitted by it.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] slot Program slot. Must be a number from 0 to 3.
+/// @param[in] timeout_us The program is aborted if it runs for longer than this number of microseconds, at most 1000000.
+/// @param[out] results Pointer to an array that will contain the values emitted by the program.
+/// @param[in,out] count Input: size of the results array. Output: number of values emitted by the program (at most 256).
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int seq_run(void* handle, uint8_t slot, uint32_t timeout_us, uint32_t* results, uint32_t* count);
+
+/// @brief Actions that can be scheduled with sched_submit(). They apply to the pins of a port selected by a mask.
+enum sched_action {
+	SCHED_SET = 0,		///< Set the pins.
+	SCHED_CLEAR,		///< Clear the pins.
+	SCHED_WRITE,		///< The pins take the value of the corresponding bits of value.
+	SCHED_TOGGLE		///< Toggle the pins.
+};
+
+#pragma pack(push,1)
+/// @brief Command executed by the device at a given time.
+typedef struct {
+	uint32_t time;		///< Target execution time in microseconds, in the device timebase (see sched_time()). Past times are executed immediately.
+	uint16_t tag;		///< User value returned in the completion record.
+	uint8_t action;		///< One of sched_action.
+	uint8_t port;		///< GPIO port. Must be a letter from 'a' to 'h'.
+	uint16_t mask;		///< Pin mask, bit n is pin n.
+	uint16_t value;		///< Pin values for SCHED_WRITE.
+} sched_command_t;
+
+/// @brief Completion record of a scheduled command.
+typedef struct {
+	uint16_t tag;		///< Tag of the command.
+	uint16_t reserved;
+	uint32_t target;	///< Target execution time in microseconds.
+	int32_t skew;		///< Actual minus target execution time, in microseconds.
+} sched_record_t;
+#pragma pack(pop)
+
+/// @brief This function reads the device time, which is the timebase of the scheduled commands.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] time Device time in microseconds. It wraps around every 2^32 microseconds.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int sched_time(void* handle, uint32_t* time);
+
+/// @brief This function queues commands to be executed by the device at their target time, independently of the USB traffic.
+///
+/// At most 64 commands can be pending, and they cannot be scheduled more than 2^31 microseconds ahead. Either all commands are queued or none is.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] commands Pointer to the commands.
+/// @param[in] count Number of commands.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int sched_submit(void* handle, const sched_command_t* commands, uint32_t count);
+
+/// @brief This function reads the completion records of the executed commands. Each record is returned once.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] records Pointer to an array that will contain the completion records.
+/// @param[in,out] count Input: size of the records array. Output: number of records copied into the array.
+/// @param[out] pending Number of commands still waiting for their target time. Can be NULL.
+/// @param[out] lost Number of completion records lost because they were not read in time. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int sched_status(void* handle, sched_record_t* records, uint32_t* count, uint32_t* pending, uint32_t* lost);
+
+/// @brief This function drops all the pending commands.
+/// @param[in] handle Handle obtained from open().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int sched_cancel(void* handle);
+
+/// @brief Edges to be captured by edge_config().
+enum edge_trigger {
+	EDGE_NONE = 0,		///< Stop capturing the pin.
+	EDGE_RISING,		///< Capture rising edges.
+	EDGE_FALLING,		///< Capture falling edges.
+	EDGE_BOTH			///< Capture both edges.
+};
+
+#pragma pack(push,1)
+/// @brief Edge record.
+typedef struct {
+	uint32_t timestamp;	///< Device high-resolution timer value when the edge was detected. See edge_read() for its frequency.
+	uint8_t port;		///< GPIO port, from 'a' to 'h'.
+	uint8_t pin;		///< GPIO pin, from 0 to 15.
+	uint8_t edge;		///< EDGE_RISING or EDGE_FALLING.
+	uint8_t reserved;
+} edge_record_t;
+#pragma pack(pop)
+
+/// @brief This function starts or stops timestamping the edges of a pin.
+///
+/// The device records the pin, the edge and a timestamp from its high-resolution timer in a ring of 1024 records, which edge_read() drains.
+/// Pins with the same number on different ports cannot be captured at the same time.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be a number from 0 to 15.
+/// @param[in] trigger One of edge_trigger.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int edge_config(void* handle, char port, uint8_t pin, uint8_t trigger);
+
+/// @brief This function reads the captured edges, oldest first. Each record is returned once.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] records Pointer to an array that will contain the edge records.
+/// @param[in,out] count Input: size of the records array. Output: number of records copied into the array.
+/// @param[out] timer_hz Frequency of the timestamp timer in Hz. Can be NULL.
+/// @param[out] lost Number of records lost because the ring was full. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int edge_read(void* handle, edge_record_t* records, uint32_t* count, uint32_t* timer_hz, uint32_t* lost);
+
+/// @brief This function discards the captured edges and clears the lost records counter.
+/// @param[in] handle Handle obtained from open().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int edge_reset(void* handle);
+
+/// @brief Types of the events read by event_read().
+enum event_type {
+	EVENT_MEAS = 1,		///< Measurement result, the payload is a meas_event_t.
+	EVENT_I3C_IBI,		///< I3C in-band interrupt, the payload is an i3c_ibi_event_t.
+	EVENT_COUNTER		///< Counter snapshot, the payload is a counter_event_t.
+};
+
+#pragma pack(push,1)
+/// @brief Header of the events read by event_read(), followed by length bytes of payload.
+typedef struct {
+	uint16_t type;		///< One of event_type.
+	uint8_t length;		///< Payload length in bytes.
+	uint8_t sequence;	///< Incremented for every event. A gap means that events were lost because the device queue was full.
+	uint32_t timestamp;	///< Device microsecond time when the event was posted. See sched_time().
+} event_header_t;
+
+/// @brief Frequency and duty cycle measurement result.
+///
+/// The frequency is counted over the first half of the gate, the period and high time are sampled over the second half.
+/// The most accurate frequency is edges * gate_hz / gate_ticks, frequency_hz is rounded to the nearest Hz.
+typedef struct {
+	uint32_t frequency_hz;	///< Frequency in Hz, 0 if the pin does not toggle.
+	uint32_t duty_ppm;		///< High time in parts per million of the period. Pin level (0 or 1000000) if the pin does not toggle.
+	uint32_t edges;			///< Rising edges counted during gate_ticks.
+	uint32_t gate_ticks;	///< Counting time, in ticks of gate_hz.
+	uint32_t gate_hz;		///< Frequency of the gate timer in Hz.
+	uint32_t samples;		///< Number of sampled periods.
+	uint32_t sample_hz;		///< Frequency of the sampling timer in Hz, unit of the periods and high times below.
+	uint32_t min_period;	///< Shortest sampled period.
+	uint32_t max_period;	///< Longest sampled period.
+	uint32_t min_high;		///< Shortest sampled high time.
+	uint32_t max_high;		///< Longest sampled high time.
+} meas_result_t;
+
+/// @brief Payload of the EVENT_MEAS events.
+typedef struct {
+	uint8_t channel;		///< Stream channel given to meas_stream().
+	uint8_t port;			///< GPIO port, from 'a' to 'h'.
+	uint8_t pin;			///< GPIO pin, from 0 to 15.
+	uint8_t reserved;
+	meas_result_t result;
+} meas_event_t;
+#pragma pack(pop)
+
+/// @brief This function measures the frequency and the duty cycle of a signal.
+///
+/// The pin is connected to channel 1 or 2 of a free device timer, which does the counting, so signals up to tens of MHz can be measured.
+/// Only pins connected to such a timer channel can be measured. The function returns at the end of the gate.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be a number from 0 to 15.
+/// @param[in] gate_ms Measurement time in milliseconds, from 1 to 10000.
+/// @param[out] result Measurement result.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int meas_run(void* handle, char port, uint8_t pin, uint32_t gate_ms, meas_result_t* result);
+
+/// @brief This function starts measuring a signal periodically. Each result is sent as an EVENT_MEAS event, see event_read().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] channel Stream channel, from 0 to 3.
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be a number from 0 to 15.
+/// @param[in] gate_ms Measurement time in milliseconds, from 1 to 10000.
+/// @param[in] interval_ms Time between the starts of two measurements. A new measurement starts as soon as the previous one ends if it is shorter than gate_ms.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int meas_stream(void* handle, uint8_t channel, char port, uint8_t pin, uint32_t gate_ms, uint32_t interval_ms);
+
+/// @brief This function stops a measurement stream and releases its timer.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] channel Stream channel, from 0 to 3.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int meas_stop(void* handle, uint8_t channel);
+
+/// @brief This function reads one event sent by the device.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] event Pointer to a buffer that will contain the event_header_t followed by the payload. 64 bytes are always enough.
+/// @param[in] size Size of the buffer.
+/// @param[in] timeout_ms Time to wait for an event in milliseconds, 0 waits forever.
+/// @returns int variable. Event length in bytes [success(>0), timeout or fail(<0)]
+extern "C" NUCLEO_WINUSB_API int event_read(void* handle, void* event, uint32_t size, uint32_t timeout_ms);
+
+/// @brief PWM output polarity.
+enum pwm_polarity {
+	PWM_ACTIVE_HIGH = 0,	///< The pin is high for the duty cycle part of the period.
+	PWM_ACTIVE_LOW			///< The pin is low for the duty cycle part of the period.
+};
+
+#pragma pack(push,1)
+/// @brief New duty cycle of a PWM pin, see pwm_duty().
+typedef struct {
+	uint8_t port;			///< GPIO port, from 'a' to 'h'.
+	uint8_t pin;			///< GPIO pin, from 0 to 15.
+	uint16_t reserved;
+	uint32_t duty_ppm;		///< Duty cycle in parts per million of the period, from 0 to 1000000.
+} pwm_duty_t;
+#pragma pack(pop)
+
+/// @brief This function starts a hardware PWM on a pin, or changes it if the pin is already a PWM output.
+///
+/// The pin is switched to the alternate function of a device timer channel. The channels of a timer share its frequency,
+/// so a pin whose timer already drives other PWM pins only accepts their frequency.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be a number from 0 to 15.
+/// @param[in] frequency_hz PWM frequency in Hz, from 1 to 125000000.
+/// @param[in] duty_ppm Duty cycle in parts per million of the period, from 0 to 1000000.
+/// @param[in] polarity One of pwm_polarity.
+/// @param[out] actual_mhz Actual frequency in millihertz, up to 125000000000. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pwm_config(void* handle, char port, uint8_t pin, uint32_t frequency_hz, uint32_t duty_ppm, uint8_t polarity, uint64_t* actual_mhz);
+
+/// @brief This function changes the duty cycle of several PWM pins in one transaction.
+///
+/// The channels of a timer switch to their new duty cycles together at the end of the current period.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] duty Pointer to an array of new duty cycles.
+/// @param[in] count Number of elements of the array, at most 16.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pwm_duty(void* handle, const pwm_duty_t* duty, uint32_t count);
+
+/// @brief This function stops the PWM of a pin and configures the pin as an input.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be a number from 0 to 15.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pwm_stop(void* handle, char port, uint8_t pin);
+
+/// @brief spi_transaction_t flags.
+enum spi_flags {
+	SPI_LSB_FIRST = 0x01,		///< Bytes are sent least significant bit first.
+	SPI_FULL_DUPLEX = 0x02,		///< The rx bytes are received while the tx bytes are sent, otherwise after them.
+	SPI_CS_ACTIVE_HIGH = 0x04,	///< The chip select is active high.
+	SPI_CS_HOLD = 0x08			///< The chip select stays active after the transaction.
+};
+
+#pragma pack(push,1)
+/// @brief SPI transaction executed by spi_transfer().
+typedef struct {
+	uint8_t cs_port;		///< Chip select GPIO port, from 'a' to 'h', or 0 for no chip select. The pin must be configured as an output.
+	uint8_t cs_pin;			///< Chip select GPIO pin, from 0 to 15.
+	uint8_t mode;			///< SPI mode (CPOL, CPHA), from 0 to 3.
+	uint8_t flags;			///< Combination of spi_flags.
+	uint32_t clock_hz;		///< Maximum SCK frequency. The actual one is 64 MHz divided by a power of 2, from 2 to 256.
+	uint16_t tx_length;		///< Number of bytes to send.
+	uint16_t rx_length;		///< Number of bytes to receive. Without SPI_FULL_DUPLEX, they are clocked after the tx bytes with MOSI high.
+} spi_transaction_t;
+#pragma pack(pop)
+
+/// @brief This function executes a batch of SPI transactions on SPI1 (SCK PA5, MISO PG9, MOSI PB5) with a single USB round trip.
+///
+/// Execution stops at the first failing transaction.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] transactions Pointer to an array of transactions.
+/// @param[in] count Number of transactions.
+/// @param[in] tx Bytes to send: the tx bytes of all the transactions, one after the other.
+/// @param[out] rx Buffer that will contain the received bytes of all the transactions, one after the other. At most 4088 bytes per batch.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] executed Number of transactions executed. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int spi_transfer(void* handle, const spi_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, uint32_t* executed);
+
+#pragma pack(push,1)
+/// @brief I2C transaction executed by i2c_transfer().
+///
+/// The device writes tx_length bytes, then reads rx_length bytes after a repeated start, then sends a stop.
+/// A transaction with no tx and no rx bytes only addresses the target, which probes it.
+typedef struct {
+	uint8_t address;		///< 7-bit target address.
+	uint8_t reserved;
+	uint16_t tx_length;		///< Number of bytes to write.
+	uint16_t rx_length;		///< Number of bytes to read.
+	uint16_t reserved2;
+} i2c_transaction_t;
+#pragma pack(pop)
+
+/// @brief This function executes a batch of I2C transactions on I2C1 (SCL PB8, SDA PB9) with a single USB round trip.
+///
+/// A NACK only fails its own transaction. Execution stops at the first bus error or timeout.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] speed_hz Bus speed, rounded down to 100000, 400000 or 1000000.
+/// @param[in] transactions Pointer to an array of transactions.
+/// @param[in] count Number of transactions.
+/// @param[in] tx Bytes to write: the tx bytes of all the transactions, one after the other.
+/// @param[out] rx Buffer that will contain the bytes read by all the transactions, one after the other. The bytes of a failed transaction are zero.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] status Pointer to an array of count elements that will contain the result of each transaction [success(0), NACK(-72), fail(<0)]. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int i2c_transfer(void* handle, uint32_t speed_hz, const i2c_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, int32_t* status);
+
+/// @brief Types of the transactions executed by i3c_transfer().
+enum i3c_transaction_type {
+	I3C_PRIVATE = 0,	///< Private write of the tx bytes, then private read of the rx bytes after a repeated start.
+	I3C_CCC_BROADCAST,	///< Broadcast CCC with the tx bytes.
+	I3C_CCC_DIRECT		///< Direct CCC: writes the tx bytes, or reads the rx bytes if rx_length > 0.
+};
+
+#define I3C_DEFINING_BYTE	0x01	///< i3c_transaction_t flag: the first tx byte of a direct CCC is its defining byte.
+
+#pragma pack(push,1)
+/// @brief I3C transaction executed by i3c_transfer().
+typedef struct {
+	uint8_t type;			///< One of i3c_transaction_type.
+	uint8_t address;		///< Dynamic address of the target, ignored by broadcast CCCs.
+	uint8_t ccc;			///< Common command code of the CCC transactions.
+	uint8_t flags;			///< I3C_DEFINING_BYTE.
+	uint16_t tx_length;		///< Number of bytes to write.
+	uint16_t rx_length;		///< Number of bytes to read.
+} i3c_transaction_t;
+
+/// @brief Target found by i3c_daa().
+typedef struct {
+	uint8_t pid[6];			///< Provisioned ID, most significant byte first.
+	uint8_t bcr;			///< Bus characteristics register.
+	uint8_t dcr;			///< Device characteristics register.
+	uint8_t address;		///< Dynamic address assigned.
+	uint8_t reserved[3];
+} i3c_target_t;
+
+/// @brief Payload of the EVENT_I3C_IBI events.
+typedef struct {
+	uint8_t address;		///< Dynamic address of the target.
+	uint8_t length;			///< Number of valid bytes in data.
+	uint8_t reserved[2];
+	uint8_t data[4];		///< Mandatory data byte and following bytes.
+} i3c_ibi_event_t;
+#pragma pack(pop)
+
+/// @brief This function sets the SCL frequency of the I3C1 controller (SCL PB8, SDA PB9). The pins are shared with i2c_transfer().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] speed_hz Push-pull SCL frequency, from 488281 to 12500000.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int i3c_config(void* handle, uint32_t speed_hz);
+
+/// @brief This function runs the dynamic address assignment (ENTDAA).
+///
+/// The in-band interrupts of the first 4 targets are then accepted and sent as EVENT_I3C_IBI events, see event_read().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] first_address Dynamic address of the first target, the following targets get the next addresses.
+/// @param[out] targets Pointer to an array of 16 elements that will contain the targets found.
+/// @param[out] count Number of targets found.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int i3c_daa(void* handle, uint8_t first_address, i3c_target_t* targets, uint32_t* count);
+
+/// @brief This function executes a batch of I3C transactions with a single USB round trip.
+///
+/// A NACK only fails its own transaction. Execution stops at the first bus error or timeout.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] transactions Pointer to an array of transactions.
+/// @param[in] count Number of transactions.
+/// @param[in] tx Bytes to write: the tx bytes of all the transactions, one after the other.
+/// @param[out] rx Buffer that will contain the bytes read by all the transactions, one after the other. Bytes not read are zero.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] status Pointer to an array of count elements that will contain the result of each transaction [bytes read(>=0), NACK(-80), fail(<0)]. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int i3c_transfer(void* handle, const i3c_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, int32_t* status);
+
+/// @brief Commands executed by jtag_run().
+enum jtag_opcode {
+	JTAG_TMS = 1,		///< Shifts bits TMS bits from the data, TDI held at JTAG_TDI_HIGH.
+	JTAG_SHIFT,			///< Shifts bits TDI bits from the data, TMS low but on the last bit if JTAG_EXIT.
+	JTAG_CLOCK,			///< Generates bits clocks, TMS/SWDIO held at JTAG_TMS_HIGH.
+	JTAG_RESET,			///< Drives nRESET low if JTAG_ASSERT, releases it otherwise.
+	JTAG_DELAY_US,		///< Waits bits microseconds.
+	SWD_SEQUENCE,		///< Shifts bits SWDIO bits from the data (line reset, JTAG-to-SWD switch...).
+	SWD_READ,			///< Reads a DP or AP register. Adds 4 bytes to the rx data.
+	SWD_WRITE			///< Writes a DP or AP register with the 4 bytes of data.
+};
+
+#define JTAG_TDI_HIGH	0x01	///< jtag_command_t flag of JTAG_TMS.
+#define JTAG_CAPTURE	0x02	///< jtag_command_t flag of JTAG_SHIFT: the TDO bits are added to the rx data.
+#define JTAG_EXIT		0x04	///< jtag_command_t flag of JTAG_SHIFT: TMS high on the last bit.
+#define JTAG_TMS_HIGH	0x08	///< jtag_command_t flag of JTAG_CLOCK.
+#define JTAG_ASSERT		0x01	///< jtag_command_t flag of JTAG_RESET.
+#define SWD_AP			0x01	///< jtag_command_t flag of SWD_READ and SWD_WRITE: access port register, debug port otherwise.
+#define SWD_ADDRESS		0x0C	///< jtag_command_t flags of SWD_READ and SWD_WRITE: register address bits A[3:2].
+
+#pragma pack(push,1)
+/// @brief Command of the buffer executed by jtag_run().
+///
+/// The command is followed by (bits+7)/8 bytes of data for JTAG_TMS, JTAG_SHIFT and SWD_SEQUENCE, LSB first,
+/// by 4 bytes for SWD_WRITE and by nothing for the others.
+typedef struct {
+	uint8_t opcode;			///< One of jtag_opcode.
+	uint8_t flags;
+	uint16_t bits;
+} jtag_command_t;
+#pragma pack(pop)
+
+/// @brief This function executes a buffer of JTAG/SWD commands with a single USB round trip.
+///
+/// Pins: TCK/SWCLK PE2, TMS/SWDIO PE4, TDI PE5, TDO PE6, nRESET PE3 (open-drain). Execution stops at the first failed command.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] half_period Number of delay loops in each half of a clock period, 0 for the highest rate.
+/// @param[in] wait_retries Number of times an SWD transfer answered with WAIT is tried again.
+/// @param[in] commands Command buffer.
+/// @param[in] length Length of the command buffer in bytes.
+/// @param[out] rx Buffer that will contain the captured TDO bits and the SWD_READ data of all the commands, one after the other.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] executed Number of commands executed successfully. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), SWD no ack(-89), SWD WAIT(-90), SWD FAULT(-91), SWD parity(-92), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int jtag_run(void* handle, uint16_t half_period, uint16_t wait_retries, const uint8_t* commands, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed);
+
+/// @brief Parity of the UART bridge.
+enum uart_parity {
+	UART_PARITY_NONE = 0,
+	UART_PARITY_EVEN,
+	UART_PARITY_ODD
+};
+
+#define UART_RTS_CTS	0x01	///< uart_config() flag: hardware flow control on RTS PD4 and CTS PD3.
+#define UART_STOP_2		0x02	///< uart_config() flag: 2 stop bits.
+
+#pragma pack(push,1)
+/// @brief Counters of the UART bridge, cleared by uart_config().
+typedef struct {
+	uint32_t rx_bytes;		///< Bytes received from the line.
+	uint32_t tx_bytes;		///< Bytes sent on the line.
+	uint32_t rx_dropped;	///< Bytes lost because uart_read() was not called often enough.
+	uint32_t overruns;		///< USART overrun errors.
+	uint32_t line_errors;	///< Framing, parity and noise errors.
+	uint32_t flow_stalls;	///< Times uart_write() was held off because the device transmit buffer was full.
+	uint16_t rx_pending;	///< Bytes received and not read yet.
+	uint16_t tx_pending;	///< Bytes written and not sent on the line yet.
+} uart_status_t;
+#pragma pack(pop)
+
+/// @brief This function (re)starts the USB-to-UART bridge on USART2 (TX PD5, RX PD6). Pending data is discarded.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] baud Baud rate, from 15 to 31250000.
+/// @param[in] data_bits Number of data bits, 7 or 8.
+/// @param[in] parity One of uart_parity.
+/// @param[in] flags UART_RTS_CTS, UART_STOP_2.
+/// @param[out] actual_baud Baud rate actually set. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int uart_config(void* handle, uint32_t baud, uint8_t data_bits, uint8_t parity, uint8_t flags, uint32_t* actual_baud);
+
+/// @brief This function reads the counters of the UART bridge.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] status Counters.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int uart_status(void* handle, uart_status_t* status);
+
+/// @brief This function stops the UART bridge and releases its pins.
+/// @param[in] handle Handle obtained from open().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int uart_stop(void* handle);
+
+/// @brief This function sends bytes on the UART. It blocks while the device transmit buffer is full.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] data Bytes to send.
+/// @param[in] length Number of bytes.
+/// @param[in] timeout_ms Time to wait in milliseconds, 0 waits forever.
+/// @returns int variable. Number of bytes sent [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int uart_write(void* handle, const uint8_t* data, uint32_t length, uint32_t timeout_ms);
+
+/// @brief This function reads the bytes received by the UART.
+///
+/// It returns as soon as some bytes are available, so size should be a multiple of 64 bytes.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] data Buffer that will contain the bytes received.
+/// @param[in] size Size of the buffer.
+/// @param[in] timeout_ms Time to wait for data in milliseconds, 0 waits forever.
+/// @returns int variable. Number of bytes read [success(>=0), timeout or fail(<0)]
+extern "C" NUCLEO_WINUSB_API int uart_read(void* handle, uint8_t* data, uint32_t size, uint32_t timeout_ms);
+
+/// @brief Commands executed by wire_run().
+enum wire_opcode {
+	WIRE_WRITE = 1,		///< Writes length bytes: each bit is a period_ns slot starting with a pulse of t0_ns for 0 bits, t1_ns for 1 bits.
+	WIRE_READ,			///< Reads length slots: pulse of t0_ns, then the pin is sampled at t1_ns. A 1-Wire reset/presence is a 1-slot read.
+	WIRE_DELAY			///< Keeps the idle level for period_ns.
+};
+
+#define WIRE_ACTIVE_LOW		0x01	///< wire_run() flag: pulses are low and the idle level is high.
+#define WIRE_OPEN_DRAIN		0x02	///< wire_run() flag: open-drain output with pull-up, needed by reads.
+#define WIRE_LSB_FIRST		0x01	///< wire_command_t flag.
+
+#pragma pack(push,1)
+/// @brief Command executed by wire_run(), followed by length bytes of data for WIRE_WRITE.
+typedef struct {
+	uint8_t opcode;			///< One of wire_opcode.
+	uint8_t flags;			///< WIRE_LSB_FIRST, MSB first otherwise.
+	uint16_t length;		///< Bytes for WIRE_WRITE (at most 1024), slots for WIRE_READ (at most 8192).
+	uint32_t period_ns;		///< Bit period.
+	uint32_t t0_ns;			///< Pulse of the 0 bits and of the read slots.
+	uint32_t t1_ns;			///< Pulse of the 1 bits, sampling time of the read slots.
+} wire_command_t;
+#pragma pack(pop)
+
+/// @brief This function executes a batch of single-wire protocol commands on a timer pin, with exact timings generated by timer and DMA.
+///
+/// At the end, the pin is left as a gpio output at the idle level.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin. Must be connected to a timer channel, see meas_run().
+/// @param[in] flags WIRE_ACTIVE_LOW, WIRE_OPEN_DRAIN.
+/// @param[in] commands Command buffer.
+/// @param[in] count Number of commands.
+/// @param[in] length Length of the command buffer in bytes.
+/// @param[out] rx Buffer that will contain the bits read by the WIRE_READ commands, (length+7)/8 bytes each, one after the other. A high level is a 1.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] executed Number of commands executed. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int wire_run(void* handle, char port, uint8_t pin, uint8_t flags, const uint8_t* commands, uint32_t count, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed);
+
+#pragma pack(push,1)
+/// @brief Analog input of adc_config().
+typedef struct {
+	uint8_t port;			///< GPIO port letter.
+	uint8_t pin;			///< GPIO pin, must be connected to ADC1: PA0-PA7, PB0, PB1, PC0-PC5, PF11, PF12.
+} adc_pin_t;
+
+/// @brief Counters of the ADC stream, cleared by adc_start().
+typedef struct {
+	uint32_t samples;		///< Samples converted.
+	uint32_t dropped;		///< Samples lost because adc_stream_read() was not called often enough.
+	uint32_t pending;		///< Bytes waiting in the device.
+} adc_status_t;
+#pragma pack(pop)
+
+/// @brief This function sets the pins in analog mode and programs the ADC conversion sequence.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] pins Inputs, converted in this order.
+/// @param[in] count Number of inputs, at most 16.
+/// @param[in] sample_time Sampling time code, from 0 (2.5 ADC cycles) to 7 (640.5 cycles). The ADC clock is 62.5 MHz.
+/// @param[in] oversampling Each result is the average of 2^oversampling conversions, from 0 to 8.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_config(void* handle, const adc_pin_t* pins, uint8_t count, uint8_t sample_time, uint8_t oversampling);
+
+/// @brief This function starts streaming the conversions, triggered rate_hz times per second.
+///
+/// The stream is read with adc_stream_read().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] rate_hz Scans of the sequence per second.
+/// @param[out] actual_mhz Rate actually set, in millihertz. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_start(void* handle, uint32_t rate_hz, uint32_t* actual_mhz);
+
+/// @brief This function converts the sequence once. It fails while streaming.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] values 12-bit results, one per input.
+/// @param[in] count Size of values.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_read(void* handle, uint16_t* values, uint32_t count);
+
+/// @brief This function stops streaming.
+/// @param[in] handle Handle obtained from open().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_stop(void* handle);
+
+/// @brief This function reads the counters of the ADC stream.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] status Counters.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_status(void* handle, adc_status_t* status);
+
+/// @brief This function reads the ADC stream.
+///
+/// Samples are 12 bits, in sequence order, packed two in three bytes:
+/// byte0 = s0[7:0], byte1 = s0[11:8] | s1[3:0] << 4, byte2 = s1[11:4].
+/// The device sends two scans at a time, and drops whole scans when the stream is not read fast enough.
+/// It returns as soon as some bytes are available, so size should be a multiple of 64 bytes.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] data Buffer that will contain the stream.
+/// @param[in] size Size of the buffer.
+/// @param[in] timeout_ms Time to wait for data in milliseconds, 0 waits forever.
+/// @returns int variable. Number of bytes read [success(>=0), timeout or fail(<0)]
+extern "C" NUCLEO_WINUSB_API int adc_stream_read(void* handle, uint8_t* data, uint32_t size, uint32_t timeout_ms);
+
+/// @brief Playback modes of dac_start().
+enum dac_mode {
+	DAC_MODE_STREAM = 0,	///< Samples are sent with dac_stream_write().
+	DAC_MODE_LOOP			///< The table is played repeatedly.
+};
+
+#pragma pack(push,1)
+/// @brief Counters of the DAC playback, cleared by dac_start().
+typedef struct {
+	uint32_t played;		///< Samples played in stream mode.
+	uint32_t underruns;		///< Samples missing because dac_stream_write() was not called often enough. The last value is held.
+	uint32_t dma_underruns;	///< Updates missed by the device.
+	uint32_t pending;		///< Bytes waiting in the device.
+} dac_status_t;
+#pragma pack(pop)
+
+/// @brief This function (re)starts playback on a DAC output, one output at a time.
+///
+/// In stream mode, playback starts when the device has received the first 512 samples.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] channel 1 for PA4, 2 for PA5.
+/// @param[in] mode One of dac_mode.
+/// @param[in] rate_hz Samples per second, at most 1000000.
+/// @param[in] table 12-bit samples played in loop mode. Ignored in stream mode.
+/// @param[in] table_length Number of samples in table, at most 2040.
+/// @param[out] actual_mhz Rate actually set, in millihertz. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int dac_start(void* handle, uint8_t channel, uint8_t mode, uint32_t rate_hz, const uint16_t* table, uint32_t table_length, uint32_t* actual_mhz);
+
+/// @brief This function stops playback. The output keeps the last value.
+/// @param[in] handle Handle obtained from open().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int dac_stop(void* handle);
+
+/// @brief This function reads the counters of the DAC playback.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] status Counters.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int dac_status(void* handle, dac_status_t* status);
+
+/// @brief This function sends samples to play in stream mode. It blocks while the device buffer is full.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] samples 12-bit samples.
+/// @param[in] count Number of samples. Large blocks are more efficient.
+/// @param[in] timeout_ms Time to wait in milliseconds, 0 waits forever.
+/// @returns int variable. Number of samples sent [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int dac_stream_write(void* handle, const uint16_t* samples, uint32_t count, uint32_t timeout_ms);
+
+/// @brief Counting modes of counter_start().
+enum counter_mode {
+	COUNTER_PULSES = 0,		///< Counts the edges on pin A, which must be connected to channel 1 or 2 of a device timer.
+	COUNTER_ENCODER			///< Counts the quadrature steps of an encoder, pin A on channel 1 and pin B on channel 2 of TIM1, TIM3, TIM4 or TIM8.
+};
+
+#define COUNTER_FALLING		0x01	///< counter_start() flag: counts the falling edges in pulse mode, reverses the direction in encoder mode.
+#define COUNTER_BOTH_EDGES	0x02	///< counter_start() flag: counts both edges in pulse mode.
+#define COUNTER_PULL_UP		0x04	///< counter_start() flag: enables the pull-ups of the pins.
+
+#pragma pack(push,1)
+/// @brief Payload of the EVENT_COUNTER events.
+typedef struct {
+	uint8_t counter;		///< Counter given to counter_start().
+	uint8_t reserved[3];
+	uint32_t timestamp_us;	///< Device time in microseconds.
+	uint32_t value;			///< Count, or signed encoder position.
+} counter_event_t;
+#pragma pack(pop)
+
+/// @brief This function connects pins to a free device timer and starts counting from 0.
+///
+/// The timer counts at full speed with no CPU involvement. The count is extended to 32 bits every millisecond,
+/// so it must not increase by more than 32767 in a millisecond.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] counter Counter, from 0 to 3.
+/// @param[in] mode One of counter_mode.
+/// @param[in] flags COUNTER_FALLING, COUNTER_BOTH_EDGES, COUNTER_PULL_UP.
+/// @param[in] filter Timer input filter code, from 0 (none) to 15 (8 samples at 1/32 of the timer clock).
+/// @param[in] port_a GPIO port of pin A. Must be a letter from 'a' to 'h'.
+/// @param[in] pin_a GPIO pin A.
+/// @param[in] port_b GPIO port of pin B, encoder mode only.
+/// @param[in] pin_b GPIO pin B, encoder mode only.
+/// @param[in] snapshot_ms If not 0, the value is sent every snapshot_ms milliseconds as an EVENT_COUNTER event, see event_read().
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int counter_start(void* handle, uint8_t counter, uint8_t mode, uint8_t flags, uint8_t filter, char port_a, uint8_t pin_a, char port_b, uint8_t pin_b, uint32_t snapshot_ms);
+
+/// @brief This function reads all counters at the same time.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] values Counts, or signed encoder positions. Stopped counters read 0.
+/// @param[in] count Size of values, at most 4 are used.
+/// @param[out] timestamp_us Device time of the reading in microseconds. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int counter_read(void* handle, uint32_t* values, uint32_t count, uint32_t* timestamp_us);
+
+/// @brief This function stops a counter and releases its timer.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] counter Counter, from 0 to 3.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int counter_stop(void* handle, uint8_t counter);
+
+/// @brief Actions applied to the target pin of a route.
+enum route_action {
+	ROUTE_NONE = 0,		///< Releases the route.
+	ROUTE_COPY,			///< The target takes the level of the source.
+	ROUTE_INVERT,		///< The target takes the inverted level of the source.
+	ROUTE_SET,			///< The target is set high.
+	ROUTE_CLEAR,		///< The target is set low.
+	ROUTE_PULSE,		///< The target goes high for pulse_us. A new edge restarts the pulse.
+	ROUTE_PULSE_LOW		///< The target goes low for pulse_us.
+};
+
+/// @brief This function sets up a reflex route: an edge on the source pin applies the action to the target pin
+/// in the device interrupt handler, within a few microseconds and without USB traffic.
+///
+/// The route stays disabled until route_enable() and its hit counter is cleared.
+/// Source pins share the device EXTI lines with edge_config(): pins with the same number on different ports cannot be used together.
+/// The pin modes are not changed: the source must be an input and the target an output, see gpio_config().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] route Route, from 0 to 15.
+/// @param[in] action One of route_action.
+/// @param[in] trigger Edges of the source that fire the route, one of edge_trigger.
+/// @param[in] source_port GPIO port of the source. Must be a letter from 'a' to 'h'.
+/// @param[in] source_pin GPIO pin of the source, from 0 to 15.
+/// @param[in] target_port GPIO port of the target.
+/// @param[in] target_pin GPIO pin of the target, from 0 to 15.
+/// @param[in] pulse_us Pulse length in microseconds for ROUTE_PULSE and ROUTE_PULSE_LOW.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int route_config(void* handle, uint8_t route, uint8_t action, uint8_t trigger, char source_port, uint8_t source_pin, char target_port, uint8_t target_pin, uint32_t pulse_us);
+
+/// @brief This function enables configured routes.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] mask Routes to enable, bit n for route n.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int route_enable(void* handle, uint32_t mask);
+
+/// @brief This function disables routes. Their configuration and hit counters are kept.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] mask Routes to disable, bit n for route n.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int route_disable(void* handle, uint32_t mask);
+
+/// @brief This function reads the state of the routes.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] enabled Mask of the enabled routes. Can be NULL.
+/// @param[out] hits Number of times each route fired, 16 values. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int route_status(void* handle, uint32_t* enabled, uint32_t* hits);
+
+/// @brief Conditions of wait_pins().
+enum wait_mode {
+	WAIT_MATCH = 0,		///< Waits until (port & mask) == value.
+	WAIT_CHANGE			///< Waits until any pin in mask changes.
+};
+
+#pragma pack(push,1)
+/// @brief Result of wait_pins().
+typedef struct {
+	uint32_t timestamp_us;	///< Device time of the last sample, see sched_time().
+	uint32_t elapsed_us;	///< Time waited.
+	uint16_t port_value;	///< Port input value at that time.
+	uint16_t reserved;
+} wait_result_t;
+#pragma pack(pop)
+
+/// @brief This function waits on the device for a condition on the pins of a port.
+///
+/// The device polls the port in a tight loop, which replaces thousands of gpio_get() calls. The other endpoints keep being serviced meanwhile.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] port GPIO port. Must be a letter from 'a' to 'h'.
+/// @param[in] mode One of wait_mode.
+/// @param[in] mask Pins to watch, bit n for pin n.
+/// @param[in] value Expected levels of the pins in mask, for WAIT_MATCH.
+/// @param[in] timeout_us Maximum waiting time in microseconds. Must be shorter than the USB transfer timeout.
+/// @param[out] result Time and port value when the condition was met or the timeout expired. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), timeout or fail(<0)]
+extern "C" NUCLEO_WINUSB_API int wait_pins(void* handle, char port, uint8_t mode, uint16_t mask, uint16_t value, uint32_t timeout_us, wait_result_t* result);
+
+/// @brief Flags of pulse_start().
+enum pulse_flags {
+	PULSE_ACTIVE_LOW = 0x01,		///< The pulses are low, the idle level high.
+	PULSE_TRIGGER = 0x02,			///< Each edge of the trigger pin starts a burst, in hardware.
+	PULSE_TRIGGER_FALLING = 0x04	///< Triggers on falling edges instead of rising edges.
+};
+
+/// @brief This function generates a pulse or a burst of pulses with a timer in one-pulse mode, with timer clock resolution and no software jitter.
+///
+/// Each pulse is delay_ticks at the idle level followed by width_ticks at the active level, repeated count times:
+/// a burst of pulses of period P is delay_ticks = P - width_ticks. The pin must be a timer channel output, see pwm_config().
+/// The times are rounded to the timer prescaler needed for delay_ticks + width_ticks; the values applied are returned.
+/// Without PULSE_TRIGGER the burst starts immediately. With it, the trigger pin must be on channel 1 or 2 of the same timer
+/// and every edge starts a new burst, until pulse_stop().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] channel Pulse channel, from 0 to 3.
+/// @param[in] flags Combination of pulse_flags.
+/// @param[in] port GPIO port of the output. Must be a letter from 'a' to 'h'.
+/// @param[in] pin GPIO pin of the output, from 0 to 15.
+/// @param[in] trigger_port GPIO port of the trigger pin, with PULSE_TRIGGER.
+/// @param[in] trigger_pin GPIO pin of the trigger pin, with PULSE_TRIGGER.
+/// @param[in] delay_ticks Time before each pulse, in ticks of the 250 MHz timer clock. At least 1.
+/// @param[in] width_ticks Pulse width, in ticks of the 250 MHz timer clock. At least 1.
+/// @param[in] count Number of pulses. Above 1, it needs a timer with a repetition counter (TIM1, TIM8 up to 65536, TIM15 up to 256).
+/// @param[out] actual_delay Delay applied, in ticks. Can be NULL.
+/// @param[out] actual_width Width applied, in ticks. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), timing(-144), count(-145), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pulse_start(void* handle, uint8_t channel, uint8_t flags, char port, uint8_t pin, char trigger_port, uint8_t trigger_pin, uint32_t delay_ticks, uint32_t width_ticks, uint32_t count, uint32_t* actual_delay, uint32_t* actual_width);
+
+/// @brief This function stops a pulse channel, leaves its pin as an output at the idle level and releases the timer.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] channel Pulse channel, from 0 to 3.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pulse_stop(void* handle, uint8_t channel);
+
+/// @brief This function reads the state of the pulse channels.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] started Mask of the started channels, bit n for channel n. Can be NULL.
+/// @param[out] running Mask of the channels generating a burst at this time. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int pulse_status(void* handle, uint32_t* started, uint32_t* running);
+
+/// @brief Bus types of par_config().
+enum par_mode {
+	PAR_8080 = 0,	///< Active-low WR and RD strobes. Data is latched on the rising edge of WR.
+	PAR_6800		///< Active-high E strobe and R/W pin, high for reads.
+};
+
+#pragma pack(push,1)
+/// @brief Parallel bus configuration of par_config().
+///
+/// Ports are letters from 'a' to 'h', or 0 for a strobe that is not used. The write strobe (WR or E) is mandatory.
+typedef struct {
+	uint8_t mode;			///< One of par_mode.
+	uint8_t width;			///< Data width, 8 or 16 bits.
+	uint8_t data_port;		///< Port of the data pins.
+	uint8_t data_shift;		///< For an 8-bit bus, 0 for pins 0 to 7, 8 for pins 8 to 15.
+	uint8_t wr_port;		///< WR, or E for PAR_6800.
+	uint8_t wr_pin;
+	uint8_t rd_port;		///< RD, or R/W for PAR_6800.
+	uint8_t rd_pin;
+	uint8_t cs_port;		///< Active-low chip select, asserted during par_run().
+	uint8_t cs_pin;
+	uint8_t dc_port;		///< Data/command pin, low for the commands with PAR_COMMAND.
+	uint8_t dc_pin;
+	uint16_t setup_loops;	///< Delay loops between the data and the strobe.
+	uint16_t strobe_loops;	///< Delay loops with the strobe active.
+	uint16_t hold_loops;	///< Delay loops after the strobe.
+	uint16_t reserved;
+	uint32_t dma_period_ns;	///< Period of the bus cycles of writes paced by a timer and DMA, 0 for writes by the CPU. Needs the write strobe on the data port.
+} par_config_t;
+#pragma pack(pop)
+
+/// @brief This function configures the parallel bus engine and sets its strobes inactive.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] config Bus configuration.
+/// @returns int variable. Holds the operation result [success(>=0), invalid pins(-152), timing(-154), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int par_config(void* handle, const par_config_t* config);
+
+/// @brief Commands executed by par_run().
+enum par_opcode {
+	PAR_WRITE = 1,		///< Writes count bus words from the data.
+	PAR_READ,			///< Reads count bus words. They are added to the rx data.
+	PAR_DELAY_US		///< Waits count microseconds.
+};
+
+#define PAR_COMMAND		0x01	///< par_command_t flag: DC low during the command.
+
+#pragma pack(push,1)
+/// @brief Command of the buffer executed by par_run().
+///
+/// PAR_WRITE is followed by count bytes of data for an 8-bit bus, 2*count bytes (little-endian words) for a 16-bit bus.
+typedef struct {
+	uint8_t opcode;			///< One of par_opcode.
+	uint8_t flags;
+	uint16_t count;
+} par_command_t;
+#pragma pack(pop)
+
+/// @brief This function executes a buffer of parallel bus commands with a single USB round trip, for example a display frame or a memory image in kilobyte chunks.
+///
+/// The data port is written and read as a whole. Execution stops at the first failed command.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] commands Command buffer.
+/// @param[in] length Length of the command buffer in bytes.
+/// @param[out] rx Buffer that will contain the words read by all the PAR_READ commands, one after the other.
+/// @param[in] rx_size Size of the rx buffer.
+/// @param[out] executed Number of commands executed successfully. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), not configured(-152), command(-153), DMA(-155), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int par_run(void* handle, const uint8_t* commands, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed);
+
+#define MOTION_AXES	3	///< Number of stepper axes.
+
+/// @brief Speed profiles of motion_move().
+enum motion_profile {
+	MOTION_TRAPEZOID = 0,	///< Constant acceleration.
+	MOTION_S_CURVE			///< The acceleration rises from 0 and falls back to 0 over the same distance, peaking at 1.5 times accel.
+};
+
+#define MOTION_DIR_INVERT	0x01	///< motion_config() flag: dir pin high for negative steps.
+#define MOTION_STEP_LOW		0x02	///< motion_config() flag: active-low step pulses.
+#define MOTION_ENABLE_HIGH	0x04	///< motion_config() flag: active-high enable pin, active-low otherwise.
+#define MOTION_DECELERATE	0x01	///< motion_stop() flag: the current move decelerates before stopping.
+
+#pragma pack(push,1)
+/// @brief State of the motion engine read by motion_status().
+typedef struct {
+	int32_t position[MOTION_AXES];	///< Steps of each axis since motion_config().
+	uint32_t queued;				///< Moves in the queue, the current one included.
+	uint32_t speed;					///< Current step rate of the leading axis, in steps per second.
+} motion_status_t;
+#pragma pack(pop)
+
+/// @brief This function sets up the step, dir and enable pins of a stepper axis and clears its position.
+///
+/// The enable pin is asserted immediately. The axes cannot be configured while moves are running.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] axis Axis, from 0 to 2.
+/// @param[in] flags Combination of MOTION_DIR_INVERT, MOTION_STEP_LOW and MOTION_ENABLE_HIGH.
+/// @param[in] step_port GPIO port of the step pin. Must be a letter from 'a' to 'h'.
+/// @param[in] step_pin GPIO pin of the step pin, from 0 to 15.
+/// @param[in] dir_port GPIO port of the dir pin.
+/// @param[in] dir_pin GPIO pin of the dir pin, from 0 to 15.
+/// @param[in] enable_port GPIO port of the enable pin, 0 if not used.
+/// @param[in] enable_pin GPIO pin of the enable pin, from 0 to 15.
+/// @param[in] pulse_ns Step pulse width, from 100 to 100000 ns. Shared by all the axes.
+/// @returns int variable. Holds the operation result [success(>=0), busy(-163), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int motion_config(void* handle, uint8_t axis, uint8_t flags, char step_port, uint8_t step_pin, char dir_port, uint8_t dir_pin, char enable_port, uint8_t enable_pin, uint32_t pulse_ns);
+
+/// @brief This function queues a coordinated relative move of the stepper axes.
+///
+/// The speed profile is computed on the device for the axis with the most steps; the other axes are interpolated so that they all end together.
+/// Moves are executed one after the other, each starting and ending at start_speed.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] profile One of motion_profile.
+/// @param[in] steps Signed steps of each axis, MOTION_AXES values.
+/// @param[in] start_speed Start and end speed in steps per second, at least 1.
+/// @param[in] max_speed Cruise speed in steps per second.
+/// @param[in] accel Acceleration in steps per second squared.
+/// @param[out] free_entries Free entries in the move queue. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), queue full(-160), axis not configured(-161), speed(-162), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int motion_move(void* handle, uint8_t profile, const int32_t* steps, uint32_t start_speed, uint32_t max_speed, uint32_t accel, uint32_t* free_entries);
+
+/// @brief This function flushes the move queue and stops the current move.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] flags MOTION_DECELERATE to decelerate the current move, 0 to stop immediately.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int motion_stop(void* handle, uint8_t flags);
+
+/// @brief This function reads the positions and the queue state of the motion engine.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] status Motion state. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int motion_status(void* handle, motion_status_t* status);
+
+#define SYNC_MAX_PORTS	8	///< Maximum number of ports of sync_write().
+
+#pragma pack(push,1)
+/// @brief Port update of sync_write().
+typedef struct {
+	uint8_t port;		///< GPIO port. Must be a letter from 'a' to 'h'.
+	uint8_t reserved;
+	uint16_t mask;		///< Pins to write, bit n for pin n.
+	uint16_t value;		///< Levels of the pins in mask.
+	uint16_t reserved2;
+} sync_port_t;
+#pragma pack(pop)
+
+/// @brief This function changes pins of several ports in the same time window.
+///
+/// The port writes are chained by DMA and started by a single timer event, without the CPU. The time between the first and
+/// the last port write is measured on the device and returned in span_ns.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] ports Port updates, in the order they are written.
+/// @param[in] count Number of port updates, from 1 to SYNC_MAX_PORTS.
+/// @param[in] delay_us Delay before the update in microseconds, up to 65535. 0 for as soon as possible.
+/// @param[out] span_ns Time between the first and the last port write in nanoseconds, 4 ns resolution. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), timeout(-168), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int sync_write(void* handle, const sync_port_t* ports, uint8_t count, uint32_t delay_us, uint32_t* span_ns);
+
+#pragma pack(push,1)
+/// @brief Configuration of the pins of a port, see port_config().
+///
+/// The fields have the layout of the STM32 port registers. Only the bits of the pins in mask are used.
+typedef struct {
+	uint8_t port;		///< GPIO port. Must be a letter from 'a' to 'h'.
+	uint8_t reserved;
+	uint16_t mask;		///< Pins to configure, bit n for pin n.
+	uint32_t moder;		///< Mode, 2 bits per pin: 0 input, 1 output, 2 alternate function, 3 analog.
+	uint32_t otyper;	///< Output type, 1 bit per pin: 0 pushpull, 1 opendrain.
+	uint32_t ospeedr;	///< Output speed, 2 bits per pin: 0 low to 3 very high.
+	uint32_t pupdr;		///< Pullup/down resistors, 2 bits per pin: 0 none, 1 pullup, 2 pulldown.
+	uint32_t afr[2];	///< Alternate functions, 4 bits per pin: pins 0 to 7 in afr[0], 8 to 15 in afr[1].
+} port_config_t;
+#pragma pack(pop)
+
+/// @brief This function configures several pins of a port in a single request.
+///
+/// Each port register is written once, the mode last, so that the pins switch to their new mode already configured.
+/// Pins left in input or output mode can then be used with gpio_set(), gpio_clear() and gpio_get().
+/// @param[in] handle Handle obtained from open().
+/// @param[in] config Port configuration.
+/// @returns int variable. Holds the operation result [success(>=0), pin used by a peripheral(-7), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int port_config(void* handle, const port_config_t* config);
+
+#define PROFILE_SLOTS			7		///< Number of profiles stored on the device.
+#define PROFILE_NAME_LENGTH		16		///< Profile name length, terminating zero included.
+#define PROFILE_PORTS			8		///< Ports of a profile.
+#define PROFILE_REQUESTS_SIZE	744		///< Bytes of recorded requests per profile.
+#define PROFILE_NONE			0xFF	///< No boot profile, see profile_boot().
+
+#pragma pack(push,1)
+/// @brief Port of a profile, see profile_save().
+typedef struct {
+	port_config_t config;	///< Pin configuration. A mask of 0 leaves the port unchanged.
+	uint16_t levels;		///< Output levels of the pins of config.mask, set before their mode.
+	uint16_t reserved;
+} profile_port_t;
+
+/// @brief Profiles stored on the device, see profile_list().
+typedef struct {
+	uint8_t boot;			///< Slot of the boot profile, PROFILE_NONE for none.
+	uint8_t reserved[3];
+	char names[PROFILE_SLOTS][PROFILE_NAME_LENGTH];	///< Profile names, empty for a free slot.
+} profile_list_t;
+#pragma pack(pop)
+
+/// @brief This function starts or stops recording the requests of a profile.
+///
+/// While recording, the successful requests that configure or start an engine are also kept by the DLL: port_config(),
+/// the *_config() functions, adc_start(), dac_start(), counter_start(), pulse_start() and route_enable(). Other calls are not recorded. profile_save() stores them with the profile, and they are replayed in the same order when the profile is applied.
+/// The gpio functions are not recorded: the pin configuration is stored in the ports of the profile.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] enable 1 to clear the recorded requests and start recording, 0 to stop.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int profile_record(void* handle, uint8_t enable);
+
+/// @brief This function stores a profile in the device flash, with the requests recorded by profile_record().
+///
+/// The flash sector is rewritten, which takes a few milliseconds.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] slot Profile slot, from 0 to PROFILE_SLOTS - 1. Its previous profile is replaced.
+/// @param[in] name Profile name, truncated to PROFILE_NAME_LENGTH - 1 characters. An empty name frees the slot.
+/// @param[in] ports PROFILE_PORTS port configurations, or NULL to store the current configuration of the pins not used by a peripheral.
+/// @returns int variable. Holds the operation result [success(>=0), flash error(-177), invalid request(-178), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int profile_save(void* handle, uint8_t slot, const char* name, const profile_port_t* ports);
+
+/// @brief This function lists the profiles stored on the device.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] list Profile names and boot profile.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int profile_list(void* handle, profile_list_t* list);
+
+/// @brief This function selects the profile applied when the device starts.
+///
+/// The boot profile is skipped if the user button is held down during the reset.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] slot Profile slot, or PROFILE_NONE for none.
+/// @returns int variable. Holds the operation result [success(>=0), empty slot(-176), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int profile_boot(void* handle, uint8_t slot);
+
+/// @brief This function applies a profile: the ports are configured, then the recorded requests are replayed.
+/// @param[in] handle Handle obtained from open().
+/// @param[in] slot Profile slot.
+/// @param[out] failed Index of the recorded request that failed, whose result is returned. Can be NULL.
+/// @returns int variable. Holds the operation result [success(>=0), empty slot(-176), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int profile_apply(void* handle, uint8_t slot, uint32_t* failed);
+
+/// @brief Boot phases, see boot_times().
+enum boot_phase {
+	BOOT_RESET = 0,			///< Start of the device initialization, time 0.
+	BOOT_CLOCK,				///< System clock switched to the PLL.
+	BOOT_USB_POWER,			///< USB transceiver powered, still disconnected.
+	BOOT_PERIPHERALS,		///< GPIO, timers and DMA initialized.
+	BOOT_USB_CONNECT,		///< Device connected to the bus.
+	BOOT_PROFILE,			///< Boot profile applied, see profile_boot().
+	BOOT_LATE_INIT,			///< Initialization not needed for the enumeration done.
+	BOOT_USB_RESET,			///< First bus reset from the host.
+	BOOT_USB_CONFIGURED,	///< Device configured by the host.
+	BOOT_PHASES
+};
+
+#pragma pack(push,1)
+/// @brief Boot phase times, see boot_times().
+typedef struct {
+	uint32_t reached;					///< Bit n is set if phase n was reached.
+	uint32_t time_us[BOOT_PHASES];		///< Time of each phase in microseconds since BOOT_RESET, 0 if not reached.
+} boot_times_t;
+#pragma pack(pop)
+
+/// @brief This function reads the times of the device startup phases.
+///
+/// The time between power-on and BOOT_RESET (boot ROM and startup code) is not included.
+/// @param[in] handle Handle obtained from open().
+/// @param[out] times Phase times.
+/// @returns int variable. Holds the operation result [success(>=0), fail(<0)]
+extern "C" NUCLEO_WINUSB_API int boot_times(void* handle, boot_times_t* times);
@@ -2,6 +2,7 @@
 #include <cfgmgr32.h>
 #include <winusb.h>
 #include <stdint.h>
+#include <vector>
 #include "..\Nucleo_WinUSB.h"
 
 #define SUCCESS								0
@@ -15,6 +16,102 @@ enum operation_type {
 	GPIO_GET,
 	GPIO_CONFIG,
 
+	/* sequencer */
+	SEQ_LOAD = 0x0300,
+	SEQ_RUN,
+
+	/* scheduler */
+	SCHED_SUBMIT = 0x0400,
+	SCHED_STATUS,
+	SCHED_CANCEL,
+	SCHED_TIME,
+
+	/* edge capture */
+	EDGE_CONFIG = 0x0500,
+	EDGE_READ,
+	EDGE_RESET,
+
+	/* measurement */
+	MEAS_RUN = 0x0600,
+	MEAS_STREAM,
+	MEAS_STOP,
+
+	/* pwm */
+	PWM_CONFIG = 0x0700,
+	PWM_DUTY,
+	PWM_STOP,
+
+	/* spi */
+	SPI_TRANSFER = 0x0800,
+
+	/* i2c */
+	I2C_TRANSFER = 0x0900,
+
+	/* i3c */
+	I3C_CONFIG = 0x0A00,
+	I3C_DAA,
+	I3C_TRANSFER,
+
+	/* jtag */
+	JTAG_RUN = 0x0B00,
+
+	/* uart */
+	UART_CONFIG = 0x0C00,
+	UART_STATUS,
+	UART_STOP,
+
+	/* wire */
+	WIRE_RUN = 0x0D00,
+
+	/* adc */
+	ADC_CONFIG = 0x0E00,
+	ADC_START,
+	ADC_READ,
+	ADC_STOP,
+	ADC_STATUS,
+
+	/* dac */
+	DAC_START = 0x0F00,
+	DAC_STOP,
+	DAC_STATUS,
+
+	/* counter */
+	COUNTER_START = 0x1000,
+	COUNTER_READ,
+	COUNTER_STOP,
+
+	/* route */
+	ROUTE_CONFIG = 0x1100,
+	ROUTE_ENABLE,
+	ROUTE_DISABLE,
+	ROUTE_STATUS,
+
+	/* wait */
+	WAIT_PINS = 0x1200,
+	/* pulse */
+	PULSE_START = 0x1300,
+	PULSE_STOP,
+	PULSE_STATUS,
+	/* parallel bus */
+	PAR_CONFIG = 0x1400,
+	PAR_RUN,
+	/* motion */
+	MOTION_CONFIG = 0x1500,
+	MOTION_MOVE,
+	MOTION_STOP,
+	MOTION_STATUS,
+	/* synchronous update */
+	SYNC_WRITE = 0x1600,
+	/* port configuration */
+	PORT_CONFIG = 0x1700,
+	/* configuration profiles */
+	PROFILE_SAVE = 0x1800,
+	PROFILE_LIST,
+	PROFILE_BOOT,
+	PROFILE_APPLY,
+	/* boot profiler */
+	BOOT_TIMES = 0x1900,
+
 	NO_OP = 0xFFFF
 };
 
@@ -27,6 +124,290 @@ struct gpio_request_t {
 	uint8_t pull;
 };
 
+struct request_header_t {
+	uint32_t operation;
+	uint32_t length;
+};
+
+struct seq_load_request_t {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+};
+
+struct edge_config_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t trigger;
+	uint8_t reserved;
+};
+
+struct edge_read_request_t {
+	request_header_t header;
+	uint32_t max_records;
+};
+
+struct meas_run_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint16_t reserved;
+	uint32_t gate_ms;
+};
+
+struct meas_stream_request_t {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t reserved;
+	uint32_t gate_ms;
+	uint32_t interval_ms;
+};
+
+struct meas_stop_request_t {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t reserved[3];
+};
+
+struct pwm_config_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t polarity;
+	uint8_t reserved;
+	uint32_t frequency_hz;
+	uint32_t duty_ppm;
+};
+
+struct pwm_duty_request_t {
+	request_header_t header;
+	uint32_t count;
+};
+
+struct pwm_stop_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint16_t reserved;
+};
+
+struct spi_transfer_request_t {
+	request_header_t header;
+	uint32_t count;
+};
+
+struct i2c_transfer_request_t {
+	request_header_t header;
+	uint32_t speed_hz;
+	uint32_t count;
+};
+
+struct i3c_config_request_t {
+	request_header_t header;
+	uint32_t speed_hz;
+};
+
+struct i3c_daa_request_t {
+	request_header_t header;
+	uint8_t first_address;
+	uint8_t reserved[3];
+};
+
+struct i3c_transfer_request_t {
+	request_header_t header;
+	uint32_t count;
+};
+
+struct jtag_run_request_t {
+	request_header_t header;
+	uint16_t half_period;
+	uint16_t wait_retries;
+};
+
+struct uart_config_request_t {
+	request_header_t header;
+	uint32_t baud;
+	uint8_t data_bits;
+	uint8_t parity;
+	uint8_t flags;
+	uint8_t reserved;
+};
+
+struct wire_run_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t count;
+};
+
+struct adc_config_request_t {
+	request_header_t header;
+	uint8_t count;
+	uint8_t sample_time;
+	uint8_t oversampling;
+	uint8_t reserved;
+};
+
+struct adc_start_request_t {
+	request_header_t header;
+	uint32_t rate_hz;
+};
+
+struct dac_start_request_t {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t mode;
+	uint16_t reserved;
+	uint32_t rate_hz;
+};
+
+struct counter_start_request_t {
+	request_header_t header;
+	uint8_t counter;
+	uint8_t mode;
+	uint8_t flags;
+	uint8_t filter;
+	uint8_t port_a;
+	uint8_t pin_a;
+	uint8_t port_b;
+	uint8_t pin_b;
+	uint32_t snapshot_ms;
+};
+
+struct counter_stop_request_t {
+	request_header_t header;
+	uint8_t counter;
+	uint8_t reserved[3];
+};
+
+struct route_config_request_t {
+	request_header_t header;
+	uint8_t route;
+	uint8_t action;
+	uint8_t trigger;
+	uint8_t reserved;
+	uint8_t source_port;
+	uint8_t source_pin;
+	uint8_t target_port;
+	uint8_t target_pin;
+	uint32_t pulse_us;
+};
+
+struct route_enable_request_t {
+	request_header_t header;
+	uint32_t mask;
+};
+
+struct wait_request_t {
+	request_header_t header;
+	uint8_t port;
+	uint8_t mode;
+	uint16_t mask;
+	uint16_t value;
+	uint16_t reserved;
+	uint32_t timeout_us;
+};
+
+struct pulse_start_request_t {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t flags;
+	uint8_t port;
+	uint8_t pin;
+	uint8_t trigger_port;
+	uint8_t trigger_pin;
+	uint16_t reserved;
+	uint32_t delay_ticks;
+	uint32_t width_ticks;
+	uint32_t count;
+};
+
+struct pulse_stop_request_t {
+	request_header_t header;
+	uint8_t channel;
+	uint8_t reserved[3];
+};
+
+struct par_config_request_t {
+	request_header_t header;
+	par_config_t config;
+};
+
+struct par_run_request_t {
+	request_header_t header;
+};
+
+struct motion_config_request_t {
+	request_header_t header;
+	uint8_t axis;
+	uint8_t flags;
+	uint8_t step_port;
+	uint8_t step_pin;
+	uint8_t dir_port;
+	uint8_t dir_pin;
+	uint8_t enable_port;
+	uint8_t enable_pin;
+	uint32_t pulse_ns;
+};
+
+struct motion_move_request_t {
+	request_header_t header;
+	uint8_t profile;
+	uint8_t reserved[3];
+	int32_t steps[MOTION_AXES];
+	uint32_t start_speed;
+	uint32_t max_speed;
+	uint32_t accel;
+};
+
+struct motion_stop_request_t {
+	request_header_t header;
+	uint8_t flags;
+	uint8_t reserved[3];
+};
+
+struct sync_write_request_t {
+	request_header_t header;
+	uint32_t delay_us;
+	uint8_t count;
+	uint8_t reserved[3];
+	sync_port_t ports[SYNC_MAX_PORTS];
+};
+
+struct port_config_request_t {
+	request_header_t header;
+	port_config_t config;
+};
+
+#define PROFILE_CAPTURE		0x01	// store the current pin configuration
+
+struct profile_save_request_t {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t flags;
+	uint16_t reserved;
+	char name[PROFILE_NAME_LENGTH];
+	profile_port_t ports[PROFILE_PORTS];
+};
+
+struct profile_slot_request_t {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+};
+
+struct seq_run_request_t {
+	request_header_t header;
+	uint8_t slot;
+	uint8_t reserved[3];
+	uint32_t timeout_us;
+};
+
 constexpr int max_num_of_interfaces{ 1 };
 
 struct Device {
@@ -34,6 +415,8 @@ struct Device {
 	HANDLE file_handle;
 	WINUSB_INTERFACE_HANDLE interface_handles[max_num_of_interfaces];
 	size_t setup_pckt_size;
+	bool recording;					// see profile_record()
+	std::vector<uint8_t> recorded;
 
 	Device();
 	//Device(char* descr);
@@ -50,6 +433,7 @@ Device::Device()
 	for (int i = 0; i < max_num_of_interfaces; i++)
 		interface_handles[i] = NULL;
 	setup_pckt_size = 64;
+	recording = false;
 }
 
 void* Device::open(char* descr)
@@ -93,7 +477,12 @@ Device::~Device()
 	name[0] = '\0';
 }
 
-constexpr char gpio_pipe_id = 0x01;
+constexpr UCHAR gpio_pipe_id = 0x01;
+constexpr UCHAR event_pipe_id = 0x82;
+constexpr UCHAR uart_pipe_id = 0x03;
+constexpr UCHAR adc_pipe_id = 0x84;
+constexpr UCHAR dac_pipe_id = 0x04;
+constexpr uint32_t max_request_length = 4096;
 char device_list[1024];
 
 Device device;
@@ -325,3 +714,1459 @@ int gpio_get(void* handle, char port, uint8_t pin, uint8_t* value)
 	return 0;
 }
 
+
+
+/*
+* Requests kept by profile_record(): those that configure or start an engine, as accepted by the device in a profile
+*/
+static bool is_recordable(uint32_t operation)
+{
+	switch (operation) {
+	case PORT_CONFIG:
+	case EDGE_CONFIG:
+	case PWM_CONFIG:
+	case I3C_CONFIG:
+	case UART_CONFIG:
+	case ADC_CONFIG:
+	case ADC_START:
+	case DAC_START:
+	case COUNTER_START:
+	case ROUTE_CONFIG:
+	case ROUTE_ENABLE:
+	case PULSE_START:
+	case PAR_CONFIG:
+	case MOTION_CONFIG:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+* Requests other than the gpio ones start with a request_header_t and can be longer than a packet.
+* The device always replies with an int32 result, possibly followed by data.
+* The reply is read with a buffer one packet longer than the maximum reply, so that the zero-length packet
+* terminating a reply whose length is a multiple of the packet size is consumed too.
+* Returns the reply length, or a negative value if the transfer has failed.
+*/
+int request(void* handle, request_header_t* request, void* reply, uint32_t reply_length)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL)
+		return -1;
+	if (request->length > max_request_length)
+		return -4;
+
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_WritePipe(h->interface_handles[0], gpio_pipe_id, (UCHAR*)request, request->length, &transferred, NULL);
+	if (bResult != TRUE) {
+		reset_ep(h, gpio_pipe_id);
+		return -2;
+	}
+
+	std::vector<uint8_t> buf(max_request_length + 64);
+	bResult = WinUsb_ReadPipe(h->interface_handles[0], gpio_pipe_id | 0x80, buf.data(), (ULONG)buf.size(), &transferred, NULL);
+	if (bResult != TRUE) {
+		reset_ep(h, gpio_pipe_id);
+		return -3;
+	}
+	if (transferred < sizeof(int32_t))
+		return -5;
+
+	if (h->recording && is_recordable(request->operation) && *(int32_t*)buf.data() >= 0)
+		h->recorded.insert(h->recorded.end(), (uint8_t*)request, (uint8_t*)request + request->length);
+
+	memcpy(reply, buf.data(), min(transferred, reply_length));
+	return transferred;
+}
+
+
+/*
+* Sequencer functions
+*/
+
+int seq_load(void* handle, uint8_t slot, const seq_instruction_t* program, uint32_t count)
+{
+	if (program == NULL || count == 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(seq_load_request_t) + count * sizeof(seq_instruction_t));
+	seq_load_request_t* request_p = (seq_load_request_t*)buf.data();
+
+	request_p->header.operation = SEQ_LOAD;
+	request_p->header.length = (uint32_t)buf.size();
+	request_p->slot = slot;
+	memcpy(buf.data() + sizeof(seq_load_request_t), program, count * sizeof(seq_instruction_t));
+
+	int32_t result;
+	int res = request(handle, &request_p->header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+int seq_run(void* handle, uint8_t slot, uint32_t timeout_us, uint32_t* results, uint32_t* count)
+{
+	if (count == NULL || (results == NULL && *count != 0))
+		return -1;
+
+	seq_run_request_t run_request = {};
+	run_request.header.operation = SEQ_RUN;
+	run_request.header.length = sizeof(run_request);
+	run_request.slot = slot;
+	run_request.timeout_us = timeout_us;
+
+	std::vector<uint32_t> reply(max_request_length / sizeof(uint32_t));
+	int res = request(handle, &run_request.header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = (int32_t)reply[0];
+	uint32_t emitted = (res >= (int)(2 * sizeof(uint32_t))) ? reply[1] : 0;
+	if (emitted > *count)
+		emitted = *count;
+	memcpy(results, &reply[2], emitted * sizeof(uint32_t));
+	*count = emitted;
+
+	return result;
+}
+
+
+/*
+* Scheduler functions
+*/
+
+int sched_time(void* handle, uint32_t* time)
+{
+	request_header_t time_request = { SCHED_TIME, sizeof(request_header_t) };
+	uint32_t reply[2];
+
+	int res = request(handle, &time_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return (int32_t)reply[0];
+
+	*time = reply[1];
+	return (int32_t)reply[0];
+}
+
+int sched_submit(void* handle, const sched_command_t* commands, uint32_t count)
+{
+	if (commands == NULL || count == 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(request_header_t) + count * sizeof(sched_command_t));
+	request_header_t* request_p = (request_header_t*)buf.data();
+
+	request_p->operation = SCHED_SUBMIT;
+	request_p->length = (uint32_t)buf.size();
+	memcpy(buf.data() + sizeof(request_header_t), commands, count * sizeof(sched_command_t));
+
+	int32_t result;
+	int res = request(handle, request_p, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+int sched_status(void* handle, sched_record_t* records, uint32_t* count, uint32_t* pending, uint32_t* lost)
+{
+	if (count == NULL || (records == NULL && *count != 0))
+		return -1;
+
+	request_header_t status_request = { SCHED_STATUS, sizeof(request_header_t) };
+	std::vector<uint8_t> reply(max_request_length);
+
+	int res = request(handle, &status_request, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(4 * sizeof(uint32_t)))
+		return result;
+
+	uint32_t* data = (uint32_t*)(reply.data() + sizeof(int32_t));
+	if (pending != NULL)
+		*pending = data[0];
+	if (lost != NULL)
+		*lost = data[1];
+	uint32_t n = data[2];
+	if (n > *count)
+		n = *count;
+	memcpy(records, &data[3], n * sizeof(sched_record_t));
+	*count = n;
+
+	return result;
+}
+
+int sched_cancel(void* handle)
+{
+	request_header_t cancel_request = { SCHED_CANCEL, sizeof(request_header_t) };
+	int32_t result;
+
+	int res = request(handle, &cancel_request, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+
+/*
+* Edge capture functions
+*/
+
+int edge_config(void* handle, char port, uint8_t pin, uint8_t trigger)
+{
+	edge_config_request_t config_request = {};
+	config_request.header.operation = EDGE_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.port = port;
+	config_request.pin = pin;
+	config_request.trigger = trigger;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+int edge_read(void* handle, edge_record_t* records, uint32_t* count, uint32_t* timer_hz, uint32_t* lost)
+{
+	if (count == NULL || (records == NULL && *count != 0))
+		return -1;
+
+	edge_read_request_t read_request = {};
+	read_request.header.operation = EDGE_READ;
+	read_request.header.length = sizeof(read_request);
+	read_request.max_records = *count;
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &read_request.header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(4 * sizeof(uint32_t)))
+		return result;
+
+	uint32_t* data = (uint32_t*)(reply.data() + sizeof(int32_t));
+	if (timer_hz != NULL)
+		*timer_hz = data[0];
+	if (lost != NULL)
+		*lost = data[1];
+	uint32_t n = data[2];
+	if (n > *count)
+		n = *count;
+	memcpy(records, &data[3], n * sizeof(edge_record_t));
+	*count = n;
+
+	return result;
+}
+
+int edge_reset(void* handle)
+{
+	request_header_t reset_request = { EDGE_RESET, sizeof(request_header_t) };
+	int32_t result;
+
+	int res = request(handle, &reset_request, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+
+/*
+* Measurement functions
+*/
+
+int meas_run(void* handle, char port, uint8_t pin, uint32_t gate_ms, meas_result_t* result)
+{
+	if (result == NULL)
+		return -1;
+
+	meas_run_request_t run_request = {};
+	run_request.header.operation = MEAS_RUN;
+	run_request.header.length = sizeof(run_request);
+	run_request.port = port;
+	run_request.pin = pin;
+	run_request.gate_ms = gate_ms;
+
+	uint8_t reply[sizeof(int32_t) + sizeof(meas_result_t)];
+	int res = request(handle, &run_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+
+	int32_t r = *(int32_t*)reply;
+	if (r >= 0 && res >= (int)sizeof(reply))
+		memcpy(result, reply + sizeof(int32_t), sizeof(meas_result_t));
+	return r;
+}
+
+int meas_stream(void* handle, uint8_t channel, char port, uint8_t pin, uint32_t gate_ms, uint32_t interval_ms)
+{
+	meas_stream_request_t stream_request = {};
+	stream_request.header.operation = MEAS_STREAM;
+	stream_request.header.length = sizeof(stream_request);
+	stream_request.channel = channel;
+	stream_request.port = port;
+	stream_request.pin = pin;
+	stream_request.gate_ms = gate_ms;
+	stream_request.interval_ms = interval_ms;
+
+	int32_t result;
+	int res = request(handle, &stream_request.header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+int meas_stop(void* handle, uint8_t channel)
+{
+	meas_stop_request_t stop_request = {};
+	stop_request.header.operation = MEAS_STOP;
+	stop_request.header.length = sizeof(stop_request);
+	stop_request.channel = channel;
+
+	int32_t result;
+	int res = request(handle, &stop_request.header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+
+/*
+* PWM functions
+*/
+
+int pwm_config(void* handle, char port, uint8_t pin, uint32_t frequency_hz, uint32_t duty_ppm, uint8_t polarity, uint64_t* actual_mhz)
+{
+	pwm_config_request_t config_request = {};
+	config_request.header.operation = PWM_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.port = port;
+	config_request.pin = pin;
+	config_request.polarity = polarity;
+	config_request.frequency_hz = frequency_hz;
+	config_request.duty_ppm = duty_ppm;
+
+	int32_t reply[3];
+	int res = request(handle, &config_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (actual_mhz != NULL && res >= (int)sizeof(reply))
+		memcpy(actual_mhz, &reply[1], sizeof(*actual_mhz));
+	return reply[0];
+}
+
+int pwm_duty(void* handle, const pwm_duty_t* duty, uint32_t count)
+{
+	if (duty == NULL || count == 0 || count > 16)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(pwm_duty_request_t) + count * sizeof(pwm_duty_t));
+	pwm_duty_request_t* duty_request = (pwm_duty_request_t*)buf.data();
+	duty_request->header.operation = PWM_DUTY;
+	duty_request->header.length = (uint32_t)buf.size();
+	duty_request->count = count;
+	memcpy(buf.data() + sizeof(pwm_duty_request_t), duty, count * sizeof(pwm_duty_t));
+
+	int32_t result;
+	int res = request(handle, &duty_request->header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+int pwm_stop(void* handle, char port, uint8_t pin)
+{
+	pwm_stop_request_t stop_request = {};
+	stop_request.header.operation = PWM_STOP;
+	stop_request.header.length = sizeof(stop_request);
+	stop_request.port = port;
+	stop_request.pin = pin;
+
+	int32_t result;
+	int res = request(handle, &stop_request.header, &result, sizeof(result));
+	if (res < 0)
+		return res;
+	return result;
+}
+
+
+/*
+* SPI functions
+*/
+
+int spi_transfer(void* handle, const spi_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, uint32_t* executed)
+{
+	if (transactions == NULL)
+		return -1;
+
+	uint32_t tx_total = 0, rx_total = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		tx_total += transactions[i].tx_length;
+		rx_total += transactions[i].rx_length;
+	}
+	if ((tx_total > 0 && tx == NULL) || (rx_total > 0 && (rx == NULL || rx_size < rx_total)))
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(spi_transfer_request_t) + count * sizeof(spi_transaction_t) + tx_total);
+	if (buf.size() > max_request_length)
+		return -4;
+	spi_transfer_request_t* transfer_request = (spi_transfer_request_t*)buf.data();
+	transfer_request->header.operation = SPI_TRANSFER;
+	transfer_request->header.length = (uint32_t)buf.size();
+	transfer_request->count = count;
+
+	uint8_t* p = buf.data() + sizeof(spi_transfer_request_t);
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(p, &transactions[i], sizeof(spi_transaction_t));
+		p += sizeof(spi_transaction_t);
+		memcpy(p, tx, transactions[i].tx_length);
+		p += transactions[i].tx_length;
+		tx += transactions[i].tx_length;
+	}
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &transfer_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(2 * sizeof(uint32_t)))
+		return result;
+	if (executed != NULL)
+		*executed = *(uint32_t*)(reply.data() + sizeof(int32_t));
+	uint32_t n = res - 2 * sizeof(uint32_t);
+	if (n > 0)
+		memcpy(rx, reply.data() + 2 * sizeof(uint32_t), min(n, rx_size));
+
+	return result;
+}
+
+
+/*
+* I2C functions
+*/
+
+int i2c_transfer(void* handle, uint32_t speed_hz, const i2c_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, int32_t* status)
+{
+	if (transactions == NULL)
+		return -1;
+
+	uint32_t tx_total = 0, rx_total = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		tx_total += transactions[i].tx_length;
+		rx_total += transactions[i].rx_length;
+	}
+	if ((tx_total > 0 && tx == NULL) || (rx_total > 0 && (rx == NULL || rx_size < rx_total)))
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(i2c_transfer_request_t) + count * sizeof(i2c_transaction_t) + tx_total);
+	if (buf.size() > max_request_length)
+		return -4;
+	i2c_transfer_request_t* transfer_request = (i2c_transfer_request_t*)buf.data();
+	transfer_request->header.operation = I2C_TRANSFER;
+	transfer_request->header.length = (uint32_t)buf.size();
+	transfer_request->speed_hz = speed_hz;
+	transfer_request->count = count;
+
+	uint8_t* p = buf.data() + sizeof(i2c_transfer_request_t);
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(p, &transactions[i], sizeof(i2c_transaction_t));
+		p += sizeof(i2c_transaction_t);
+		memcpy(p, tx, transactions[i].tx_length);
+		p += transactions[i].tx_length;
+		tx += transactions[i].tx_length;
+	}
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &transfer_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	uint32_t header_size = (2 + count) * sizeof(uint32_t);
+	if (res < (int)(header_size + rx_total))
+		return result;
+	if (status != NULL)
+		memcpy(status, reply.data() + 2 * sizeof(uint32_t), count * sizeof(int32_t));
+	if (rx_total > 0)
+		memcpy(rx, reply.data() + header_size, rx_total);
+
+	return result;
+}
+
+
+/*
+* I3C functions
+*/
+
+int i3c_config(void* handle, uint32_t speed_hz)
+{
+	i3c_config_request_t config_request = {};
+	config_request.header.operation = I3C_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.speed_hz = speed_hz;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int i3c_daa(void* handle, uint8_t first_address, i3c_target_t* targets, uint32_t* count)
+{
+	if (targets == NULL || count == NULL)
+		return -1;
+
+	i3c_daa_request_t daa_request = {};
+	daa_request.header.operation = I3C_DAA;
+	daa_request.header.length = sizeof(daa_request);
+	daa_request.first_address = first_address;
+
+	uint8_t reply[2 * sizeof(uint32_t) + 16 * sizeof(i3c_target_t)];
+	int res = request(handle, &daa_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply;
+	*count = 0;
+	if (res < (int)(2 * sizeof(uint32_t)))
+		return result;
+	uint32_t n = min(*(uint32_t*)(reply + sizeof(uint32_t)), (uint32_t)16);
+	if (res < (int)(2 * sizeof(uint32_t) + n * sizeof(i3c_target_t)))
+		return -5;
+	memcpy(targets, reply + 2 * sizeof(uint32_t), n * sizeof(i3c_target_t));
+	*count = n;
+
+	return result;
+}
+
+int i3c_transfer(void* handle, const i3c_transaction_t* transactions, uint32_t count, const uint8_t* tx, uint8_t* rx, uint32_t rx_size, int32_t* status)
+{
+	if (transactions == NULL)
+		return -1;
+
+	uint32_t tx_total = 0, rx_total = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		tx_total += transactions[i].tx_length;
+		rx_total += transactions[i].rx_length;
+	}
+	if ((tx_total > 0 && tx == NULL) || (rx_total > 0 && (rx == NULL || rx_size < rx_total)))
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(i3c_transfer_request_t) + count * sizeof(i3c_transaction_t) + tx_total);
+	if (buf.size() > max_request_length)
+		return -4;
+	i3c_transfer_request_t* transfer_request = (i3c_transfer_request_t*)buf.data();
+	transfer_request->header.operation = I3C_TRANSFER;
+	transfer_request->header.length = (uint32_t)buf.size();
+	transfer_request->count = count;
+
+	uint8_t* p = buf.data() + sizeof(i3c_transfer_request_t);
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(p, &transactions[i], sizeof(i3c_transaction_t));
+		p += sizeof(i3c_transaction_t);
+		memcpy(p, tx, transactions[i].tx_length);
+		p += transactions[i].tx_length;
+		tx += transactions[i].tx_length;
+	}
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &transfer_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	uint32_t header_size = (2 + count) * sizeof(uint32_t);
+	if (res < (int)(header_size + rx_total))
+		return result;
+	if (status != NULL)
+		memcpy(status, reply.data() + 2 * sizeof(uint32_t), count * sizeof(int32_t));
+	if (rx_total > 0)
+		memcpy(rx, reply.data() + header_size, rx_total);
+
+	return result;
+}
+
+
+/*
+* JTAG/SWD functions
+*/
+
+int jtag_run(void* handle, uint16_t half_period, uint16_t wait_retries, const uint8_t* commands, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed)
+{
+	if (commands == NULL && length > 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(jtag_run_request_t) + length);
+	if (buf.size() > max_request_length)
+		return -4;
+	jtag_run_request_t* run_request = (jtag_run_request_t*)buf.data();
+	run_request->header.operation = JTAG_RUN;
+	run_request->header.length = (uint32_t)buf.size();
+	run_request->half_period = half_period;
+	run_request->wait_retries = wait_retries;
+	memcpy(buf.data() + sizeof(jtag_run_request_t), commands, length);
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &run_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(2 * sizeof(uint32_t)))
+		return result;
+	if (executed != NULL)
+		*executed = *(uint32_t*)(reply.data() + sizeof(uint32_t));
+	uint32_t n = res - 2 * sizeof(uint32_t);
+	if (n > 0 && rx != NULL)
+		memcpy(rx, reply.data() + 2 * sizeof(uint32_t), min(n, rx_size));
+
+	return result;
+}
+
+
+/*
+* UART bridge functions. The byte stream has its own pair of pipes.
+*/
+
+int uart_config(void* handle, uint32_t baud, uint8_t data_bits, uint8_t parity, uint8_t flags, uint32_t* actual_baud)
+{
+	uart_config_request_t config_request = {};
+	config_request.header.operation = UART_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.baud = baud;
+	config_request.data_bits = data_bits;
+	config_request.parity = parity;
+	config_request.flags = flags;
+
+	uint32_t reply[2];
+	int res = request(handle, &config_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (actual_baud != NULL && res >= (int)sizeof(reply))
+		*actual_baud = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+int uart_status(void* handle, uart_status_t* status)
+{
+	if (status == NULL)
+		return -1;
+
+	request_header_t status_request = { UART_STATUS, sizeof(request_header_t) };
+	uint8_t reply[sizeof(int32_t) + sizeof(uart_status_t)];
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return *(int32_t*)reply;
+	memcpy(status, reply + sizeof(int32_t), sizeof(uart_status_t));
+
+	return *(int32_t*)reply;
+}
+
+int uart_stop(void* handle)
+{
+	request_header_t stop_request = { UART_STOP, sizeof(request_header_t) };
+
+	int32_t result;
+	int res = request(handle, &stop_request, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int uart_write(void* handle, const uint8_t* data, uint32_t length, uint32_t timeout_ms)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL || (data == NULL && length > 0))
+		return -1;
+
+	ULONG timeout = timeout_ms;
+	WinUsb_SetPipePolicy(h->interface_handles[0], uart_pipe_id, PIPE_TRANSFER_TIMEOUT, sizeof(timeout), &timeout);
+
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_WritePipe(h->interface_handles[0], uart_pipe_id, (UCHAR*)data, length, &transferred, NULL);
+	if (bResult != TRUE) {
+		if (GetLastError() == ERROR_SEM_TIMEOUT)
+			return -6;
+		WinUsb_ResetPipe(h->interface_handles[0], uart_pipe_id);
+		return -2;
+	}
+	return transferred;
+}
+
+int uart_read(void* handle, uint8_t* data, uint32_t size, uint32_t timeout_ms)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL || data == NULL)
+		return -1;
+
+	ULONG timeout = timeout_ms;
+	WinUsb_SetPipePolicy(h->interface_handles[0], uart_pipe_id | 0x80, PIPE_TRANSFER_TIMEOUT, sizeof(timeout), &timeout);
+
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_ReadPipe(h->interface_handles[0], uart_pipe_id | 0x80, data, size, &transferred, NULL);
+	if (bResult != TRUE) {
+		if (GetLastError() == ERROR_SEM_TIMEOUT)
+			return -6;
+		WinUsb_ResetPipe(h->interface_handles[0], uart_pipe_id | 0x80);
+		return -3;
+	}
+	return transferred;
+}
+
+
+/*
+* Single-wire protocol functions
+*/
+
+int wire_run(void* handle, char port, uint8_t pin, uint8_t flags, const uint8_t* commands, uint32_t count, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed)
+{
+	if (commands == NULL && length > 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(wire_run_request_t) + length);
+	if (buf.size() > max_request_length)
+		return -4;
+	wire_run_request_t* run_request = (wire_run_request_t*)buf.data();
+	run_request->header.operation = WIRE_RUN;
+	run_request->header.length = (uint32_t)buf.size();
+	run_request->port = port;
+	run_request->pin = pin;
+	run_request->flags = flags;
+	run_request->count = count;
+	memcpy(buf.data() + sizeof(wire_run_request_t), commands, length);
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &run_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(2 * sizeof(uint32_t)))
+		return result;
+	if (executed != NULL)
+		*executed = *(uint32_t*)(reply.data() + sizeof(uint32_t));
+	uint32_t n = res - 2 * sizeof(uint32_t);
+	if (n > 0 && rx != NULL)
+		memcpy(rx, reply.data() + 2 * sizeof(uint32_t), min(n, rx_size));
+
+	return result;
+}
+
+
+/*
+* ADC functions. The sample stream has its own pipe.
+*/
+
+int adc_config(void* handle, const adc_pin_t* pins, uint8_t count, uint8_t sample_time, uint8_t oversampling)
+{
+	if (pins == NULL && count > 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(adc_config_request_t) + count * sizeof(adc_pin_t));
+	adc_config_request_t* config_request = (adc_config_request_t*)buf.data();
+	config_request->header.operation = ADC_CONFIG;
+	config_request->header.length = (uint32_t)buf.size();
+	config_request->count = count;
+	config_request->sample_time = sample_time;
+	config_request->oversampling = oversampling;
+	memcpy(buf.data() + sizeof(adc_config_request_t), pins, count * sizeof(adc_pin_t));
+
+	int32_t result;
+	int res = request(handle, &config_request->header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int adc_start(void* handle, uint32_t rate_hz, uint32_t* actual_mhz)
+{
+	adc_start_request_t start_request = {};
+	start_request.header.operation = ADC_START;
+	start_request.header.length = sizeof(start_request);
+	start_request.rate_hz = rate_hz;
+
+	uint32_t reply[2];
+	int res = request(handle, &start_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (actual_mhz != NULL && res >= (int)sizeof(reply))
+		*actual_mhz = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+int adc_read(void* handle, uint16_t* values, uint32_t count)
+{
+	if (values == NULL)
+		return -1;
+
+	request_header_t read_request = { ADC_READ, sizeof(request_header_t) };
+	uint8_t reply[sizeof(int32_t) + 16 * sizeof(uint16_t)];
+	int res = request(handle, &read_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(int32_t))
+		return -3;
+	uint32_t n = (res - sizeof(int32_t)) / sizeof(uint16_t);
+	memcpy(values, reply + sizeof(int32_t), min(n, count) * sizeof(uint16_t));
+
+	return *(int32_t*)reply;
+}
+
+int adc_stop(void* handle)
+{
+	request_header_t stop_request = { ADC_STOP, sizeof(request_header_t) };
+
+	int32_t result;
+	int res = request(handle, &stop_request, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int adc_status(void* handle, adc_status_t* status)
+{
+	if (status == NULL)
+		return -1;
+
+	request_header_t status_request = { ADC_STATUS, sizeof(request_header_t) };
+	uint8_t reply[sizeof(int32_t) + sizeof(adc_status_t)];
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return *(int32_t*)reply;
+	memcpy(status, reply + sizeof(int32_t), sizeof(adc_status_t));
+
+	return *(int32_t*)reply;
+}
+
+int adc_stream_read(void* handle, uint8_t* data, uint32_t size, uint32_t timeout_ms)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL || data == NULL)
+		return -1;
+
+	ULONG timeout = timeout_ms;
+	WinUsb_SetPipePolicy(h->interface_handles[0], adc_pipe_id, PIPE_TRANSFER_TIMEOUT, sizeof(timeout), &timeout);
+
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_ReadPipe(h->interface_handles[0], adc_pipe_id, data, size, &transferred, NULL);
+	if (bResult != TRUE) {
+		if (GetLastError() == ERROR_SEM_TIMEOUT)
+			return -6;
+		WinUsb_ResetPipe(h->interface_handles[0], adc_pipe_id);
+		return -3;
+	}
+	return transferred;
+}
+
+
+/*
+* DAC functions. The sample stream has its own pipe.
+*/
+
+int dac_start(void* handle, uint8_t channel, uint8_t mode, uint32_t rate_hz, const uint16_t* table, uint32_t table_length, uint32_t* actual_mhz)
+{
+	if (mode != DAC_MODE_LOOP)
+		table_length = 0;
+	if (table == NULL && table_length > 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(dac_start_request_t) + table_length * sizeof(uint16_t));
+	if (buf.size() > max_request_length)
+		return -4;
+	dac_start_request_t* start_request = (dac_start_request_t*)buf.data();
+	start_request->header.operation = DAC_START;
+	start_request->header.length = (uint32_t)buf.size();
+	start_request->channel = channel;
+	start_request->mode = mode;
+	start_request->rate_hz = rate_hz;
+	memcpy(buf.data() + sizeof(dac_start_request_t), table, table_length * sizeof(uint16_t));
+
+	uint32_t reply[2];
+	int res = request(handle, &start_request->header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (actual_mhz != NULL && res >= (int)sizeof(reply))
+		*actual_mhz = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+int dac_stop(void* handle)
+{
+	request_header_t stop_request = { DAC_STOP, sizeof(request_header_t) };
+
+	int32_t result;
+	int res = request(handle, &stop_request, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int dac_status(void* handle, dac_status_t* status)
+{
+	if (status == NULL)
+		return -1;
+
+	request_header_t status_request = { DAC_STATUS, sizeof(request_header_t) };
+	uint8_t reply[sizeof(int32_t) + sizeof(dac_status_t)];
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return *(int32_t*)reply;
+	memcpy(status, reply + sizeof(int32_t), sizeof(dac_status_t));
+
+	return *(int32_t*)reply;
+}
+
+int dac_stream_write(void* handle, const uint16_t* samples, uint32_t count, uint32_t timeout_ms)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL || (samples == NULL && count > 0))
+		return -1;
+
+	ULONG timeout = timeout_ms;
+	WinUsb_SetPipePolicy(h->interface_handles[0], dac_pipe_id, PIPE_TRANSFER_TIMEOUT, sizeof(timeout), &timeout);
+
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_WritePipe(h->interface_handles[0], dac_pipe_id, (UCHAR*)samples, count * sizeof(uint16_t), &transferred, NULL);
+	if (bResult != TRUE) {
+		if (GetLastError() == ERROR_SEM_TIMEOUT)
+			return -6;
+		WinUsb_ResetPipe(h->interface_handles[0], dac_pipe_id);
+		return -2;
+	}
+	return transferred / sizeof(uint16_t);
+}
+
+
+/*
+* Counter functions
+*/
+
+int counter_start(void* handle, uint8_t counter, uint8_t mode, uint8_t flags, uint8_t filter, char port_a, uint8_t pin_a, char port_b, uint8_t pin_b, uint32_t snapshot_ms)
+{
+	counter_start_request_t start_request = {};
+	start_request.header.operation = COUNTER_START;
+	start_request.header.length = sizeof(start_request);
+	start_request.counter = counter;
+	start_request.mode = mode;
+	start_request.flags = flags;
+	start_request.filter = filter;
+	start_request.port_a = port_a;
+	start_request.pin_a = pin_a;
+	start_request.port_b = port_b;
+	start_request.pin_b = pin_b;
+	start_request.snapshot_ms = snapshot_ms;
+
+	int32_t result;
+	int res = request(handle, &start_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int counter_read(void* handle, uint32_t* values, uint32_t count, uint32_t* timestamp_us)
+{
+	if (values == NULL && count > 0)
+		return -1;
+
+	request_header_t read_request = { COUNTER_READ, sizeof(request_header_t) };
+	uint32_t reply[2 + 4];
+	int res = request(handle, &read_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return (int32_t)reply[0];
+	if (timestamp_us != NULL)
+		*timestamp_us = reply[1];
+	memcpy(values, &reply[2], min(count, (uint32_t)4) * sizeof(uint32_t));
+
+	return (int32_t)reply[0];
+}
+
+int counter_stop(void* handle, uint8_t counter)
+{
+	counter_stop_request_t stop_request = {};
+	stop_request.header.operation = COUNTER_STOP;
+	stop_request.header.length = sizeof(stop_request);
+	stop_request.counter = counter;
+
+	int32_t result;
+	int res = request(handle, &stop_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+
+/*
+* Reflex route functions
+*/
+
+int route_config(void* handle, uint8_t route, uint8_t action, uint8_t trigger, char source_port, uint8_t source_pin, char target_port, uint8_t target_pin, uint32_t pulse_us)
+{
+	route_config_request_t config_request = {};
+	config_request.header.operation = ROUTE_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.route = route;
+	config_request.action = action;
+	config_request.trigger = trigger;
+	config_request.source_port = source_port;
+	config_request.source_pin = source_pin;
+	config_request.target_port = target_port;
+	config_request.target_pin = target_pin;
+	config_request.pulse_us = pulse_us;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int route_mask(void* handle, enum operation_type op_type, uint32_t mask)
+{
+	route_enable_request_t enable_request = {};
+	enable_request.header.operation = op_type;
+	enable_request.header.length = sizeof(enable_request);
+	enable_request.mask = mask;
+
+	int32_t result;
+	int res = request(handle, &enable_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int route_enable(void* handle, uint32_t mask)
+{
+	return route_mask(handle, ROUTE_ENABLE, mask);
+}
+
+int route_disable(void* handle, uint32_t mask)
+{
+	return route_mask(handle, ROUTE_DISABLE, mask);
+}
+
+int route_status(void* handle, uint32_t* enabled, uint32_t* hits)
+{
+	request_header_t status_request = { ROUTE_STATUS, sizeof(request_header_t) };
+	uint32_t reply[2 + 16];
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (res < (int)sizeof(reply))
+		return (int32_t)reply[0];
+	if (enabled != NULL)
+		*enabled = reply[1];
+	if (hits != NULL)
+		memcpy(hits, &reply[2], 16 * sizeof(uint32_t));
+
+	return (int32_t)reply[0];
+}
+
+
+/*
+* Wait functions
+*/
+
+int wait_pins(void* handle, char port, uint8_t mode, uint16_t mask, uint16_t value, uint32_t timeout_us, wait_result_t* result)
+{
+	wait_request_t wait_request = {};
+	wait_request.header.operation = WAIT_PINS;
+	wait_request.header.length = sizeof(wait_request);
+	wait_request.port = port;
+	wait_request.mode = mode;
+	wait_request.mask = mask;
+	wait_request.value = value;
+	wait_request.timeout_us = timeout_us;
+
+	uint8_t reply[sizeof(int32_t) + sizeof(wait_result_t)];
+	int res = request(handle, &wait_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (result != NULL && res >= (int)sizeof(reply))
+		memcpy(result, reply + sizeof(int32_t), sizeof(wait_result_t));
+
+	return *(int32_t*)reply;
+}
+
+
+/*
+* Pulse functions
+*/
+
+int pulse_start(void* handle, uint8_t channel, uint8_t flags, char port, uint8_t pin, char trigger_port, uint8_t trigger_pin, uint32_t delay_ticks, uint32_t width_ticks, uint32_t count, uint32_t* actual_delay, uint32_t* actual_width)
+{
+	pulse_start_request_t start_request = {};
+	start_request.header.operation = PULSE_START;
+	start_request.header.length = sizeof(start_request);
+	start_request.channel = channel;
+	start_request.flags = flags;
+	start_request.port = port;
+	start_request.pin = pin;
+	start_request.trigger_port = trigger_port;
+	start_request.trigger_pin = trigger_pin;
+	start_request.delay_ticks = delay_ticks;
+	start_request.width_ticks = width_ticks;
+	start_request.count = count;
+
+	uint32_t reply[3] = {};
+	int res = request(handle, &start_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (actual_delay != NULL)
+		*actual_delay = reply[1];
+	if (actual_width != NULL)
+		*actual_width = reply[2];
+
+	return (int32_t)reply[0];
+}
+
+int pulse_stop(void* handle, uint8_t channel)
+{
+	pulse_stop_request_t stop_request = {};
+	stop_request.header.operation = PULSE_STOP;
+	stop_request.header.length = sizeof(stop_request);
+	stop_request.channel = channel;
+
+	int32_t result;
+	int res = request(handle, &stop_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int pulse_status(void* handle, uint32_t* started, uint32_t* running)
+{
+	request_header_t status_request = {};
+	status_request.operation = PULSE_STATUS;
+	status_request.length = sizeof(status_request);
+
+	uint32_t reply[3] = {};
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (started != NULL)
+		*started = reply[1];
+	if (running != NULL)
+		*running = reply[2];
+
+	return (int32_t)reply[0];
+}
+
+
+/*
+* Parallel bus functions
+*/
+
+int par_config(void* handle, const par_config_t* config)
+{
+	if (config == NULL)
+		return -1;
+
+	par_config_request_t config_request = {};
+	config_request.header.operation = PAR_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.config = *config;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int par_run(void* handle, const uint8_t* commands, uint32_t length, uint8_t* rx, uint32_t rx_size, uint32_t* executed)
+{
+	if (commands == NULL && length > 0)
+		return -1;
+
+	std::vector<uint8_t> buf(sizeof(par_run_request_t) + length);
+	if (buf.size() > max_request_length)
+		return -4;
+	par_run_request_t* run_request = (par_run_request_t*)buf.data();
+	run_request->header.operation = PAR_RUN;
+	run_request->header.length = (uint32_t)buf.size();
+	memcpy(buf.data() + sizeof(par_run_request_t), commands, length);
+
+	std::vector<uint8_t> reply(max_request_length);
+	int res = request(handle, &run_request->header, reply.data(), max_request_length);
+	if (res < 0)
+		return res;
+
+	int32_t result = *(int32_t*)reply.data();
+	if (res < (int)(2 * sizeof(uint32_t)))
+		return result;
+	if (executed != NULL)
+		*executed = *(uint32_t*)(reply.data() + sizeof(uint32_t));
+	uint32_t n = res - 2 * sizeof(uint32_t);
+	if (n > 0 && rx != NULL)
+		memcpy(rx, reply.data() + 2 * sizeof(uint32_t), min(n, rx_size));
+
+	return result;
+}
+
+
+/*
+* Motion functions
+*/
+
+int motion_config(void* handle, uint8_t axis, uint8_t flags, char step_port, uint8_t step_pin, char dir_port, uint8_t dir_pin, char enable_port, uint8_t enable_pin, uint32_t pulse_ns)
+{
+	motion_config_request_t config_request = {};
+	config_request.header.operation = MOTION_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.axis = axis;
+	config_request.flags = flags;
+	config_request.step_port = step_port;
+	config_request.step_pin = step_pin;
+	config_request.dir_port = dir_port;
+	config_request.dir_pin = dir_pin;
+	config_request.enable_port = enable_port;
+	config_request.enable_pin = enable_pin;
+	config_request.pulse_ns = pulse_ns;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int motion_move(void* handle, uint8_t profile, const int32_t* steps, uint32_t start_speed, uint32_t max_speed, uint32_t accel, uint32_t* free_entries)
+{
+	if (steps == NULL)
+		return -1;
+
+	motion_move_request_t move_request = {};
+	move_request.header.operation = MOTION_MOVE;
+	move_request.header.length = sizeof(move_request);
+	move_request.profile = profile;
+	memcpy(move_request.steps, steps, sizeof(move_request.steps));
+	move_request.start_speed = start_speed;
+	move_request.max_speed = max_speed;
+	move_request.accel = accel;
+
+	uint32_t reply[2] = {};
+	int res = request(handle, &move_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (free_entries != NULL)
+		*free_entries = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+int motion_stop(void* handle, uint8_t flags)
+{
+	motion_stop_request_t stop_request = {};
+	stop_request.header.operation = MOTION_STOP;
+	stop_request.header.length = sizeof(stop_request);
+	stop_request.flags = flags;
+
+	int32_t result;
+	int res = request(handle, &stop_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int motion_status(void* handle, motion_status_t* status)
+{
+	request_header_t status_request = {};
+	status_request.operation = MOTION_STATUS;
+	status_request.length = sizeof(status_request);
+
+	uint8_t reply[sizeof(int32_t) + sizeof(motion_status_t)];
+	int res = request(handle, &status_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (status != NULL && res >= (int)sizeof(reply))
+		memcpy(status, reply + sizeof(int32_t), sizeof(motion_status_t));
+
+	return *(int32_t*)reply;
+}
+
+
+/*
+* Synchronous update functions
+*/
+
+int sync_write(void* handle, const sync_port_t* ports, uint8_t count, uint32_t delay_us, uint32_t* span_ns)
+{
+	if (ports == NULL || count == 0 || count > SYNC_MAX_PORTS)
+		return -1;
+
+	sync_write_request_t write_request = {};
+	write_request.header.operation = SYNC_WRITE;
+	write_request.header.length = sizeof(write_request) - (SYNC_MAX_PORTS - count) * sizeof(sync_port_t);
+	write_request.delay_us = delay_us;
+	write_request.count = count;
+	memcpy(write_request.ports, ports, count * sizeof(sync_port_t));
+
+	uint32_t reply[2] = {};
+	int res = request(handle, &write_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (span_ns != NULL)
+		*span_ns = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+
+/*
+* Port configuration functions
+*/
+
+int port_config(void* handle, const port_config_t* config)
+{
+	if (config == NULL)
+		return -1;
+
+	port_config_request_t config_request = {};
+	config_request.header.operation = PORT_CONFIG;
+	config_request.header.length = sizeof(config_request);
+	config_request.config = *config;
+
+	int32_t result;
+	int res = request(handle, &config_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+
+/*
+* Configuration profile functions
+*/
+
+int profile_record(void* handle, uint8_t enable)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL)
+		return -1;
+	if (enable)
+		h->recorded.clear();
+	h->recording = enable != 0;
+	return 0;
+}
+
+int profile_save(void* handle, uint8_t slot, const char* name, const profile_port_t* ports)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || name == NULL)
+		return -1;
+	if (h->recorded.size() > PROFILE_REQUESTS_SIZE)
+		return -4;
+
+	std::vector<uint8_t> buf(sizeof(profile_save_request_t) + h->recorded.size());
+	profile_save_request_t* request_p = (profile_save_request_t*)buf.data();
+
+	request_p->header.operation = PROFILE_SAVE;
+	request_p->header.length = (uint32_t)buf.size();
+	request_p->slot = slot;
+	strncpy_s(request_p->name, name, _TRUNCATE);
+	if (ports != NULL)
+		memcpy(request_p->ports, ports, sizeof(request_p->ports));
+	else
+		request_p->flags = PROFILE_CAPTURE;
+	if (!h->recorded.empty())
+		memcpy(buf.data() + sizeof(profile_save_request_t), h->recorded.data(), h->recorded.size());
+
+	int32_t result;
+	int res = request(handle, &request_p->header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int profile_list(void* handle, profile_list_t* list)
+{
+	request_header_t list_request = {};
+	list_request.operation = PROFILE_LIST;
+	list_request.length = sizeof(list_request);
+
+	uint8_t reply[sizeof(int32_t) + sizeof(profile_list_t)];
+	int res = request(handle, &list_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (list != NULL && res >= (int)sizeof(reply))
+		memcpy(list, reply + sizeof(int32_t), sizeof(profile_list_t));
+
+	return *(int32_t*)reply;
+}
+
+int profile_boot(void* handle, uint8_t slot)
+{
+	profile_slot_request_t boot_request = {};
+	boot_request.header.operation = PROFILE_BOOT;
+	boot_request.header.length = sizeof(boot_request);
+	boot_request.slot = slot;
+
+	int32_t result;
+	int res = request(handle, &boot_request.header, &result, sizeof(result));
+	return res < 0 ? res : result;
+}
+
+int profile_apply(void* handle, uint8_t slot, uint32_t* failed)
+{
+	profile_slot_request_t apply_request = {};
+	apply_request.header.operation = PROFILE_APPLY;
+	apply_request.header.length = sizeof(apply_request);
+	apply_request.slot = slot;
+
+	uint32_t reply[2] = {};
+	int res = request(handle, &apply_request.header, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (failed != NULL)
+		*failed = reply[1];
+
+	return (int32_t)reply[0];
+}
+
+
+/*
+* Boot profiler functions
+*/
+
+int boot_times(void* handle, boot_times_t* times)
+{
+	request_header_t times_request = {};
+	times_request.operation = BOOT_TIMES;
+	times_request.length = sizeof(times_request);
+
+	uint8_t reply[sizeof(int32_t) + sizeof(boot_times_t)];
+	int res = request(handle, &times_request, reply, sizeof(reply));
+	if (res < 0)
+		return res;
+	if (times != NULL && res >= (int)sizeof(reply))
+		memcpy(times, reply + sizeof(int32_t), sizeof(boot_times_t));
+
+	return *(int32_t*)reply;
+}
+
+
+/*
+* Events are read from their own pipe, one event per packet
+*/
+
+int event_read(void* handle, void* event, uint32_t size, uint32_t timeout_ms)
+{
+	Device* h = (Device*)handle;
+
+	if (h == NULL || h->interface_handles[0] == NULL || event == NULL)
+		return -1;
+
+	ULONG timeout = timeout_ms;
+	WinUsb_SetPipePolicy(h->interface_handles[0], event_pipe_id, PIPE_TRANSFER_TIMEOUT, sizeof(timeout), &timeout);
+
+	uint8_t buf[64];
+	ULONG transferred = 0;
+	BOOL bResult = WinUsb_ReadPipe(h->interface_handles[0], event_pipe_id, buf, sizeof(buf), &transferred, NULL);
+	if (bResult != TRUE) {
+		if (GetLastError() == ERROR_SEM_TIMEOUT)
+			return -6;
+		WinUsb_ResetPipe(h->interface_handles[0], event_pipe_id);
+		return -3;
+	}
+	if (transferred < sizeof(event_header_t))
+		return -5;
+
+	memcpy(event, buf, min(transferred, size));
+	return transferred;
+}